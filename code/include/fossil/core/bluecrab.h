@@ -24,6 +24,7 @@ Description:
  * - fossil_crabdb_namespace_t management within the database.
  * - Insert, update, search, and remove data within namespaces.
  * - Execute custom queries on the database.
+ * - Hash-indexed namespaces and keys with incremental resizing.
  * 
  * Usage:
  * 
@@ -100,12 +101,46 @@ Description:
  * 
  * 8. Executing custom queries:
  *    @code
- *    fossil_crabdb_execute_query(db, "SELECT * FROM my_namespace WHERE key='key1'");
+ *    fossil_crabdb_execute_query(db, "insert(my_namespace, key1, 'hello, world')");
+ *    @endcode
+ * 
+ * 9. Reusing a prepared query:
+ *    @code
+ *    fossil_crabdb_stmt_t *stmt;
+ *    fossil_crabdb_prepare(db, "get(my_namespace, ?)", &stmt);
+ *    fossil_crabdb_bind(stmt, 1, "key1");
+ *    if (fossil_crabdb_stmt_execute(stmt) == CRABDB_OK) {
+ *        puts(fossil_crabdb_stmt_result(stmt));
+ *    }
+ *    fossil_crabdb_finalize(stmt);
+ *    @endcode
+ * 
+ * 10. Scanning a namespace while writers carry on:
+ *    @code
+ *    fossil_crabdb_snapshot_t *snap;
+ *    fossil_crabdb_cursor_t *cursor;
+ *    const char *key, *value;
+ *    fossil_crabdb_snapshot_begin(db, &snap);
+ *    fossil_crabdb_snapshot_scan(snap, "my_namespace", &cursor);
+ *    while (fossil_crabdb_cursor_next(cursor, &key, &value, NULL)) {
+ *        // Every pair as of fossil_crabdb_snapshot_begin
+ *    }
+ *    fossil_crabdb_cursor_close(cursor);
+ *    fossil_crabdb_snapshot_end(snap);
+ *    @endcode
+ * 
+ * 11. Dumping the whole database to a file and back:
+ *    @code
+ *    fossil_fstream_t out;
+ *    fossil_fstream_open(&out, "my_database.dump", "wb");
+ *    fossil_crabdb_dump(db, &out);
+ *    fossil_fstream_close(&out);
  *    @endcode
  * 
  */
 
 #include "fossil/common/common.h"
+#include "fossil/io/fstream.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -120,27 +155,249 @@ typedef enum {
     CRABDB_ERR_SUB_NS_NOT_FOUND, /**< Sub-namespace not found */
     CRABDB_ERR_SUB_NS_EXISTS, /**< Sub-namespace already exists */
     CRABDB_ERR_KEY_NOT_FOUND, /**< Key not found */
-    CRABDB_ERR_INVALID_QUERY /**< Invalid query */
+    CRABDB_ERR_INVALID_QUERY, /**< Invalid query */
+    CRABDB_ERR_IO, /**< Reading or writing the persistent files failed */
+    CRABDB_ERR_READ_ONLY, /**< The database is a read-only mapped image */
+    CRABDB_ERR_NO_INDEX /**< The namespace has no ordered index */
 } fossil_crabdb_error_t;
 
+/**
+ * @brief When the write-ahead log is flushed to stable storage.
+ */
+typedef enum {
+    CRABDB_SYNC_ALWAYS = 0, /**< fsync after every write */
+    CRABDB_SYNC_GROUP, /**< fsync at most once per group commit interval */
+    CRABDB_SYNC_OS /**< Hand writes to the OS and let it decide when to flush */
+} fossil_crabdb_sync_policy_t;
+
 typedef struct fossil_crabdb_keyvalue_t {
     char *key; /**< Key of the key-value pair */
-    char *value; /**< Value of the key-value pair */
+    size_t key_length; /**< Length of the key, excluding the terminator */
+    char *value; /**< Value of the key-value pair, NUL terminated but possibly holding NUL bytes */
+    size_t value_length; /**< Length of the value, excluding the terminator */
+    size_t value_room; /**< Bytes kept after the key for an inline value, 0 if it has none */
+    size_t raw_length; /**< Length of the value once decompressed, 0 when it is stored as is */
+    uint64_t hash; /**< Cached hash of the key */
     struct fossil_crabdb_keyvalue_t *next; /**< Pointer to the next key-value pair */
+    struct fossil_crabdb_keyvalue_t *prev; /**< Pointer to the previous key-value pair */
+    struct fossil_crabdb_timer_t *timer; /**< Expiry timer, null when the pair never expires */
+    size_t clock_slot; /**< Position in the eviction clock of its partition, if it has one */
+    uint64_t version; /**< Commit sequence of the write that produced the current value */
 } fossil_crabdb_keyvalue_t;
 
+/**
+ * @brief Slot of an open-addressing hash index.
+ *
+ * An empty slot has a null entry; a deleted slot points at an internal tombstone.
+ */
+typedef struct {
+    uint64_t hash; /**< Hash of the key stored in the entry */
+    void *entry; /**< Pointer to the indexed entry */
+} fossil_crabdb_slot_t;
+
+/**
+ * @brief Open-addressing hash index with incremental resizing.
+ *
+ * While a resize is in progress the previous table is kept in `old_slots` and
+ * migrated a few slots at a time on every write, so no single insert pays for
+ * rehashing the whole table.
+ */
+typedef struct {
+    fossil_crabdb_slot_t *slots; /**< Current table (power of two capacity) */
+    size_t capacity; /**< Number of slots in the current table */
+    size_t used; /**< Live plus tombstone slots in the current table */
+    size_t count; /**< Live entries across both tables */
+    fossil_crabdb_slot_t *old_slots; /**< Table being migrated, if any */
+    size_t old_capacity; /**< Number of slots in the table being migrated */
+    size_t rehash_index; /**< Next slot of the old table to migrate */
+    size_t key_offset; /**< Offset of the `char *` key inside an entry */
+    struct fossil_crabdb_rcu_t *rcu; /**< Defers freeing tables that lock-free readers may still probe, null otherwise */
+} fossil_crabdb_index_t;
+
 typedef struct fossil_crabdb_namespace_t {
-    char *name; /**< Name of the namespace */
-    struct fossil_crabdb_namespace_t *sub_namespaces; /**< Pointer to the sub-namespaces */
+    char *name; /**< Full path of the namespace, its levels separated by '/' */
+    uint64_t hash; /**< Cached hash of the name */
+    struct fossil_crabdb_namespace_t **sub_namespaces; /**< Namespaces nested one level below */
     size_t sub_namespace_count; /**< Number of sub-namespaces */
+    size_t sub_namespace_capacity; /**< Room in `sub_namespaces`, doubled as it fills */
+    struct fossil_crabdb_namespace_t *parent; /**< Enclosing namespace, null at the top level */
+    size_t parent_slot; /**< Position in the `sub_namespaces` of the parent */
     struct fossil_crabdb_namespace_t *next; /**< Pointer to the next namespace */
-    fossil_crabdb_keyvalue_t *data; /**< Linked list of key-value pairs */
+    struct fossil_crabdb_namespace_t *prev; /**< Pointer to the previous namespace */
+    struct fossil_crabdb_stripe_t *stripes; /**< Key partitions, each with its own hash index, pair list and lock */
+    size_t stripe_count; /**< Number of key partitions */
+    struct fossil_crabdb_ordered_t *ordered; /**< Ordered index over the keys, null unless enabled */
+    struct fossil_crabdb_codec_t *codec; /**< Value compression settings, null unless enabled */
 } fossil_crabdb_namespace_t;
 
 typedef struct {
     fossil_crabdb_namespace_t *namespaces; /**< Pointer to the namespaces */
+    fossil_crabdb_index_t namespace_index; /**< Hash index over the namespaces */
+    size_t stripe_count; /**< Key partitions created per namespace */
+    struct fossil_crabdb_locks_t *locks; /**< Database-wide lock, null unless thread-safe */
+    struct fossil_crabdb_persist_t *persist; /**< Write-ahead log state, null when in-memory only */
+    struct fossil_crabdb_persist_t *stream; /**< Change stream sent to followers, null unless open */
+    struct fossil_crabdb_follower_t *follower; /**< Change stream applied from a leader, null unless following */
+    struct fossil_crabdb_image_t *image; /**< Mapped read-only image, null for a writable database */
+    struct fossil_crabdb_versions_t *versions; /**< Commit sequence and open snapshots */
+    struct fossil_crabdb_metrics_t *metrics; /**< Operation counters and latency histograms */
 } fossil_crabdb_t;
 
+/**
+ * @brief Borrowed view of a stored value.
+ *
+ * The view points straight into the store; nothing is copied, except that a
+ * compressed value is decompressed into a buffer the view owns. It stays
+ * valid until it is passed to fossil_crabdb_view_release.
+ */
+typedef struct {
+    const char *data; /**< First byte of the value, NUL terminated */
+    size_t length; /**< Length of the value, excluding the terminator */
+    fossil_crabdb_t *db; /**< Database the view borrows from */
+    struct fossil_crabdb_stripe_t *guard; /**< Partition held for reading, null when unlocked */
+    char *copy; /**< Decompressed value owned by the view, null when borrowing */
+} fossil_crabdb_view_t;
+
+/**
+ * @brief Operation of a write batch entry.
+ */
+typedef enum {
+    CRABDB_BATCH_INSERT, /**< Insert a new key, fails if it exists */
+    CRABDB_BATCH_UPDATE, /**< Replace the value of an existing key */
+    CRABDB_BATCH_DELETE  /**< Remove an existing key */
+} fossil_crabdb_batch_op_t;
+
+/**
+ * @brief One operation of a write batch.
+ */
+typedef struct {
+    fossil_crabdb_batch_op_t op; /**< Operation to apply */
+    const char *key; /**< Key the operation applies to */
+    const char *value; /**< New value, ignored for CRABDB_BATCH_DELETE */
+} fossil_crabdb_batch_entry_t;
+
+/**
+ * @brief Operations metered by fossil_crabdb_stats.
+ */
+typedef enum {
+    CRABDB_STAT_GET, /**< fossil_crabdb_get and fossil_crabdb_get_view */
+    CRABDB_STAT_INSERT, /**< fossil_crabdb_insert and fossil_crabdb_insert_ttl */
+    CRABDB_STAT_UPDATE, /**< fossil_crabdb_update and fossil_crabdb_update_ttl */
+    CRABDB_STAT_DELETE, /**< fossil_crabdb_delete */
+    CRABDB_STAT_MULTI_GET, /**< fossil_crabdb_multi_get */
+    CRABDB_STAT_WRITE_BATCH, /**< fossil_crabdb_write_batch */
+    CRABDB_STAT_SCAN, /**< Opening a cursor with fossil_crabdb_scan_range, fossil_crabdb_scan_prefix or fossil_crabdb_scan_all */
+    CRABDB_STAT_OP_COUNT /**< Number of metered operations */
+} fossil_crabdb_stat_op_t;
+
+/**
+ * @brief Counters and sampled latency of one operation, see fossil_crabdb_stats.
+ */
+typedef struct {
+    uint64_t calls; /**< Calls made */
+    uint64_t errors; /**< Calls that did not return CRABDB_OK, misses included */
+    uint64_t samples; /**< Calls timed for the latency figures */
+    uint64_t mean_ns; /**< Mean latency of the timed calls */
+    uint64_t p50_ns; /**< Median latency */
+    uint64_t p90_ns; /**< 90th percentile latency */
+    uint64_t p99_ns; /**< 99th percentile latency */
+    uint64_t p999_ns; /**< 99.9th percentile latency */
+    uint64_t max_ns; /**< Slowest timed call */
+} fossil_crabdb_op_stats_t;
+
+/**
+ * @brief Runtime metrics of a database, see fossil_crabdb_stats.
+ */
+typedef struct {
+    fossil_crabdb_op_stats_t ops[CRABDB_STAT_OP_COUNT]; /**< Per operation, indexed by fossil_crabdb_stat_op_t */
+    size_t namespaces; /**< Namespaces at every depth */
+    size_t pairs; /**< Pairs held, including expired ones not yet reclaimed */
+    size_t resident_bytes; /**< Bytes held by the pairs */
+    size_t arena_bytes; /**< Arena space in use, including garbage not yet compacted */
+    size_t index_slots; /**< Slots of the partition hash indexes */
+    double load_factor; /**< Pairs per index slot */
+    double mean_probe; /**< Slots a lookup of a stored key inspects on average */
+    size_t max_probe; /**< Slots the worst stored key takes to find */
+} fossil_crabdb_stats_t;
+
+/**
+ * @brief Input format of fossil_crabdb_bulk_load.
+ */
+typedef enum {
+    CRABDB_LOAD_TSV /**< `namespace<TAB>key<TAB>value` lines; a backslash escapes `\t`, `\n`, `\r` and `\\` */
+} fossil_crabdb_load_format_t;
+
+/**
+ * @brief Direction of an ordered scan.
+ */
+typedef enum {
+    CRABDB_SCAN_FORWARD, /**< Ascending key order */
+    CRABDB_SCAN_REVERSE  /**< Descending key order */
+} fossil_crabdb_scan_dir_t;
+
+/**
+ * @brief Memory use of a namespace, see fossil_crabdb_memory_stats.
+ */
+typedef struct {
+    size_t resident_bytes; /**< Bytes held by the pairs: node, key and value */
+    size_t budget_bytes; /**< Budget in force, 0 when unbounded */
+    size_t pairs; /**< Pairs held, including expired ones not yet reclaimed */
+    uint64_t evictions; /**< Pairs evicted to stay within the budget */
+    size_t arena_bytes; /**< Arena space in use, including garbage not yet compacted */
+    size_t bloom_bytes; /**< Bloom filter space, 0 unless the namespace has one */
+    size_t versions; /**< Replaced and deleted values still kept for open snapshots */
+    size_t dictionary_bytes; /**< Compression dictionary size, 0 without one */
+} fossil_crabdb_memory_stats_t;
+
+/**
+ * @brief Progress of a follower, see fossil_crabdb_follower_stats.
+ */
+typedef struct {
+    uint64_t applied; /**< Sequence number of the last change applied, 0 before the first */
+    uint64_t records; /**< Records applied, the initial contents included */
+    uint64_t batches; /**< Write batches that runs of pair changes were applied as */
+    uint64_t lag_bytes; /**< Stream bytes the leader has written that are not applied yet */
+    uint64_t lag_ms; /**< Time since the follower was last caught up, 0 while it is */
+    int closed; /**< The leader closed the stream */
+} fossil_crabdb_follower_stats_t;
+
+/**
+ * @brief Position in an ordered scan, see fossil_crabdb_scan_range.
+ */
+typedef struct fossil_crabdb_cursor_t fossil_crabdb_cursor_t;
+
+/**
+ * @brief Consistent read view of a database, see fossil_crabdb_snapshot_begin.
+ */
+typedef struct fossil_crabdb_snapshot_t fossil_crabdb_snapshot_t;
+
+/**
+ * @brief Thread pool from fossil/threads/threadpool.h.
+ */
+struct fossil_xthread_pool_t;
+
+/**
+ * @brief Queue of operations run on a thread pool, see fossil_crabdb_async_create.
+ */
+typedef struct fossil_crabdb_async_t fossil_crabdb_async_t;
+
+/**
+ * @brief Completion handle of an asynchronous operation.
+ */
+typedef struct fossil_crabdb_request_t fossil_crabdb_request_t;
+
+/**
+ * @brief Completion callback of an asynchronous operation.
+ *
+ * Runs on a pool thread, or on the submitting thread when the pool queue is
+ * full, and must not wait for other operations of the same queue.
+ *
+ * @param result Result of the operation.
+ * @param value Value found by a get, valid only during the call; null otherwise.
+ * @param user Pointer given at submission.
+ */
+typedef void (*fossil_crabdb_callback_t)(fossil_crabdb_error_t result, const char *value, void *user);
+
 /**
  * @brief Create a new fossil_crabdb_t database.
  * 
@@ -148,6 +405,36 @@ typedef struct {
  */
 fossil_crabdb_t* fossil_crabdb_create(void);
 
+/**
+ * @brief Create a new thread-safe fossil_crabdb_t database.
+ *
+ * Namespaces are guarded by one reader-writer lock and the keys of every
+ * namespace are spread over `stripe_count` partitions, each with its own
+ * reader-writer lock. Concurrent reads never block each other and writes to
+ * different partitions proceed in parallel.
+ *
+ * @param stripe_count Number of key partitions per namespace, 0 for the default.
+ * @return Pointer to the newly created fossil_crabdb_t database.
+ */
+fossil_crabdb_t* fossil_crabdb_create_concurrent(size_t stripe_count);
+
+/**
+ * @brief Create a thread-safe database whose gets take no lock.
+ *
+ * Like fossil_crabdb_create_concurrent, except that fossil_crabdb_get and
+ * fossil_crabdb_get_bytes read optimistically: they check that no writer
+ * overlapped the lookup and retry if one did. Readers never write to memory
+ * that other threads read, so they scale with the number of cores. Writers
+ * keep their locks. Memory they replace is freed only once the readers that
+ * might still see it have finished. Only the first 128 threads of the
+ * process to use bluecrab read this way; later threads take the locks, and
+ * so does a get that keeps running into writers.
+ *
+ * @param stripe_count Number of key partitions per namespace, 0 for the default.
+ * @return Pointer to the newly created fossil_crabdb_t database.
+ */
+fossil_crabdb_t* fossil_crabdb_create_read_mostly(size_t stripe_count);
+
 /**
  * @brief Erase the fossil_crabdb_t database.
  * 
@@ -157,37 +444,44 @@ void fossil_crabdb_erase(fossil_crabdb_t *db);
 
 /**
  * @brief Create a new namespace.
+ *
+ * A name with '/' in it is a path: `tenant/app/cache` is the namespace
+ * `cache` nested in `tenant/app`, which must already exist. Every namespace,
+ * nested or not, holds its own data and is addressed by its full path in
+ * all other calls.
  * 
  * @param db Pointer to the fossil_crabdb_t database.
- * @param namespace_name Name of the new namespace.
+ * @param namespace_name Name or path of the new namespace.
  * @return Error code indicating the result of the operation.
  */
 fossil_crabdb_error_t fossil_crabdb_create_namespace(fossil_crabdb_t *db, const char *namespace_name);
 
 /**
  * @brief Create a new sub-namespace.
+ *
+ * Same as creating the namespace `namespace_name/sub_namespace_name`.
  * 
  * @param db Pointer to the fossil_crabdb_t database.
- * @param namespace_name Name of the parent namespace.
- * @param sub_namespace_name Name of the new sub-namespace.
+ * @param namespace_name Path of the parent namespace.
+ * @param sub_namespace_name Name of the new sub-namespace, without any '/'.
  * @return Error code indicating the result of the operation.
  */
 fossil_crabdb_error_t fossil_crabdb_create_sub_namespace(fossil_crabdb_t *db, const char *namespace_name, const char *sub_namespace_name);
 
 /**
- * @brief Erase a namespace.
+ * @brief Erase a namespace together with every namespace nested in it.
  * 
  * @param db Pointer to the fossil_crabdb_t database.
- * @param namespace_name Name of the namespace to erase.
+ * @param namespace_name Path of the namespace to erase.
  * @return Error code indicating the result of the operation.
  */
 fossil_crabdb_error_t fossil_crabdb_erase_namespace(fossil_crabdb_t *db, const char *namespace_name);
 
 /**
- * @brief Erase a sub-namespace.
+ * @brief Erase a sub-namespace together with every namespace nested in it.
  * 
  * @param db Pointer to the fossil_crabdb_t database.
- * @param namespace_name Name of the parent namespace.
+ * @param namespace_name Path of the parent namespace.
  * @param sub_namespace_name Name of the sub-namespace to erase.
  * @return Error code indicating the result of the operation.
  */
@@ -204,6 +498,36 @@ fossil_crabdb_error_t fossil_crabdb_erase_sub_namespace(fossil_crabdb_t *db, con
  */
 fossil_crabdb_error_t fossil_crabdb_insert(fossil_crabdb_t *db, const char *namespace_name, const char *key, const char *value);
 
+/**
+ * @brief Insert data into a namespace with a time to live.
+ *
+ * Once `ttl_ms` milliseconds have passed the pair reads as absent and is
+ * reclaimed by later writes to its partition or by fossil_crabdb_expire.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param namespace_name Name of the namespace.
+ * @param key Key of the data to insert.
+ * @param value Value of the data to insert.
+ * @param ttl_ms Time to live in milliseconds, 0 for a pair that never expires.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_insert_ttl(fossil_crabdb_t *db, const char *namespace_name, const char *key, const char *value, uint64_t ttl_ms);
+
+/**
+ * @brief Insert a value of explicit length into a namespace.
+ *
+ * The value may hold NUL bytes. Values up to a few dozen bytes are stored
+ * inline with their key; larger ones get a block of their own.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param namespace_name Name of the namespace.
+ * @param key Key of the data to insert.
+ * @param value Bytes to store; may be null when `length` is 0.
+ * @param length Number of bytes in `value`.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_insert_bytes(fossil_crabdb_t *db, const char *namespace_name, const char *key, const void *value, size_t length);
+
 /**
  * @brief Get data from a namespace.
  * 
@@ -215,6 +539,102 @@ fossil_crabdb_error_t fossil_crabdb_insert(fossil_crabdb_t *db, const char *name
  */
 fossil_crabdb_error_t fossil_crabdb_get(fossil_crabdb_t *db, const char *namespace_name, const char *key, char **value);
 
+/**
+ * @brief Get a value from a namespace together with its length.
+ *
+ * Unlike fossil_crabdb_get this returns values holding NUL bytes intact.
+ * The copy is still NUL terminated past `length` bytes.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param namespace_name Name of the namespace.
+ * @param key Key of the data to get.
+ * @param value Receives a copy of the value; the caller frees it.
+ * @param length Receives the number of bytes in the value.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_get_bytes(fossil_crabdb_t *db, const char *namespace_name, const char *key, void **value, size_t *length);
+
+/**
+ * @brief Borrow a value from a namespace without copying it.
+ *
+ * On a thread-safe database the view holds a read guard on the key's
+ * partition until it is released, so writers to that partition wait; the
+ * calling thread must not modify the database while it holds a view. On a
+ * plain database the view is valid until the namespace is next modified.
+ * On failure the view is left empty and nothing needs releasing.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param namespace_name Name of the namespace.
+ * @param key Key of the data to borrow.
+ * @param view View to fill in.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_get_view(fossil_crabdb_t *db, const char *namespace_name, const char *key, fossil_crabdb_view_t *view);
+
+/**
+ * @brief Release a view obtained from fossil_crabdb_get_view.
+ *
+ * @param view View to release; releasing an empty view is a no-op.
+ */
+void fossil_crabdb_view_release(fossil_crabdb_view_t *view);
+
+/**
+ * @brief Get several values from a namespace in one pass.
+ *
+ * The namespace is resolved once and the keys are looked up grouped by
+ * partition, so a thread-safe database takes each partition lock only once.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param namespace_name Name of the namespace.
+ * @param keys Keys to look up.
+ * @param count Number of keys.
+ * @param values Receives a copy of each value, or null for a missing key; the caller frees them.
+ * @return CRABDB_OK if every key was found, CRABDB_ERR_KEY_NOT_FOUND if any was missing.
+ */
+fossil_crabdb_error_t fossil_crabdb_multi_get(fossil_crabdb_t *db, const char *namespace_name, const char *const *keys, size_t count, char **values);
+
+/**
+ * @brief Apply a batch of inserts, updates and deletes atomically.
+ *
+ * Entries are applied in order against a single namespace resolution. If any
+ * entry would fail (duplicate insert, missing key) nothing is applied, and
+ * concurrent readers never observe a partially applied batch. The batch is
+ * logged as a single write-ahead log record.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param namespace_name Name of the namespace.
+ * @param entries Operations to apply.
+ * @param count Number of operations.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_write_batch(fossil_crabdb_t *db, const char *namespace_name, const fossil_crabdb_batch_entry_t *entries, size_t count);
+
+/**
+ * @brief Load a file of pairs in bulk.
+ *
+ * The file is mapped and cut into chunks at line boundaries, which worker
+ * threads parse and hash in parallel. Each partition is then filled by one
+ * worker without taking any per-key lock, so a concurrent database loads its
+ * partitions side by side. The database is locked exclusively throughout.
+ *
+ * Every line sets one pair, replacing any pair of the same key along with
+ * its time to live; a later line wins over an earlier one. Namespaces that
+ * do not exist yet are created, together with their parents. Empty lines
+ * are skipped and a trailing carriage return is ignored. A malformed line
+ * fails the load before anything changes, but running out of memory part
+ * way through can leave the file partly loaded.
+ *
+ * With persistence enabled the load is recorded by writing a fresh
+ * snapshot, not one log record per pair.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param path Path of the file to load.
+ * @param format Format of the file.
+ * @return CRABDB_OK, CRABDB_ERR_IO if the file cannot be read, or
+ *         CRABDB_ERR_INVALID_QUERY for a malformed line or namespace path.
+ */
+fossil_crabdb_error_t fossil_crabdb_bulk_load(fossil_crabdb_t *db, const char *path, fossil_crabdb_load_format_t format);
+
 /**
  * @brief Update data in a namespace.
  * 
@@ -226,6 +646,127 @@ fossil_crabdb_error_t fossil_crabdb_get(fossil_crabdb_t *db, const char *namespa
  */
 fossil_crabdb_error_t fossil_crabdb_update(fossil_crabdb_t *db, const char *namespace_name, const char *key, const char *value);
 
+/**
+ * @brief Update data in a namespace and restart its time to live.
+ *
+ * fossil_crabdb_update keeps the current expiry of a pair; this call replaces
+ * it, so it also serves to extend a session.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param namespace_name Name of the namespace.
+ * @param key Key of the data to update.
+ * @param value New value of the data.
+ * @param ttl_ms Time to live in milliseconds from now, 0 to never expire.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_update_ttl(fossil_crabdb_t *db, const char *namespace_name, const char *key, const char *value, uint64_t ttl_ms);
+
+/**
+ * @brief Update data in a namespace with a value of explicit length.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param namespace_name Name of the namespace.
+ * @param key Key of the data to update.
+ * @param value New bytes of the data; may be null when `length` is 0.
+ * @param length Number of bytes in `value`.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_update_bytes(fossil_crabdb_t *db, const char *namespace_name, const char *key, const void *value, size_t length);
+
+/**
+ * @brief Time left before a pair expires.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param namespace_name Name of the namespace.
+ * @param key Key of the pair.
+ * @param remaining_ms Receives the milliseconds left, or UINT64_MAX when the pair never expires.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_ttl(fossil_crabdb_t *db, const char *namespace_name, const char *key, uint64_t *remaining_ms);
+
+/**
+ * @brief Reclaim expired pairs.
+ *
+ * Expired pairs are already invisible to readers and every write reclaims a
+ * few in its own partition; this call does the rest, one partition at a
+ * time, and is meant for idle loops or a housekeeping thread.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param max_pairs Stop after reclaiming this many pairs, 0 for no limit.
+ * @return Number of pairs reclaimed.
+ */
+size_t fossil_crabdb_expire(fossil_crabdb_t *db, size_t max_pairs);
+
+/**
+ * @brief Cap the memory held by the pairs of a namespace.
+ *
+ * The budget is split evenly over the key partitions. A write that takes a
+ * partition over its share evicts pairs that have not been read or updated
+ * recently, using the CLOCK approximation of LRU. An insert or update never
+ * evicts the pair it writes, though a write batch larger than the budget
+ * may. Evictions are logged as deletes. The budget itself is not persisted,
+ * so set it after fossil_crabdb_persist_open.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param namespace_name Name of the namespace.
+ * @param max_bytes Budget in bytes, 0 to remove it.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_set_memory_budget(fossil_crabdb_t *db, const char *namespace_name, size_t max_bytes);
+
+/**
+ * @brief Report the memory held by a namespace and its eviction count.
+ *
+ * Mapped images hold nothing on the heap and report zeros.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param namespace_name Name of the namespace.
+ * @param stats Receives the figures.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_memory_stats(fossil_crabdb_t *db, const char *namespace_name, fossil_crabdb_memory_stats_t *stats);
+
+/**
+ * @brief Read the runtime metrics of a database.
+ *
+ * Metering is always on. Every data operation is counted on a shard of the
+ * calling thread without any shared write, and one call in 64 per thread is
+ * timed into a latency histogram whose percentiles are within 12.5%. The
+ * storage figures walk every partition under its read lock, so this call
+ * is meant for periodic scraping rather than hot paths.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param stats Receives the metrics.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_stats(fossil_crabdb_t *db, fossil_crabdb_stats_t *stats);
+
+/**
+ * @brief Render metrics as text in the Prometheus exposition format.
+ *
+ * Behaves like snprintf: the text is cut to fit `size` bytes and always
+ * terminated when `size` is not 0.
+ *
+ * @param stats Metrics from fossil_crabdb_stats.
+ * @param buffer Receives the text; may be null when `size` is 0.
+ * @param size Size of `buffer` in bytes.
+ * @return Length of the full text, excluding the terminator.
+ */
+size_t fossil_crabdb_stats_format(const fossil_crabdb_stats_t *stats, char *buffer, size_t size);
+
+/**
+ * @brief Reclaim the arena space left behind by deleted and updated pairs.
+ *
+ * Pairs are stored in per-partition arenas that compact themselves once
+ * most of their space is garbage; this compacts every partition of the
+ * namespace now, one at a time. Mapped images have nothing to compact.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param namespace_name Name of the namespace.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_compact(fossil_crabdb_t *db, const char *namespace_name);
+
 /**
  * @brief Delete data from a namespace.
  * 
@@ -237,62 +778,630 @@ fossil_crabdb_error_t fossil_crabdb_update(fossil_crabdb_t *db, const char *name
 fossil_crabdb_error_t fossil_crabdb_delete(fossil_crabdb_t *db, const char *namespace_name, const char *key);
 
 /**
- * @brief Execute a custom query.
- * 
+ * @brief Maintain an ordered index over the keys of a namespace.
+ *
+ * The index is a B+tree built from the existing keys and kept up to date by
+ * every later write; it enables fossil_crabdb_scan_prefix and
+ * fossil_crabdb_scan_range. Enabling it twice is a no-op.
+ *
  * @param db Pointer to the fossil_crabdb_t database.
- * @param query Custom query to execute.
+ * @param namespace_name Name of the namespace.
  * @return Error code indicating the result of the operation.
  */
-fossil_crabdb_error_t fossil_crabdb_execute_query(fossil_crabdb_t *db, const char *query);
+fossil_crabdb_error_t fossil_crabdb_create_ordered_index(fossil_crabdb_t *db, const char *namespace_name);
 
-#ifdef __cplusplus
-}
-#endif
+/**
+ * @brief Maintain a Bloom filter over the keys of a namespace.
+ *
+ * Lookups of keys that were never inserted are then usually answered by
+ * one cache-line probe, without touching the hash index. The filter grows
+ * as keys are added and sheds deleted keys when their partition is
+ * compacted. Enabling it twice is a no-op.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param namespace_name Name of the namespace.
+ * @param bits_per_key Filter bits per key, 0 for the default of 10 (about 1% false positives).
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_create_bloom_filter(fossil_crabdb_t *db, const char *namespace_name, size_t bits_per_key);
 
-#ifdef __cplusplus
-#include <string>
+/**
+ * @brief Store the large values of a namespace compressed.
+ *
+ * Values of at least `threshold` bytes are compressed with a built-in LZ
+ * codec when that saves at least an eighth of their size, and decompressed
+ * whenever they are read; nothing changes for callers. Values already
+ * stored are converted on the spot. A dictionary trained earlier is kept.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param namespace_name Name of the namespace.
+ * @param threshold Shortest value to compress, 0 to store every value as is and drop the dictionary.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_set_compression(fossil_crabdb_t *db, const char *namespace_name, size_t threshold);
 
-namespace fossil {
+/**
+ * @brief Train a compression dictionary from the values of a namespace.
+ *
+ * Samples the values the namespace would compress, keeps the content they
+ * share and recompresses every value against it, so even values too short
+ * to compress well on their own shrink. Retrain once the data has changed
+ * character.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param namespace_name Name of the namespace, which must have compression enabled.
+ * @param dictionary_size Dictionary size in bytes, 0 for the default of 16 KiB; at most 32 KiB.
+ * @return CRABDB_ERR_INVALID_QUERY if compression is not enabled.
+ */
+fossil_crabdb_error_t fossil_crabdb_train_dictionary(fossil_crabdb_t *db, const char *namespace_name, size_t dictionary_size);
 
-class BlueCrabDB {
-public:
-    BlueCrabDB() {
-        db = fossil_crabdb_create();
-    }
+/**
+ * @brief Open a cursor over the keys in `[start, end)`.
+ *
+ * On a thread-safe database the cursor holds read guards on every partition
+ * of the namespace until it is closed, so the scan sees a consistent view;
+ * the calling thread must not modify the database while a cursor is open.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param namespace_name Name of the namespace.
+ * @param start First key of the range, or null to start at the smallest key.
+ * @param end Key the range stops before, or null to run to the largest key.
+ * @param direction Whether to walk the range ascending or descending.
+ * @param cursor Receives the cursor, to be released with fossil_crabdb_cursor_close.
+ * @return CRABDB_ERR_NO_INDEX if the namespace has no ordered index.
+ */
+fossil_crabdb_error_t fossil_crabdb_scan_range(fossil_crabdb_t *db, const char *namespace_name, const char *start, const char *end, fossil_crabdb_scan_dir_t direction, fossil_crabdb_cursor_t **cursor);
 
-    ~BlueCrabDB() {
-        try {
-            fossil_crabdb_erase(db);
-        } catch (...) {
-            // Handle the exception here
-        }
-    }
+/**
+ * @brief Open a cursor over the keys that start with `prefix`.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param namespace_name Name of the namespace.
+ * @param prefix Common prefix of the keys to visit; an empty prefix visits every key.
+ * @param direction Whether to walk the keys ascending or descending.
+ * @param cursor Receives the cursor, to be released with fossil_crabdb_cursor_close.
+ * @return CRABDB_ERR_NO_INDEX if the namespace has no ordered index.
+ */
+fossil_crabdb_error_t fossil_crabdb_scan_prefix(fossil_crabdb_t *db, const char *namespace_name, const char *prefix, fossil_crabdb_scan_dir_t direction, fossil_crabdb_cursor_t **cursor);
 
-    /**
-     * @brief Create a new namespace.
-     * 
-     * @param namespace_name Name of the new namespace.
-     * @return Error code indicating the result of the operation.
-     */
-    fossil_crabdb_error_t create_namespace(const std::string& namespace_name) {
-        try {
-            return fossil_crabdb_create_namespace(db, namespace_name.c_str());
-        } catch (...) {
-            // Handle the exception here
-            return CRABDB_ERR_INVALID_QUERY;
-        }
-    }
+/**
+ * @brief Open a cursor over every pair of every namespace.
+ *
+ * Pairs come partition by partition in no particular order, straight from
+ * the store, so memory use does not grow with the database. The cursor
+ * holds a read guard on the database, keeping namespaces from being created
+ * or erased, and on the partition it is in, so writers to that partition
+ * wait; the calling thread must not modify the database while it is open.
+ * Pairs changed meanwhile in other partitions may or may not be seen.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param cursor Receives the cursor, to be released with fossil_crabdb_cursor_close.
+ * @return CRABDB_ERR_NO_INDEX for a mapped image.
+ */
+fossil_crabdb_error_t fossil_crabdb_scan_all(fossil_crabdb_t *db, fossil_crabdb_cursor_t **cursor);
 
-    /**
-     * @brief Create a new sub-namespace.
-     * 
-     * @param namespace_name Name of the parent namespace.
-     * @param sub_namespace_name Name of the new sub-namespace.
-     * @return Error code indicating the result of the operation.
-     */
-    fossil_crabdb_error_t create_subnamespace(const std::string& namespace_name, const std::string& sub_namespace_name) {
-        try {
-            return fossil_crabdb_create_sub_namespace(db, namespace_name.c_str(), sub_namespace_name.c_str());
+/**
+ * @brief Advance a cursor to its next pair.
+ *
+ * The returned strings point into the store and stay valid while the cursor
+ * is open; those of a snapshot scan, and compressed values, stay valid until
+ * the next call.
+ *
+ * @param cursor Open cursor.
+ * @param key Receives the key, may be null.
+ * @param value Receives the value, may be null.
+ * @param value_length Receives the value length, may be null.
+ * @return 1 if a pair was produced, 0 once the scan is exhausted.
+ */
+int fossil_crabdb_cursor_next(fossil_crabdb_cursor_t *cursor, const char **key, const char **value, size_t *value_length);
+
+/**
+ * @brief Namespace of the pair a cursor produced last.
+ *
+ * @param cursor Open cursor.
+ * @return Full path of the namespace, valid while the cursor is open; null
+ *         before the first pair and once exhausted for fossil_crabdb_scan_all.
+ */
+const char *fossil_crabdb_cursor_namespace(const fossil_crabdb_cursor_t *cursor);
+
+/**
+ * @brief Close a cursor and release its read guards.
+ *
+ * @param cursor Cursor to close; null is ignored.
+ */
+void fossil_crabdb_cursor_close(fossil_crabdb_cursor_t *cursor);
+
+/**
+ * @brief Open a consistent read view of the database.
+ *
+ * The snapshot sees every write that completed before it began and none
+ * that came after, across all namespaces, while writers carry on. Values
+ * replaced or deleted while a snapshot is open are kept until no open
+ * snapshot can see them any more. Pairs still expire as usual, and
+ * creating or erasing namespaces is not versioned. End every snapshot
+ * before erasing the database.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param snapshot Receives the snapshot, to be released with fossil_crabdb_snapshot_end.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_snapshot_begin(fossil_crabdb_t *db, fossil_crabdb_snapshot_t **snapshot);
+
+/**
+ * @brief Get data from a namespace as it was when the snapshot began.
+ *
+ * @param snapshot Open snapshot.
+ * @param namespace_name Name of the namespace.
+ * @param key Key of the data to get.
+ * @param value Pointer to store a copy of the value, freed by the caller.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_snapshot_get(fossil_crabdb_snapshot_t *snapshot, const char *namespace_name, const char *key, char **value);
+
+/**
+ * @brief Open a cursor over every pair of a namespace as of the snapshot.
+ *
+ * Pairs come in no particular order. The cursor copies the pairs of one
+ * key partition at a time, holding that partition's read guard only while
+ * it copies, so writers are never blocked for the whole scan. The strings
+ * returned by fossil_crabdb_cursor_next stay valid until its next call.
+ * The scan ends early if the namespace is erased or memory runs out.
+ * Mapped images have no snapshot scans.
+ *
+ * @param snapshot Open snapshot; it must outlive the cursor.
+ * @param namespace_name Name of the namespace.
+ * @param cursor Receives the cursor, to be released with fossil_crabdb_cursor_close.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_snapshot_scan(fossil_crabdb_snapshot_t *snapshot, const char *namespace_name, fossil_crabdb_cursor_t **cursor);
+
+/**
+ * @brief Close a snapshot and reclaim the old values only it could see.
+ *
+ * The calling thread must not hold a view or an ordered cursor.
+ *
+ * @param snapshot Snapshot to close; null is ignored.
+ */
+void fossil_crabdb_snapshot_end(fossil_crabdb_snapshot_t *snapshot);
+
+/**
+ * @brief Execute a custom query.
+ * 
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param query Custom query to execute.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_execute_query(fossil_crabdb_t *db, const char *query);
+
+/**
+ * @brief Compiled query, see fossil_crabdb_prepare.
+ */
+typedef struct fossil_crabdb_stmt_t fossil_crabdb_stmt_t;
+
+/**
+ * @brief Compile a query into a reusable prepared statement.
+ *
+ * A query has the form `command(arg, ...)`. An argument is a bare word with
+ * surrounding whitespace trimmed, a single or double quoted string with
+ * backslash escapes, or a bind parameter: `?` takes the next position and
+ * `?N` names position N (1-based). Executing the statement afterwards does
+ * no parsing and no allocation.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param query Query to compile.
+ * @param stmt Receives the statement, to be released with fossil_crabdb_finalize.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_prepare(fossil_crabdb_t *db, const char *query, fossil_crabdb_stmt_t **stmt);
+
+/**
+ * @brief Bind a value to a parameter of a prepared statement.
+ *
+ * The string is borrowed, not copied; it must stay valid until the statement
+ * is executed or rebound.
+ *
+ * @param stmt Prepared statement.
+ * @param index Parameter position, starting at 1.
+ * @param value Value to bind, or null to clear the binding.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_bind(fossil_crabdb_stmt_t *stmt, size_t index, const char *value);
+
+/**
+ * @brief Number of bind parameters of a prepared statement.
+ *
+ * @param stmt Prepared statement.
+ * @return Highest parameter position used by the query.
+ */
+size_t fossil_crabdb_stmt_param_count(const fossil_crabdb_stmt_t *stmt);
+
+/**
+ * @brief Execute a prepared statement with its current bindings.
+ *
+ * @param stmt Prepared statement.
+ * @return Error code of the operation; CRABDB_ERR_INVALID_QUERY if a parameter is unbound.
+ */
+fossil_crabdb_error_t fossil_crabdb_stmt_execute(fossil_crabdb_stmt_t *stmt);
+
+/**
+ * @brief Value read by the last successful execution of a `get` statement.
+ *
+ * @param stmt Prepared statement.
+ * @return The value, valid until the statement is executed again or finalized; null if none.
+ */
+const char *fossil_crabdb_stmt_result(const fossil_crabdb_stmt_t *stmt);
+
+/**
+ * @brief Release a prepared statement.
+ *
+ * @param stmt Statement to release; null is ignored.
+ */
+void fossil_crabdb_finalize(fossil_crabdb_stmt_t *stmt);
+
+/**
+ * @brief Attach durable storage to a database.
+ *
+ * Loads `<path>.snapshot` if present, replays the tail of `<path>.wal` on top
+ * of it and then appends every successful mutation to the log. A torn record
+ * at the end of the log is discarded during recovery.
+ *
+ * @param db Pointer to the fossil_crabdb_t database (normally still empty).
+ * @param path Path prefix of the snapshot and log files.
+ * @param policy When log writes are flushed to stable storage.
+ * @param group_commit_ms Interval between flushes for CRABDB_SYNC_GROUP.
+ * @param checkpoint_bytes Log size that triggers an automatic checkpoint, 0 to disable.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_persist_open(fossil_crabdb_t *db, const char *path, fossil_crabdb_sync_policy_t policy, uint32_t group_commit_ms, uint64_t checkpoint_bytes);
+
+/**
+ * @brief Flush the log, detach durable storage and keep the data in memory.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_persist_close(fossil_crabdb_t *db);
+
+/**
+ * @brief Force buffered log records to stable storage.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_sync(fossil_crabdb_t *db);
+
+/**
+ * @brief Write a snapshot of the whole database and truncate the log.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_checkpoint(fossil_crabdb_t *db);
+
+/**
+ * @brief Write the database as a compact, hash-indexed image file.
+ *
+ * Keys are stored sorted within each namespace together with an open-addressing
+ * slot table, so the file can be served directly by fossil_crabdb_open_mmap.
+ * Nested namespaces are stored under their full paths.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param path Path of the image file to write.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_export(fossil_crabdb_t *db, const char *path);
+
+/**
+ * @brief Open an image written by fossil_crabdb_export without loading it.
+ *
+ * The file is memory mapped read-only and lookups probe the mapping directly,
+ * so pages are shared by every process that maps the same image. Mutating
+ * calls on the returned database fail with CRABDB_ERR_READ_ONLY; release it
+ * with fossil_crabdb_erase.
+ *
+ * @param path Path of the image file.
+ * @return Pointer to the read-only database, or null if the image is invalid.
+ */
+fossil_crabdb_t* fossil_crabdb_open_mmap(const char *path);
+
+/**
+ * @brief Write every namespace, its settings and its live pairs to a stream.
+ *
+ * The dump is a compact binary format written in large blocks and closed
+ * by a checksum. Namespaces are read-guarded one partition at a time, as
+ * with fossil_crabdb_scan_all, so writers carry on elsewhere and the dump
+ * is not a point-in-time copy while they do. TTLs are kept as deadlines.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param stream Stream opened for binary writing.
+ * @return CRABDB_ERR_IO if a write fails.
+ */
+fossil_crabdb_error_t fossil_crabdb_dump(fossil_crabdb_t *db, fossil_fstream_t *stream);
+
+/**
+ * @brief Load a stream written by fossil_crabdb_dump.
+ *
+ * Missing namespaces are created with the dumped settings, pairs that are
+ * already there are replaced and pairs whose deadline has passed are left
+ * out. Everything goes through the normal write path, so it is logged when
+ * the database is persistent. The dump is checked as it is read; pairs read
+ * before a damaged or truncated part stay in.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param stream Stream opened for binary reading.
+ * @return CRABDB_ERR_IO if the stream is not a complete, intact dump.
+ */
+fossil_crabdb_error_t fossil_crabdb_restore(fossil_crabdb_t *db, fossil_fstream_t *stream);
+
+/**
+ * @brief Send every change of a database to a follower through a descriptor.
+ *
+ * The stream starts with the records that rebuild the current contents,
+ * then carries each successful mutation as an ordered record numbered from
+ * 1, in the framing of the write-ahead log. A bulk load is sent as a fresh
+ * copy of the whole contents. Records are flushed as they are
+ * made, so a writer blocks while a pipe or socket to a slow follower is
+ * full. A write that fails stops the stream without failing the mutation.
+ * Ignore SIGPIPE when the follower may exit first.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param fd Pipe, socket or file to write to; it is duplicated and stays open.
+ * @return CRABDB_ERR_IO if a stream is already open or the descriptor fails.
+ */
+fossil_crabdb_error_t fossil_crabdb_stream_open(fossil_crabdb_t *db, int fd);
+
+/**
+ * @brief Stop sending changes.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @return CRABDB_ERR_IO if a write to the stream failed since it was opened.
+ */
+fossil_crabdb_error_t fossil_crabdb_stream_close(fossil_crabdb_t *db);
+
+/**
+ * @brief Make a database follow the change stream of a leader.
+ *
+ * Changes are applied by fossil_crabdb_follower_poll. The descriptor can be
+ * the read end of a fossil_crabdb_stream_open pipe or socket, a file the
+ * stream is written to, or the `.wal` file of a persistent leader, which
+ * is followed until the leader next checkpoints. Start from an empty
+ * database and do not write to it directly; such writes are not sent back
+ * and make the follower diverge.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param fd Descriptor to read from; it is duplicated and stays open.
+ * @return CRABDB_ERR_IO if the database already follows a stream.
+ */
+fossil_crabdb_error_t fossil_crabdb_follow(fossil_crabdb_t *db, int fd);
+
+/**
+ * @brief Apply the changes that have arrived from the leader.
+ *
+ * Waits up to `timeout_ms` for the stream to have data, reads what is
+ * there and applies every complete record. Runs of inserts, updates and
+ * deletes on one namespace go in as one write batch each. Call it from
+ * one thread at a time; other threads may read the database meanwhile if
+ * it is thread-safe.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param timeout_ms Longest wait for data, 0 to only take what is there.
+ * @return CRABDB_OK, or CRABDB_ERR_IO once the leader closed the stream and
+ *         it is fully applied, or when it is unreadable or corrupt.
+ */
+fossil_crabdb_error_t fossil_crabdb_follower_poll(fossil_crabdb_t *db, int timeout_ms);
+
+/**
+ * @brief How far a follower has got and how far behind the leader it is.
+ *
+ * Safe to call from any thread while another one polls.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @param stats Receives the figures.
+ * @return CRABDB_ERR_IO if the database follows no stream.
+ */
+fossil_crabdb_error_t fossil_crabdb_follower_stats(fossil_crabdb_t *db, fossil_crabdb_follower_stats_t *stats);
+
+/**
+ * @brief Stop following; the data applied so far stays.
+ *
+ * @param db Pointer to the fossil_crabdb_t database.
+ * @return Error code indicating the result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_unfollow(fossil_crabdb_t *db);
+
+/**
+ * @brief Create a queue that runs operations of a database on a thread pool.
+ *
+ * Submitting copies the arguments and returns at once. Operations of one
+ * queue run in submission order, one pool task at a time, and adjacent
+ * submissions are coalesced: consecutive gets on a namespace run as one
+ * fossil_crabdb_multi_get and consecutive inserts, updates and deletes as
+ * one fossil_crabdb_write_batch, which takes each lock and writes the log
+ * once. A batch that fails is retried one operation at a time, so every
+ * operation completes with the result it would have had alone. Use a
+ * thread-safe database when other threads use it too, and one queue per
+ * stream of operations that may run in parallel.
+ *
+ * @param db Pointer to the fossil_crabdb_t database; it must outlive the queue.
+ * @param pool Running thread pool; it must outlive the queue.
+ * @return Pointer to the queue, or null on failure.
+ */
+fossil_crabdb_async_t *fossil_crabdb_async_create(fossil_crabdb_t *db, struct fossil_xthread_pool_t *pool);
+
+/**
+ * @brief Wait for every queued operation to complete and free the queue.
+ *
+ * Handles of completed operations stay valid until they are freed.
+ *
+ * @param async Queue to free; null is ignored.
+ */
+void fossil_crabdb_async_erase(fossil_crabdb_async_t *async);
+
+/**
+ * @brief Queue an insert, see fossil_crabdb_insert.
+ *
+ * @param async Queue to submit to.
+ * @param namespace_name Name of the namespace.
+ * @param key Key of the data to insert.
+ * @param value Value of the data to insert.
+ * @param callback Called on completion; may be null.
+ * @param user Passed to the callback.
+ * @param request Receives a handle to be freed with fossil_crabdb_request_free; may be null.
+ * @return CRABDB_OK once the operation is queued, or an error if it could not be.
+ */
+fossil_crabdb_error_t fossil_crabdb_async_insert(fossil_crabdb_async_t *async, const char *namespace_name, const char *key, const char *value, fossil_crabdb_callback_t callback, void *user, fossil_crabdb_request_t **request);
+
+/**
+ * @brief Queue a get, see fossil_crabdb_get.
+ *
+ * The value reaches the callback and can be taken from the handle with
+ * fossil_crabdb_request_wait.
+ *
+ * @param async Queue to submit to.
+ * @param namespace_name Name of the namespace.
+ * @param key Key of the data to get.
+ * @param callback Called on completion; may be null.
+ * @param user Passed to the callback.
+ * @param request Receives a handle to be freed with fossil_crabdb_request_free; may be null.
+ * @return CRABDB_OK once the operation is queued, or an error if it could not be.
+ */
+fossil_crabdb_error_t fossil_crabdb_async_get(fossil_crabdb_async_t *async, const char *namespace_name, const char *key, fossil_crabdb_callback_t callback, void *user, fossil_crabdb_request_t **request);
+
+/**
+ * @brief Queue an update, see fossil_crabdb_update.
+ *
+ * @param async Queue to submit to.
+ * @param namespace_name Name of the namespace.
+ * @param key Key of the data to update.
+ * @param value New value of the data.
+ * @param callback Called on completion; may be null.
+ * @param user Passed to the callback.
+ * @param request Receives a handle to be freed with fossil_crabdb_request_free; may be null.
+ * @return CRABDB_OK once the operation is queued, or an error if it could not be.
+ */
+fossil_crabdb_error_t fossil_crabdb_async_update(fossil_crabdb_async_t *async, const char *namespace_name, const char *key, const char *value, fossil_crabdb_callback_t callback, void *user, fossil_crabdb_request_t **request);
+
+/**
+ * @brief Queue a delete, see fossil_crabdb_delete.
+ *
+ * @param async Queue to submit to.
+ * @param namespace_name Name of the namespace.
+ * @param key Key of the data to delete.
+ * @param callback Called on completion; may be null.
+ * @param user Passed to the callback.
+ * @param request Receives a handle to be freed with fossil_crabdb_request_free; may be null.
+ * @return CRABDB_OK once the operation is queued, or an error if it could not be.
+ */
+fossil_crabdb_error_t fossil_crabdb_async_delete(fossil_crabdb_async_t *async, const char *namespace_name, const char *key, fossil_crabdb_callback_t callback, void *user, fossil_crabdb_request_t **request);
+
+/**
+ * @brief Queue a custom query, see fossil_crabdb_execute_query.
+ *
+ * @param async Queue to submit to.
+ * @param query Custom query to execute.
+ * @param callback Called on completion; may be null.
+ * @param user Passed to the callback.
+ * @param request Receives a handle to be freed with fossil_crabdb_request_free; may be null.
+ * @return CRABDB_OK once the operation is queued, or an error if it could not be.
+ */
+fossil_crabdb_error_t fossil_crabdb_async_execute_query(fossil_crabdb_async_t *async, const char *query, fossil_crabdb_callback_t callback, void *user, fossil_crabdb_request_t **request);
+
+/**
+ * @brief Check whether an asynchronous operation has completed.
+ *
+ * @param request Handle of the operation.
+ * @return Nonzero once the operation and its callback have completed.
+ */
+int fossil_crabdb_request_poll(const fossil_crabdb_request_t *request);
+
+/**
+ * @brief Wait for an asynchronous operation to complete.
+ *
+ * @param request Handle of the operation.
+ * @param value Receives the value found by a get, freed by the caller; null
+ *              for other operations. May be null to leave the value in the handle.
+ * @return Result of the operation.
+ */
+fossil_crabdb_error_t fossil_crabdb_request_wait(fossil_crabdb_request_t *request, char **value);
+
+/**
+ * @brief Wait for an asynchronous operation to complete and free its handle.
+ *
+ * @param request Handle to free; null is ignored.
+ */
+void fossil_crabdb_request_free(fossil_crabdb_request_t *request);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+#include <string>
+#include <string_view>
+#include <optional>
+#include <vector>
+
+namespace fossil {
+
+class BlueCrabDB {
+public:
+    BlueCrabDB() {
+        db = fossil_crabdb_create();
+    }
+
+    /**
+     * @brief Create a thread-safe database, see fossil_crabdb_create_concurrent.
+     * 
+     * @param stripe_count Number of key partitions per namespace, 0 for the default.
+     */
+    explicit BlueCrabDB(size_t stripe_count) {
+        db = fossil_crabdb_create_concurrent(stripe_count);
+    }
+
+    /**
+     * @brief Create a thread-safe database, lock-free for gets when `read_mostly`
+     * is set, see fossil_crabdb_create_read_mostly.
+     *
+     * @param stripe_count Number of key partitions per namespace, 0 for the default.
+     * @param read_mostly Whether gets skip the locks.
+     */
+    BlueCrabDB(size_t stripe_count, bool read_mostly) {
+        db = read_mostly ? fossil_crabdb_create_read_mostly(stripe_count) : fossil_crabdb_create_concurrent(stripe_count);
+    }
+
+    ~BlueCrabDB() {
+        try {
+            fossil_crabdb_erase(db);
+        } catch (...) {
+            // Handle the exception here
+        }
+    }
+
+    /**
+     * @brief Create a new namespace.
+     * 
+     * @param namespace_name Name of the new namespace.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t create_namespace(const std::string& namespace_name) {
+        try {
+            return fossil_crabdb_create_namespace(db, namespace_name.c_str());
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Create a new sub-namespace.
+     * 
+     * @param namespace_name Name of the parent namespace.
+     * @param sub_namespace_name Name of the new sub-namespace.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t create_subnamespace(const std::string& namespace_name, const std::string& sub_namespace_name) {
+        try {
+            return fossil_crabdb_create_sub_namespace(db, namespace_name.c_str(), sub_namespace_name.c_str());
         } catch (...) {
             // Handle the exception here
             return CRABDB_ERR_INVALID_QUERY;
@@ -348,22 +1457,17 @@ public:
     }
 
     /**
-     * @brief Get data from a namespace.
+     * @brief Insert data into a namespace with a time to live.
      * 
      * @param namespace_name Name of the namespace.
-     * @param key Key of the data to get.
-     * @param value Pointer to store the retrieved value.
+     * @param key Key of the data to insert.
+     * @param value Value of the data to insert.
+     * @param ttl_ms Time to live in milliseconds, 0 to never expire.
      * @return Error code indicating the result of the operation.
      */
-    fossil_crabdb_error_t get(const std::string& namespace_name, const std::string& key, std::string& value) {
+    fossil_crabdb_error_t insert_ttl(const std::string& namespace_name, const std::string& key, const std::string& value, uint64_t ttl_ms) {
         try {
-            char* result;
-            fossil_crabdb_error_t error = fossil_crabdb_get(db, namespace_name.c_str(), key.c_str(), &result);
-            if (error == CRABDB_OK) {
-                value = result;
-                free(result);
-            }
-            return error;
+            return fossil_crabdb_insert_ttl(db, namespace_name.c_str(), key.c_str(), value.c_str(), ttl_ms);
         } catch (...) {
             // Handle the exception here
             return CRABDB_ERR_INVALID_QUERY;
@@ -371,16 +1475,16 @@ public:
     }
 
     /**
-     * @brief Update data in a namespace.
+     * @brief Insert a value that may hold NUL bytes into a namespace.
      * 
      * @param namespace_name Name of the namespace.
-     * @param key Key of the data to update.
-     * @param value New value for the data.
+     * @param key Key of the data to insert.
+     * @param value Bytes of the data to insert.
      * @return Error code indicating the result of the operation.
      */
-    fossil_crabdb_error_t update(const std::string& namespace_name, const std::string& key, const std::string& value) {
+    fossil_crabdb_error_t insert_bytes(const std::string& namespace_name, const std::string& key, std::string_view value) {
         try {
-            return fossil_crabdb_update(db, namespace_name.c_str(), key.c_str(), value.c_str());
+            return fossil_crabdb_insert_bytes(db, namespace_name.c_str(), key.c_str(), value.data(), value.size());
         } catch (...) {
             // Handle the exception here
             return CRABDB_ERR_INVALID_QUERY;
@@ -388,15 +1492,22 @@ public:
     }
 
     /**
-     * @brief Delete data from a namespace.
+     * @brief Get data from a namespace.
      * 
      * @param namespace_name Name of the namespace.
-     * @param key Key of the data to delete.
+     * @param key Key of the data to get.
+     * @param value Pointer to store the retrieved value.
      * @return Error code indicating the result of the operation.
      */
-    fossil_crabdb_error_t remove(const std::string& namespace_name, const std::string& key) {
+    fossil_crabdb_error_t get(const std::string& namespace_name, const std::string& key, std::string& value) {
         try {
-            return fossil_crabdb_delete(db, namespace_name.c_str(), key.c_str());
+            char* result;
+            fossil_crabdb_error_t error = fossil_crabdb_get(db, namespace_name.c_str(), key.c_str(), &result);
+            if (error == CRABDB_OK) {
+                value = result;
+                free(result);
+            }
+            return error;
         } catch (...) {
             // Handle the exception here
             return CRABDB_ERR_INVALID_QUERY;
@@ -404,9 +1515,318 @@ public:
     }
 
     /**
-     * @brief Execute a custom query.
+     * @brief Get a value that may hold NUL bytes from a namespace.
      * 
-     * @param query Custom query to execute.
+     * @param namespace_name Name of the namespace.
+     * @param key Key of the data to get.
+     * @param value Receives every byte of the value.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t get_bytes(const std::string& namespace_name, const std::string& key, std::string& value) {
+        void* result = nullptr;
+        size_t length = 0;
+        fossil_crabdb_error_t error = fossil_crabdb_get_bytes(db, namespace_name.c_str(), key.c_str(), &result, &length);
+        if (error == CRABDB_OK) {
+            try {
+                value.assign(static_cast<const char*>(result), length);
+            } catch (...) {
+                error = CRABDB_ERR_INVALID_QUERY;
+            }
+            free(result);
+        }
+        return error;
+    }
+
+    /**
+     * @brief Borrowed value returned by get_view.
+     *
+     * Releases its read guard when it goes out of scope.
+     */
+    class View {
+    public:
+        View() : view_{} {}
+        View(const View&) = delete;
+        View& operator=(const View&) = delete;
+        View(View&& other) noexcept : view_(other.view_) { other.view_ = fossil_crabdb_view_t{}; }
+        View& operator=(View&& other) noexcept {
+            if (this != &other) {
+                fossil_crabdb_view_release(&view_);
+                view_ = other.view_;
+                other.view_ = fossil_crabdb_view_t{};
+            }
+            return *this;
+        }
+        ~View() { fossil_crabdb_view_release(&view_); }
+
+        /**
+         * @brief The borrowed value, empty when nothing is held.
+         */
+        std::string_view value() const { return view_.data ? std::string_view(view_.data, view_.length) : std::string_view(); }
+
+        operator std::string_view() const { return value(); }
+
+    private:
+        friend class BlueCrabDB;
+        fossil_crabdb_view_t view_;
+    };
+
+    /**
+     * @brief Borrow data from a namespace without copying it.
+     * 
+     * @param namespace_name Name of the namespace.
+     * @param key Key of the data to get.
+     * @param view View that receives the value; any previous value is released.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t get_view(const std::string& namespace_name, const std::string& key, View& view) {
+        fossil_crabdb_view_release(&view.view_);
+        return fossil_crabdb_get_view(db, namespace_name.c_str(), key.c_str(), &view.view_);
+    }
+
+    /**
+     * @brief Get several values from a namespace in one pass.
+     * 
+     * @param namespace_name Name of the namespace.
+     * @param keys Keys to look up.
+     * @param values Receives one entry per key, empty for a missing key.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t multi_get(const std::string& namespace_name, const std::vector<std::string>& keys, std::vector<std::optional<std::string>>& values) {
+        try {
+            std::vector<const char*> raw_keys;
+            raw_keys.reserve(keys.size());
+            for (const auto& key : keys) {
+                raw_keys.push_back(key.c_str());
+            }
+            std::vector<char*> raw_values(keys.size(), nullptr);
+            fossil_crabdb_error_t error = fossil_crabdb_multi_get(db, namespace_name.c_str(), raw_keys.data(), raw_keys.size(), raw_values.data());
+            values.assign(keys.size(), std::nullopt);
+            for (size_t i = 0; i < raw_values.size(); i++) {
+                if (raw_values[i]) {
+                    values[i] = raw_values[i];
+                    free(raw_values[i]);
+                }
+            }
+            return error;
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Apply a batch of inserts, updates and deletes atomically.
+     * 
+     * @param namespace_name Name of the namespace.
+     * @param entries Operations to apply.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t write_batch(const std::string& namespace_name, const std::vector<fossil_crabdb_batch_entry_t>& entries) {
+        try {
+            return fossil_crabdb_write_batch(db, namespace_name.c_str(), entries.data(), entries.size());
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Load a file of pairs in bulk.
+     * 
+     * @param path Path of the file to load.
+     * @param format Format of the file.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t bulk_load(const std::string& path, fossil_crabdb_load_format_t format = CRABDB_LOAD_TSV) {
+        try {
+            return fossil_crabdb_bulk_load(db, path.c_str(), format);
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Update data in a namespace.
+     * 
+     * @param namespace_name Name of the namespace.
+     * @param key Key of the data to update.
+     * @param value New value for the data.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t update(const std::string& namespace_name, const std::string& key, const std::string& value) {
+        try {
+            return fossil_crabdb_update(db, namespace_name.c_str(), key.c_str(), value.c_str());
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Update data in a namespace and restart its time to live.
+     * 
+     * @param namespace_name Name of the namespace.
+     * @param key Key of the data to update.
+     * @param value New value for the data.
+     * @param ttl_ms Time to live in milliseconds from now, 0 to never expire.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t update_ttl(const std::string& namespace_name, const std::string& key, const std::string& value, uint64_t ttl_ms) {
+        try {
+            return fossil_crabdb_update_ttl(db, namespace_name.c_str(), key.c_str(), value.c_str(), ttl_ms);
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Update data in a namespace with a value that may hold NUL bytes.
+     * 
+     * @param namespace_name Name of the namespace.
+     * @param key Key of the data to update.
+     * @param value New bytes for the data.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t update_bytes(const std::string& namespace_name, const std::string& key, std::string_view value) {
+        try {
+            return fossil_crabdb_update_bytes(db, namespace_name.c_str(), key.c_str(), value.data(), value.size());
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Time left before a pair expires.
+     * 
+     * @param namespace_name Name of the namespace.
+     * @param key Key of the pair.
+     * @param remaining_ms Receives the milliseconds left, UINT64_MAX if the pair never expires.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t ttl(const std::string& namespace_name, const std::string& key, uint64_t& remaining_ms) {
+        try {
+            return fossil_crabdb_ttl(db, namespace_name.c_str(), key.c_str(), &remaining_ms);
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Reclaim expired pairs.
+     * 
+     * @param max_pairs Stop after this many pairs, 0 for no limit.
+     * @return Number of pairs reclaimed.
+     */
+    size_t expire(size_t max_pairs = 0) {
+        return fossil_crabdb_expire(db, max_pairs);
+    }
+
+    /**
+     * @brief Cap the memory held by the pairs of a namespace.
+     * 
+     * @param namespace_name Name of the namespace.
+     * @param max_bytes Budget in bytes, 0 to remove it.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t set_memory_budget(const std::string& namespace_name, size_t max_bytes) {
+        try {
+            return fossil_crabdb_set_memory_budget(db, namespace_name.c_str(), max_bytes);
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Report the memory held by a namespace and its eviction count.
+     * 
+     * @param namespace_name Name of the namespace.
+     * @param stats Receives the figures.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t memory_stats(const std::string& namespace_name, fossil_crabdb_memory_stats_t& stats) {
+        try {
+            return fossil_crabdb_memory_stats(db, namespace_name.c_str(), &stats);
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Read the runtime metrics of the database.
+     * 
+     * @param stats Receives the metrics.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t stats(fossil_crabdb_stats_t& stats) {
+        try {
+            return fossil_crabdb_stats(db, &stats);
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Render the runtime metrics in the Prometheus exposition format.
+     * 
+     * @param text Receives the text.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t stats_text(std::string& text) {
+        try {
+            fossil_crabdb_stats_t figures;
+            fossil_crabdb_error_t result = fossil_crabdb_stats(db, &figures);
+            if (result != CRABDB_OK) return result;
+            text.resize(fossil_crabdb_stats_format(&figures, nullptr, 0));
+            fossil_crabdb_stats_format(&figures, &text[0], text.size() + 1);
+            return CRABDB_OK;
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Reclaim the arena space left behind by deleted and updated pairs.
+     * 
+     * @param namespace_name Name of the namespace.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t compact(const std::string& namespace_name) {
+        try {
+            return fossil_crabdb_compact(db, namespace_name.c_str());
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Delete data from a namespace.
+     * 
+     * @param namespace_name Name of the namespace.
+     * @param key Key of the data to delete.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t remove(const std::string& namespace_name, const std::string& key) {
+        try {
+            return fossil_crabdb_delete(db, namespace_name.c_str(), key.c_str());
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Execute a custom query.
+     * 
+     * @param query Custom query to execute.
      * @return Error code indicating the result of the operation.
      */
     fossil_crabdb_error_t execute_query(const std::string& query) {
@@ -418,6 +1838,407 @@ public:
         }
     }
 
+    /**
+     * @brief Maintain an ordered index over the keys of a namespace.
+     * 
+     * @param namespace_name Name of the namespace.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t create_ordered_index(const std::string& namespace_name) {
+        try {
+            return fossil_crabdb_create_ordered_index(db, namespace_name.c_str());
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Maintain a Bloom filter over the keys of a namespace.
+     * 
+     * @param namespace_name Name of the namespace.
+     * @param bits_per_key Filter bits per key, 0 for the default.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t create_bloom_filter(const std::string& namespace_name, size_t bits_per_key = 0) {
+        try {
+            return fossil_crabdb_create_bloom_filter(db, namespace_name.c_str(), bits_per_key);
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Store the large values of a namespace compressed.
+     * 
+     * @param namespace_name Name of the namespace.
+     * @param threshold Shortest value to compress, 0 to turn compression off.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t set_compression(const std::string& namespace_name, size_t threshold) {
+        try {
+            return fossil_crabdb_set_compression(db, namespace_name.c_str(), threshold);
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Train a compression dictionary from the values of a namespace.
+     * 
+     * @param namespace_name Name of the namespace.
+     * @param dictionary_size Dictionary size in bytes, 0 for the default.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t train_dictionary(const std::string& namespace_name, size_t dictionary_size = 0) {
+        try {
+            return fossil_crabdb_train_dictionary(db, namespace_name.c_str(), dictionary_size);
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Scan returned by scan_prefix, scan_range, scan_all and Snapshot::scan.
+     *
+     * Closes the underlying cursor when it goes out of scope.
+     */
+    class Cursor {
+    public:
+        Cursor() : cursor_(nullptr) {}
+        Cursor(const Cursor&) = delete;
+        Cursor& operator=(const Cursor&) = delete;
+        Cursor(Cursor&& other) noexcept : cursor_(other.cursor_) { other.cursor_ = nullptr; }
+        Cursor& operator=(Cursor&& other) noexcept {
+            if (this != &other) {
+                fossil_crabdb_cursor_close(cursor_);
+                cursor_ = other.cursor_;
+                other.cursor_ = nullptr;
+            }
+            return *this;
+        }
+        ~Cursor() { fossil_crabdb_cursor_close(cursor_); }
+
+        /**
+         * @brief Advance to the next pair.
+         *
+         * @return false once the scan is exhausted.
+         */
+        bool next(std::string_view& key, std::string_view& value) {
+            const char *raw_key;
+            const char *raw_value;
+            size_t length;
+            if (!cursor_ || !fossil_crabdb_cursor_next(cursor_, &raw_key, &raw_value, &length)) return false;
+            key = raw_key;
+            value = std::string_view(raw_value, length);
+            return true;
+        }
+
+        /**
+         * @brief Namespace of the pair produced last.
+         *
+         * @return Empty when there is none.
+         */
+        std::string_view namespace_name() const {
+            const char *name = fossil_crabdb_cursor_namespace(cursor_);
+            return name ? std::string_view(name) : std::string_view();
+        }
+
+    private:
+        friend class BlueCrabDB;
+        fossil_crabdb_cursor_t *cursor_;
+    };
+
+    /**
+     * @brief Scan the keys that start with a prefix.
+     * 
+     * @param namespace_name Name of the namespace.
+     * @param prefix Common prefix of the keys to visit.
+     * @param cursor Receives the scan; any previous scan is closed.
+     * @param direction Whether to walk the keys ascending or descending.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t scan_prefix(const std::string& namespace_name, const std::string& prefix, Cursor& cursor, fossil_crabdb_scan_dir_t direction = CRABDB_SCAN_FORWARD) {
+        try {
+            cursor = Cursor();
+            return fossil_crabdb_scan_prefix(db, namespace_name.c_str(), prefix.c_str(), direction, &cursor.cursor_);
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Scan every pair of every namespace, in no particular order.
+     * 
+     * @param cursor Receives the scan; any previous scan is closed.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t scan_all(Cursor& cursor) {
+        try {
+            cursor = Cursor();
+            return fossil_crabdb_scan_all(db, &cursor.cursor_);
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Scan the keys in `[start, end)`.
+     * 
+     * @param namespace_name Name of the namespace.
+     * @param start First key of the range.
+     * @param end Key the range stops before.
+     * @param cursor Receives the scan; any previous scan is closed.
+     * @param direction Whether to walk the range ascending or descending.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t scan_range(const std::string& namespace_name, const std::string& start, const std::string& end, Cursor& cursor, fossil_crabdb_scan_dir_t direction = CRABDB_SCAN_FORWARD) {
+        try {
+            cursor = Cursor();
+            return fossil_crabdb_scan_range(db, namespace_name.c_str(), start.c_str(), end.c_str(), direction, &cursor.cursor_);
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Consistent read view returned by snapshot.
+     *
+     * Ends the underlying snapshot when it goes out of scope.
+     */
+    class Snapshot {
+    public:
+        Snapshot() : snapshot_(nullptr) {}
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+        Snapshot(Snapshot&& other) noexcept : snapshot_(other.snapshot_) { other.snapshot_ = nullptr; }
+        Snapshot& operator=(Snapshot&& other) noexcept {
+            if (this != &other) {
+                fossil_crabdb_snapshot_end(snapshot_);
+                snapshot_ = other.snapshot_;
+                other.snapshot_ = nullptr;
+            }
+            return *this;
+        }
+        ~Snapshot() { fossil_crabdb_snapshot_end(snapshot_); }
+
+        /**
+         * @brief Get data from a namespace as it was when the snapshot began.
+         */
+        fossil_crabdb_error_t get(const std::string& namespace_name, const std::string& key, std::string& value) {
+            if (!snapshot_) return CRABDB_ERR_INVALID_QUERY;
+            char *raw_value = nullptr;
+            fossil_crabdb_error_t error = fossil_crabdb_snapshot_get(snapshot_, namespace_name.c_str(), key.c_str(), &raw_value);
+            if (error == CRABDB_OK) {
+                try {
+                    value = raw_value;
+                } catch (...) {
+                    error = CRABDB_ERR_MEM;
+                }
+                free(raw_value);
+            }
+            return error;
+        }
+
+        /**
+         * @brief Scan every pair of a namespace as of the snapshot.
+         *
+         * @param cursor Receives the scan; any previous scan is closed.
+         */
+        fossil_crabdb_error_t scan(const std::string& namespace_name, Cursor& cursor) {
+            cursor = Cursor();
+            if (!snapshot_) return CRABDB_ERR_INVALID_QUERY;
+            return fossil_crabdb_snapshot_scan(snapshot_, namespace_name.c_str(), &cursor.cursor_);
+        }
+
+    private:
+        friend class BlueCrabDB;
+        fossil_crabdb_snapshot_t *snapshot_;
+    };
+
+    /**
+     * @brief Open a consistent read view of the database.
+     * 
+     * @param snapshot Receives the view; any previous view is ended.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t snapshot(Snapshot& snapshot) {
+        try {
+            snapshot = Snapshot();
+            return fossil_crabdb_snapshot_begin(db, &snapshot.snapshot_);
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Prepared statement returned by prepare.
+     *
+     * Bound values are copied into the statement, so temporaries may be bound.
+     */
+    class Statement {
+    public:
+        Statement() : stmt_(nullptr) {}
+        Statement(const Statement&) = delete;
+        Statement& operator=(const Statement&) = delete;
+        Statement(Statement&& other) noexcept : stmt_(other.stmt_), bound_(std::move(other.bound_)) { other.stmt_ = nullptr; }
+        Statement& operator=(Statement&& other) noexcept {
+            if (this != &other) {
+                fossil_crabdb_finalize(stmt_);
+                stmt_ = other.stmt_;
+                bound_ = std::move(other.bound_);
+                other.stmt_ = nullptr;
+            }
+            return *this;
+        }
+        ~Statement() { fossil_crabdb_finalize(stmt_); }
+
+        /**
+         * @brief Bind a value to a parameter, starting at 1.
+         */
+        fossil_crabdb_error_t bind(size_t index, const std::string& value) {
+            if (!stmt_ || index == 0 || index > bound_.size()) return CRABDB_ERR_INVALID_QUERY;
+            try {
+                bound_[index - 1] = value;
+            } catch (...) {
+                return CRABDB_ERR_MEM;
+            }
+            return fossil_crabdb_bind(stmt_, index, bound_[index - 1].c_str());
+        }
+
+        /**
+         * @brief Execute the statement with its current bindings.
+         */
+        fossil_crabdb_error_t execute() {
+            return stmt_ ? fossil_crabdb_stmt_execute(stmt_) : CRABDB_ERR_INVALID_QUERY;
+        }
+
+        /**
+         * @brief Value read by the last `get` execution, empty if none.
+         */
+        std::string_view result() const {
+            const char *value = stmt_ ? fossil_crabdb_stmt_result(stmt_) : nullptr;
+            return value ? std::string_view(value) : std::string_view();
+        }
+
+    private:
+        friend class BlueCrabDB;
+        fossil_crabdb_stmt_t *stmt_;
+        std::vector<std::string> bound_;
+    };
+
+    /**
+     * @brief Compile a query into a reusable prepared statement.
+     * 
+     * @param query Query to compile.
+     * @param statement Receives the statement; any previous statement is released.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t prepare(const std::string& query, Statement& statement) {
+        try {
+            statement = Statement();
+            fossil_crabdb_error_t error = fossil_crabdb_prepare(db, query.c_str(), &statement.stmt_);
+            if (error == CRABDB_OK) {
+                statement.bound_.resize(fossil_crabdb_stmt_param_count(statement.stmt_));
+            }
+            return error;
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    /**
+     * @brief Queue of operations run on a thread pool, see fossil_crabdb_async_create.
+     *
+     * Erasing the queue waits for every queued operation.
+     */
+    class Async {
+    public:
+        Async() : async_(nullptr) {}
+        Async(const Async&) = delete;
+        Async& operator=(const Async&) = delete;
+        Async(Async&& other) noexcept : async_(other.async_) { other.async_ = nullptr; }
+        Async& operator=(Async&& other) noexcept {
+            if (this != &other) {
+                fossil_crabdb_async_erase(async_);
+                async_ = other.async_;
+                other.async_ = nullptr;
+            }
+            return *this;
+        }
+        ~Async() { fossil_crabdb_async_erase(async_); }
+
+        /**
+         * @brief Queue an insert.
+         */
+        fossil_crabdb_error_t insert(const std::string& namespace_name, const std::string& key, const std::string& value,
+                                     fossil_crabdb_callback_t callback = nullptr, void *user = nullptr, fossil_crabdb_request_t **request = nullptr) {
+            return fossil_crabdb_async_insert(async_, namespace_name.c_str(), key.c_str(), value.c_str(), callback, user, request);
+        }
+
+        /**
+         * @brief Queue a get; the value reaches the callback or the handle.
+         */
+        fossil_crabdb_error_t get(const std::string& namespace_name, const std::string& key,
+                                  fossil_crabdb_callback_t callback = nullptr, void *user = nullptr, fossil_crabdb_request_t **request = nullptr) {
+            return fossil_crabdb_async_get(async_, namespace_name.c_str(), key.c_str(), callback, user, request);
+        }
+
+        /**
+         * @brief Queue an update.
+         */
+        fossil_crabdb_error_t update(const std::string& namespace_name, const std::string& key, const std::string& value,
+                                     fossil_crabdb_callback_t callback = nullptr, void *user = nullptr, fossil_crabdb_request_t **request = nullptr) {
+            return fossil_crabdb_async_update(async_, namespace_name.c_str(), key.c_str(), value.c_str(), callback, user, request);
+        }
+
+        /**
+         * @brief Queue a delete.
+         */
+        fossil_crabdb_error_t remove(const std::string& namespace_name, const std::string& key,
+                                     fossil_crabdb_callback_t callback = nullptr, void *user = nullptr, fossil_crabdb_request_t **request = nullptr) {
+            return fossil_crabdb_async_delete(async_, namespace_name.c_str(), key.c_str(), callback, user, request);
+        }
+
+        /**
+         * @brief Queue a custom query.
+         */
+        fossil_crabdb_error_t execute_query(const std::string& query,
+                                            fossil_crabdb_callback_t callback = nullptr, void *user = nullptr, fossil_crabdb_request_t **request = nullptr) {
+            return fossil_crabdb_async_execute_query(async_, query.c_str(), callback, user, request);
+        }
+
+    private:
+        friend class BlueCrabDB;
+        fossil_crabdb_async_t *async_;
+    };
+
+    /**
+     * @brief Create a queue that runs operations of this database on a thread pool.
+     * 
+     * @param pool Running thread pool; it must outlive the queue.
+     * @param async Receives the queue; any previous queue is erased.
+     * @return Error code indicating the result of the operation.
+     */
+    fossil_crabdb_error_t async(struct fossil_xthread_pool_t *pool, Async& async) {
+        try {
+            async = Async();
+            async.async_ = fossil_crabdb_async_create(db, pool);
+            return async.async_ ? CRABDB_OK : CRABDB_ERR_MEM;
+        } catch (...) {
+            // Handle the exception here
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
 private:
     fossil_crabdb_t* db;
 };
@@ -109,12 +109,22 @@ typedef union {
     uint8_t bool_val; // for bool types
 } fossil_tofu_value_t;
 
-// Struct for tofu
+// Flags kept in fossil_tofu_t.flags
+#define FOSSIL_TOFU_FLAG_CACHED 0x01 // Set by fossil_tofu_memorize
+#define FOSSIL_TOFU_FLAG_INLINE 0x02 // String stored inside the tofu, not on the heap
+
+// Longest string, without its NUL, that a tofu stores inline
+#define FOSSIL_TOFU_INLINE_MAX 13
+
+// Struct for tofu, 16 bytes so two fit in a register pair and four in a cache line.
+// C, byte and bchar strings of up to FOSSIL_TOFU_INLINE_MAX characters are stored
+// in place of `value` and `inline_tail` with no allocation, so read strings through
+// fossil_tofu_cstr rather than the pointer members of `value`.
 typedef struct {
-    fossil_tofu_type_t type;
     fossil_tofu_value_t value;
-    bool is_cached;    // Flag to track if value is cached
-    fossil_tofu_value_t cached_value; // Cached value for memorization
+    char inline_tail[6]; // Rest of an inline string
+    uint8_t type;        // A fossil_tofu_type_t
+    uint8_t flags;       // FOSSIL_TOFU_FLAG_*
 } fossil_tofu_t;
 
 #ifdef __cplusplus
@@ -132,12 +142,61 @@ extern "C"
 fossil_tofu_t fossil_tofu_create(char* type, char* value);
 
 /**
- * Memorization (caching) function for a `fossil_tofu_t` object.
+ * Functions to create a `fossil_tofu_t` object straight from a value, without
+ * formatting it to a string and parsing it back.
+ *
+ * @param value The value; strings are copied.
+ * @return The created `fossil_tofu_t` object, a ghost if a copy cannot be allocated.
+ */
+fossil_tofu_t fossil_tofu_from_int64(int64_t value);
+fossil_tofu_t fossil_tofu_from_uint64(uint64_t value);
+fossil_tofu_t fossil_tofu_from_hex(uint64_t value);
+fossil_tofu_t fossil_tofu_from_octal(uint64_t value);
+fossil_tofu_t fossil_tofu_from_float(float value);
+fossil_tofu_t fossil_tofu_from_double(double value);
+fossil_tofu_t fossil_tofu_from_bool(bool value);
+fossil_tofu_t fossil_tofu_from_char(char value);
+fossil_tofu_t fossil_tofu_from_wchar(wchar_t value);
+fossil_tofu_t fossil_tofu_from_cstr(const char *value);
+fossil_tofu_t fossil_tofu_from_bstr(const char *value);
+fossil_tofu_t fossil_tofu_from_wstr(const wchar_t *value);
+
+/**
+ * Function to create a C string `fossil_tofu_t` object from the first `length`
+ * bytes of `value`, which need not be NUL terminated.
+ *
+ * @param value The characters to copy.
+ * @param length The number of characters.
+ * @return The created `fossil_tofu_t` object, a ghost if the copy cannot be allocated.
+ */
+fossil_tofu_t fossil_tofu_from_cstr_len(const char *value, size_t length);
+
+/**
+ * Memorization (caching) function for a `fossil_tofu_t` object. Kept for
+ * compatibility: the value is no longer copied aside, the tofu is only
+ * flagged as cached.
  *
  * @param tofu The `fossil_tofu_t` object to be memorized.
  */
 void fossil_tofu_memorize(fossil_tofu_t *tofu);
 
+/**
+ * Utility function to check if a `fossil_tofu_t` object has been memorized.
+ *
+ * @param tofu The `fossil_tofu_t` object.
+ * @return `true` if `fossil_tofu_memorize` was called on it, `false` otherwise.
+ */
+bool fossil_tofu_is_cached(const fossil_tofu_t *tofu);
+
+/**
+ * Utility function to get the characters of a C, byte or bchar string
+ * `fossil_tofu_t` object, wherever they are stored.
+ *
+ * @param tofu The `fossil_tofu_t` object.
+ * @return The NUL terminated string, owned by the tofu, or `NULL` for other types.
+ */
+const char *fossil_tofu_cstr(const fossil_tofu_t *tofu);
+
 /**
  * Utility function to print a `fossil_tofu_t` object.
  *
@@ -194,6 +253,9 @@ bool fossil_tofu_compare(fossil_tofu_t *tofu1, fossil_tofu_t *tofu2);
 #include <utility>
 #include <algorithm>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
 
 namespace fossil {
 
@@ -206,6 +268,14 @@ namespace fossil {
             tofu_ = fossil_tofu_create(const_cast<char*>(type.c_str()), const_cast<char*>(std::to_string(value).c_str()));
         }
 
+        /**
+         * @brief Build straight from the value, with the type picked from `T`
+         * at compile time: bool, char and wchar_t keep their own type, other
+         * integers become int or uint, floating point float or double, and
+         * anything viewable as a string a C string.
+         */
+        explicit Tofu(const T& value) : tofu_(from(value)) {}
+
         Tofu(Tofu&& other) noexcept {
             tofu_ = std::move(other.tofu_);
             other.tofu_ = nullptr;
@@ -228,7 +298,7 @@ namespace fossil {
         }
 
         const char* getTypeString() {
-            return fossil_tofu_type_to_string(tofu_.type);
+            return fossil_tofu_type_to_string(static_cast<fossil_tofu_type_t>(tofu_.type));
         }
         
         bool equals(const Tofu<T>& other) {
@@ -244,6 +314,29 @@ namespace fossil {
         }
 
     private:
+        static fossil_tofu_t from(const T& value) {
+            if constexpr (std::is_same_v<T, bool>) {
+                return fossil_tofu_from_bool(value);
+            } else if constexpr (std::is_same_v<T, char>) {
+                return fossil_tofu_from_char(value);
+            } else if constexpr (std::is_same_v<T, wchar_t>) {
+                return fossil_tofu_from_wchar(value);
+            } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+                return fossil_tofu_from_int64(static_cast<int64_t>(value));
+            } else if constexpr (std::is_integral_v<T>) {
+                return fossil_tofu_from_uint64(static_cast<uint64_t>(value));
+            } else if constexpr (std::is_same_v<T, float>) {
+                return fossil_tofu_from_float(value);
+            } else if constexpr (std::is_floating_point_v<T>) {
+                return fossil_tofu_from_double(static_cast<double>(value));
+            } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+                std::string_view view(value);
+                return fossil_tofu_from_cstr_len(view.data(), view.size());
+            } else {
+                static_assert(sizeof(T) == 0, "no tofu type for T");
+            }
+        }
+
         fossil_tofu_t tofu_;
     };
 
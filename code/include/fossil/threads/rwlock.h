@@ -0,0 +1,137 @@
+/*
+==============================================================================
+Author: Michael Gene Brockus (Dreamer)
+Email: michaelbrockus@gmail.com
+Organization: Fossil Logic
+Description: 
+    This file is part of the Fossil Logic project, where innovation meets
+    excellence in software development. Michael Gene Brockus, also known as
+    "Dreamer," is a dedicated contributor to this project. For any inquiries,
+    feel free to contact Michael at michaelbrockus@gmail.com.
+==============================================================================
+*/
+#ifndef FOSSIL_THREADS_RWLOCK_H
+#define FOSSIL_THREADS_RWLOCK_H
+
+#ifdef _WIN32
+#include <windows.h>
+typedef SRWLOCK fossil_xrwlock_t;
+#else
+// pthread_rwlock_t needs POSIX.1-2001, e.g. _GNU_SOURCE or -std=gnu18
+#include <pthread.h>
+typedef pthread_rwlock_t fossil_xrwlock_t;
+#endif
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Initializes a reader-writer lock.
+ *
+ * @param lock Pointer to the reader-writer lock to initialize.
+ * @return int32_t 0 if the lock is successfully initialized, -1 otherwise.
+ */
+int32_t fossil_rwlock_create(fossil_xrwlock_t *lock);
+
+/**
+ * @brief Destroys a reader-writer lock.
+ *
+ * @param lock Pointer to the reader-writer lock to destroy.
+ * @return int32_t 0 if the lock is successfully destroyed, -1 otherwise.
+ */
+int32_t fossil_rwlock_erase(fossil_xrwlock_t *lock);
+
+/**
+ * @brief Acquires a reader-writer lock in shared mode; readers never block each other.
+ *
+ * @param lock Pointer to the reader-writer lock.
+ * @return int32_t 0 if the lock is successfully acquired, -1 otherwise.
+ */
+int32_t fossil_rwlock_read_lock(fossil_xrwlock_t *lock);
+
+/**
+ * @brief Acquires a reader-writer lock in exclusive mode.
+ *
+ * @param lock Pointer to the reader-writer lock.
+ * @return int32_t 0 if the lock is successfully acquired, -1 otherwise.
+ */
+int32_t fossil_rwlock_write_lock(fossil_xrwlock_t *lock);
+
+/**
+ * @brief Releases a shared hold on a reader-writer lock.
+ *
+ * @param lock Pointer to the reader-writer lock.
+ * @return int32_t 0 if the lock is successfully released, -1 otherwise.
+ */
+int32_t fossil_rwlock_read_unlock(fossil_xrwlock_t *lock);
+
+/**
+ * @brief Releases an exclusive hold on a reader-writer lock.
+ *
+ * @param lock Pointer to the reader-writer lock.
+ * @return int32_t 0 if the lock is successfully released, -1 otherwise.
+ */
+int32_t fossil_rwlock_write_unlock(fossil_xrwlock_t *lock);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+
+#include <stdexcept>
+
+namespace fossil {
+
+class RWLock {
+public:
+    RWLock() {
+        if (fossil_rwlock_create(&lock_) != 0) {
+            throw std::runtime_error("Failed to create reader-writer lock");
+        }
+    }
+
+    ~RWLock() {
+        fossil_rwlock_erase(&lock_);
+    }
+
+    void read_lock() {
+        if (fossil_rwlock_read_lock(&lock_) != 0) {
+            throw std::runtime_error("Failed to acquire read lock");
+        }
+    }
+
+    void write_lock() {
+        if (fossil_rwlock_write_lock(&lock_) != 0) {
+            throw std::runtime_error("Failed to acquire write lock");
+        }
+    }
+
+    void read_unlock() {
+        if (fossil_rwlock_read_unlock(&lock_) != 0) {
+            throw std::runtime_error("Failed to release read lock");
+        }
+    }
+
+    void write_unlock() {
+        if (fossil_rwlock_write_unlock(&lock_) != 0) {
+            throw std::runtime_error("Failed to release write lock");
+        }
+    }
+
+    fossil_xrwlock_t &get() {
+        return lock_;
+    }
+
+private:
+    fossil_xrwlock_t lock_;
+};
+
+} // namespace fossil
+
+#endif // __cplusplus
+
+#endif
@@ -27,7 +27,7 @@ Description:
 #define xtask(name) void name(void* arg)
 #endif
 
-typedef struct {
+typedef struct fossil_xthread_pool_t {
     fossil_xthread_t *threads;
     int32_t thread_count;
     fossil_xmutex_t queue_mutex;
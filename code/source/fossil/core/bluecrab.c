@@ -10,357 +10,7608 @@ Description:
     feel free to contact Michael at michaelbrockus@gmail.com.
 ==============================================================================
 */
+#define _GNU_SOURCE // for fileno, fsync and ftruncate
 #include "fossil/core/bluecrab.h"
+#include "fossil/threads/rwlock.h"
+#include "fossil/threads/mutexs.h"
+#include "fossil/threads/threadpool.h"
+#include <stdatomic.h>
 #include <ctype.h>
+#include <time.h>
 
-fossil_crabdb_t* fossil_crabdb_create(void) {
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// *****************************************************************************
+// Hash index
+// *****************************************************************************
+
+#define FOSSIL_CRABDB_INDEX_MIN_CAPACITY 16
+#define FOSSIL_CRABDB_REHASH_STEP 64
+
+static char fossil_crabdb_tombstone;
+#define FOSSIL_CRABDB_TOMBSTONE ((void *)&fossil_crabdb_tombstone)
+
+#if defined(__GNUC__) || defined(__clang__)
+#define FOSSIL_CRABDB_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define FOSSIL_CRABDB_PREFETCH(addr) ((void)(addr))
+#endif
+
+// Lock-free readers may still hold what a writer replaces, see Concurrency
+typedef void (*fossil_crabdb_release_t)(fossil_crabdb_t *db, void *data);
+static void fossil_crabdb_defer(struct fossil_crabdb_rcu_t *rcu, void *data, fossil_crabdb_release_t release);
+static void fossil_crabdb_release_memory(fossil_crabdb_t *db, void *data);
+
+static uint64_t fossil_crabdb_hash(const char *key) {
+    // FNV-1a followed by a final avalanche so the low bits are well mixed
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static inline const char *fossil_crabdb_index_key(const fossil_crabdb_index_t *index, const void *entry) {
+    return *(char *const *)((const char *)entry + index->key_offset);
+}
+
+static void fossil_crabdb_index_init(fossil_crabdb_index_t *index, size_t key_offset) {
+    memset(index, 0, sizeof(*index));
+    index->key_offset = key_offset;
+}
+
+static void fossil_crabdb_index_free(fossil_crabdb_index_t *index) {
+    struct fossil_crabdb_rcu_t *rcu = index->rcu;
+    free(index->slots);
+    free(index->old_slots);
+    fossil_crabdb_index_init(index, index->key_offset);
+    index->rcu = rcu;
+}
+
+static fossil_crabdb_slot_t *fossil_crabdb_table_find(const fossil_crabdb_index_t *index, fossil_crabdb_slot_t *table, size_t capacity, const char *key, uint64_t hash) {
+    if (!table) return cnullptr;
+
+    size_t mask = capacity - 1;
+    size_t i = (size_t)hash & mask;
+    for (size_t probes = 0; probes < capacity; probes++, i = (i + 1) & mask) {
+        fossil_crabdb_slot_t *slot = &table[i];
+        if (!slot->entry) return cnullptr;
+        if (slot->entry != FOSSIL_CRABDB_TOMBSTONE && slot->hash == hash &&
+            strcmp(fossil_crabdb_index_key(index, slot->entry), key) == 0) {
+            return slot;
+        }
+    }
+    return cnullptr;
+}
+
+static fossil_crabdb_slot_t *fossil_crabdb_index_find_slot(const fossil_crabdb_index_t *index, const char *key, uint64_t hash) {
+    fossil_crabdb_slot_t *slot = fossil_crabdb_table_find(index, index->slots, index->capacity, key, hash);
+    if (!slot) {
+        slot = fossil_crabdb_table_find(index, index->old_slots, index->old_capacity, key, hash);
+    }
+    return slot;
+}
+
+static void *fossil_crabdb_index_find(const fossil_crabdb_index_t *index, const char *key, uint64_t hash) {
+    fossil_crabdb_slot_t *slot = fossil_crabdb_index_find_slot(index, key, hash);
+    return slot ? slot->entry : cnullptr;
+}
+
+/**
+ * Store an entry in the first free slot of its probe sequence.
+ *
+ * @return 1 if a never-used slot was consumed, 0 if a tombstone was reused.
+ */
+static size_t fossil_crabdb_table_place(fossil_crabdb_slot_t *table, size_t capacity, uint64_t hash, void *entry) {
+    size_t mask = capacity - 1;
+    size_t i = (size_t)hash & mask;
+    while (table[i].entry && table[i].entry != FOSSIL_CRABDB_TOMBSTONE) {
+        i = (i + 1) & mask;
+    }
+    size_t fresh = table[i].entry == cnullptr;
+    table[i].hash = hash;
+    table[i].entry = entry;
+    return fresh;
+}
+
+/**
+ * Move up to `steps` slots of the old table into the current one.
+ */
+static void fossil_crabdb_index_rehash_step(fossil_crabdb_index_t *index, size_t steps) {
+    while (index->old_slots && steps--) {
+        fossil_crabdb_slot_t *slot = &index->old_slots[index->rehash_index++];
+        if (slot->entry && slot->entry != FOSSIL_CRABDB_TOMBSTONE) {
+            index->used += fossil_crabdb_table_place(index->slots, index->capacity, slot->hash, slot->entry);
+            // Keep the probe chain intact but stop lookups finding the stale copy
+            slot->entry = FOSSIL_CRABDB_TOMBSTONE;
+        }
+        if (index->rehash_index == index->old_capacity) {
+            fossil_crabdb_slot_t *old_slots = index->old_slots;
+            index->old_slots = cnullptr;
+            index->old_capacity = 0;
+            index->rehash_index = 0;
+            fossil_crabdb_defer(index->rcu, old_slots, fossil_crabdb_release_memory);
+        }
+    }
+}
+
+/**
+ * Make room for one more entry, starting an incremental resize when the
+ * current table passes a 3/4 load factor (tombstones included).
+ */
+static int fossil_crabdb_index_reserve(fossil_crabdb_index_t *index) {
+    fossil_crabdb_index_rehash_step(index, FOSSIL_CRABDB_REHASH_STEP);
+
+    if (!index->slots) {
+        index->slots = (fossil_crabdb_slot_t *)calloc(FOSSIL_CRABDB_INDEX_MIN_CAPACITY, sizeof(fossil_crabdb_slot_t));
+        if (!index->slots) return -1;
+        index->capacity = FOSSIL_CRABDB_INDEX_MIN_CAPACITY;
+        return 0;
+    }
+
+    if ((index->used + 1) * 4 <= index->capacity * 3) return 0;
+
+    if (index->old_slots) {
+        // The current table filled up before the previous resize finished
+        fossil_crabdb_index_rehash_step(index, index->old_capacity);
+    }
+
+    size_t capacity = index->capacity;
+    while (capacity < FOSSIL_CRABDB_INDEX_MIN_CAPACITY || (index->count + 1) * 2 > capacity) {
+        capacity *= 2;
+    }
+
+    fossil_crabdb_slot_t *slots = (fossil_crabdb_slot_t *)calloc(capacity, sizeof(fossil_crabdb_slot_t));
+    if (!slots) return -1;
+
+    index->old_slots = index->slots;
+    index->old_capacity = index->capacity;
+    index->rehash_index = 0;
+    index->slots = slots;
+    index->capacity = capacity;
+    index->used = 0;
+    fossil_crabdb_index_rehash_step(index, FOSSIL_CRABDB_REHASH_STEP);
+    return 0;
+}
+
+/**
+ * Grow the index up front so that the next `extra` inserts cannot fail,
+ * finishing any resize in progress.
+ */
+static int fossil_crabdb_index_prepare(fossil_crabdb_index_t *index, size_t extra) {
+    if (!extra) return 0;
+    fossil_crabdb_index_rehash_step(index, index->old_capacity);
+    if (index->slots && (index->used + extra) * 4 <= index->capacity * 3) return 0;
+
+    size_t capacity = index->capacity ? index->capacity : FOSSIL_CRABDB_INDEX_MIN_CAPACITY;
+    while ((index->count + extra) * 2 > capacity) {
+        capacity *= 2;
+    }
+
+    fossil_crabdb_slot_t *slots = (fossil_crabdb_slot_t *)calloc(capacity, sizeof(fossil_crabdb_slot_t));
+    if (!slots) return -1;
+
+    index->old_slots = index->slots;
+    index->old_capacity = index->capacity;
+    index->rehash_index = 0;
+    index->slots = slots;
+    index->capacity = capacity;
+    index->used = 0;
+    fossil_crabdb_index_rehash_step(index, index->old_capacity);
+    return 0;
+}
+
+static int fossil_crabdb_index_insert(fossil_crabdb_index_t *index, uint64_t hash, void *entry) {
+    if (fossil_crabdb_index_reserve(index) != 0) return -1;
+    index->used += fossil_crabdb_table_place(index->slots, index->capacity, hash, entry);
+    index->count++;
+    return 0;
+}
+
+static void *fossil_crabdb_index_remove(fossil_crabdb_index_t *index, const char *key, uint64_t hash) {
+    fossil_crabdb_slot_t *slot = fossil_crabdb_index_find_slot(index, key, hash);
+    if (!slot) return cnullptr;
+
+    void *entry = slot->entry;
+    slot->entry = FOSSIL_CRABDB_TOMBSTONE;
+    index->count--;
+    fossil_crabdb_index_rehash_step(index, FOSSIL_CRABDB_REHASH_STEP);
+    return entry;
+}
+
+// *****************************************************************************
+// Concurrency
+// *****************************************************************************
+
+/*
+ * Lock order: the database lock first, then at most one stripe lock. Data
+ * operations hold the database lock shared and their stripe lock shared or
+ * exclusive; namespace management, checkpoints and exports hold the database
+ * lock exclusively, which drains every stripe.
+ *
+ * A read-mostly database also runs gets without any lock, seqlock style.
+ * Writers still lock as above and, while they hold the database lock or a
+ * stripe lock exclusively, keep its sequence number odd. A reader notes the
+ * numbers it depends on, checks them again before following any pointer it
+ * read, and keeps its result only if they never moved; otherwise it tries
+ * again, and after a few attempts takes the locks after all. Memory a writer
+ * unlinks is handed to fossil_crabdb_defer, which frees it once no reader
+ * that entered before the unlink is left. Readers announce themselves by
+ * storing the current epoch in a cache line of their own, picked by thread
+ * number, so a get performs no atomic read-modify-write and writes nothing
+ * another thread reads on its way.
+ */
+
+#define FOSSIL_CRABDB_DEFAULT_STRIPES 64
+#define FOSSIL_CRABDB_READERS 128 // Threads that can read a read-mostly database without locks
+#define FOSSIL_CRABDB_OPTIMISTIC_TRIES 4 // Lock-free attempts before a get takes the locks
+#define FOSSIL_CRABDB_CACHE_LINE 64
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define FOSSIL_CRABDB_THREAD_LOCAL __declspec(thread)
+#else
+#define FOSSIL_CRABDB_THREAD_LOCAL _Thread_local
+#endif
+
+static atomic_uint fossil_crabdb_thread_count;
+static FOSSIL_CRABDB_THREAD_LOCAL unsigned fossil_crabdb_thread_number; // 0 until drawn
+
+/**
+ * Number of the calling thread, counted from 1 and drawn on first use.
+ */
+static inline unsigned fossil_crabdb_thread_id(void) {
+    if (!fossil_crabdb_thread_number) fossil_crabdb_thread_number = atomic_fetch_add(&fossil_crabdb_thread_count, 1) + 1;
+    return fossil_crabdb_thread_number;
+}
+
+typedef struct fossil_crabdb_stripe_t {
+    fossil_xrwlock_t lock; /**< Guards the index and the pair list */
+    atomic_uint_fast64_t sequence; /**< Odd while a writer holds `lock`; kept only in a read-mostly database */
+    struct fossil_crabdb_rcu_t *rcu; /**< Deferred frees of a read-mostly database, null otherwise */
+    fossil_crabdb_index_t index; /**< Hash index over the pairs of this stripe */
+    fossil_crabdb_keyvalue_t *data; /**< Linked list of key-value pairs */
+    struct fossil_crabdb_wheel_t *wheel; /**< Expiry timers of this stripe, null until a pair has a TTL */
+    struct fossil_crabdb_clock_t *clock; /**< Eviction clock, null unless the namespace has a memory budget */
+    size_t resident; /**< Bytes held by the pairs of this stripe */
+    uint64_t evictions; /**< Pairs evicted to stay within the budget */
+    struct fossil_crabdb_chunk_t *chunks; /**< Arena holding the pairs, newest chunk first */
+    size_t allocated; /**< Arena bytes handed out */
+    size_t garbage; /**< Arena bytes handed out and no longer used */
+    struct fossil_crabdb_bloom_t *bloom; /**< Bloom filter over the keys, newest layer first; null unless enabled */
+    fossil_crabdb_index_t history; /**< Values replaced or deleted while snapshots were open, newest per key */
+    size_t retained; /**< Versions held in the history */
+} fossil_crabdb_stripe_t;
+
+typedef struct {
+    atomic_uint_fast64_t epoch; /**< Epoch the reader entered in, 0 while it is outside */
+    char padding[FOSSIL_CRABDB_CACHE_LINE - sizeof(atomic_uint_fast64_t)];
+} fossil_crabdb_reader_t;
+
+typedef struct fossil_crabdb_deferred_t {
+    void *data; /**< Memory new readers can no longer reach */
+    fossil_crabdb_release_t release; /**< Frees `data` */
+    uint64_t epoch; /**< Epoch current when it was unlinked */
+    struct fossil_crabdb_deferred_t *next; /**< Deferred before this one */
+} fossil_crabdb_deferred_t;
+
+typedef struct fossil_crabdb_rcu_t {
+    fossil_crabdb_reader_t *readers; /**< One cache line per thread number */
+    void *reader_memory; /**< Allocation `readers` is aligned in */
+    atomic_uint_fast64_t epoch; /**< Current epoch, advanced by every deferral */
+    fossil_xmutex_t lock; /**< Guards the deferred list */
+    fossil_crabdb_deferred_t *deferred; /**< Waiting for readers to leave, newest first */
+    atomic_size_t pending; /**< Entries in the deferred list */
+    fossil_crabdb_t *db; /**< Database handed to the release functions */
+} fossil_crabdb_rcu_t;
+
+typedef struct fossil_crabdb_locks_t {
+    fossil_xrwlock_t namespaces; /**< Guards the namespace index, list and sub-namespaces */
+    atomic_uint_fast64_t sequence; /**< Odd while `namespaces` is held exclusively; kept only in a read-mostly database */
+    fossil_crabdb_rcu_t *rcu; /**< Lock-free read state, null unless read-mostly */
+} fossil_crabdb_locks_t;
+
+static void fossil_crabdb_release_memory(fossil_crabdb_t *db, void *data) {
+    (void)db;
+    free(data);
+}
+
+static fossil_crabdb_rcu_t *fossil_crabdb_rcu_new(fossil_crabdb_t *db) {
+    fossil_crabdb_rcu_t *rcu = (fossil_crabdb_rcu_t *)calloc(1, sizeof(fossil_crabdb_rcu_t));
+    if (!rcu) return cnullptr;
+    rcu->reader_memory = calloc(FOSSIL_CRABDB_READERS + 1, sizeof(fossil_crabdb_reader_t));
+    if (!rcu->reader_memory || fossil_mutex_create(&rcu->lock) != 0) {
+        free(rcu->reader_memory);
+        free(rcu);
+        return cnullptr;
+    }
+    uintptr_t first = ((uintptr_t)rcu->reader_memory + FOSSIL_CRABDB_CACHE_LINE - 1) & ~(uintptr_t)(FOSSIL_CRABDB_CACHE_LINE - 1);
+    rcu->readers = (fossil_crabdb_reader_t *)first;
+    for (size_t i = 0; i < FOSSIL_CRABDB_READERS; i++) {
+        atomic_init(&rcu->readers[i].epoch, 0);
+    }
+    atomic_init(&rcu->epoch, 1);
+    atomic_init(&rcu->pending, 0);
+    rcu->db = db;
+    return rcu;
+}
+
+/**
+ * Oldest epoch a reader is still in, UINT64_MAX when none is reading.
+ */
+static uint64_t fossil_crabdb_rcu_oldest(fossil_crabdb_rcu_t *rcu) {
+    // Pairs with the fence of fossil_crabdb_reader_enter: a reader this
+    // scan misses sees everything unlinked before it
+    atomic_thread_fence(memory_order_seq_cst);
+    uint64_t oldest = UINT64_MAX;
+    for (size_t i = 0; i < FOSSIL_CRABDB_READERS; i++) {
+        uint64_t epoch = atomic_load_explicit(&rcu->readers[i].epoch, memory_order_relaxed);
+        if (epoch && epoch < oldest) oldest = epoch;
+    }
+    return oldest;
+}
+
+/**
+ * Free whatever no reader can still hold; `lock` is held.
+ */
+static void fossil_crabdb_rcu_reclaim(fossil_crabdb_rcu_t *rcu) {
+    uint64_t oldest = fossil_crabdb_rcu_oldest(rcu);
+    fossil_crabdb_deferred_t **link = &rcu->deferred;
+    while (*link && (*link)->epoch >= oldest) link = &(*link)->next;
+
+    // The list runs newest first, so the rest is at least as old
+    fossil_crabdb_deferred_t *deferred = *link;
+    *link = cnullptr;
+    while (deferred) {
+        fossil_crabdb_deferred_t *next = deferred->next;
+        deferred->release(rcu->db, deferred->data);
+        free(deferred);
+        atomic_store_explicit(&rcu->pending, atomic_load_explicit(&rcu->pending, memory_order_relaxed) - 1, memory_order_relaxed);
+        deferred = next;
+    }
+}
+
+/**
+ * Free `data` through `release` once no reader can hold it, right away
+ * when readers take locks (`rcu` null). The caller has already unlinked it.
+ */
+static void fossil_crabdb_defer(fossil_crabdb_rcu_t *rcu, void *data, fossil_crabdb_release_t release) {
+    if (!data) return;
+    if (!rcu) {
+        release(cnullptr, data);
+        return;
+    }
+
+    fossil_crabdb_deferred_t *deferred = (fossil_crabdb_deferred_t *)malloc(sizeof(fossil_crabdb_deferred_t));
+    fossil_mutex_lock(&rcu->lock);
+    uint64_t epoch = atomic_load_explicit(&rcu->epoch, memory_order_relaxed);
+    atomic_store_explicit(&rcu->epoch, epoch + 1, memory_order_seq_cst);
+    if (deferred) {
+        deferred->data = data;
+        deferred->release = release;
+        deferred->epoch = epoch;
+        deferred->next = rcu->deferred;
+        rcu->deferred = deferred;
+        atomic_store_explicit(&rcu->pending, atomic_load_explicit(&rcu->pending, memory_order_relaxed) + 1, memory_order_relaxed);
+    } else {
+        // No memory to keep track of it: wait the readers out instead
+        while (fossil_crabdb_rcu_oldest(rcu) <= epoch) {
+        }
+        release(rcu->db, data);
+    }
+    fossil_crabdb_rcu_reclaim(rcu);
+    fossil_mutex_unlock(&rcu->lock);
+}
+
+/**
+ * Free what has become safe to free since the last deferral, if anything
+ * is waiting.
+ */
+static void fossil_crabdb_rcu_poll(fossil_crabdb_rcu_t *rcu) {
+    if (!atomic_load_explicit(&rcu->pending, memory_order_relaxed)) return;
+    fossil_mutex_lock(&rcu->lock);
+    fossil_crabdb_rcu_reclaim(rcu);
+    fossil_mutex_unlock(&rcu->lock);
+}
+
+/**
+ * Free everything still deferred and the read state itself; no reader may
+ * be left.
+ */
+static void fossil_crabdb_rcu_free(fossil_crabdb_rcu_t *rcu) {
+    if (!rcu) return;
+    while (rcu->deferred) {
+        fossil_crabdb_deferred_t *deferred = rcu->deferred;
+        rcu->deferred = deferred->next;
+        deferred->release(rcu->db, deferred->data);
+        free(deferred);
+    }
+    fossil_mutex_erase(&rcu->lock);
+    free(rcu->reader_memory);
+    free(rcu);
+}
+
+/**
+ * Enter a lock-free read.
+ *
+ * @return Slot of the calling thread, null when it has none and must lock.
+ */
+static inline fossil_crabdb_reader_t *fossil_crabdb_reader_enter(fossil_crabdb_rcu_t *rcu) {
+    unsigned id = fossil_crabdb_thread_id();
+    if (id > FOSSIL_CRABDB_READERS) return cnullptr;
+
+    fossil_crabdb_reader_t *reader = &rcu->readers[id - 1];
+    atomic_store_explicit(&reader->epoch, atomic_load_explicit(&rcu->epoch, memory_order_acquire), memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    return reader;
+}
+
+static inline void fossil_crabdb_reader_exit(fossil_crabdb_reader_t *reader) {
+    atomic_store_explicit(&reader->epoch, 0, memory_order_release);
+}
+
+/**
+ * Make a sequence number odd as a writer takes the lock it goes with. The
+ * writer is alone, so a load and a store do.
+ */
+static inline void fossil_crabdb_seq_begin(atomic_uint_fast64_t *sequence) {
+    atomic_store_explicit(sequence, atomic_load_explicit(sequence, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void fossil_crabdb_seq_end(atomic_uint_fast64_t *sequence) {
+    atomic_store_explicit(sequence, atomic_load_explicit(sequence, memory_order_relaxed) + 1, memory_order_release);
+}
+
+/**
+ * Sequence numbers a lock-free read depends on, as it first saw them.
+ */
+typedef struct {
+    atomic_uint_fast64_t *database; /**< Sequence of the database lock */
+    atomic_uint_fast64_t *stripe; /**< Sequence of the stripe lock, null until a stripe is picked */
+    uint64_t database_seen; /**< Even value `database` had */
+    uint64_t stripe_seen; /**< Even value `stripe` had */
+} fossil_crabdb_optimistic_t;
+
+/**
+ * Whether no writer has got in since the read began, so everything it read
+ * so far is consistent.
+ */
+static inline int fossil_crabdb_optimistic_valid(const fossil_crabdb_optimistic_t *read) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(read->database, memory_order_relaxed) == read->database_seen &&
+           (!read->stripe || atomic_load_explicit(read->stripe, memory_order_relaxed) == read->stripe_seen);
+}
+
+/**
+ * Look a key up in an index without its lock, validating `read` before
+ * following anything read from it.
+ *
+ * @return 1 with `*entry` set, null on a miss; 0 when a writer got in.
+ */
+static int fossil_crabdb_index_peek(const fossil_crabdb_index_t *index, const char *key, uint64_t hash, const fossil_crabdb_optimistic_t *read, void **entry) {
+    fossil_crabdb_slot_t *tables[2] = { index->slots, index->old_slots };
+    size_t capacities[2] = { index->capacity, index->old_capacity };
+    if (!fossil_crabdb_optimistic_valid(read)) return 0;
+
+    for (int t = 0; t < 2; t++) {
+        if (!tables[t]) continue;
+        size_t mask = capacities[t] - 1;
+        size_t i = (size_t)hash & mask;
+        for (size_t probes = 0; probes < capacities[t]; probes++, i = (i + 1) & mask) {
+            uint64_t slot_hash = tables[t][i].hash;
+            void *candidate = tables[t][i].entry;
+            if (!fossil_crabdb_optimistic_valid(read)) return 0;
+            if (!candidate) break;
+            if (candidate != FOSSIL_CRABDB_TOMBSTONE && slot_hash == hash &&
+                strcmp(fossil_crabdb_index_key(index, candidate), key) == 0) {
+                *entry = candidate;
+                return 1;
+            }
+        }
+    }
+    *entry = cnullptr;
+    return 1;
+}
+
+static inline void fossil_crabdb_read_lock(fossil_crabdb_t *db) {
+    if (db->locks) fossil_rwlock_read_lock(&db->locks->namespaces);
+}
+
+static inline void fossil_crabdb_read_unlock(fossil_crabdb_t *db) {
+    if (db->locks) fossil_rwlock_read_unlock(&db->locks->namespaces);
+}
+
+static inline void fossil_crabdb_write_lock(fossil_crabdb_t *db) {
+    if (!db->locks) return;
+    fossil_rwlock_write_lock(&db->locks->namespaces);
+    if (db->locks->rcu) fossil_crabdb_seq_begin(&db->locks->sequence);
+}
+
+static inline void fossil_crabdb_write_unlock(fossil_crabdb_t *db) {
+    if (!db->locks) return;
+    if (db->locks->rcu) fossil_crabdb_seq_end(&db->locks->sequence);
+    fossil_rwlock_write_unlock(&db->locks->namespaces);
+    if (db->locks->rcu) fossil_crabdb_rcu_poll(db->locks->rcu);
+}
+
+static inline void fossil_crabdb_stripe_read_lock(fossil_crabdb_t *db, fossil_crabdb_stripe_t *stripe) {
+    if (db->locks) fossil_rwlock_read_lock(&stripe->lock);
+}
+
+static inline void fossil_crabdb_stripe_read_unlock(fossil_crabdb_t *db, fossil_crabdb_stripe_t *stripe) {
+    if (db->locks) fossil_rwlock_read_unlock(&stripe->lock);
+}
+
+static inline void fossil_crabdb_stripe_write_lock(fossil_crabdb_t *db, fossil_crabdb_stripe_t *stripe) {
+    if (!db->locks) return;
+    fossil_rwlock_write_lock(&stripe->lock);
+    if (stripe->rcu) fossil_crabdb_seq_begin(&stripe->sequence);
+}
+
+static inline void fossil_crabdb_stripe_write_unlock(fossil_crabdb_t *db, fossil_crabdb_stripe_t *stripe) {
+    if (!db->locks) return;
+    if (stripe->rcu) fossil_crabdb_seq_end(&stripe->sequence);
+    fossil_rwlock_write_unlock(&stripe->lock);
+    if (stripe->rcu) fossil_crabdb_rcu_poll(stripe->rcu);
+}
+
+static inline fossil_crabdb_stripe_t *fossil_crabdb_stripe_for(const fossil_crabdb_namespace_t *ns, uint64_t hash) {
+    // High bits pick the stripe so the low bits stay independent for probing
+    return &ns->stripes[(size_t)(hash >> 32) % ns->stripe_count];
+}
+
+static size_t fossil_crabdb_namespace_size(const fossil_crabdb_namespace_t *ns) {
+    size_t count = 0;
+    for (size_t i = 0; i < ns->stripe_count; i++) {
+        count += ns->stripes[i].index.count;
+    }
+    return count;
+}
+
+// *****************************************************************************
+// Pair storage
+// *****************************************************************************
+
+/*
+ * The pairs of a stripe live in a bump-pointer arena: one block for the
+ * pair and its key, one for the value and one for the timer, if any. A
+ * value of up to FOSSIL_CRABDB_INLINE_VALUE bytes shares the block of its
+ * pair instead, right behind the key, and a later value that fits the room
+ * left there is written back in place. A block is never freed on its own. Deletes and value changes only count
+ * the space as garbage, and once garbage outweighs live data the stripe is
+ * compacted by copying its live pairs into a fresh arena. Dropping a
+ * namespace frees whole chunks without visiting its pairs.
+ */
+
+#define FOSSIL_CRABDB_CHUNK_SIZE (64 * 1024)
+#define FOSSIL_CRABDB_BLOCK_ALIGN 8
+#define FOSSIL_CRABDB_COMPACT_MIN FOSSIL_CRABDB_CHUNK_SIZE
+#define FOSSIL_CRABDB_INLINE_VALUE 64 // Largest value, terminator included, stored in the pair block
+
+typedef struct fossil_crabdb_chunk_t {
+    struct fossil_crabdb_chunk_t *next; /**< Older chunk */
+    size_t size; /**< Usable bytes */
+    size_t used; /**< Bytes handed out */
+    uint64_t data[]; /**< Block storage, aligned for any pair field */
+} fossil_crabdb_chunk_t;
+
+static inline size_t fossil_crabdb_block_size(size_t size) {
+    return (size + FOSSIL_CRABDB_BLOCK_ALIGN - 1) & ~(size_t)(FOSSIL_CRABDB_BLOCK_ALIGN - 1);
+}
+
+static inline size_t fossil_crabdb_node_block(size_t key_length, size_t value_room) {
+    return fossil_crabdb_block_size(sizeof(fossil_crabdb_keyvalue_t) + key_length + 1 + value_room);
+}
+
+static inline size_t fossil_crabdb_value_block(size_t value_length) {
+    return fossil_crabdb_block_size(value_length + 1);
+}
+
+/**
+ * Room a new pair keeps behind its key for a value, alignment slack
+ * included, or 0 when the value is too large to be stored inline.
+ */
+static inline size_t fossil_crabdb_value_room(size_t key_length, size_t value_length) {
+    if (value_length + 1 > FOSSIL_CRABDB_INLINE_VALUE) return 0;
+    return fossil_crabdb_node_block(key_length, value_length + 1) - sizeof(fossil_crabdb_keyvalue_t) - key_length - 1;
+}
+
+/**
+ * Arena bytes a new pair takes, its value included.
+ */
+static inline size_t fossil_crabdb_pair_blocks(size_t key_length, size_t value_length) {
+    size_t room = fossil_crabdb_value_room(key_length, value_length);
+    return fossil_crabdb_node_block(key_length, room) + (room ? 0 : fossil_crabdb_value_block(value_length));
+}
+
+static inline char *fossil_crabdb_inline_value(const fossil_crabdb_keyvalue_t *kv) {
+    return kv->key + kv->key_length + 1;
+}
+
+static inline int fossil_crabdb_value_inline(const fossil_crabdb_keyvalue_t *kv) {
+    return kv->value_room && kv->value == fossil_crabdb_inline_value(kv);
+}
+
+/**
+ * Copy `length` bytes into a new NUL terminated buffer.
+ */
+static char *fossil_crabdb_memdup(const char *data, size_t length) {
+    char *copy = (char *)malloc(length + 1);
+    if (!copy) return cnullptr;
+    memcpy(copy, data, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+static void fossil_crabdb_chunks_free(fossil_crabdb_chunk_t *chunk) {
+    while (chunk) {
+        fossil_crabdb_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+}
+
+static void fossil_crabdb_release_chunks(fossil_crabdb_t *db, void *data) {
+    (void)db;
+    fossil_crabdb_chunks_free((fossil_crabdb_chunk_t *)data);
+}
+
+/**
+ * Make sure the newest chunk has `size` contiguous bytes left, so that
+ * blocks adding up to it can be allocated without failing.
+ */
+static int fossil_crabdb_arena_reserve(fossil_crabdb_stripe_t *stripe, size_t size) {
+    fossil_crabdb_chunk_t *head = stripe->chunks;
+    if (head && head->size - head->used >= size) return 0;
+
+    size_t capacity = size > FOSSIL_CRABDB_CHUNK_SIZE ? size : FOSSIL_CRABDB_CHUNK_SIZE;
+    fossil_crabdb_chunk_t *chunk = (fossil_crabdb_chunk_t *)malloc(sizeof(fossil_crabdb_chunk_t) + capacity);
+    if (!chunk) return -1;
+    chunk->next = head;
+    chunk->size = capacity;
+    chunk->used = 0;
+    stripe->chunks = chunk;
+    return 0;
+}
+
+/**
+ * Hand out a block from space already reserved.
+ */
+static void *fossil_crabdb_arena_take(fossil_crabdb_stripe_t *stripe, size_t size) {
+    fossil_crabdb_chunk_t *head = stripe->chunks;
+    void *block = (unsigned char *)head->data + head->used;
+    head->used += size;
+    stripe->allocated += size;
+    return block;
+}
+
+/**
+ * Carve a pair out of reserved space; only the list links are left unset.
+ * `raw_length` is the decompressed length of a compressed value, else 0.
+ */
+static fossil_crabdb_keyvalue_t *fossil_crabdb_new_pair(fossil_crabdb_stripe_t *stripe, const char *key, size_t key_length, uint64_t hash, const char *value, size_t value_length, size_t raw_length) {
+    size_t room = fossil_crabdb_value_room(key_length, value_length);
+    fossil_crabdb_keyvalue_t *kv = (fossil_crabdb_keyvalue_t *)fossil_crabdb_arena_take(stripe, fossil_crabdb_node_block(key_length, room));
+    kv->key = (char *)(kv + 1);
+    kv->key_length = key_length;
+    memcpy(kv->key, key, key_length + 1);
+    kv->value_room = room;
+    kv->value = room ? fossil_crabdb_inline_value(kv) : (char *)fossil_crabdb_arena_take(stripe, fossil_crabdb_value_block(value_length));
+    memcpy(kv->value, value, value_length);
+    kv->value[value_length] = '\0';
+    kv->value_length = value_length;
+    kv->raw_length = raw_length;
+    kv->hash = hash;
+    kv->next = cnullptr;
+    kv->prev = cnullptr;
+    kv->timer = cnullptr;
+    kv->clock_slot = 0;
+    kv->version = 0;
+    return kv;
+}
+
+/**
+ * Arena bytes `value` needs to replace the value of `kv`; a value that fits
+ * the inline room, or an out of line block of the same size, is
+ * overwritten in place.
+ */
+static inline size_t fossil_crabdb_value_need(const fossil_crabdb_keyvalue_t *kv, size_t value_length) {
+    if (value_length < kv->value_room) return 0;
+    size_t block = fossil_crabdb_value_block(value_length);
+    return !fossil_crabdb_value_inline(kv) && block == fossil_crabdb_value_block(kv->value_length) ? 0 : block;
+}
+
+/**
+ * Replace the value of a pair from space reserved per fossil_crabdb_value_need.
+ */
+static void fossil_crabdb_store_value(fossil_crabdb_stripe_t *stripe, fossil_crabdb_keyvalue_t *kv, const char *value, size_t value_length, size_t raw_length) {
+    size_t need = fossil_crabdb_value_need(kv, value_length);
+    if (value_length < kv->value_room || need) {
+        if (!fossil_crabdb_value_inline(kv)) stripe->garbage += fossil_crabdb_value_block(kv->value_length);
+        kv->value = need ? (char *)fossil_crabdb_arena_take(stripe, need) : fossil_crabdb_inline_value(kv);
+    }
+    memcpy(kv->value, value, value_length);
+    kv->value[value_length] = '\0';
+    kv->value_length = value_length;
+    kv->raw_length = raw_length;
+}
+
+static inline int fossil_crabdb_compaction_due(const fossil_crabdb_stripe_t *stripe) {
+    return stripe->garbage >= FOSSIL_CRABDB_COMPACT_MIN && stripe->garbage >= stripe->allocated - stripe->garbage;
+}
+
+// *****************************************************************************
+// Compression
+// *****************************************************************************
+
+/*
+ * A namespace can store its large values compressed by a small LZ77 codec
+ * laid out like an LZ4 block. A value is a run of sequences:
+ *
+ *     token | [literal length] | literals | u16 offset | [match length]
+ *
+ * The high nibble of the token counts literals and the low nibble the match
+ * length past the minimum of four; a saturated nibble continues in bytes of
+ * 255 up to the first smaller one. The last sequence stops after its
+ * literals. Offsets may reach back past the start of the value into the
+ * dictionary of the namespace, content its values tend to share, so even a
+ * value of a few hundred bytes finds matches.
+ *
+ * A compressed pair keeps its decompressed length in `raw_length` and every
+ * read that hands a value out decompresses it. Versions kept for snapshots
+ * are stored decompressed, so they never depend on a dictionary that has
+ * since been replaced.
+ */
+
+#define FOSSIL_CRABDB_LZ_MIN_MATCH 4
+#define FOSSIL_CRABDB_LZ_HASH_BITS 12
+#define FOSSIL_CRABDB_LZ_WINDOW 65535
+#define FOSSIL_CRABDB_DICT_DEFAULT (16 * 1024)
+#define FOSSIL_CRABDB_DICT_MAX (32 * 1024)
+#define FOSSIL_CRABDB_TRAIN_SAMPLES 1024
+#define FOSSIL_CRABDB_TRAIN_SAMPLE_BYTES 4096 // Longest piece of a value used as a sample
+#define FOSSIL_CRABDB_TRAIN_SEGMENT 64
+#define FOSSIL_CRABDB_TRAIN_GRAM 8
+#define FOSSIL_CRABDB_TRAIN_BITS 16
+
+typedef struct fossil_crabdb_codec_t {
+    size_t threshold; /**< Values at least this long are compressed */
+    unsigned char *dictionary; /**< Content offsets may reach back into, null for none */
+    size_t dictionary_length; /**< Bytes in the dictionary */
+    uint32_t table[1 << FOSSIL_CRABDB_LZ_HASH_BITS]; /**< Match table primed with the dictionary, positions plus one */
+} fossil_crabdb_codec_t;
+
+/**
+ * A value as it is to be stored: compressed into `buffer`, or as given.
+ */
+typedef struct {
+    const char *data; /**< Bytes to store */
+    size_t length; /**< Number of bytes to store */
+    size_t raw_length; /**< Length once decompressed, 0 when stored as is */
+    char *buffer; /**< Compressed bytes, reused across calls and freed by the caller */
+    size_t buffer_size; /**< Capacity of `buffer` */
+} fossil_crabdb_packed_t;
+
+static inline uint32_t fossil_crabdb_lz_read32(const unsigned char *p) {
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+static inline uint32_t fossil_crabdb_lz_hash(uint32_t word) {
+    return (word * 2654435761u) >> (32 - FOSSIL_CRABDB_LZ_HASH_BITS);
+}
+
+static fossil_crabdb_codec_t *fossil_crabdb_codec_new(size_t threshold, const char *dictionary, size_t dictionary_length) {
+    fossil_crabdb_codec_t *codec = (fossil_crabdb_codec_t *)calloc(1, sizeof(fossil_crabdb_codec_t));
+    if (!codec) return cnullptr;
+    codec->threshold = threshold;
+    if (dictionary_length) {
+        codec->dictionary = (unsigned char *)malloc(dictionary_length);
+        if (!codec->dictionary) {
+            free(codec);
+            return cnullptr;
+        }
+        memcpy(codec->dictionary, dictionary, dictionary_length);
+        codec->dictionary_length = dictionary_length;
+        for (size_t i = 0; i + FOSSIL_CRABDB_LZ_MIN_MATCH <= dictionary_length; i++) {
+            codec->table[fossil_crabdb_lz_hash(fossil_crabdb_lz_read32(codec->dictionary + i))] = (uint32_t)(i + 1);
+        }
+    }
+    return codec;
+}
+
+static void fossil_crabdb_codec_free(fossil_crabdb_codec_t *codec) {
+    if (!codec) return;
+    free(codec->dictionary);
+    free(codec);
+}
+
+static void fossil_crabdb_release_codec(fossil_crabdb_t *db, void *data) {
+    (void)db;
+    fossil_crabdb_codec_free((fossil_crabdb_codec_t *)data);
+}
+
+/**
+ * Four bytes at position `at` of the dictionary followed by the value.
+ */
+static inline uint32_t fossil_crabdb_lz_fetch(const fossil_crabdb_codec_t *codec, const unsigned char *src, size_t at) {
+    size_t d = codec->dictionary_length;
+    if (at >= d) return fossil_crabdb_lz_read32(src + at - d);
+    if (at + 4 <= d) return fossil_crabdb_lz_read32(codec->dictionary + at);
+    unsigned char word[4];
+    for (size_t i = 0; i < 4; i++) {
+        word[i] = at + i < d ? codec->dictionary[at + i] : src[at + i - d];
+    }
+    return fossil_crabdb_lz_read32(word);
+}
+
+/**
+ * Count the bytes from `at` on, up to `end`, that repeat those from `ref` on.
+ */
+static size_t fossil_crabdb_lz_extend(const fossil_crabdb_codec_t *codec, const unsigned char *src, size_t ref, size_t at, size_t end) {
+    size_t d = codec->dictionary_length;
+    size_t start = at;
+    // A reference into the dictionary runs on into the value
+    for (; ref < d && at < end; ref++, at++) {
+        if (codec->dictionary[ref] != src[at - d]) return at - start;
+    }
+    if (at == end) return at - start;
+    const unsigned char *a = src + ref - d;
+    const unsigned char *b = src + at - d;
+    const unsigned char *limit = src + end - d;
+    while (b + 8 <= limit) {
+        uint64_t x, y;
+        memcpy(&x, a, 8);
+        memcpy(&y, b, 8);
+        if (x != y) break;
+        a += 8;
+        b += 8;
+    }
+    while (b < limit && *a == *b) {
+        a++;
+        b++;
+    }
+    return (size_t)(b - (src + start - d));
+}
+
+static inline unsigned char *fossil_crabdb_lz_put_length(unsigned char *out, size_t length) {
+    for (; length >= 255; length -= 255) *out++ = 255;
+    *out++ = (unsigned char)length;
+    return out;
+}
+
+static inline int fossil_crabdb_lz_get_length(const unsigned char **in, const unsigned char *end, size_t *length) {
+    unsigned char byte;
+    do {
+        if (*in == end) return -1;
+        byte = *(*in)++;
+        *length += byte;
+    } while (byte == 255);
+    return 0;
+}
+
+/**
+ * Emit one sequence; a match length of 0 makes it the closing one.
+ *
+ * @return The end of the output, or null if it would pass `limit`.
+ */
+static unsigned char *fossil_crabdb_lz_emit(unsigned char *out, unsigned char *limit, const unsigned char *literals, size_t literal_length, size_t offset, size_t match) {
+    size_t extra = match ? match - FOSSIL_CRABDB_LZ_MIN_MATCH : 0;
+    if ((size_t)(limit - out) < 1 + literal_length / 255 + 1 + literal_length + 2 + extra / 255 + 1) return cnullptr;
+
+    unsigned char *token = out++;
+    *token = (unsigned char)((literal_length < 15 ? literal_length : 15) << 4);
+    if (literal_length >= 15) out = fossil_crabdb_lz_put_length(out, literal_length - 15);
+    memcpy(out, literals, literal_length);
+    out += literal_length;
+    if (!match) return out;
+
+    *out++ = (unsigned char)offset;
+    *out++ = (unsigned char)(offset >> 8);
+    *token |= (unsigned char)(extra < 15 ? extra : 15);
+    if (extra >= 15) out = fossil_crabdb_lz_put_length(out, extra - 15);
+    return out;
+}
+
+/**
+ * Compress `length` bytes into at most `capacity` bytes of `dst`.
+ *
+ * @return Compressed size, or 0 if it does not fit.
+ */
+static size_t fossil_crabdb_lz_compress(const fossil_crabdb_codec_t *codec, const unsigned char *src, size_t length, unsigned char *dst, size_t capacity) {
+    // Positions count from the start of the dictionary, the value follows it
+    uint32_t table[1 << FOSSIL_CRABDB_LZ_HASH_BITS];
+    memcpy(table, codec->table, sizeof(table));
+    size_t d = codec->dictionary_length;
+    size_t end = d + length;
+    size_t at = d;
+    size_t anchor = d;
+    unsigned char *out = dst;
+    unsigned char *limit = dst + capacity;
+
+    while (at + FOSSIL_CRABDB_LZ_MIN_MATCH <= end) {
+        uint32_t word = fossil_crabdb_lz_read32(src + at - d);
+        uint32_t *slot = &table[fossil_crabdb_lz_hash(word)];
+        size_t candidate = *slot;
+        *slot = (uint32_t)(at + 1);
+        if (!candidate || at - (candidate - 1) > FOSSIL_CRABDB_LZ_WINDOW || fossil_crabdb_lz_fetch(codec, src, candidate - 1) != word) {
+            // Step faster through input that keeps failing to match
+            at += 1 + ((at - anchor) >> 6);
+            continue;
+        }
+
+        size_t ref = candidate - 1;
+        size_t match = FOSSIL_CRABDB_LZ_MIN_MATCH + fossil_crabdb_lz_extend(codec, src, ref + FOSSIL_CRABDB_LZ_MIN_MATCH, at + FOSSIL_CRABDB_LZ_MIN_MATCH, end);
+        out = fossil_crabdb_lz_emit(out, limit, src + anchor - d, at - anchor, at - ref, match);
+        if (!out) return 0;
+        at += match;
+        anchor = at;
+        if (at + 2 <= end) table[fossil_crabdb_lz_hash(fossil_crabdb_lz_read32(src + at - 2 - d))] = (uint32_t)(at - 1);
+    }
+
+    out = fossil_crabdb_lz_emit(out, limit, src + anchor - d, end - anchor, 0, 0);
+    return out ? (size_t)(out - dst) : 0;
+}
+
+/**
+ * Decompress into exactly `raw_length` bytes of `dst`.
+ *
+ * @return 0 on success, -1 if the input is malformed.
+ */
+static int fossil_crabdb_lz_decompress(const fossil_crabdb_codec_t *codec, const unsigned char *src, size_t length, unsigned char *dst, size_t raw_length) {
+    const unsigned char *in = src;
+    const unsigned char *in_end = src + length;
+    unsigned char *out = dst;
+    unsigned char *out_end = dst + raw_length;
+    size_t d = codec ? codec->dictionary_length : 0;
+
+    while (in < in_end) {
+        unsigned token = *in++;
+        size_t literals = token >> 4;
+        if (literals == 15 && fossil_crabdb_lz_get_length(&in, in_end, &literals) != 0) return -1;
+        if ((size_t)(in_end - in) < literals || (size_t)(out_end - out) < literals) return -1;
+        memcpy(out, in, literals);
+        in += literals;
+        out += literals;
+        if (in == in_end) break;
+
+        if (in_end - in < 2) return -1;
+        size_t offset = (size_t)in[0] | ((size_t)in[1] << 8);
+        in += 2;
+        size_t match = token & 15;
+        if (match == 15 && fossil_crabdb_lz_get_length(&in, in_end, &match) != 0) return -1;
+        match += FOSSIL_CRABDB_LZ_MIN_MATCH;
+        if (!offset || (size_t)(out_end - out) < match) return -1;
+
+        size_t produced = (size_t)(out - dst);
+        if (offset > produced) {
+            // The match starts in the dictionary and may run on into the value
+            size_t back = offset - produced;
+            if (back > d) return -1;
+            size_t part = back < match ? back : match;
+            memcpy(out, codec->dictionary + d - back, part);
+            out += part;
+            match -= part;
+        }
+        if (!match) continue;
+        const unsigned char *ref = out - offset;
+        if (offset >= match) {
+            memcpy(out, ref, match);
+            out += match;
+        } else {
+            while (match--) *out++ = *ref++;
+        }
+    }
+    return out == out_end ? 0 : -1;
+}
+
+/**
+ * Work out how a value is to be stored under `codec`, which may be null.
+ * A value is compressed only when that saves at least an eighth of it.
+ *
+ * @return 0, or -1 when out of memory.
+ */
+static int fossil_crabdb_pack(const fossil_crabdb_codec_t *codec, const char *value, size_t length, fossil_crabdb_packed_t *packed) {
+    packed->data = value;
+    packed->length = length;
+    packed->raw_length = 0;
+    if (!codec || length < codec->threshold || length > UINT32_MAX - FOSSIL_CRABDB_DICT_MAX) return 0;
+
+    size_t capacity = length - length / 8;
+    if (packed->buffer_size < capacity) {
+        char *buffer = (char *)realloc(packed->buffer, capacity);
+        if (!buffer) return -1;
+        packed->buffer = buffer;
+        packed->buffer_size = capacity;
+    }
+    size_t size = fossil_crabdb_lz_compress(codec, (const unsigned char *)value, length, (unsigned char *)packed->buffer, capacity);
+    if (size) {
+        packed->data = packed->buffer;
+        packed->length = size;
+        packed->raw_length = length;
+    }
+    return 0;
+}
+
+/**
+ * Copy out a stored value in full, NUL terminated.
+ *
+ * @return The copy, or null when out of memory or the value is damaged.
+ */
+static char *fossil_crabdb_unpack(const fossil_crabdb_codec_t *codec, const char *data, size_t length, size_t raw_length) {
+    if (!raw_length) return fossil_crabdb_memdup(data, length);
+    char *copy = (char *)malloc(raw_length + 1);
+    if (!copy) return cnullptr;
+    if (fossil_crabdb_lz_decompress(codec, (const unsigned char *)data, length, (unsigned char *)copy, raw_length) != 0) {
+        free(copy);
+        return cnullptr;
+    }
+    copy[raw_length] = '\0';
+    return copy;
+}
+
+static inline size_t fossil_crabdb_plain_length(const fossil_crabdb_keyvalue_t *kv) {
+    return kv->raw_length ? kv->raw_length : kv->value_length;
+}
+
+/**
+ * Copy out the value of a pair of a namespace whose codec is `codec`.
+ */
+static inline char *fossil_crabdb_value_copy(const fossil_crabdb_codec_t *codec, const fossil_crabdb_keyvalue_t *kv) {
+    return fossil_crabdb_unpack(codec, kv->value, kv->value_length, kv->raw_length);
+}
+
+typedef struct {
+    uint32_t sample; /**< Sample the segment comes from */
+    uint32_t offset; /**< Start of the segment in its sample */
+    uint64_t score; /**< Frequency of its content across the samples */
+} fossil_crabdb_segment_t;
+
+static inline uint32_t fossil_crabdb_gram_hash(const unsigned char *p) {
+    uint64_t gram;
+    memcpy(&gram, p, sizeof(gram));
+    return (uint32_t)((gram * 0x9E3779B97F4A7C15ull) >> (64 - FOSSIL_CRABDB_TRAIN_BITS));
+}
+
+/**
+ * Sum the counts of the 8-byte grams of a segment that more than one
+ * sample contains.
+ */
+static uint64_t fossil_crabdb_segment_score(const uint32_t *counts, const unsigned char *segment) {
+    uint64_t score = 0;
+    for (size_t i = 0; i + FOSSIL_CRABDB_TRAIN_GRAM <= FOSSIL_CRABDB_TRAIN_SEGMENT; i++) {
+        uint32_t count = counts[fossil_crabdb_gram_hash(segment + i)];
+        if (count > 1) score += count;
+    }
+    return score;
+}
+
+static int fossil_crabdb_compare_segments(const void *a, const void *b) {
+    uint64_t x = ((const fossil_crabdb_segment_t *)a)->score;
+    uint64_t y = ((const fossil_crabdb_segment_t *)b)->score;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/**
+ * Build a dictionary of up to `size` bytes from the segments of the samples
+ * whose content recurs across most of them. Once a segment is chosen its
+ * grams stop counting, so the dictionary does not repeat itself. The best
+ * segments go last, nearest to the values.
+ *
+ * @return Bytes of dictionary written at the start of `dictionary`, or SIZE_MAX when out of memory.
+ */
+static size_t fossil_crabdb_train(char *const *samples, const size_t *lengths, size_t count, unsigned char *dictionary, size_t size) {
+    uint32_t *counts = (uint32_t *)calloc((size_t)1 << FOSSIL_CRABDB_TRAIN_BITS, sizeof(uint32_t));
+    uint32_t *stamps = (uint32_t *)calloc((size_t)1 << FOSSIL_CRABDB_TRAIN_BITS, sizeof(uint32_t));
+    size_t segment_count = 0;
+    for (size_t s = 0; s < count; s++) {
+        if (lengths[s] >= FOSSIL_CRABDB_TRAIN_SEGMENT) segment_count += (lengths[s] - FOSSIL_CRABDB_TRAIN_SEGMENT) / (FOSSIL_CRABDB_TRAIN_SEGMENT / 2) + 1;
+    }
+    fossil_crabdb_segment_t *segments = (fossil_crabdb_segment_t *)malloc((segment_count + 1) * sizeof(fossil_crabdb_segment_t));
+    if (!counts || !stamps || !segments) {
+        free(counts);
+        free(stamps);
+        free(segments);
+        return SIZE_MAX;
+    }
+
+    // Count each gram once per sample that holds it
+    for (size_t s = 0; s < count; s++) {
+        const unsigned char *sample = (const unsigned char *)samples[s];
+        for (size_t i = 0; i + FOSSIL_CRABDB_TRAIN_GRAM <= lengths[s]; i++) {
+            uint32_t h = fossil_crabdb_gram_hash(sample + i);
+            if (stamps[h] != s + 1) {
+                stamps[h] = (uint32_t)(s + 1);
+                counts[h]++;
+            }
+        }
+    }
+
+    size_t n = 0;
+    for (size_t s = 0; s < count; s++) {
+        for (size_t offset = 0; offset + FOSSIL_CRABDB_TRAIN_SEGMENT <= lengths[s]; offset += FOSSIL_CRABDB_TRAIN_SEGMENT / 2) {
+            segments[n].sample = (uint32_t)s;
+            segments[n].offset = (uint32_t)offset;
+            segments[n].score = fossil_crabdb_segment_score(counts, (const unsigned char *)samples[s] + offset);
+            n++;
+        }
+    }
+    qsort(segments, n, sizeof(*segments), fossil_crabdb_compare_segments);
+
+    size_t fill = size;
+    for (size_t i = 0; i < n && fill >= FOSSIL_CRABDB_TRAIN_SEGMENT && segments[i].score; i++) {
+        const unsigned char *segment = (const unsigned char *)samples[segments[i].sample] + segments[i].offset;
+        // Skip segments that chiefly repeat what is already chosen
+        uint64_t score = fossil_crabdb_segment_score(counts, segment);
+        if (!score || score * 2 < segments[i].score) continue;
+        fill -= FOSSIL_CRABDB_TRAIN_SEGMENT;
+        memcpy(dictionary + fill, segment, FOSSIL_CRABDB_TRAIN_SEGMENT);
+        for (size_t g = 0; g + FOSSIL_CRABDB_TRAIN_GRAM <= FOSSIL_CRABDB_TRAIN_SEGMENT; g++) {
+            counts[fossil_crabdb_gram_hash(segment + g)] = 0;
+        }
+    }
+    memmove(dictionary, dictionary + fill, size - fill);
+
+    free(counts);
+    free(stamps);
+    free(segments);
+    return size - fill;
+}
+
+// *****************************************************************************
+// Bloom filters
+// *****************************************************************************
+
+/*
+ * A namespace can keep a blocked Bloom filter in every stripe, so a lookup
+ * of a missing key is answered without touching the hash index. A key maps
+ * to one 64-byte block, a single cache line, and sets one bit in each of
+ * its eight words; a probe is one line load and eight masked compares,
+ * done in two AVX2 tests where available.
+ *
+ * A filter is a stack of layers. Keys go into the newest layer and once it
+ * is full a layer twice its size is pushed on top, so the filter grows with
+ * the stripe without ever revisiting a key. Deleted keys leave their bits
+ * behind until compaction, which already walks every live pair, rebuilds
+ * the filter as a single layer.
+ */
+
+#define FOSSIL_CRABDB_BLOOM_WORDS 8
+#define FOSSIL_CRABDB_BLOOM_BLOCK_BITS (FOSSIL_CRABDB_BLOOM_WORDS * 64)
+#define FOSSIL_CRABDB_BLOOM_MIN_KEYS 256
+#define FOSSIL_CRABDB_BLOOM_DEFAULT_BITS 10
+#define FOSSIL_CRABDB_BLOOM_MAX_BITS 64
+
+typedef struct {
+    uint64_t words[FOSSIL_CRABDB_BLOOM_WORDS];
+} fossil_crabdb_bloom_block_t;
+
+typedef struct fossil_crabdb_bloom_t {
+    struct fossil_crabdb_bloom_t *next; /**< Older, smaller layer */
+    fossil_crabdb_bloom_block_t *blocks; /**< Cache-line aligned blocks, a power of two of them */
+    size_t block_mask; /**< Number of blocks minus one */
+    size_t capacity; /**< Keys the layer takes before a larger one is pushed */
+    size_t count; /**< Keys added to the layer */
+    size_t bits_per_key; /**< Sizing of the layer */
+} fossil_crabdb_bloom_t;
+
+// Odd multipliers that spread one 32-bit hash over the eight words
+static const uint32_t fossil_crabdb_bloom_salts[FOSSIL_CRABDB_BLOOM_WORDS] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+/**
+ * Remix a key hash: stripes and index slots already consume its bits.
+ */
+static inline uint64_t fossil_crabdb_bloom_mix(uint64_t hash) {
+    hash ^= hash >> 31;
+    return hash * 0x94d049bb133111ebULL;
+}
+
+static void fossil_crabdb_bloom_free(fossil_crabdb_bloom_t *bloom) {
+    while (bloom) {
+        fossil_crabdb_bloom_t *next = bloom->next;
+        free(bloom);
+        bloom = next;
+    }
+}
+
+static void fossil_crabdb_release_bloom(fossil_crabdb_t *db, void *data) {
+    (void)db;
+    fossil_crabdb_bloom_free((fossil_crabdb_bloom_t *)data);
+}
+
+/**
+ * Allocate an empty layer for `capacity` keys on top of `next`; the layer
+ * and its blocks share one allocation.
+ */
+static fossil_crabdb_bloom_t *fossil_crabdb_bloom_layer(size_t bits_per_key, size_t capacity, fossil_crabdb_bloom_t *next) {
+    if (capacity < FOSSIL_CRABDB_BLOOM_MIN_KEYS) capacity = FOSSIL_CRABDB_BLOOM_MIN_KEYS;
+    size_t blocks = 1;
+    while (blocks * FOSSIL_CRABDB_BLOOM_BLOCK_BITS < capacity * bits_per_key) blocks *= 2;
+
+    size_t size = sizeof(fossil_crabdb_bloom_t) + sizeof(fossil_crabdb_bloom_block_t) * (blocks + 1);
+    fossil_crabdb_bloom_t *bloom = (fossil_crabdb_bloom_t *)calloc(1, size);
+    if (!bloom) return cnullptr;
+    uintptr_t first = ((uintptr_t)(bloom + 1) + sizeof(fossil_crabdb_bloom_block_t) - 1) & ~(uintptr_t)(sizeof(fossil_crabdb_bloom_block_t) - 1);
+    bloom->blocks = (fossil_crabdb_bloom_block_t *)first;
+    bloom->block_mask = blocks - 1;
+    bloom->capacity = capacity;
+    bloom->bits_per_key = bits_per_key;
+    bloom->next = next;
+    return bloom;
+}
+
+static size_t fossil_crabdb_bloom_bytes(const fossil_crabdb_bloom_t *bloom) {
+    size_t bytes = 0;
+    for (; bloom; bloom = bloom->next) {
+        bytes += (bloom->block_mask + 1) * sizeof(fossil_crabdb_bloom_block_t);
+    }
+    return bytes;
+}
+
+/**
+ * Make room in the newest layer for `extra` more keys so that adding them
+ * cannot fail.
+ */
+static int fossil_crabdb_bloom_reserve(fossil_crabdb_stripe_t *stripe, size_t extra) {
+    fossil_crabdb_bloom_t *top = stripe->bloom;
+    if (!top || top->count + extra <= top->capacity) return 0;
+
+    size_t capacity = top->capacity * 2 > top->count + extra ? top->capacity * 2 : top->count + extra;
+    fossil_crabdb_bloom_t *layer = fossil_crabdb_bloom_layer(top->bits_per_key, capacity, top);
+    if (!layer) return -1;
+    stripe->bloom = layer;
+    return 0;
+}
+
+static void fossil_crabdb_bloom_add(fossil_crabdb_bloom_t *bloom, uint64_t hash) {
+    uint64_t mix = fossil_crabdb_bloom_mix(hash);
+    uint32_t h = (uint32_t)mix;
+    fossil_crabdb_bloom_block_t *block = &bloom->blocks[(size_t)(mix >> 32) & bloom->block_mask];
+    for (unsigned i = 0; i < FOSSIL_CRABDB_BLOOM_WORDS; i++) {
+        block->words[i] |= (uint64_t)1 << ((h * fossil_crabdb_bloom_salts[i]) >> 26);
+    }
+    bloom->count++;
+}
+
+static inline int fossil_crabdb_bloom_block_has(const fossil_crabdb_bloom_block_t *block, uint32_t h) {
+#if defined(__AVX2__)
+    const __m256i salts = _mm256_loadu_si256((const __m256i *)fossil_crabdb_bloom_salts);
+    __m256i shifts = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32((int)h), salts), 26);
+    __m256i one = _mm256_set1_epi64x(1);
+    __m256i low = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(shifts)));
+    __m256i high = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(shifts, 1)));
+    return _mm256_testc_si256(_mm256_load_si256((const __m256i *)&block->words[0]), low) &&
+           _mm256_testc_si256(_mm256_load_si256((const __m256i *)&block->words[4]), high);
+#else
+    // Branch free so that compilers can vectorize it
+    uint64_t missing = 0;
+    for (unsigned i = 0; i < FOSSIL_CRABDB_BLOOM_WORDS; i++) {
+        missing |= ~block->words[i] & ((uint64_t)1 << ((h * fossil_crabdb_bloom_salts[i]) >> 26));
+    }
+    return missing == 0;
+#endif
+}
+
+/**
+ * Whether a key with this hash may have been added; 0 is a definite miss.
+ */
+static int fossil_crabdb_bloom_may_contain(const fossil_crabdb_bloom_t *bloom, uint64_t hash) {
+    uint64_t mix = fossil_crabdb_bloom_mix(hash);
+    for (; bloom; bloom = bloom->next) {
+        if (fossil_crabdb_bloom_block_has(&bloom->blocks[(size_t)(mix >> 32) & bloom->block_mask], (uint32_t)mix)) return 1;
+    }
+    return 0;
+}
+
+/**
+ * Look up a pair of a locked stripe, letting its Bloom filter answer
+ * definite misses.
+ */
+static inline fossil_crabdb_keyvalue_t *fossil_crabdb_stripe_find(const fossil_crabdb_stripe_t *stripe, const char *key, uint64_t hash) {
+    if (stripe->bloom && !fossil_crabdb_bloom_may_contain(stripe->bloom, hash)) return cnullptr;
+    return (fossil_crabdb_keyvalue_t *)fossil_crabdb_index_find(&stripe->index, key, hash);
+}
+
+// *****************************************************************************
+// Ordered index
+// *****************************************************************************
+
+/*
+ * A B+tree over the pairs of a namespace. Leaves hold pair pointers in key
+ * order and are linked both ways for scans; inner nodes hold a copy of the
+ * lower bound of every child but the first. Deletes never rebalance, they
+ * only drop nodes that become empty, so separators stay valid lower bounds.
+ *
+ * Writers come from different partitions and are serialized by `lock`;
+ * scans hold every partition lock for reading, which already excludes them.
+ */
+
+#define FOSSIL_CRABDB_BTREE_FANOUT 64
+#define FOSSIL_CRABDB_BTREE_MAX_HEIGHT 16
+
+typedef struct fossil_crabdb_bnode_t {
+    int leaf; /**< Leaf or inner node */
+    size_t count; /**< Entries of a leaf, children of an inner node */
+    struct fossil_crabdb_bnode_t *parent; /**< Parent node, null for the root */
+    union {
+        struct {
+            fossil_crabdb_keyvalue_t *entries[FOSSIL_CRABDB_BTREE_FANOUT];
+            struct fossil_crabdb_bnode_t *next;
+            struct fossil_crabdb_bnode_t *prev;
+        } l;
+        struct {
+            char *keys[FOSSIL_CRABDB_BTREE_FANOUT]; // keys[0] is unused
+            struct fossil_crabdb_bnode_t *children[FOSSIL_CRABDB_BTREE_FANOUT];
+        } n;
+    };
+} fossil_crabdb_bnode_t;
+
+typedef struct fossil_crabdb_ordered_t {
+    fossil_crabdb_bnode_t *root; /**< Root node, null while empty */
+    fossil_xmutex_t lock; /**< Serializes writers from different partitions */
+    int locked; /**< The mutex was created */
+} fossil_crabdb_ordered_t;
+
+static void fossil_crabdb_bnode_free(fossil_crabdb_bnode_t *node) {
+    if (!node) return;
+    if (!node->leaf) {
+        for (size_t i = 0; i < node->count; i++) {
+            if (i) free(node->n.keys[i]);
+            fossil_crabdb_bnode_free(node->n.children[i]);
+        }
+    }
+    free(node);
+}
+
+static void fossil_crabdb_ordered_free(fossil_crabdb_ordered_t *ordered) {
+    if (!ordered) return;
+    fossil_crabdb_bnode_free(ordered->root);
+    if (ordered->locked) fossil_mutex_erase(&ordered->lock);
+    free(ordered);
+}
+
+/**
+ * Child of an inner node whose range holds `key`; with `strict` the leftmost
+ * child that may hold an entry equal to `key`.
+ */
+static size_t fossil_crabdb_bnode_child(const fossil_crabdb_bnode_t *node, const char *key, int strict) {
+    size_t lo = 1, hi = node->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(node->n.keys[mid], key);
+        if (cmp < 0 || (!strict && cmp == 0)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo - 1;
+}
+
+/**
+ * First entry of a leaf not below `key`; with `upper` the first entry above it.
+ */
+static size_t fossil_crabdb_bnode_search(const fossil_crabdb_bnode_t *leaf, const char *key, int upper) {
+    size_t lo = 0, hi = leaf->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(leaf->l.entries[mid]->key, key);
+        if (cmp < 0 || (upper && cmp == 0)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static fossil_crabdb_bnode_t *fossil_crabdb_bnode_descend(fossil_crabdb_bnode_t *node, const char *key, int strict) {
+    while (node && !node->leaf) {
+        node = node->n.children[fossil_crabdb_bnode_child(node, key, strict)];
+    }
+    return node;
+}
+
+static size_t fossil_crabdb_bnode_slot(const fossil_crabdb_bnode_t *parent, const fossil_crabdb_bnode_t *child) {
+    size_t i = 0;
+    while (parent->n.children[i] != child) i++;
+    return i;
+}
+
+/**
+ * Hang `right` after `left` in the parent of `left`, splitting full inner
+ * nodes with nodes taken from `pool`.
+ */
+static void fossil_crabdb_bnode_attach(fossil_crabdb_ordered_t *ordered, fossil_crabdb_bnode_t *left, char *key, fossil_crabdb_bnode_t *right, fossil_crabdb_bnode_t **pool) {
+    fossil_crabdb_bnode_t *node = left->parent;
+    if (!node) {
+        node = *pool++;
+        node->leaf = 0;
+        node->parent = cnullptr;
+        node->count = 2;
+        node->n.keys[0] = cnullptr;
+        node->n.keys[1] = key;
+        node->n.children[0] = left;
+        node->n.children[1] = right;
+        left->parent = right->parent = node;
+        ordered->root = node;
+        return;
+    }
+
+    size_t at = fossil_crabdb_bnode_slot(node, left) + 1;
+    if (node->count < FOSSIL_CRABDB_BTREE_FANOUT) {
+        memmove(&node->n.keys[at + 1], &node->n.keys[at], (node->count - at) * sizeof(char *));
+        memmove(&node->n.children[at + 1], &node->n.children[at], (node->count - at) * sizeof(fossil_crabdb_bnode_t *));
+        node->n.keys[at] = key;
+        node->n.children[at] = right;
+        right->parent = node;
+        node->count++;
+        return;
+    }
+
+    char *keys[FOSSIL_CRABDB_BTREE_FANOUT + 1];
+    fossil_crabdb_bnode_t *children[FOSSIL_CRABDB_BTREE_FANOUT + 1];
+    memcpy(keys, node->n.keys, at * sizeof(char *));
+    memcpy(children, node->n.children, at * sizeof(fossil_crabdb_bnode_t *));
+    keys[at] = key;
+    children[at] = right;
+    memcpy(&keys[at + 1], &node->n.keys[at], (FOSSIL_CRABDB_BTREE_FANOUT - at) * sizeof(char *));
+    memcpy(&children[at + 1], &node->n.children[at], (FOSSIL_CRABDB_BTREE_FANOUT - at) * sizeof(fossil_crabdb_bnode_t *));
+
+    // The lower bound of the first child of the new node moves up a level
+    size_t mid = (FOSSIL_CRABDB_BTREE_FANOUT + 1) / 2;
+    fossil_crabdb_bnode_t *sibling = *pool++;
+    sibling->leaf = 0;
+    sibling->count = FOSSIL_CRABDB_BTREE_FANOUT + 1 - mid;
+    memcpy(node->n.keys, keys, mid * sizeof(char *));
+    memcpy(node->n.children, children, mid * sizeof(fossil_crabdb_bnode_t *));
+    node->count = mid;
+    memcpy(sibling->n.keys, &keys[mid], sibling->count * sizeof(char *));
+    memcpy(sibling->n.children, &children[mid], sibling->count * sizeof(fossil_crabdb_bnode_t *));
+    char *up = sibling->n.keys[0];
+    sibling->n.keys[0] = cnullptr;
+    for (size_t i = 0; i < node->count; i++) node->n.children[i]->parent = node;
+    for (size_t i = 0; i < sibling->count; i++) sibling->n.children[i]->parent = sibling;
+
+    fossil_crabdb_bnode_attach(ordered, node, up, sibling, pool);
+}
+
+/**
+ * Add a pair; equal keys are allowed and go after the existing ones. Every
+ * allocation happens before the tree is touched, so a failure leaves it as
+ * it was.
+ */
+static int fossil_crabdb_ordered_insert(fossil_crabdb_ordered_t *ordered, fossil_crabdb_keyvalue_t *kv) {
+    if (!ordered->root) {
+        fossil_crabdb_bnode_t *root = (fossil_crabdb_bnode_t *)calloc(1, sizeof(fossil_crabdb_bnode_t));
+        if (!root) return -1;
+        root->leaf = 1;
+        ordered->root = root;
+    }
+
+    fossil_crabdb_bnode_t *leaf = fossil_crabdb_bnode_descend(ordered->root, kv->key, 0);
+    size_t at = fossil_crabdb_bnode_search(leaf, kv->key, 1);
+    if (leaf->count < FOSSIL_CRABDB_BTREE_FANOUT) {
+        memmove(&leaf->l.entries[at + 1], &leaf->l.entries[at], (leaf->count - at) * sizeof(kv));
+        leaf->l.entries[at] = kv;
+        leaf->count++;
+        return 0;
+    }
+
+    // One node per full level on the way up, plus a new root if all are full
+    size_t needed = 0;
+    fossil_crabdb_bnode_t *full = leaf;
+    while (full && full->count == FOSSIL_CRABDB_BTREE_FANOUT) {
+        needed++;
+        full = full->parent;
+    }
+    if (!full) needed++;
+    if (needed > FOSSIL_CRABDB_BTREE_MAX_HEIGHT) return -1;
+
+    fossil_crabdb_bnode_t *pool[FOSSIL_CRABDB_BTREE_MAX_HEIGHT];
+    for (size_t i = 0; i < needed; i++) {
+        pool[i] = (fossil_crabdb_bnode_t *)calloc(1, sizeof(fossil_crabdb_bnode_t));
+        if (!pool[i]) {
+            while (i--) free(pool[i]);
+            return -1;
+        }
+    }
+
+    fossil_crabdb_keyvalue_t *entries[FOSSIL_CRABDB_BTREE_FANOUT + 1];
+    memcpy(entries, leaf->l.entries, at * sizeof(kv));
+    entries[at] = kv;
+    memcpy(&entries[at + 1], &leaf->l.entries[at], (FOSSIL_CRABDB_BTREE_FANOUT - at) * sizeof(kv));
+
+    // Appending to the last leaf keeps it full, so ascending loads pack tightly
+    size_t mid = (at == FOSSIL_CRABDB_BTREE_FANOUT && !leaf->l.next) ? FOSSIL_CRABDB_BTREE_FANOUT : (FOSSIL_CRABDB_BTREE_FANOUT + 1) / 2;
+    char *separator = _custom_fossil_strdup(entries[mid]->key);
+    if (!separator) {
+        for (size_t i = 0; i < needed; i++) free(pool[i]);
+        return -1;
+    }
+
+    fossil_crabdb_bnode_t *right = pool[0];
+    right->leaf = 1;
+    right->count = FOSSIL_CRABDB_BTREE_FANOUT + 1 - mid;
+    memcpy(right->l.entries, &entries[mid], right->count * sizeof(kv));
+    leaf->count = mid;
+    memcpy(leaf->l.entries, entries, mid * sizeof(kv));
+    right->l.next = leaf->l.next;
+    right->l.prev = leaf;
+    if (leaf->l.next) leaf->l.next->l.prev = right;
+    leaf->l.next = right;
+
+    fossil_crabdb_bnode_attach(ordered, leaf, separator, right, pool + 1);
+    return 0;
+}
+
+/**
+ * Unhook an empty node from the tree, collapsing parents that empty out and
+ * a root left with a single child.
+ */
+static void fossil_crabdb_bnode_detach(fossil_crabdb_ordered_t *ordered, fossil_crabdb_bnode_t *node) {
+    while (node->count == 0) {
+        fossil_crabdb_bnode_t *parent = node->parent;
+        size_t at = parent ? fossil_crabdb_bnode_slot(parent, node) : 0;
+        if (node->leaf) {
+            if (node->l.prev) node->l.prev->l.next = node->l.next;
+            if (node->l.next) node->l.next->l.prev = node->l.prev;
+        }
+        free(node);
+
+        if (!parent) {
+            ordered->root = cnullptr;
+            return;
+        }
+
+        if (at > 0) {
+            free(parent->n.keys[at]);
+        } else if (parent->count > 1) {
+            free(parent->n.keys[1]);
+        }
+        size_t from = at > 0 ? at : 1;
+        memmove(&parent->n.children[at], &parent->n.children[at + 1], (parent->count - at - 1) * sizeof(fossil_crabdb_bnode_t *));
+        if (parent->count > from) {
+            memmove(&parent->n.keys[from], &parent->n.keys[from + 1], (parent->count - from - 1) * sizeof(char *));
+        }
+        parent->count--;
+        parent->n.keys[0] = cnullptr;
+        node = parent;
+    }
+
+    while (ordered->root && !ordered->root->leaf && ordered->root->count == 1) {
+        fossil_crabdb_bnode_t *root = ordered->root;
+        ordered->root = root->n.children[0];
+        ordered->root->parent = cnullptr;
+        free(root);
+    }
+}
+
+/**
+ * Leaf holding the given pair, matched by identity among entries with its
+ * key, and its position there; null if the pair is not indexed.
+ */
+static fossil_crabdb_bnode_t *fossil_crabdb_ordered_locate(const fossil_crabdb_ordered_t *ordered, const fossil_crabdb_keyvalue_t *kv, size_t *position) {
+    fossil_crabdb_bnode_t *leaf = fossil_crabdb_bnode_descend(ordered->root, kv->key, 1);
+    size_t at = leaf ? fossil_crabdb_bnode_search(leaf, kv->key, 0) : 0;
+
+    while (leaf) {
+        if (at == leaf->count) {
+            leaf = leaf->l.next;
+            at = 0;
+            continue;
+        }
+        if (leaf->l.entries[at] == kv) break;
+        if (strcmp(leaf->l.entries[at]->key, kv->key) > 0) return cnullptr;
+        at++;
+    }
+    *position = at;
+    return leaf;
+}
+
+static void fossil_crabdb_ordered_remove(fossil_crabdb_ordered_t *ordered, const fossil_crabdb_keyvalue_t *kv) {
+    size_t at;
+    fossil_crabdb_bnode_t *leaf = fossil_crabdb_ordered_locate(ordered, kv, &at);
+    if (!leaf) return;
+
+    memmove(&leaf->l.entries[at], &leaf->l.entries[at + 1], (leaf->count - at - 1) * sizeof(kv));
+    leaf->count--;
+    if (leaf->count == 0) fossil_crabdb_bnode_detach(ordered, leaf);
+}
+
+/**
+ * Point the entry of a pair that moved in memory at its new place.
+ */
+static void fossil_crabdb_ordered_replace(fossil_crabdb_ordered_t *ordered, const fossil_crabdb_keyvalue_t *from, fossil_crabdb_keyvalue_t *to) {
+    size_t at;
+    fossil_crabdb_bnode_t *leaf = fossil_crabdb_ordered_locate(ordered, from, &at);
+    if (leaf) leaf->l.entries[at] = to;
+}
+
+/**
+ * Build a packed tree bottom-up from pairs already sorted by key.
+ */
+static int fossil_crabdb_ordered_build(fossil_crabdb_ordered_t *ordered, fossil_crabdb_keyvalue_t **sorted, size_t count) {
+    if (!count) return 0;
+
+    size_t level_count = (count + FOSSIL_CRABDB_BTREE_FANOUT - 1) / FOSSIL_CRABDB_BTREE_FANOUT;
+    fossil_crabdb_bnode_t **level = (fossil_crabdb_bnode_t **)calloc(level_count, sizeof(fossil_crabdb_bnode_t *));
+    const char **lows = (const char **)malloc(level_count * sizeof(const char *));
+    if (!level || !lows) {
+        free(level);
+        free(lows);
+        return -1;
+    }
+
+    for (size_t i = 0; i < level_count; i++) {
+        fossil_crabdb_bnode_t *leaf = (fossil_crabdb_bnode_t *)calloc(1, sizeof(fossil_crabdb_bnode_t));
+        if (!leaf) {
+            for (size_t j = 0; j < i; j++) free(level[j]);
+            free(level);
+            free(lows);
+            return -1;
+        }
+        leaf->leaf = 1;
+        leaf->count = count - i * FOSSIL_CRABDB_BTREE_FANOUT < FOSSIL_CRABDB_BTREE_FANOUT ? count - i * FOSSIL_CRABDB_BTREE_FANOUT : FOSSIL_CRABDB_BTREE_FANOUT;
+        memcpy(leaf->l.entries, &sorted[i * FOSSIL_CRABDB_BTREE_FANOUT], leaf->count * sizeof(*sorted));
+        if (i) {
+            leaf->l.prev = level[i - 1];
+            level[i - 1]->l.next = leaf;
+        }
+        level[i] = leaf;
+        lows[i] = leaf->l.entries[0]->key;
+    }
+
+    // Group each level under parents until a single root is left
+    while (level_count > 1) {
+        size_t parent_count = (level_count + FOSSIL_CRABDB_BTREE_FANOUT - 1) / FOSSIL_CRABDB_BTREE_FANOUT;
+        int failed = 0;
+        for (size_t p = 0; p < parent_count; p++) {
+            fossil_crabdb_bnode_t *parent = (fossil_crabdb_bnode_t *)calloc(1, sizeof(fossil_crabdb_bnode_t));
+            size_t first = p * FOSSIL_CRABDB_BTREE_FANOUT;
+            size_t children = level_count - first < FOSSIL_CRABDB_BTREE_FANOUT ? level_count - first : FOSSIL_CRABDB_BTREE_FANOUT;
+            if (parent) {
+                for (size_t c = 0; c < children; c++) {
+                    parent->n.children[c] = level[first + c];
+                    parent->n.children[c]->parent = parent;
+                    parent->count++;
+                    if (c && !(parent->n.keys[c] = _custom_fossil_strdup(lows[first + c]))) failed = 1;
+                }
+            } else {
+                failed = 1;
+                for (size_t c = 0; c < children; c++) fossil_crabdb_bnode_free(level[first + c]);
+            }
+            level[p] = parent;
+            lows[p] = lows[first];
+        }
+        level_count = parent_count;
+        if (failed) {
+            for (size_t p = 0; p < parent_count; p++) fossil_crabdb_bnode_free(level[p]);
+            free(level);
+            free(lows);
+            return -1;
+        }
+    }
+
+    ordered->root = level[0];
+    free(level);
+    free(lows);
+    return 0;
+}
+
+static inline void fossil_crabdb_ordered_lock(fossil_crabdb_ordered_t *ordered) {
+    if (ordered->locked) fossil_mutex_lock(&ordered->lock);
+}
+
+static inline void fossil_crabdb_ordered_unlock(fossil_crabdb_ordered_t *ordered) {
+    if (ordered->locked) fossil_mutex_unlock(&ordered->lock);
+}
+
+// *****************************************************************************
+// Expiry and eviction
+// *****************************************************************************
+
+/*
+ * A pair with a TTL owns a timer in the hierarchical timing wheel of its
+ * stripe. Level k has 64 slots spanning 64^k milliseconds each, so arming or
+ * cancelling a timer is O(1). Advancing the wheel jumps between occupied
+ * slots using per-level bitmaps, and when it reaches the start of a coarse
+ * slot the timers in it are cascaded into finer levels.
+ *
+ * Expiry runs under the stripe write lock. Every write to a stripe reclaims
+ * a bounded number of pairs, and fossil_crabdb_expire reclaims the rest one
+ * stripe at a time. Readers never wait for it: a pair past its deadline is
+ * simply reported as absent.
+ */
+
+#define FOSSIL_CRABDB_WHEEL_BITS 6
+#define FOSSIL_CRABDB_WHEEL_SLOTS (1u << FOSSIL_CRABDB_WHEEL_BITS)
+#define FOSSIL_CRABDB_WHEEL_LEVELS 5
+#define FOSSIL_CRABDB_EXPIRE_STEP 8
+
+typedef struct fossil_crabdb_timer_t {
+    fossil_crabdb_keyvalue_t *kv; /**< Pair that expires */
+    uint64_t expires; /**< Deadline in milliseconds since the epoch */
+    struct fossil_crabdb_timer_t *next; /**< Next timer of the slot */
+    struct fossil_crabdb_timer_t *prev; /**< Previous timer of the slot */
+    uint8_t level; /**< Wheel level holding the timer */
+    uint8_t slot; /**< Slot of that level */
+} fossil_crabdb_timer_t;
+
+typedef struct fossil_crabdb_wheel_t {
+    uint64_t now; /**< Time the wheel has been advanced to */
+    size_t count; /**< Timers in the wheel */
+    uint64_t occupied[FOSSIL_CRABDB_WHEEL_LEVELS]; /**< One bit per non-empty slot */
+    fossil_crabdb_timer_t *slots[FOSSIL_CRABDB_WHEEL_LEVELS][FOSSIL_CRABDB_WHEEL_SLOTS];
+} fossil_crabdb_wheel_t;
+
+static uint64_t fossil_crabdb_now_ms(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static inline unsigned fossil_crabdb_lowest_bit(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_ctzll(bits);
+#else
+    unsigned i = 0;
+    while (!(bits & 1)) {
+        bits >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+#define FOSSIL_CRABDB_TIMER_BLOCK fossil_crabdb_block_size(sizeof(fossil_crabdb_timer_t))
+
+/**
+ * Give the arena blocks of a pair that left its stripe back as garbage.
+ */
+static void fossil_crabdb_free_pair(fossil_crabdb_stripe_t *stripe, fossil_crabdb_keyvalue_t *kv) {
+    stripe->garbage += fossil_crabdb_node_block(kv->key_length, kv->value_room);
+    if (!fossil_crabdb_value_inline(kv)) stripe->garbage += fossil_crabdb_value_block(kv->value_length);
+    if (kv->timer) stripe->garbage += FOSSIL_CRABDB_TIMER_BLOCK;
+}
+
+/**
+ * Whether a pair is past its deadline. `now` is read from the clock on first
+ * use only, so pairs without a TTL never pay for it.
+ */
+static inline int fossil_crabdb_expired(const fossil_crabdb_keyvalue_t *kv, uint64_t *now) {
+    if (!kv->timer) return 0;
+    if (!*now) *now = fossil_crabdb_now_ms();
+    return kv->timer->expires <= *now;
+}
+
+static void fossil_crabdb_wheel_link(fossil_crabdb_wheel_t *wheel, fossil_crabdb_timer_t *timer) {
+    uint64_t delta = timer->expires > wheel->now ? timer->expires - wheel->now : 0;
+    unsigned level = 0;
+    while (level + 1 < FOSSIL_CRABDB_WHEEL_LEVELS && delta >> (FOSSIL_CRABDB_WHEEL_BITS * (level + 1))) {
+        level++;
+    }
+    if (delta >> (FOSSIL_CRABDB_WHEEL_BITS * FOSSIL_CRABDB_WHEEL_LEVELS)) {
+        // Beyond the wheel: park in the farthest slot and cascade again from there
+        delta = ((uint64_t)1 << (FOSSIL_CRABDB_WHEEL_BITS * FOSSIL_CRABDB_WHEEL_LEVELS)) - 1;
+    }
+
+    unsigned slot = (unsigned)(((wheel->now + delta) >> (FOSSIL_CRABDB_WHEEL_BITS * level)) & (FOSSIL_CRABDB_WHEEL_SLOTS - 1));
+    timer->level = (uint8_t)level;
+    timer->slot = (uint8_t)slot;
+    timer->prev = cnullptr;
+    timer->next = wheel->slots[level][slot];
+    if (timer->next) timer->next->prev = timer;
+    wheel->slots[level][slot] = timer;
+    wheel->occupied[level] |= (uint64_t)1 << slot;
+    wheel->count++;
+}
+
+static void fossil_crabdb_wheel_unlink(fossil_crabdb_wheel_t *wheel, fossil_crabdb_timer_t *timer) {
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        wheel->slots[timer->level][timer->slot] = timer->next;
+    }
+    if (timer->next) timer->next->prev = timer->prev;
+    if (!wheel->slots[timer->level][timer->slot]) {
+        wheel->occupied[timer->level] &= ~((uint64_t)1 << timer->slot);
+    }
+    wheel->count--;
+}
+
+/**
+ * Earliest time after `now` at which the wheel has work: a level 0 slot to
+ * drain or the start of a coarser slot to cascade.
+ */
+static uint64_t fossil_crabdb_wheel_next(const fossil_crabdb_wheel_t *wheel) {
+    for (unsigned level = 0; level < FOSSIL_CRABDB_WHEEL_LEVELS; level++) {
+        unsigned shift = FOSSIL_CRABDB_WHEEL_BITS * level;
+        uint64_t tick = wheel->now >> shift;
+        unsigned index = (unsigned)(tick & (FOSSIL_CRABDB_WHEEL_SLOTS - 1));
+        uint64_t later = index + 1 < FOSSIL_CRABDB_WHEEL_SLOTS ? wheel->occupied[level] & (~(uint64_t)0 << (index + 1)) : 0;
+        if (later) {
+            return (tick - index + fossil_crabdb_lowest_bit(later)) << shift;
+        }
+        if (wheel->occupied[level]) {
+            // Slots behind the current one belong to the next turn of this level
+            return ((tick >> FOSSIL_CRABDB_WHEEL_BITS) + 1) << (shift + FOSSIL_CRABDB_WHEEL_BITS);
+        }
+    }
+    return UINT64_MAX;
+}
+
+/**
+ * Redistribute the coarse slots that start at `now`, highest level first so
+ * that a cascaded timer can be cascaded again on the way down.
+ */
+static void fossil_crabdb_wheel_cascade(fossil_crabdb_wheel_t *wheel) {
+    for (unsigned level = FOSSIL_CRABDB_WHEEL_LEVELS - 1; level > 0; level--) {
+        unsigned shift = FOSSIL_CRABDB_WHEEL_BITS * level;
+        if (wheel->now & (((uint64_t)1 << shift) - 1)) continue;
+
+        unsigned slot = (unsigned)((wheel->now >> shift) & (FOSSIL_CRABDB_WHEEL_SLOTS - 1));
+        fossil_crabdb_timer_t *timer = wheel->slots[level][slot];
+        wheel->slots[level][slot] = cnullptr;
+        wheel->occupied[level] &= ~((uint64_t)1 << slot);
+        while (timer) {
+            fossil_crabdb_timer_t *next = timer->next;
+            wheel->count--;
+            fossil_crabdb_wheel_link(wheel, timer);
+            timer = next;
+        }
+    }
+}
+
+/**
+ * Give a pair a new deadline, or none when `expires` is 0. The stripe must
+ * be write-locked and, for a pair without a timer yet, have a wheel and
+ * FOSSIL_CRABDB_TIMER_BLOCK bytes of arena reserved.
+ */
+static void fossil_crabdb_timer_arm(fossil_crabdb_stripe_t *stripe, fossil_crabdb_keyvalue_t *kv, uint64_t expires) {
+    fossil_crabdb_timer_t *timer = kv->timer;
+    if (timer) fossil_crabdb_wheel_unlink(stripe->wheel, timer);
+    if (!expires) {
+        if (timer) stripe->garbage += FOSSIL_CRABDB_TIMER_BLOCK;
+        kv->timer = cnullptr;
+        return;
+    }
+    if (!timer) {
+        timer = (fossil_crabdb_timer_t *)fossil_crabdb_arena_take(stripe, FOSSIL_CRABDB_TIMER_BLOCK);
+        timer->kv = kv;
+        kv->timer = timer;
+    }
+    timer->expires = expires;
+    fossil_crabdb_wheel_link(stripe->wheel, timer);
+}
+
+static int fossil_crabdb_wheel_reserve(fossil_crabdb_stripe_t *stripe) {
+    if (stripe->wheel) return 0;
+    stripe->wheel = (fossil_crabdb_wheel_t *)calloc(1, sizeof(fossil_crabdb_wheel_t));
+    if (!stripe->wheel) return -1;
+    stripe->wheel->now = fossil_crabdb_now_ms();
+    return 0;
+}
+
+/*
+ * Every stripe counts the bytes its pairs hold. Once the namespace has a
+ * memory budget each stripe also keeps its pairs in a CLOCK ring with one
+ * reference bit per pair. Readers set the bit with a relaxed store under
+ * their read lock, and the hand clears it. A write that takes the stripe
+ * over its share sweeps the hand and evicts the first pair whose bit is
+ * already clear. Evictions are logged as deletes, so recovery sees exactly
+ * the pairs that were left.
+ */
+
+typedef struct fossil_crabdb_clock_t {
+    fossil_crabdb_keyvalue_t **ring; /**< Resident pairs in sweep order */
+    atomic_uchar *referenced; /**< Reference bit of each ring entry */
+    size_t count; /**< Pairs in the ring */
+    size_t capacity; /**< Allocated ring entries */
+    size_t hand; /**< Next ring entry to inspect */
+    size_t budget; /**< Bytes this stripe may hold */
+} fossil_crabdb_clock_t;
+
+static inline size_t fossil_crabdb_pair_bytes(const fossil_crabdb_keyvalue_t *kv) {
+    return sizeof(fossil_crabdb_keyvalue_t) + kv->key_length + 1 + kv->value_length + 1;
+}
+
+static void fossil_crabdb_clock_free(fossil_crabdb_clock_t *clock) {
+    if (!clock) return;
+    free(clock->ring);
+    free(clock->referenced);
+    free(clock);
+}
+
+static void fossil_crabdb_release_clock(fossil_crabdb_t *db, void *data) {
+    (void)db;
+    fossil_crabdb_clock_free((fossil_crabdb_clock_t *)data);
+}
+
+/**
+ * Make room for `extra` more pairs so that charging them cannot fail.
+ * Lock-free readers (`rcu` set) may still mark the old reference bits, so
+ * those are copied and deferred rather than reallocated.
+ */
+static int fossil_crabdb_clock_reserve(fossil_crabdb_rcu_t *rcu, fossil_crabdb_clock_t *clock, size_t extra) {
+    if (!clock || clock->count + extra <= clock->capacity) return 0;
+
+    size_t capacity = clock->capacity ? clock->capacity : 64;
+    while (capacity < clock->count + extra) capacity *= 2;
+    fossil_crabdb_keyvalue_t **ring = (fossil_crabdb_keyvalue_t **)realloc(clock->ring, capacity * sizeof(*ring));
+    if (!ring) return -1;
+    clock->ring = ring;
+    atomic_uchar *referenced;
+    if (rcu) {
+        referenced = (atomic_uchar *)malloc(capacity * sizeof(*referenced));
+        if (!referenced) return -1;
+        if (clock->count) memcpy(referenced, clock->referenced, clock->count * sizeof(*referenced));
+        fossil_crabdb_defer(rcu, clock->referenced, fossil_crabdb_release_memory);
+    } else {
+        referenced = (atomic_uchar *)realloc(clock->referenced, capacity * sizeof(*referenced));
+        if (!referenced) return -1;
+    }
+    clock->referenced = referenced;
+    clock->capacity = capacity;
+    return 0;
+}
+
+/**
+ * Account for a pair that joined a write-locked stripe. A new pair starts
+ * out unreferenced, so a stream of one-off writes cannot push out pairs
+ * that are being read.
+ */
+static void fossil_crabdb_charge_pair(fossil_crabdb_stripe_t *stripe, fossil_crabdb_keyvalue_t *kv) {
+    stripe->resident += fossil_crabdb_pair_bytes(kv);
+    fossil_crabdb_clock_t *clock = stripe->clock;
+    if (clock) {
+        kv->clock_slot = clock->count;
+        clock->ring[clock->count] = kv;
+        atomic_store_explicit(&clock->referenced[clock->count], 0, memory_order_relaxed);
+        clock->count++;
+    }
+}
+
+static void fossil_crabdb_discharge_pair(fossil_crabdb_stripe_t *stripe, fossil_crabdb_keyvalue_t *kv) {
+    stripe->resident -= fossil_crabdb_pair_bytes(kv);
+    fossil_crabdb_clock_t *clock = stripe->clock;
+    if (clock) {
+        // Fill the hole with the last entry to keep the ring dense
+        size_t last = --clock->count;
+        if (kv->clock_slot != last) {
+            fossil_crabdb_keyvalue_t *moved = clock->ring[last];
+            clock->ring[kv->clock_slot] = moved;
+            atomic_store_explicit(&clock->referenced[kv->clock_slot],
+                                  atomic_load_explicit(&clock->referenced[last], memory_order_relaxed), memory_order_relaxed);
+            moved->clock_slot = kv->clock_slot;
+        }
+    }
+}
+
+/**
+ * Record an access to a pair; safe under the stripe read lock.
+ */
+static inline void fossil_crabdb_touch(const fossil_crabdb_stripe_t *stripe, const fossil_crabdb_keyvalue_t *kv) {
+    fossil_crabdb_clock_t *clock = stripe->clock;
+    // Load first so hot pairs do not keep dirtying the cache line
+    if (clock && !atomic_load_explicit(&clock->referenced[kv->clock_slot], memory_order_relaxed)) {
+        atomic_store_explicit(&clock->referenced[kv->clock_slot], 1, memory_order_relaxed);
+    }
+}
+
+/**
+ * Detach a pair that has left its stripe index from the pair list, the
+ * ordered index (locked by the caller), the timer wheel and the accounting.
+ */
+static void fossil_crabdb_unlink_pair(fossil_crabdb_namespace_t *ns, fossil_crabdb_stripe_t *stripe, fossil_crabdb_keyvalue_t *kv) {
+    if (kv->prev) {
+        kv->prev->next = kv->next;
+    } else {
+        stripe->data = kv->next;
+    }
+    if (kv->next) {
+        kv->next->prev = kv->prev;
+    }
+    if (ns->ordered) fossil_crabdb_ordered_remove(ns->ordered, kv);
+    if (kv->timer) fossil_crabdb_wheel_unlink(stripe->wheel, kv->timer);
+    fossil_crabdb_discharge_pair(stripe, kv);
+}
+
+/**
+ * Remove and free an expired pair. The stripe is write-locked and so is the
+ * ordered index, if any.
+ */
+static void fossil_crabdb_purge_pair(fossil_crabdb_namespace_t *ns, fossil_crabdb_stripe_t *stripe, fossil_crabdb_keyvalue_t *kv) {
+    fossil_crabdb_index_remove(&stripe->index, kv->key, kv->hash);
+    fossil_crabdb_unlink_pair(ns, stripe, kv);
+    fossil_crabdb_free_pair(stripe, kv);
+}
+
+/**
+ * Advance the wheel of a write-locked stripe to `now`, reclaiming at most
+ * `budget` pairs (0 for no limit). Stops early, without losing its place,
+ * when the budget runs out.
+ *
+ * @return Number of pairs reclaimed.
+ */
+static size_t fossil_crabdb_stripe_expire(fossil_crabdb_namespace_t *ns, fossil_crabdb_stripe_t *stripe, uint64_t now, size_t budget) {
+    fossil_crabdb_wheel_t *wheel = stripe->wheel;
+    size_t reclaimed = 0;
+    int locked = 0;
+
+    while (wheel) {
+        // Every timer in the current level 0 slot is due
+        fossil_crabdb_timer_t **slot = &wheel->slots[0][wheel->now & (FOSSIL_CRABDB_WHEEL_SLOTS - 1)];
+        while (*slot && (!budget || reclaimed < budget)) {
+            if (ns->ordered && !locked) {
+                fossil_crabdb_ordered_lock(ns->ordered);
+                locked = 1;
+            }
+            fossil_crabdb_purge_pair(ns, stripe, (*slot)->kv);
+            reclaimed++;
+        }
+        if (*slot) break;
+
+        if (!wheel->count) {
+            if (wheel->now < now) wheel->now = now;
+            break;
+        }
+        uint64_t next = fossil_crabdb_wheel_next(wheel);
+        if (next > now) {
+            if (wheel->now < now) wheel->now = now;
+            break;
+        }
+        wheel->now = next;
+        fossil_crabdb_wheel_cascade(wheel);
+    }
+
+    if (locked) fossil_crabdb_ordered_unlock(ns->ordered);
+    return reclaimed;
+}
+
+// *****************************************************************************
+// Compaction
+// *****************************************************************************
+
+/**
+ * Copy the live pairs of a write-locked stripe into a fresh arena and free
+ * the old one, repointing the index, the pair list, the ordered index, the
+ * timers and the eviction clock, and rebuilding the Bloom filter without
+ * the deleted keys. The ordered index must not be locked by the caller.
+ * Leaves the stripe untouched if memory runs out.
+ */
+static int fossil_crabdb_stripe_compact(fossil_crabdb_namespace_t *ns, fossil_crabdb_stripe_t *stripe) {
+    fossil_crabdb_chunk_t *old = stripe->chunks;
+    size_t live = stripe->allocated - stripe->garbage;
+    fossil_crabdb_bloom_t *bloom = cnullptr;
+    if (stripe->bloom) {
+        bloom = fossil_crabdb_bloom_layer(stripe->bloom->bits_per_key, stripe->index.count * 2, cnullptr);
+        if (!bloom) return -1;
+    }
+    stripe->chunks = cnullptr;
+    if (live && fossil_crabdb_arena_reserve(stripe, live) != 0) {
+        stripe->chunks = old;
+        fossil_crabdb_bloom_free(bloom);
+        return -1;
+    }
+    stripe->allocated = 0;
+    stripe->garbage = 0;
+
+    if (ns->ordered) fossil_crabdb_ordered_lock(ns->ordered);
+    fossil_crabdb_keyvalue_t *last = cnullptr;
+    for (fossil_crabdb_keyvalue_t *kv = stripe->data; kv; kv = kv->next) {
+        fossil_crabdb_keyvalue_t *moved = fossil_crabdb_new_pair(stripe, kv->key, kv->key_length, kv->hash, kv->value, kv->value_length, kv->raw_length);
+        moved->clock_slot = kv->clock_slot;
+        moved->version = kv->version;
+        moved->prev = last;
+        if (last) last->next = moved;
+        else stripe->data = moved;
+        last = moved;
+
+        fossil_crabdb_index_find_slot(&stripe->index, kv->key, kv->hash)->entry = moved;
+        if (ns->ordered) fossil_crabdb_ordered_replace(ns->ordered, kv, moved);
+        if (stripe->clock) stripe->clock->ring[kv->clock_slot] = moved;
+        if (bloom) fossil_crabdb_bloom_add(bloom, kv->hash);
+        if (kv->timer) {
+            fossil_crabdb_wheel_unlink(stripe->wheel, kv->timer);
+            moved->timer = (fossil_crabdb_timer_t *)fossil_crabdb_arena_take(stripe, FOSSIL_CRABDB_TIMER_BLOCK);
+            moved->timer->kv = moved;
+            moved->timer->expires = kv->timer->expires;
+            fossil_crabdb_wheel_link(stripe->wheel, moved->timer);
+        }
+    }
+    if (ns->ordered) fossil_crabdb_ordered_unlock(ns->ordered);
+
+    if (bloom) {
+        fossil_crabdb_bloom_t *stale = stripe->bloom;
+        stripe->bloom = bloom;
+        fossil_crabdb_defer(stripe->rcu, stale, fossil_crabdb_release_bloom);
+    }
+    fossil_crabdb_defer(stripe->rcu, old, fossil_crabdb_release_chunks);
+    return 0;
+}
+
+/**
+ * Compact a write-locked stripe once most of its arena is garbage.
+ */
+static inline void fossil_crabdb_stripe_tidy(fossil_crabdb_namespace_t *ns, fossil_crabdb_stripe_t *stripe) {
+    if (fossil_crabdb_compaction_due(stripe)) fossil_crabdb_stripe_compact(ns, stripe);
+}
+
+// *****************************************************************************
+// Versions
+// *****************************************************************************
+
+/*
+ * Every write draws the next number of a database-wide commit sequence while
+ * it holds its partition locks and stamps it on the pairs it writes; a write
+ * batch draws one number for all its entries. A snapshot is the sequence
+ * number current when it began, and sees exactly the values stamped at or
+ * below it.
+ *
+ * While any snapshot is open, a write that replaces or deletes a value first
+ * copies it into the history of its partition, a hash index from each key to
+ * its retired versions, newest first. A snapshot that finds the current pair
+ * too new walks that chain for the version that was live at its sequence.
+ * With no snapshot open nothing is copied and writes pay one atomic add.
+ *
+ * Retired versions are reclaimed by epoch: when a snapshot ends, everything
+ * retired at or before the oldest sequence still open (or the current one,
+ * once none is) is freed, since no snapshot left can see it. Pairs that
+ * expire are dropped without a copy, as no snapshot would see them anyway.
+ */
+
+typedef struct fossil_crabdb_version_t {
+    char *key; /**< Key, stored after the structure */
+    char *value; /**< Retired value, stored after the key */
+    size_t value_length; /**< Length of the value, excluding the terminator */
+    uint64_t hash; /**< Cached hash of the key */
+    uint64_t created; /**< Sequence of the write that produced the value */
+    uint64_t retired; /**< Sequence of the write that replaced or deleted it */
+    uint64_t expires; /**< Deadline the pair had, 0 for never */
+    struct fossil_crabdb_version_t *older; /**< Previous retired version of the key */
+} fossil_crabdb_version_t;
+
+struct fossil_crabdb_snapshot_t {
+    fossil_crabdb_t *db; /**< Database the snapshot reads */
+    uint64_t sequence; /**< Last commit the snapshot sees */
+    struct fossil_crabdb_snapshot_t *next; /**< Next open snapshot */
+    struct fossil_crabdb_snapshot_t *prev; /**< Previous open snapshot */
+};
+
+typedef struct fossil_crabdb_versions_t {
+    atomic_uint_fast64_t sequence; /**< Last commit sequence drawn */
+    atomic_size_t open; /**< Open snapshots, read by writers without the lock */
+    atomic_size_t retained; /**< Versions held across every history */
+    fossil_crabdb_snapshot_t *snapshots; /**< Open snapshots, newest first */
+    fossil_xmutex_t lock; /**< Guards the snapshot list of a thread-safe database */
+} fossil_crabdb_versions_t;
+
+static inline void fossil_crabdb_versions_lock(fossil_crabdb_t *db) {
+    if (db->locks) fossil_mutex_lock(&db->versions->lock);
+}
+
+static inline void fossil_crabdb_versions_unlock(fossil_crabdb_t *db) {
+    if (db->locks) fossil_mutex_unlock(&db->versions->lock);
+}
+
+/**
+ * Draw the sequence of a write; call it with the partition locks held.
+ */
+static inline uint64_t fossil_crabdb_commit(fossil_crabdb_t *db) {
+    return atomic_fetch_add(&db->versions->sequence, 1) + 1;
+}
+
+/**
+ * Whether the write that just drew its sequence must keep what it replaces.
+ * Both counters are sequentially consistent and a snapshot counts itself
+ * open before reading the sequence, so any snapshot missed here began after
+ * the write's sequence and sees its result.
+ */
+static inline int fossil_crabdb_retaining(fossil_crabdb_t *db) {
+    return atomic_load(&db->versions->open) != 0;
+}
+
+/**
+ * Copy the current value of a pair into a version retired at `retired`,
+ * decompressing it with the namespace codec. The caller makes room for it
+ * in the history first.
+ */
+static fossil_crabdb_version_t *fossil_crabdb_version_new(const fossil_crabdb_codec_t *codec, const fossil_crabdb_keyvalue_t *kv, uint64_t retired) {
+    size_t key_length = kv->key_length;
+    size_t value_length = fossil_crabdb_plain_length(kv);
+    fossil_crabdb_version_t *version = (fossil_crabdb_version_t *)malloc(sizeof(fossil_crabdb_version_t) + key_length + value_length + 2);
+    if (!version) return cnullptr;
+
+    version->key = (char *)(version + 1);
+    memcpy(version->key, kv->key, key_length + 1);
+    version->value = version->key + key_length + 1;
+    if (!kv->raw_length) {
+        memcpy(version->value, kv->value, value_length + 1);
+    } else if (fossil_crabdb_lz_decompress(codec, (const unsigned char *)kv->value, kv->value_length, (unsigned char *)version->value, value_length) == 0) {
+        version->value[value_length] = '\0';
+    } else {
+        free(version);
+        return cnullptr;
+    }
+    version->value_length = value_length;
+    version->hash = kv->hash;
+    version->created = kv->version;
+    version->retired = retired;
+    version->expires = kv->timer ? kv->timer->expires : 0;
+    version->older = cnullptr;
+    return version;
+}
+
+/**
+ * Copy a pair of a write-locked stripe that the write at `retired` is about
+ * to replace or delete, with room for it in the history.
+ */
+static fossil_crabdb_version_t *fossil_crabdb_retire(const fossil_crabdb_namespace_t *ns, fossil_crabdb_stripe_t *stripe, const fossil_crabdb_keyvalue_t *kv, uint64_t retired) {
+    if (fossil_crabdb_index_prepare(&stripe->history, 1) != 0) return cnullptr;
+    return fossil_crabdb_version_new(ns->codec, kv, retired);
+}
+
+/**
+ * Put a version at the head of its key's chain; the history has room for it.
+ */
+static void fossil_crabdb_history_push(fossil_crabdb_t *db, fossil_crabdb_stripe_t *stripe, fossil_crabdb_version_t *version) {
+    fossil_crabdb_slot_t *slot = fossil_crabdb_index_find_slot(&stripe->history, version->key, version->hash);
+    if (slot) {
+        version->older = (fossil_crabdb_version_t *)slot->entry;
+        slot->entry = version;
+    } else {
+        fossil_crabdb_index_insert(&stripe->history, version->hash, version);
+    }
+    stripe->retained++;
+    atomic_fetch_add(&db->versions->retained, 1);
+}
+
+static size_t fossil_crabdb_chain_free(fossil_crabdb_version_t *version) {
+    size_t freed = 0;
+    while (version) {
+        fossil_crabdb_version_t *older = version->older;
+        free(version);
+        freed++;
+        version = older;
+    }
+    return freed;
+}
+
+/**
+ * Free the versions of a write-locked stripe retired at or before `horizon`.
+ */
+static void fossil_crabdb_history_prune(fossil_crabdb_t *db, fossil_crabdb_stripe_t *stripe, uint64_t horizon) {
+    fossil_crabdb_index_t *history = &stripe->history;
+    size_t freed = 0;
+    for (int table = 0; table < 2; table++) {
+        fossil_crabdb_slot_t *slots = table ? history->old_slots : history->slots;
+        size_t capacity = table ? history->old_capacity : history->capacity;
+        for (size_t i = 0; slots && i < capacity; i++) {
+            if (!slots[i].entry || slots[i].entry == FOSSIL_CRABDB_TOMBSTONE) continue;
+
+            // Chains run newest first, so whatever follows the first
+            // reclaimable version is reclaimable too
+            fossil_crabdb_version_t *newest = (fossil_crabdb_version_t *)slots[i].entry;
+            if (newest->retired <= horizon) {
+                freed += fossil_crabdb_chain_free(newest);
+                slots[i].entry = FOSSIL_CRABDB_TOMBSTONE;
+                history->count--;
+                continue;
+            }
+            while (newest->older && newest->older->retired > horizon) newest = newest->older;
+            freed += fossil_crabdb_chain_free(newest->older);
+            newest->older = cnullptr;
+        }
+    }
+    if (!history->count) fossil_crabdb_index_free(history);
+    stripe->retained -= freed;
+    atomic_fetch_sub(&db->versions->retained, freed);
+}
+
+/**
+ * Version of a chain that was live at `sequence`, null if the key had none
+ * then or it has expired since.
+ */
+static const fossil_crabdb_version_t *fossil_crabdb_version_at(const fossil_crabdb_version_t *version, uint64_t sequence, uint64_t *now) {
+    for (; version && version->retired > sequence; version = version->older) {
+        if (version->created > sequence) continue;
+        if (version->expires) {
+            if (!*now) *now = fossil_crabdb_now_ms();
+            if (version->expires <= *now) return cnullptr;
+        }
+        return version;
+    }
+    return cnullptr;
+}
+
+/**
+ * Find the value of a key as of `sequence` in a read-locked stripe.
+ *
+ * @return 1 with the value, its length and its decompressed length (0 when
+ *         stored as is) filled in, 0 if the key had none.
+ */
+static int fossil_crabdb_stripe_find_at(const fossil_crabdb_stripe_t *stripe, const char *key, uint64_t hash, uint64_t sequence, uint64_t *now, const char **value, size_t *length, size_t *raw_length) {
+    const fossil_crabdb_keyvalue_t *kv = fossil_crabdb_stripe_find(stripe, key, hash);
+    if (kv && kv->version <= sequence) {
+        if (fossil_crabdb_expired(kv, now)) return 0;
+        *value = kv->value;
+        *length = kv->value_length;
+        *raw_length = kv->raw_length;
+        return 1;
+    }
+
+    // The current pair is newer than the snapshot, or gone since
+    const fossil_crabdb_version_t *version = cnullptr;
+    if (stripe->retained) {
+        version = fossil_crabdb_version_at((const fossil_crabdb_version_t *)fossil_crabdb_index_find(&stripe->history, key, hash), sequence, now);
+    }
+    if (!version) return 0;
+    *value = version->value;
+    *length = version->value_length;
+    *raw_length = 0;
+    return 1;
+}
+
+// *****************************************************************************
+// Metrics
+// *****************************************************************************
+
+/*
+ * Every data operation counts its calls and failures, and one call in
+ * FOSSIL_CRABDB_METER_SAMPLE on each thread is timed into a log-linear
+ * latency histogram with eight buckets per power of two, so a reported
+ * percentile is within 12.5% of the exact one. The counters are sharded by
+ * a number each thread draws on first use and are bumped with a relaxed
+ * load and store instead of an atomic add, which costs what a plain
+ * increment does. Threads that share a shard can lose the odd count; that
+ * is the price of never contending. fossil_crabdb_stats sums the shards.
+ */
+
+#define FOSSIL_CRABDB_METER_SHARDS 16
+#define FOSSIL_CRABDB_METER_SAMPLE 64
+#define FOSSIL_CRABDB_HISTOGRAM_SUB_BITS 3
+#define FOSSIL_CRABDB_HISTOGRAM_SUB (1u << FOSSIL_CRABDB_HISTOGRAM_SUB_BITS)
+#define FOSSIL_CRABDB_HISTOGRAM_BITS 40 // Up to about 18 minutes in nanoseconds
+#define FOSSIL_CRABDB_HISTOGRAM_BUCKETS ((FOSSIL_CRABDB_HISTOGRAM_BITS - FOSSIL_CRABDB_HISTOGRAM_SUB_BITS + 1) * FOSSIL_CRABDB_HISTOGRAM_SUB)
+
+typedef struct {
+    atomic_uint_fast64_t calls; /**< Calls made */
+    atomic_uint_fast64_t errors; /**< Calls that did not return CRABDB_OK */
+    atomic_uint_fast64_t samples; /**< Calls timed */
+    atomic_uint_fast64_t total_ns; /**< Time of the timed calls */
+    atomic_uint_fast64_t max_ns; /**< Slowest timed call */
+    atomic_uint_fast64_t buckets[FOSSIL_CRABDB_HISTOGRAM_BUCKETS]; /**< Timed calls by latency */
+} fossil_crabdb_meter_t;
+
+typedef struct fossil_crabdb_metrics_t {
+    size_t shard_count; /**< Shards, each holding one meter per operation */
+    fossil_crabdb_meter_t meters[]; /**< Meter of operation `op` in shard `s` at s * CRABDB_STAT_OP_COUNT + op */
+} fossil_crabdb_metrics_t;
+
+static FOSSIL_CRABDB_THREAD_LOCAL unsigned fossil_crabdb_thread_ticks;
+
+static uint64_t fossil_crabdb_now_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER counter;
+    LARGE_INTEGER frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static fossil_crabdb_metrics_t *fossil_crabdb_metrics_new(size_t shard_count) {
+    fossil_crabdb_metrics_t *metrics = (fossil_crabdb_metrics_t *)calloc(1, sizeof(fossil_crabdb_metrics_t) + shard_count * CRABDB_STAT_OP_COUNT * sizeof(fossil_crabdb_meter_t));
+    if (metrics) metrics->shard_count = shard_count;
+    return metrics;
+}
+
+static inline size_t fossil_crabdb_histogram_bucket(uint64_t ns) {
+    if (ns < FOSSIL_CRABDB_HISTOGRAM_SUB) return (size_t)ns;
+    if (ns >> FOSSIL_CRABDB_HISTOGRAM_BITS) ns = (1ULL << FOSSIL_CRABDB_HISTOGRAM_BITS) - 1;
+#if defined(__GNUC__) || defined(__clang__)
+    unsigned top = 63u - (unsigned)__builtin_clzll(ns);
+#else
+    unsigned top = 0;
+    while (ns >> (top + 1)) top++;
+#endif
+    unsigned shift = top - FOSSIL_CRABDB_HISTOGRAM_SUB_BITS;
+    return (size_t)(top - FOSSIL_CRABDB_HISTOGRAM_SUB_BITS + 1) * FOSSIL_CRABDB_HISTOGRAM_SUB + (size_t)((ns >> shift) & (FOSSIL_CRABDB_HISTOGRAM_SUB - 1));
+}
+
+/**
+ * Largest latency that falls in a bucket.
+ */
+static inline uint64_t fossil_crabdb_histogram_value(size_t bucket) {
+    if (bucket < FOSSIL_CRABDB_HISTOGRAM_SUB) return bucket;
+    unsigned shift = (unsigned)(bucket / FOSSIL_CRABDB_HISTOGRAM_SUB) - 1;
+    uint64_t lowest = (uint64_t)(FOSSIL_CRABDB_HISTOGRAM_SUB + bucket % FOSSIL_CRABDB_HISTOGRAM_SUB) << shift;
+    return lowest + (1ULL << shift) - 1;
+}
+
+static inline void fossil_crabdb_bump(atomic_uint_fast64_t *counter, uint64_t by) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + by, memory_order_relaxed);
+}
+
+/**
+ * Start metering a call: the clock is read only for the calls sampled.
+ *
+ * @return Start time, or 0 when the call is only counted.
+ */
+static inline uint64_t fossil_crabdb_meter_start(void) {
+    if (++fossil_crabdb_thread_ticks % FOSSIL_CRABDB_METER_SAMPLE) return 0;
+    return fossil_crabdb_now_ns();
+}
+
+/**
+ * Count a finished call into the shard of the calling thread.
+ *
+ * @return `result`, so a call can be metered in its return statement.
+ */
+static fossil_crabdb_error_t fossil_crabdb_meter(fossil_crabdb_t *db, fossil_crabdb_stat_op_t op, uint64_t start, fossil_crabdb_error_t result) {
+    if (!db) return result;
+
+    fossil_crabdb_metrics_t *metrics = db->metrics;
+    fossil_crabdb_meter_t *meter = &metrics->meters[(fossil_crabdb_thread_id() - 1) % metrics->shard_count * CRABDB_STAT_OP_COUNT + op];
+    fossil_crabdb_bump(&meter->calls, 1);
+    if (result != CRABDB_OK) fossil_crabdb_bump(&meter->errors, 1);
+    if (start) {
+        uint64_t elapsed = fossil_crabdb_now_ns() - start;
+        fossil_crabdb_bump(&meter->samples, 1);
+        fossil_crabdb_bump(&meter->total_ns, elapsed);
+        fossil_crabdb_bump(&meter->buckets[fossil_crabdb_histogram_bucket(elapsed)], 1);
+        if (elapsed > atomic_load_explicit(&meter->max_ns, memory_order_relaxed)) {
+            atomic_store_explicit(&meter->max_ns, elapsed, memory_order_relaxed);
+        }
+    }
+    return result;
+}
+
+// *****************************************************************************
+// Persistence
+// *****************************************************************************
+
+/*
+ * Both the write-ahead log and the snapshot are a file magic followed by
+ * framed records:
+ *
+ *     u32 body_length | u32 crc32(body) | body
+ *     body = u64 lsn | u8 op | [u64 deadline] | u32 len | ns | u32 len | arg1 | u32 len | arg2
+ *
+ * The deadline, in milliseconds since the epoch, is present only in
+ * CRABDB_OP_INSERT_TTL and CRABDB_OP_UPDATE_TTL records. Expired pairs are
+ * reclaimed without logging anything; replay recreates them past their
+ * deadline and they expire again.
+ *
+ * All integers are little endian. A snapshot stores the LSN it covers right
+ * after its magic and ends with a CRABDB_OP_END record; log records with an
+ * LSN at or below that are skipped during replay.
+ *
+ * A write batch is a single CRABDB_OP_BATCH record whose first argument is
+ * the packed entry list, so it is replayed entirely or not at all:
+ *
+ *     entry = u8 op | u32 len | key \0 | u32 len | value \0
+ *
+ * Values are always logged decompressed. A CRABDB_OP_COMPRESSION record
+ * carries the threshold in decimal and the dictionary itself, since
+ * training again on replay could pick a different one.
+ */
+
+#define FOSSIL_CRABDB_WAL_MAGIC "CRABWAL1"
+#define FOSSIL_CRABDB_SNAPSHOT_MAGIC "CRABSNP1"
+#define FOSSIL_CRABDB_MAGIC_SIZE 8
+#define FOSSIL_CRABDB_RECORD_HEADER 8
+#define FOSSIL_CRABDB_RECORD_FIXED 21
+
+typedef enum {
+    CRABDB_OP_CREATE_NAMESPACE = 1,
+    CRABDB_OP_ERASE_NAMESPACE,
+    CRABDB_OP_CREATE_SUB_NAMESPACE,
+    CRABDB_OP_ERASE_SUB_NAMESPACE,
+    CRABDB_OP_INSERT,
+    CRABDB_OP_UPDATE,
+    CRABDB_OP_DELETE,
+    CRABDB_OP_END,
+    CRABDB_OP_BATCH,
+    CRABDB_OP_ORDERED_INDEX,
+    CRABDB_OP_INSERT_TTL,
+    CRABDB_OP_UPDATE_TTL,
+    CRABDB_OP_BLOOM_FILTER,
+    CRABDB_OP_COMPRESSION
+} fossil_crabdb_op_t;
+
+typedef struct fossil_crabdb_persist_t {
+    char *wal_path; /**< Path of the write-ahead log */
+    char *snapshot_path; /**< Path of the snapshot */
+    FILE *wal; /**< Log opened for appending */
+    fossil_crabdb_sync_policy_t policy; /**< Flush policy for the log */
+    uint32_t group_commit_ms; /**< Flush interval for CRABDB_SYNC_GROUP */
+    uint64_t checkpoint_bytes; /**< Log size that triggers a checkpoint */
+    uint64_t wal_bytes; /**< Bytes appended since the last checkpoint */
+    uint64_t lsn; /**< Sequence number of the last logged record */
+    uint64_t last_sync_ms; /**< Time of the last flush */
+    int dirty; /**< Records written since the last flush */
+    atomic_int checkpoint_due; /**< The log outgrew checkpoint_bytes */
+    fossil_xmutex_t lock; /**< Serializes appends from concurrent writers */
+    unsigned char *buffer; /**< Scratch space for encoding records */
+    size_t buffer_size; /**< Capacity of the scratch space */
+} fossil_crabdb_persist_t;
+
+typedef struct {
+    uint64_t lsn;
+    uint8_t op;
+    const char *args[3];
+    uint32_t lengths[3];
+    uint64_t expires; /**< Deadline of the TTL ops, 0 for none */
+} fossil_crabdb_record_t;
+
+static inline int fossil_crabdb_op_has_deadline(uint8_t op) {
+    return op == CRABDB_OP_INSERT_TTL || op == CRABDB_OP_UPDATE_TTL;
+}
+
+// Slice k advances a byte that is followed by k more
+static uint32_t fossil_crabdb_crc_table[8][256];
+
+static void fossil_crabdb_crc_init(void) {
+    if (fossil_crabdb_crc_table[7][255]) return;
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xedb88320U ^ (c >> 1) : c >> 1;
+        }
+        fossil_crabdb_crc_table[0][i] = c;
+    }
+    for (int k = 1; k < 8; k++) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = fossil_crabdb_crc_table[k - 1][i];
+            fossil_crabdb_crc_table[k][i] = fossil_crabdb_crc_table[0][c & 0xff] ^ (c >> 8);
+        }
+    }
+}
+
+/**
+ * Feed bytes to a running checksum, which starts at 0xffffffff and is
+ * inverted once everything is in. Eight bytes go in per step.
+ */
+static uint32_t fossil_crabdb_crc32_extend(uint32_t crc, const unsigned char *data, size_t size) {
+    const uint32_t (*t)[256] = fossil_crabdb_crc_table;
+    for (; size >= 8; data += 8, size -= 8) {
+        crc ^= (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+        crc = t[7][crc & 0xff] ^ t[6][(crc >> 8) & 0xff] ^ t[5][(crc >> 16) & 0xff] ^ t[4][crc >> 24] ^
+              t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+    }
+    for (size_t i = 0; i < size; i++) {
+        crc = t[0][(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static uint32_t fossil_crabdb_crc32(const unsigned char *data, size_t size) {
+    return fossil_crabdb_crc32_extend(0xffffffffU, data, size) ^ 0xffffffffU;
+}
+
+static void fossil_crabdb_put_u32(unsigned char *out, uint32_t v) {
+    for (int i = 0; i < 4; i++) out[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void fossil_crabdb_put_u64(unsigned char *out, uint64_t v) {
+    for (int i = 0; i < 8; i++) out[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint32_t fossil_crabdb_get_u32(const unsigned char *in) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) v |= (uint32_t)in[i] << (8 * i);
+    return v;
+}
+
+static uint64_t fossil_crabdb_get_u64(const unsigned char *in) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= (uint64_t)in[i] << (8 * i);
+    return v;
+}
+
+static int fossil_crabdb_fsync(FILE *file) {
+    if (fflush(file) != 0) return -1;
+#ifdef _WIN32
+    return _commit(_fileno(file));
+#else
+    return fsync(fileno(file));
+#endif
+}
+
+static int fossil_crabdb_reserve_buffer(fossil_crabdb_persist_t *persist, size_t size) {
+    if (size <= persist->buffer_size) return 0;
+    size_t capacity = persist->buffer_size ? persist->buffer_size : 256;
+    while (capacity < size) capacity *= 2;
+    unsigned char *buffer = (unsigned char *)realloc(persist->buffer, capacity);
+    if (!buffer) return -1;
+    persist->buffer = buffer;
+    persist->buffer_size = capacity;
+    return 0;
+}
+
+/**
+ * Encode one framed record into the scratch buffer and write it to `file`.
+ *
+ * @return Number of bytes written, or 0 on failure.
+ */
+static size_t fossil_crabdb_write_record(fossil_crabdb_persist_t *persist, FILE *file, const fossil_crabdb_record_t *record) {
+    size_t body = FOSSIL_CRABDB_RECORD_FIXED + (fossil_crabdb_op_has_deadline(record->op) ? 8 : 0);
+    for (int i = 0; i < 3; i++) body += record->lengths[i];
+    if (body > UINT32_MAX || fossil_crabdb_reserve_buffer(persist, FOSSIL_CRABDB_RECORD_HEADER + body) != 0) return 0;
+
+    unsigned char *out = persist->buffer + FOSSIL_CRABDB_RECORD_HEADER;
+    fossil_crabdb_put_u64(out, record->lsn);
+    out[8] = record->op;
+    out += 9;
+    if (fossil_crabdb_op_has_deadline(record->op)) {
+        fossil_crabdb_put_u64(out, record->expires);
+        out += 8;
+    }
+    for (int i = 0; i < 3; i++) {
+        fossil_crabdb_put_u32(out, record->lengths[i]);
+        if (record->lengths[i]) memcpy(out + 4, record->args[i], record->lengths[i]);
+        out += 4 + record->lengths[i];
+    }
+
+    fossil_crabdb_put_u32(persist->buffer, (uint32_t)body);
+    fossil_crabdb_put_u32(persist->buffer + 4, fossil_crabdb_crc32(persist->buffer + FOSSIL_CRABDB_RECORD_HEADER, body));
+    size_t total = FOSSIL_CRABDB_RECORD_HEADER + body;
+    return fwrite(persist->buffer, 1, total, file) == total ? total : 0;
+}
+
+/**
+ * Decode the checked body of a framed record; string arguments point into
+ * the body and are NUL terminated in place.
+ *
+ * @return 1 on success, 0 on a malformed body.
+ */
+static int fossil_crabdb_decode_record(unsigned char *body, uint32_t size, fossil_crabdb_record_t *record) {
+    unsigned char *in = body;
+    unsigned char *end = body + size;
+    record->lsn = fossil_crabdb_get_u64(in);
+    record->op = in[8];
+    record->expires = 0;
+    in += 9;
+    if (fossil_crabdb_op_has_deadline(record->op)) {
+        if (end - in < 8) return 0;
+        record->expires = fossil_crabdb_get_u64(in);
+        in += 8;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (end - in < 4) return 0;
+        uint32_t length = fossil_crabdb_get_u32(in);
+        if ((uint64_t)(end - in - 4) < length) return 0;
+        // Shift the bytes over their length prefix so they can be terminated
+        memmove(in, in + 4, length);
+        in[length] = '\0';
+        record->args[i] = (const char *)in;
+        record->lengths[i] = length;
+        in += 4 + length;
+    }
+    return 1;
+}
+
+/**
+ * Read one framed record; string arguments point into the scratch buffer and
+ * are NUL terminated in place.
+ *
+ * @return 1 on success, 0 at end of file or on a torn/corrupt record.
+ */
+static int fossil_crabdb_read_record(fossil_crabdb_persist_t *persist, FILE *file, fossil_crabdb_record_t *record) {
+    unsigned char header[FOSSIL_CRABDB_RECORD_HEADER];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)) return 0;
+
+    uint32_t body = fossil_crabdb_get_u32(header);
+    if (body < FOSSIL_CRABDB_RECORD_FIXED || fossil_crabdb_reserve_buffer(persist, (size_t)body + 3) != 0) return 0;
+    if (fread(persist->buffer, 1, body, file) != body) return 0;
+    if (fossil_crabdb_crc32(persist->buffer, body) != fossil_crabdb_get_u32(header + 4)) return 0;
+    return fossil_crabdb_decode_record(persist->buffer, body, record);
+}
+
+/**
+ * Pack batch entries into the CRABDB_OP_BATCH record layout.
+ *
+ * @return Newly allocated buffer, or null when out of memory or too large.
+ */
+static unsigned char *fossil_crabdb_encode_batch(const fossil_crabdb_batch_entry_t *entries, size_t count, size_t *size) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        const char *value = entries[i].op == CRABDB_BATCH_DELETE ? "" : entries[i].value;
+        total += 9 + strlen(entries[i].key) + 1 + strlen(value) + 1;
+    }
+    if (total > UINT32_MAX) return cnullptr;
+
+    unsigned char *out = (unsigned char *)malloc(total ? total : 1);
+    if (!out) return cnullptr;
+
+    unsigned char *p = out;
+    for (size_t i = 0; i < count; i++) {
+        const char *fields[2] = { entries[i].key, entries[i].op == CRABDB_BATCH_DELETE ? "" : entries[i].value };
+        *p++ = (unsigned char)entries[i].op;
+        for (int f = 0; f < 2; f++) {
+            size_t length = strlen(fields[f]);
+            fossil_crabdb_put_u32(p, (uint32_t)length);
+            memcpy(p + 4, fields[f], length + 1);
+            p += 4 + length + 1;
+        }
+    }
+    *size = total;
+    return out;
+}
+
+// Defined with the other database operations, shared by the public calls and replay
+static fossil_crabdb_error_t fossil_crabdb_put(fossil_crabdb_t *db, const char *namespace_name, const char *key, const char *value, size_t value_length, uint64_t expires);
+static fossil_crabdb_error_t fossil_crabdb_set(fossil_crabdb_t *db, const char *namespace_name, const char *key, const char *value, size_t value_length, int retime, uint64_t expires);
+static fossil_crabdb_error_t fossil_crabdb_do_delete(fossil_crabdb_t *db, const char *namespace_name, const char *key);
+static fossil_crabdb_error_t fossil_crabdb_do_write_batch(fossil_crabdb_t *db, const char *namespace_name, const fossil_crabdb_batch_entry_t *entries, size_t count);
+static fossil_crabdb_error_t fossil_crabdb_do_get(fossil_crabdb_t *db, const char *namespace_name, const char *key, char **value, size_t *value_length);
+static fossil_crabdb_error_t fossil_crabdb_use_compression(fossil_crabdb_t *db, const char *namespace_name, size_t threshold, const char *dictionary, size_t dictionary_length);
+
+static fossil_crabdb_error_t fossil_crabdb_apply_batch(fossil_crabdb_t *db, const char *ns, const unsigned char *data, size_t size) {
+    size_t count = 0;
+    size_t capacity = 16;
+    fossil_crabdb_batch_entry_t *entries = (fossil_crabdb_batch_entry_t *)malloc(capacity * sizeof(fossil_crabdb_batch_entry_t));
+    if (!entries) return CRABDB_ERR_MEM;
+
+    const unsigned char *p = data;
+    const unsigned char *end = data + size;
+    while (p < end) {
+        if (count == capacity) {
+            fossil_crabdb_batch_entry_t *grown = (fossil_crabdb_batch_entry_t *)realloc(entries, capacity * 2 * sizeof(fossil_crabdb_batch_entry_t));
+            if (!grown) {
+                free(entries);
+                return CRABDB_ERR_MEM;
+            }
+            entries = grown;
+            capacity *= 2;
+        }
+
+        const char *fields[2];
+        entries[count].op = (fossil_crabdb_batch_op_t)*p++;
+        for (int f = 0; f < 2; f++) {
+            uint32_t length = end - p >= 4 ? fossil_crabdb_get_u32(p) : UINT32_MAX;
+            if (length == UINT32_MAX || (uint64_t)(end - p - 4) <= length || p[4 + length] != '\0') {
+                free(entries);
+                return CRABDB_ERR_IO;
+            }
+            fields[f] = (const char *)p + 4;
+            p += 4 + (size_t)length + 1;
+        }
+        entries[count].key = fields[0];
+        entries[count].value = fields[1];
+        count++;
+    }
+
+    fossil_crabdb_error_t result = fossil_crabdb_do_write_batch(db, ns, entries, count);
+    free(entries);
+    return result;
+}
+
+static fossil_crabdb_error_t fossil_crabdb_apply_record(fossil_crabdb_t *db, const fossil_crabdb_record_t *record) {
+    const char *ns = record->args[0];
+    const char *a = record->args[1];
+    const char *b = record->args[2];
+
+    switch (record->op) {
+        case CRABDB_OP_CREATE_NAMESPACE: return fossil_crabdb_create_namespace(db, ns);
+        case CRABDB_OP_ERASE_NAMESPACE: return fossil_crabdb_erase_namespace(db, ns);
+        case CRABDB_OP_CREATE_SUB_NAMESPACE: return fossil_crabdb_create_sub_namespace(db, ns, a);
+        case CRABDB_OP_ERASE_SUB_NAMESPACE: return fossil_crabdb_erase_sub_namespace(db, ns, a);
+        case CRABDB_OP_INSERT: return fossil_crabdb_put(db, ns, a, b, record->lengths[2], 0);
+        case CRABDB_OP_UPDATE: return fossil_crabdb_set(db, ns, a, b, record->lengths[2], 0, 0);
+        case CRABDB_OP_DELETE: return fossil_crabdb_do_delete(db, ns, a);
+        case CRABDB_OP_BATCH: return fossil_crabdb_apply_batch(db, ns, (const unsigned char *)a, record->lengths[1]);
+        case CRABDB_OP_ORDERED_INDEX: return fossil_crabdb_create_ordered_index(db, ns);
+        case CRABDB_OP_INSERT_TTL: return fossil_crabdb_put(db, ns, a, b, record->lengths[2], record->expires);
+        case CRABDB_OP_UPDATE_TTL: return fossil_crabdb_set(db, ns, a, b, record->lengths[2], 1, record->expires);
+        case CRABDB_OP_BLOOM_FILTER: return fossil_crabdb_create_bloom_filter(db, ns, (size_t)strtoull(a, cnullptr, 10));
+        case CRABDB_OP_COMPRESSION: return fossil_crabdb_use_compression(db, ns, (size_t)strtoull(a, cnullptr, 10), b, record->lengths[2]);
+        default: return CRABDB_ERR_INVALID_QUERY;
+    }
+}
+
+static fossil_crabdb_error_t fossil_crabdb_sync_persist(fossil_crabdb_persist_t *persist) {
+    if (!persist->dirty) return CRABDB_OK;
+    if (fossil_crabdb_fsync(persist->wal) != 0) return CRABDB_ERR_IO;
+    persist->dirty = 0;
+    persist->last_sync_ms = fossil_crabdb_now_ms();
+    return CRABDB_OK;
+}
+
+/**
+ * Append a successful mutation to the log and flush it according to the
+ * sync policy. A no-op for in-memory databases. Called with the locks of
+ * the mutation still held, so records of one key are logged in apply order.
+ */
+static void fossil_crabdb_stream_record(fossil_crabdb_t *db, fossil_crabdb_record_t *record);
+
+static fossil_crabdb_error_t fossil_crabdb_log_record(fossil_crabdb_t *db, fossil_crabdb_record_t *record) {
+    if (db->stream) fossil_crabdb_stream_record(db, record);
+    fossil_crabdb_persist_t *persist = db->persist;
+    if (!persist) return CRABDB_OK;
+
+    if (db->locks) fossil_mutex_lock(&persist->lock);
+    fossil_crabdb_error_t result = CRABDB_OK;
+    record->lsn = persist->lsn + 1;
+    size_t written = fossil_crabdb_write_record(persist, persist->wal, record);
+    if (!written) {
+        result = CRABDB_ERR_IO;
+    } else {
+        persist->lsn++;
+        persist->wal_bytes += written;
+        persist->dirty = 1;
+
+        if (persist->policy == CRABDB_SYNC_ALWAYS) {
+            result = fossil_crabdb_sync_persist(persist);
+        } else if (persist->policy == CRABDB_SYNC_GROUP) {
+            if (fossil_crabdb_now_ms() - persist->last_sync_ms >= persist->group_commit_ms) {
+                result = fossil_crabdb_sync_persist(persist);
+            }
+        } else if (fflush(persist->wal) != 0) {
+            result = CRABDB_ERR_IO;
+        }
+
+        if (persist->checkpoint_bytes && persist->wal_bytes >= persist->checkpoint_bytes) {
+            atomic_store(&persist->checkpoint_due, 1);
+        }
+    }
+    if (db->locks) fossil_mutex_unlock(&persist->lock);
+    return result;
+}
+
+static fossil_crabdb_error_t fossil_crabdb_log(fossil_crabdb_t *db, fossil_crabdb_op_t op, const char *ns, const char *a, const char *b) {
+    if (!db->persist && !db->stream) return CRABDB_OK;
+
+    fossil_crabdb_record_t record = { 0, (uint8_t)op, { ns, a, b }, { 0, 0, 0 }, 0 };
+    for (int i = 0; i < 3; i++) {
+        record.lengths[i] = record.args[i] ? (uint32_t)strlen(record.args[i]) : 0;
+    }
+    return fossil_crabdb_log_record(db, &record);
+}
+
+/**
+ * Log a write of `value_length` bytes, which may hold NUL bytes.
+ */
+static fossil_crabdb_error_t fossil_crabdb_log_value(fossil_crabdb_t *db, fossil_crabdb_op_t op, const char *ns, const char *key, const char *value, size_t value_length, uint64_t expires) {
+    if (!db->persist && !db->stream) return CRABDB_OK;
+    if (value_length > UINT32_MAX) return CRABDB_ERR_IO;
+
+    fossil_crabdb_record_t record = { 0, (uint8_t)op, { ns, key, value }, { (uint32_t)strlen(ns), (uint32_t)strlen(key), (uint32_t)value_length }, expires };
+    return fossil_crabdb_log_record(db, &record);
+}
+
+/**
+ * Run a checkpoint the log asked for once the mutation has dropped its locks.
+ */
+static fossil_crabdb_error_t fossil_crabdb_after_write(fossil_crabdb_t *db, fossil_crabdb_error_t result) {
+    if (result == CRABDB_OK && db->persist && atomic_exchange(&db->persist->checkpoint_due, 0)) {
+        return fossil_crabdb_checkpoint(db);
+    }
+    return result;
+}
+
+/**
+ * Sweep the clock of a write-locked stripe until it fits its budget, never
+ * evicting `keep`. Each eviction is logged as a delete. The ordered index
+ * must not be locked by the caller.
+ */
+static fossil_crabdb_error_t fossil_crabdb_stripe_evict(fossil_crabdb_t *db, fossil_crabdb_namespace_t *ns, fossil_crabdb_stripe_t *stripe, const fossil_crabdb_keyvalue_t *keep) {
+    fossil_crabdb_clock_t *clock = stripe->clock;
+    fossil_crabdb_error_t result = CRABDB_OK;
+    uint64_t now = 0;
+    uint64_t sequence = 0;
+    int locked = 0;
+
+    while (clock && stripe->resident > clock->budget && clock->count > (keep ? 1u : 0u)) {
+        if (clock->hand >= clock->count) clock->hand = 0;
+        fossil_crabdb_keyvalue_t *kv = clock->ring[clock->hand];
+        if (kv == keep || atomic_exchange_explicit(&clock->referenced[clock->hand], 0, memory_order_relaxed)) {
+            clock->hand++;
+            continue;
+        }
+
+        // An expired pair is already gone from the log's point of view
+        fossil_crabdb_error_t logged = CRABDB_OK;
+        if (!fossil_crabdb_expired(kv, &now)) {
+            if (!sequence) sequence = fossil_crabdb_commit(db);
+            if (fossil_crabdb_retaining(db)) {
+                // Open snapshots may still read the pair; stay over budget
+                // rather than take it from them
+                fossil_crabdb_version_t *retired = fossil_crabdb_retire(ns, stripe, kv, sequence);
+                if (!retired) {
+                    if (result == CRABDB_OK) result = CRABDB_ERR_MEM;
+                    break;
+                }
+                fossil_crabdb_history_push(db, stripe, retired);
+            }
+            logged = fossil_crabdb_log(db, CRABDB_OP_DELETE, ns->name, kv->key, cnullptr);
+        }
+        if (result == CRABDB_OK) result = logged;
+        if (ns->ordered && !locked) {
+            fossil_crabdb_ordered_lock(ns->ordered);
+            locked = 1;
+        }
+        // The last ring entry takes the freed place and so goes behind the
+        // hand, like a pair added since the sweep began
+        fossil_crabdb_purge_pair(ns, stripe, kv);
+        stripe->evictions++;
+        clock->hand++;
+    }
+
+    if (locked) fossil_crabdb_ordered_unlock(ns->ordered);
+    return result;
+}
+
+static void fossil_crabdb_persist_free(fossil_crabdb_persist_t *persist) {
+    if (!persist) return;
+    if (persist->wal) fclose(persist->wal);
+    fossil_mutex_erase(&persist->lock);
+    free(persist->wal_path);
+    free(persist->snapshot_path);
+    free(persist->buffer);
+    free(persist);
+}
+
+static char *fossil_crabdb_path_with(const char *path, const char *suffix) {
+    size_t length = strlen(path);
+    size_t suffix_length = strlen(suffix);
+    char *out = (char *)malloc(length + suffix_length + 1);
+    if (!out) return cnullptr;
+    memcpy(out, path, length);
+    memcpy(out + length, suffix, suffix_length + 1);
+    return out;
+}
+
+static fossil_crabdb_error_t fossil_crabdb_load_snapshot(fossil_crabdb_t *db, fossil_crabdb_persist_t *persist) {
+    FILE *file = fopen(persist->snapshot_path, "rb");
+    if (!file) return CRABDB_OK; // No snapshot yet
+
+    unsigned char header[FOSSIL_CRABDB_MAGIC_SIZE + 8];
+    fossil_crabdb_error_t result = CRABDB_ERR_IO;
+    if (fread(header, 1, sizeof(header), file) == sizeof(header) &&
+        memcmp(header, FOSSIL_CRABDB_SNAPSHOT_MAGIC, FOSSIL_CRABDB_MAGIC_SIZE) == 0) {
+        persist->lsn = fossil_crabdb_get_u64(header + FOSSIL_CRABDB_MAGIC_SIZE);
+
+        fossil_crabdb_record_t record;
+        while (fossil_crabdb_read_record(persist, file, &record)) {
+            if (record.op == CRABDB_OP_END) {
+                result = CRABDB_OK;
+                break;
+            }
+            if (fossil_crabdb_apply_record(db, &record) != CRABDB_OK) break;
+        }
+    }
+
+    fclose(file);
+    return result;
+}
+
+static fossil_crabdb_error_t fossil_crabdb_replay_wal(fossil_crabdb_t *db, fossil_crabdb_persist_t *persist) {
+    FILE *file = fopen(persist->wal_path, "r+b");
+    if (!file) return CRABDB_OK; // No log yet
+
+    unsigned char magic[FOSSIL_CRABDB_MAGIC_SIZE];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, FOSSIL_CRABDB_WAL_MAGIC, FOSSIL_CRABDB_MAGIC_SIZE) != 0) {
+        fclose(file);
+        return CRABDB_ERR_IO;
+    }
+
+    long good = FOSSIL_CRABDB_MAGIC_SIZE;
+    fossil_crabdb_record_t record;
+    while (fossil_crabdb_read_record(persist, file, &record)) {
+        if (record.lsn > persist->lsn) {
+            // Replayed operations may legitimately fail the same way they did
+            // not at the time, e.g. after a crash mid-checkpoint; keep going
+            fossil_crabdb_apply_record(db, &record);
+            persist->lsn = record.lsn;
+        }
+        good = ftell(file);
+    }
+    persist->wal_bytes = (uint64_t)good;
+
+    // Drop a torn tail so new records are appended right after the last good one
+    int truncated = 0;
+    fseek(file, 0, SEEK_END);
+    if (ftell(file) != good) {
+#ifdef _WIN32
+        truncated = _chsize(_fileno(file), good);
+#else
+        truncated = ftruncate(fileno(file), (off_t)good);
+#endif
+    }
+    fclose(file);
+    return truncated == 0 ? CRABDB_OK : CRABDB_ERR_IO;
+}
+
+static fossil_crabdb_error_t fossil_crabdb_start_wal(fossil_crabdb_persist_t *persist, int truncate) {
+    if (persist->wal) fclose(persist->wal);
+
+    persist->wal = fopen(persist->wal_path, truncate ? "wb" : "ab");
+    if (!persist->wal) return CRABDB_ERR_IO;
+
+    if (truncate || ftell(persist->wal) == 0) {
+        if (fwrite(FOSSIL_CRABDB_WAL_MAGIC, 1, FOSSIL_CRABDB_MAGIC_SIZE, persist->wal) != FOSSIL_CRABDB_MAGIC_SIZE ||
+            fossil_crabdb_fsync(persist->wal) != 0) {
+            return CRABDB_ERR_IO;
+        }
+        persist->wal_bytes = FOSSIL_CRABDB_MAGIC_SIZE;
+    }
+    persist->last_sync_ms = fossil_crabdb_now_ms();
+    persist->dirty = 0;
+    return CRABDB_OK;
+}
+
+fossil_crabdb_error_t fossil_crabdb_persist_open(fossil_crabdb_t *db, const char *path, fossil_crabdb_sync_policy_t policy, uint32_t group_commit_ms, uint64_t checkpoint_bytes) {
+    if (!db || !path) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+    if (db->persist) return CRABDB_ERR_IO;
+
+    fossil_crabdb_crc_init();
+
+    fossil_crabdb_persist_t *persist = (fossil_crabdb_persist_t *)calloc(1, sizeof(fossil_crabdb_persist_t));
+    if (!persist) return CRABDB_ERR_MEM;
+    persist->wal_path = fossil_crabdb_path_with(path, ".wal");
+    persist->snapshot_path = fossil_crabdb_path_with(path, ".snapshot");
+    persist->policy = policy;
+    persist->group_commit_ms = group_commit_ms;
+    persist->checkpoint_bytes = checkpoint_bytes;
+    atomic_init(&persist->checkpoint_due, 0);
+    fossil_mutex_create(&persist->lock);
+    if (!persist->wal_path || !persist->snapshot_path) {
+        fossil_crabdb_persist_free(persist);
+        return CRABDB_ERR_MEM;
+    }
+
+    fossil_crabdb_error_t result = fossil_crabdb_load_snapshot(db, persist);
+    if (result == CRABDB_OK) result = fossil_crabdb_replay_wal(db, persist);
+    if (result == CRABDB_OK) result = fossil_crabdb_start_wal(persist, 0);
+    if (result != CRABDB_OK) {
+        fossil_crabdb_persist_free(persist);
+        return result;
+    }
+
+    db->persist = persist;
+    return CRABDB_OK;
+}
+
+fossil_crabdb_error_t fossil_crabdb_sync(fossil_crabdb_t *db) {
+    if (!db) return CRABDB_ERR_MEM;
+    fossil_crabdb_persist_t *persist = db->persist;
+    if (!persist) return CRABDB_OK;
+
+    if (db->locks) fossil_mutex_lock(&persist->lock);
+    fossil_crabdb_error_t result = fossil_crabdb_sync_persist(persist);
+    if (db->locks) fossil_mutex_unlock(&persist->lock);
+    return result;
+}
+
+fossil_crabdb_error_t fossil_crabdb_persist_close(fossil_crabdb_t *db) {
+    if (!db) return CRABDB_ERR_MEM;
+    if (!db->persist) return CRABDB_OK;
+
+    fossil_crabdb_error_t result = fossil_crabdb_sync(db);
+    fossil_crabdb_persist_free(db->persist);
+    db->persist = cnullptr;
+    return result;
+}
+
+/**
+ * Write the records that rebuild a namespace, then those of the namespaces
+ * nested in it, so every parent precedes its children.
+ */
+static int fossil_crabdb_write_namespace(fossil_crabdb_persist_t *persist, FILE *file, const fossil_crabdb_namespace_t *ns, uint64_t *now) {
+    fossil_crabdb_record_t record = { persist->lsn, CRABDB_OP_CREATE_NAMESPACE, { ns->name, cnullptr, cnullptr }, { (uint32_t)strlen(ns->name), 0, 0 }, 0 };
+    int ok = fossil_crabdb_write_record(persist, file, &record) != 0;
+
+    // Before the pairs, which are logged decompressed, so recovery
+    // compresses each one as it goes in
+    if (ok && ns->codec) {
+        char threshold[24];
+        int length = snprintf(threshold, sizeof(threshold), "%zu", ns->codec->threshold);
+        fossil_crabdb_record_t codec = { persist->lsn, CRABDB_OP_COMPRESSION, { ns->name, threshold, (const char *)ns->codec->dictionary },
+                                         { (uint32_t)strlen(ns->name), (uint32_t)length, (uint32_t)ns->codec->dictionary_length }, 0 };
+        ok = fossil_crabdb_write_record(persist, file, &codec) != 0;
+    }
+
+    for (size_t i = 0; ok && i < ns->stripe_count; i++) {
+        for (fossil_crabdb_keyvalue_t *kv = ns->stripes[i].data; ok && kv; kv = kv->next) {
+            if (fossil_crabdb_expired(kv, now)) continue;
+            char *plain = kv->raw_length ? fossil_crabdb_value_copy(ns->codec, kv) : cnullptr;
+            if (kv->raw_length && !plain) {
+                ok = 0;
+                break;
+            }
+            record.op = kv->timer ? CRABDB_OP_INSERT_TTL : CRABDB_OP_INSERT;
+            record.expires = kv->timer ? kv->timer->expires : 0;
+            record.args[1] = kv->key;
+            record.lengths[1] = (uint32_t)kv->key_length;
+            record.args[2] = plain ? plain : kv->value;
+            record.lengths[2] = (uint32_t)fossil_crabdb_plain_length(kv);
+            ok = fossil_crabdb_write_record(persist, file, &record) != 0;
+            free(plain);
+        }
+    }
+
+    // After the pairs, so recovery builds the indexes in one bulk pass
+    if (ok && ns->ordered) {
+        fossil_crabdb_record_t ordered = { persist->lsn, CRABDB_OP_ORDERED_INDEX, { ns->name, cnullptr, cnullptr }, { (uint32_t)strlen(ns->name), 0, 0 }, 0 };
+        ok = fossil_crabdb_write_record(persist, file, &ordered) != 0;
+    }
+    if (ok && ns->stripes[0].bloom) {
+        char bits[24];
+        int length = snprintf(bits, sizeof(bits), "%zu", ns->stripes[0].bloom->bits_per_key);
+        fossil_crabdb_record_t bloom = { persist->lsn, CRABDB_OP_BLOOM_FILTER, { ns->name, bits, cnullptr }, { (uint32_t)strlen(ns->name), (uint32_t)length, 0 }, 0 };
+        ok = fossil_crabdb_write_record(persist, file, &bloom) != 0;
+    }
+
+    for (size_t i = 0; ok && i < ns->sub_namespace_count; i++) {
+        ok = fossil_crabdb_write_namespace(persist, file, ns->sub_namespaces[i], now);
+    }
+    return ok;
+}
+
+/**
+ * Write the snapshot and restart the log; the caller holds the database
+ * lock exclusively.
+ */
+static fossil_crabdb_error_t fossil_crabdb_write_snapshot(fossil_crabdb_t *db, fossil_crabdb_persist_t *persist) {
+    char *tmp_path = fossil_crabdb_path_with(persist->snapshot_path, ".tmp");
+    if (!tmp_path) return CRABDB_ERR_MEM;
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        free(tmp_path);
+        return CRABDB_ERR_IO;
+    }
+
+    uint64_t now = 0;
+    unsigned char header[FOSSIL_CRABDB_MAGIC_SIZE + 8];
+    memcpy(header, FOSSIL_CRABDB_SNAPSHOT_MAGIC, FOSSIL_CRABDB_MAGIC_SIZE);
+    fossil_crabdb_put_u64(header + FOSSIL_CRABDB_MAGIC_SIZE, persist->lsn);
+    int ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+    // Top-level namespaces each bring their subtree, parents first
+    for (fossil_crabdb_namespace_t *ns = db->namespaces; ok && ns; ns = ns->next) {
+        if (!ns->parent) ok = fossil_crabdb_write_namespace(persist, file, ns, &now);
+    }
+
+    if (ok) {
+        fossil_crabdb_record_t end = { persist->lsn, CRABDB_OP_END, { cnullptr, cnullptr, cnullptr }, { 0, 0, 0 }, 0 };
+        ok = fossil_crabdb_write_record(persist, file, &end) != 0;
+    }
+    if (ok) ok = fossil_crabdb_fsync(file) == 0;
+    if (fclose(file) != 0) ok = 0;
+
+    // Publish the snapshot atomically, then start a fresh log after it
+    if (ok) {
+#ifdef _WIN32
+        ok = MoveFileExA(tmp_path, persist->snapshot_path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        ok = rename(tmp_path, persist->snapshot_path) == 0;
+#endif
+    }
+    if (!ok) remove(tmp_path);
+    free(tmp_path);
+    if (!ok) return CRABDB_ERR_IO;
+
+    return fossil_crabdb_start_wal(persist, 1);
+}
+
+fossil_crabdb_error_t fossil_crabdb_checkpoint(fossil_crabdb_t *db) {
+    if (!db) return CRABDB_ERR_MEM;
+    fossil_crabdb_persist_t *persist = db->persist;
+    if (!persist) return CRABDB_ERR_IO;
+
+    fossil_crabdb_write_lock(db);
+    fossil_crabdb_error_t result = fossil_crabdb_write_snapshot(db, persist);
+    fossil_crabdb_write_unlock(db);
+    return result;
+}
+
+// *****************************************************************************
+// Replication
+// *****************************************************************************
+
+/*
+ * A change stream is a log whose file is a descriptor shared with a
+ * follower: a magic, then framed records as in the write-ahead log. It
+ * opens with the records that rebuild the contents, numbered with sequence
+ * 0 and closed by CRABDB_OP_END, and goes on with one record per mutation
+ * numbered from 1. A bulk load is followed by a fresh copy of the contents
+ * in the same form. The follower treats an insert of a key it already has
+ * as an update, so such copies converge on the leader's contents.
+ *
+ * The follower reads whatever has arrived into a buffer, applies every
+ * complete record in it and keeps a torn tail for the next poll. Runs of
+ * plain inserts, updates and deletes on one namespace go through one write
+ * batch; a run that fails applied nothing and is replayed record by record,
+ * as the asynchronous queue does.
+ */
+
+#define FOSSIL_CRABDB_STREAM_MAGIC "CRABSTR1"
+#define FOSSIL_CRABDB_FOLLOW_READ 65536 // Bytes requested from the descriptor per read
+#define FOSSIL_CRABDB_FOLLOW_RUN 256 // Records applied as one write batch at most
+
+typedef struct fossil_crabdb_follower_t {
+    int fd; /**< Duplicate of the descriptor the stream is read from */
+    int file; /**< The descriptor is a regular file, whose end only means no data yet */
+    int started; /**< The magic has been read */
+    int broken; /**< The stream is unreadable or corrupt */
+    unsigned char *buffer; /**< Bytes read and not applied yet */
+    size_t size; /**< Bytes in `buffer` */
+    size_t capacity; /**< Room in `buffer` */
+    fossil_xmutex_t lock; /**< Guards the figures below */
+    fossil_crabdb_follower_stats_t stats; /**< Figures reported by fossil_crabdb_follower_stats */
+    size_t buffered; /**< Copy of `size` for the figures */
+    uint64_t caught_up_ms; /**< When the follower last had nothing left to apply */
+} fossil_crabdb_follower_t;
+
+/**
+ * Send one record to the followers. A write that fails closes the stream,
+ * so a follower that went away does not fail the writes of the leader.
+ */
+static void fossil_crabdb_stream_record(fossil_crabdb_t *db, fossil_crabdb_record_t *record) {
+    fossil_crabdb_persist_t *stream = db->stream;
+
+    if (db->locks) fossil_mutex_lock(&stream->lock);
+    if (stream->wal) {
+        record->lsn = stream->lsn + 1;
+        if (fossil_crabdb_write_record(stream, stream->wal, record) && fflush(stream->wal) == 0) {
+            stream->lsn++;
+        } else {
+            fclose(stream->wal);
+            stream->wal = cnullptr;
+        }
+    }
+    if (db->locks) fossil_mutex_unlock(&stream->lock);
+}
+
+/**
+ * Write the records that rebuild the whole database to the stream; the
+ * caller holds the database lock exclusively.
+ */
+static void fossil_crabdb_stream_contents(fossil_crabdb_t *db, fossil_crabdb_persist_t *stream) {
+    if (!stream->wal) return;
+
+    uint64_t now = 0;
+    int ok = 1;
+    for (fossil_crabdb_namespace_t *ns = db->namespaces; ok && ns; ns = ns->next) {
+        if (!ns->parent) ok = fossil_crabdb_write_namespace(stream, stream->wal, ns, &now);
+    }
+    if (ok) {
+        fossil_crabdb_record_t end = { stream->lsn, CRABDB_OP_END, { cnullptr, cnullptr, cnullptr }, { 0, 0, 0 }, 0 };
+        ok = fossil_crabdb_write_record(stream, stream->wal, &end) != 0;
+    }
+    if (!ok || fflush(stream->wal) != 0) {
+        fclose(stream->wal);
+        stream->wal = cnullptr;
+    }
+}
+
+static int fossil_crabdb_dup(int fd) {
+#ifdef _WIN32
+    return _dup(fd);
+#else
+    return dup(fd);
+#endif
+}
+
+static void fossil_crabdb_close_fd(int fd) {
+#ifdef _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
+fossil_crabdb_error_t fossil_crabdb_stream_open(fossil_crabdb_t *db, int fd) {
+    if (!db) return CRABDB_ERR_MEM;
+    if (db->stream || fd < 0) return CRABDB_ERR_IO;
+
+    fossil_crabdb_crc_init();
+
+    fossil_crabdb_persist_t *stream = (fossil_crabdb_persist_t *)calloc(1, sizeof(fossil_crabdb_persist_t));
+    if (!stream) return CRABDB_ERR_MEM;
+    atomic_init(&stream->checkpoint_due, 0);
+    fossil_mutex_create(&stream->lock);
+    int own = fossil_crabdb_dup(fd);
+    if (own >= 0) {
+#ifdef _WIN32
+        stream->wal = _fdopen(own, "wb");
+#else
+        stream->wal = fdopen(own, "wb");
+#endif
+        if (!stream->wal) fossil_crabdb_close_fd(own);
+    }
+    if (!stream->wal || fwrite(FOSSIL_CRABDB_STREAM_MAGIC, 1, FOSSIL_CRABDB_MAGIC_SIZE, stream->wal) != FOSSIL_CRABDB_MAGIC_SIZE) {
+        fossil_crabdb_persist_free(stream);
+        return CRABDB_ERR_IO;
+    }
+
+    // No writer can slip in between the copy and the first record after it
+    fossil_crabdb_write_lock(db);
+    fossil_crabdb_stream_contents(db, stream);
+    fossil_crabdb_error_t result = stream->wal ? CRABDB_OK : CRABDB_ERR_IO;
+    if (result == CRABDB_OK) db->stream = stream;
+    fossil_crabdb_write_unlock(db);
+
+    if (result != CRABDB_OK) fossil_crabdb_persist_free(stream);
+    return result;
+}
+
+fossil_crabdb_error_t fossil_crabdb_stream_close(fossil_crabdb_t *db) {
+    if (!db) return CRABDB_ERR_MEM;
+    if (!db->stream) return CRABDB_OK;
+
+    fossil_crabdb_write_lock(db);
+    fossil_crabdb_persist_t *stream = db->stream;
+    db->stream = cnullptr;
+    fossil_crabdb_write_unlock(db);
+
+    fossil_crabdb_error_t result = stream->wal ? CRABDB_OK : CRABDB_ERR_IO;
+    fossil_crabdb_persist_free(stream);
+    return result;
+}
+
+fossil_crabdb_error_t fossil_crabdb_follow(fossil_crabdb_t *db, int fd) {
+    if (!db) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+    if (db->follower || fd < 0) return CRABDB_ERR_IO;
+
+    fossil_crabdb_crc_init();
+
+    fossil_crabdb_follower_t *follower = (fossil_crabdb_follower_t *)calloc(1, sizeof(fossil_crabdb_follower_t));
+    if (!follower) return CRABDB_ERR_MEM;
+    follower->fd = fossil_crabdb_dup(fd);
+    if (follower->fd < 0) {
+        free(follower);
+        return CRABDB_ERR_IO;
+    }
+#ifdef _WIN32
+    struct _stat64 st;
+    follower->file = _fstat64(follower->fd, &st) == 0 && (st.st_mode & _S_IFREG);
+#else
+    struct stat st;
+    follower->file = fstat(follower->fd, &st) == 0 && S_ISREG(st.st_mode);
+#endif
+    fossil_mutex_create(&follower->lock);
+    follower->caught_up_ms = fossil_crabdb_now_ms();
+    db->follower = follower;
+    return CRABDB_OK;
+}
+
+fossil_crabdb_error_t fossil_crabdb_unfollow(fossil_crabdb_t *db) {
+    if (!db) return CRABDB_ERR_MEM;
+    fossil_crabdb_follower_t *follower = db->follower;
+    if (!follower) return CRABDB_OK;
+
+    db->follower = cnullptr;
+    fossil_crabdb_close_fd(follower->fd);
+    fossil_mutex_erase(&follower->lock);
+    free(follower->buffer);
+    free(follower);
+    return CRABDB_OK;
+}
+
+/**
+ * Bytes written to the descriptor that the follower has not read yet.
+ */
+static uint64_t fossil_crabdb_follower_pending(const fossil_crabdb_follower_t *follower) {
+#ifdef _WIN32
+    if (!follower->file) return 0;
+    __int64 at = _telli64(follower->fd);
+    __int64 end = _filelengthi64(follower->fd);
+    return at >= 0 && end > at ? (uint64_t)(end - at) : 0;
+#else
+    if (follower->file) {
+        struct stat st;
+        off_t at = lseek(follower->fd, 0, SEEK_CUR);
+        return at >= 0 && fstat(follower->fd, &st) == 0 && st.st_size > at ? (uint64_t)(st.st_size - at) : 0;
+    }
+    int queued = 0;
+    return ioctl(follower->fd, FIONREAD, &queued) == 0 && queued > 0 ? (uint64_t)queued : 0;
+#endif
+}
+
+/**
+ * Read what has arrived, waiting up to `timeout_ms` for something.
+ *
+ * @return Bytes read, 0 if none, or -1 once the leader closed the stream
+ *         or the descriptor failed, the latter marked as broken.
+ */
+static long fossil_crabdb_follower_read(fossil_crabdb_follower_t *follower, int timeout_ms) {
+    if (follower->capacity - follower->size < FOSSIL_CRABDB_FOLLOW_READ) {
+        size_t capacity = follower->capacity ? follower->capacity : FOSSIL_CRABDB_FOLLOW_READ;
+        while (capacity - follower->size < FOSSIL_CRABDB_FOLLOW_READ) capacity *= 2;
+        unsigned char *buffer = (unsigned char *)realloc(follower->buffer, capacity);
+        if (!buffer) return 0;
+        follower->buffer = buffer;
+        follower->capacity = capacity;
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+#ifdef _WIN32
+        int got = _read(follower->fd, follower->buffer + follower->size, FOSSIL_CRABDB_FOLLOW_READ);
+#else
+        if (!follower->file) {
+            struct pollfd ready = { follower->fd, POLLIN, 0 };
+            int waited = poll(&ready, 1, timeout_ms);
+            if (waited == 0 || (waited < 0 && errno == EINTR)) return 0;
+        }
+        ssize_t got = read(follower->fd, follower->buffer + follower->size, FOSSIL_CRABDB_FOLLOW_READ);
+        if (got < 0 && (errno == EINTR || errno == EAGAIN)) return 0;
+#endif
+        if (got < 0) {
+            follower->broken = 1;
+            return -1;
+        }
+        if (got > 0) {
+            follower->size += (size_t)got;
+            return (long)got;
+        }
+        if (!follower->file) return -1;
+
+        // The end of a file only means the leader has not written more yet
+        if (attempt || timeout_ms <= 0) break;
+#ifdef _WIN32
+        Sleep((DWORD)timeout_ms);
+#else
+        poll(cnullptr, 0, timeout_ms);
+#endif
+    }
+    return 0;
+}
+
+/**
+ * Apply one record. An insert of a key that is already there, as in a
+ * fresh copy of the contents, sets the pair instead.
+ */
+static fossil_crabdb_error_t fossil_crabdb_follower_apply(fossil_crabdb_t *db, const fossil_crabdb_record_t *record) {
+    if (record->op == CRABDB_OP_END) return CRABDB_OK;
+
+    fossil_crabdb_error_t result = fossil_crabdb_apply_record(db, record);
+    if (result == CRABDB_ERR_KEY_NOT_FOUND && (record->op == CRABDB_OP_INSERT || record->op == CRABDB_OP_INSERT_TTL)) {
+        result = fossil_crabdb_set(db, record->args[0], record->args[1], record->args[2], record->lengths[2], 1, record->expires);
+    }
+    return result;
+}
+
+/**
+ * Whether a record can go into a write batch: a plain pair change whose
+ * value holds no NUL byte, since batch entries are strings.
+ */
+static int fossil_crabdb_follower_batches(const fossil_crabdb_record_t *record) {
+    return (record->op == CRABDB_OP_INSERT || record->op == CRABDB_OP_UPDATE || record->op == CRABDB_OP_DELETE) &&
+           strlen(record->args[2]) == record->lengths[2];
+}
+
+/**
+ * Apply a run of records on one namespace, as one write batch when there
+ * is more than one and every record can join it.
+ *
+ * @return Whether a write batch took the whole run.
+ */
+static int fossil_crabdb_follower_run(fossil_crabdb_t *db, const fossil_crabdb_record_t *run, size_t count) {
+    if (count > 1) {
+        fossil_crabdb_batch_entry_t entries[FOSSIL_CRABDB_FOLLOW_RUN];
+        for (size_t i = 0; i < count; i++) {
+            entries[i].op = run[i].op == CRABDB_OP_INSERT ? CRABDB_BATCH_INSERT :
+                            run[i].op == CRABDB_OP_UPDATE ? CRABDB_BATCH_UPDATE : CRABDB_BATCH_DELETE;
+            entries[i].key = run[i].args[1];
+            entries[i].value = run[i].args[2];
+        }
+        if (fossil_crabdb_do_write_batch(db, run[0].args[0], entries, count) == CRABDB_OK) return 1;
+    }
+    // Replayed operations may fail as they did not on the leader when the
+    // follower did not start empty; keep going, as recovery does
+    for (size_t i = 0; i < count; i++) fossil_crabdb_follower_apply(db, &run[i]);
+    return 0;
+}
+
+fossil_crabdb_error_t fossil_crabdb_follower_poll(fossil_crabdb_t *db, int timeout_ms) {
+    if (!db) return CRABDB_ERR_MEM;
+    fossil_crabdb_follower_t *follower = db->follower;
+    if (!follower) return CRABDB_ERR_IO;
+    if (follower->broken) return CRABDB_ERR_IO;
+
+    int ended = fossil_crabdb_follower_read(follower, timeout_ms) < 0;
+    unsigned char *in = follower->buffer;
+    unsigned char *end = follower->buffer + follower->size;
+    if (!follower->started && end - in >= FOSSIL_CRABDB_MAGIC_SIZE) {
+        if (memcmp(in, FOSSIL_CRABDB_STREAM_MAGIC, FOSSIL_CRABDB_MAGIC_SIZE) != 0 &&
+            memcmp(in, FOSSIL_CRABDB_WAL_MAGIC, FOSSIL_CRABDB_MAGIC_SIZE) != 0) {
+            follower->broken = 1;
+        }
+        follower->started = 1;
+        in += FOSSIL_CRABDB_MAGIC_SIZE;
+    }
+
+    fossil_crabdb_record_t run[FOSSIL_CRABDB_FOLLOW_RUN];
+    size_t count = 0;
+    uint64_t applied = 0;
+    uint64_t records = 0;
+    uint64_t batches = 0;
+    while (follower->started && !follower->broken && end - in >= FOSSIL_CRABDB_RECORD_HEADER) {
+        uint32_t body = fossil_crabdb_get_u32(in);
+        if ((uint64_t)(end - in - FOSSIL_CRABDB_RECORD_HEADER) < body) break; // Not all here yet
+
+        fossil_crabdb_record_t record;
+        unsigned char *data = in + FOSSIL_CRABDB_RECORD_HEADER;
+        if (body < FOSSIL_CRABDB_RECORD_FIXED || fossil_crabdb_crc32(data, body) != fossil_crabdb_get_u32(in + 4) ||
+            !fossil_crabdb_decode_record(data, body, &record)) {
+            follower->broken = 1;
+            break;
+        }
+        in = data + body;
+
+        int joins = fossil_crabdb_follower_batches(&record);
+        if (count && (!joins || count == FOSSIL_CRABDB_FOLLOW_RUN || strcmp(run[0].args[0], record.args[0]) != 0)) {
+            batches += (uint64_t)fossil_crabdb_follower_run(db, run, count);
+            count = 0;
+        }
+        if (joins) {
+            run[count++] = record;
+        } else {
+            fossil_crabdb_follower_apply(db, &record);
+        }
+        if (record.lsn > applied) applied = record.lsn;
+        records++;
+    }
+    if (count) batches += (uint64_t)fossil_crabdb_follower_run(db, run, count);
+
+    follower->size = (size_t)(end - in);
+    memmove(follower->buffer, in, follower->size);
+
+    fossil_mutex_lock(&follower->lock);
+    if (applied > follower->stats.applied) follower->stats.applied = applied;
+    follower->stats.records += records;
+    follower->stats.batches += batches;
+    follower->stats.closed = ended && !follower->broken;
+    follower->buffered = follower->size;
+    if (!follower->size && !fossil_crabdb_follower_pending(follower)) follower->caught_up_ms = fossil_crabdb_now_ms();
+    fossil_mutex_unlock(&follower->lock);
+
+    return follower->broken || ended ? CRABDB_ERR_IO : CRABDB_OK;
+}
+
+fossil_crabdb_error_t fossil_crabdb_follower_stats(fossil_crabdb_t *db, fossil_crabdb_follower_stats_t *stats) {
+    if (!db || !stats) return CRABDB_ERR_MEM;
+    fossil_crabdb_follower_t *follower = db->follower;
+    if (!follower) return CRABDB_ERR_IO;
+
+    fossil_mutex_lock(&follower->lock);
+    *stats = follower->stats;
+    stats->lag_bytes = follower->buffered + fossil_crabdb_follower_pending(follower);
+    stats->lag_ms = stats->lag_bytes ? fossil_crabdb_now_ms() - follower->caught_up_ms : 0;
+    fossil_mutex_unlock(&follower->lock);
+    return CRABDB_OK;
+}
+
+// *****************************************************************************
+// Mapped images
+// *****************************************************************************
+
+/*
+ * Image layout, all integers little endian and every record 8-byte aligned:
+ *
+ *     header    magic[8] | u32 version | u32 namespace_count |
+ *               u64 ns_slot_count | u64 ns_slots_offset | u64 file_size
+ *     entry     u32 key_len | u32 value_len | key \0 | value \0
+ *     namespace u64 hash | u64 name_len | u64 key_count | u64 slot_count |
+ *               u64 slots_offset | u64 entries_offset | name \0
+ *     slot      u64 hash | u64 record_offset (0 = empty)
+ *
+ * Entries of a namespace are written sorted by key, followed by its slot
+ * table and its namespace record; the namespace slot table comes last.
+ */
+
+#define FOSSIL_CRABDB_IMAGE_MAGIC "CRABIMG1"
+#define FOSSIL_CRABDB_IMAGE_VERSION 1
+#define FOSSIL_CRABDB_IMAGE_HEADER 40
+#define FOSSIL_CRABDB_IMAGE_NAMESPACE 48
+#define FOSSIL_CRABDB_IMAGE_ENTRY 8
+#define FOSSIL_CRABDB_IMAGE_SLOT 16
+
+typedef struct fossil_crabdb_image_t {
+    const unsigned char *base; /**< Start of the mapping */
+    uint64_t size; /**< Size of the mapping */
+    uint64_t ns_slot_count; /**< Slots in the namespace table */
+    uint64_t ns_slots_offset; /**< Offset of the namespace table */
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} fossil_crabdb_image_t;
+
+typedef struct {
+    FILE *file;
+    uint64_t offset;
+    int ok;
+} fossil_crabdb_image_writer_t;
+
+static void fossil_crabdb_image_write(fossil_crabdb_image_writer_t *w, const void *data, size_t size) {
+    if (w->ok && size && fwrite(data, 1, size, w->file) != size) w->ok = 0;
+    w->offset += size;
+}
+
+static void fossil_crabdb_image_pad(fossil_crabdb_image_writer_t *w) {
+    static const unsigned char zeros[8] = { 0 };
+    fossil_crabdb_image_write(w, zeros, (size_t)((8 - (w->offset & 7)) & 7));
+}
+
+static void fossil_crabdb_image_write_u64(fossil_crabdb_image_writer_t *w, uint64_t v) {
+    unsigned char out[8];
+    fossil_crabdb_put_u64(out, v);
+    fossil_crabdb_image_write(w, out, sizeof(out));
+}
+
+static uint64_t fossil_crabdb_image_slot_count(uint64_t count) {
+    uint64_t slots = 8;
+    while (slots < count * 2) slots *= 2;
+    return slots;
+}
+
+/**
+ * Write an open-addressing slot table for `count` records.
+ */
+static void fossil_crabdb_image_write_slots(fossil_crabdb_image_writer_t *w, const uint64_t *hashes, const uint64_t *offsets, uint64_t count, uint64_t slot_count) {
+    unsigned char *table = (unsigned char *)calloc((size_t)slot_count, FOSSIL_CRABDB_IMAGE_SLOT);
+    if (!table) {
+        w->ok = 0;
+        return;
+    }
+
+    uint64_t mask = slot_count - 1;
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t at = hashes[i] & mask;
+        while (fossil_crabdb_get_u64(table + at * FOSSIL_CRABDB_IMAGE_SLOT + 8)) {
+            at = (at + 1) & mask;
+        }
+        fossil_crabdb_put_u64(table + at * FOSSIL_CRABDB_IMAGE_SLOT, hashes[i]);
+        fossil_crabdb_put_u64(table + at * FOSSIL_CRABDB_IMAGE_SLOT + 8, offsets[i]);
+    }
+
+    fossil_crabdb_image_write(w, table, (size_t)(slot_count * FOSSIL_CRABDB_IMAGE_SLOT));
+    free(table);
+}
+
+static int fossil_crabdb_compare_keys(const void *a, const void *b) {
+    const fossil_crabdb_keyvalue_t *x = *(fossil_crabdb_keyvalue_t *const *)a;
+    const fossil_crabdb_keyvalue_t *y = *(fossil_crabdb_keyvalue_t *const *)b;
+    return strcmp(x->key, y->key);
+}
+
+fossil_crabdb_error_t fossil_crabdb_export(fossil_crabdb_t *db, const char *path) {
+    if (!db || !path) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+
+    fossil_crabdb_image_writer_t w = { fopen(path, "wb"), 0, 1 };
+    if (!w.file) return CRABDB_ERR_IO;
+
+    fossil_crabdb_write_lock(db);
+
+    uint64_t ns_count = db->namespace_index.count;
+    uint64_t *ns_hashes = (uint64_t *)malloc(sizeof(uint64_t) * (size_t)(ns_count + 1));
+    uint64_t *ns_offsets = (uint64_t *)malloc(sizeof(uint64_t) * (size_t)(ns_count + 1));
+    if (!ns_hashes || !ns_offsets) w.ok = 0;
+
+    // The header is rewritten once the table offsets are known
+    unsigned char header[FOSSIL_CRABDB_IMAGE_HEADER] = { 0 };
+    fossil_crabdb_image_write(&w, header, sizeof(header));
+
+    uint64_t ns_written = 0;
+    for (fossil_crabdb_namespace_t *ns = db->namespaces; w.ok && ns; ns = ns->next) {
+        size_t count = fossil_crabdb_namespace_size(ns);
+        fossil_crabdb_keyvalue_t **sorted = (fossil_crabdb_keyvalue_t **)malloc(sizeof(*sorted) * (count + 1));
+        uint64_t *hashes = (uint64_t *)malloc(sizeof(uint64_t) * (count + 1));
+        uint64_t *offsets = (uint64_t *)malloc(sizeof(uint64_t) * (count + 1));
+        if (!sorted || !hashes || !offsets) w.ok = 0;
+
+        // Images do not expire; pairs still alive are exported without a TTL
+        size_t n = 0;
+        uint64_t now = 0;
+        for (size_t i = 0; w.ok && i < ns->stripe_count; i++) {
+            for (fossil_crabdb_keyvalue_t *kv = ns->stripes[i].data; kv; kv = kv->next) {
+                if (!fossil_crabdb_expired(kv, &now)) sorted[n++] = kv;
+            }
+        }
+        if (w.ok) qsort(sorted, n, sizeof(*sorted), fossil_crabdb_compare_keys);
+
+        fossil_crabdb_image_pad(&w);
+        uint64_t entries_offset = w.offset;
+        for (size_t i = 0; w.ok && i < n; i++) {
+            unsigned char entry[FOSSIL_CRABDB_IMAGE_ENTRY];
+            size_t key_len = sorted[i]->key_length;
+            size_t value_len = fossil_crabdb_plain_length(sorted[i]);
+            // Images are read without a codec, so values go out decompressed
+            char *plain = sorted[i]->raw_length ? fossil_crabdb_value_copy(ns->codec, sorted[i]) : cnullptr;
+            if (sorted[i]->raw_length && !plain) {
+                w.ok = 0;
+                break;
+            }
+            hashes[i] = sorted[i]->hash;
+            offsets[i] = w.offset;
+            fossil_crabdb_put_u32(entry, (uint32_t)key_len);
+            fossil_crabdb_put_u32(entry + 4, (uint32_t)value_len);
+            fossil_crabdb_image_write(&w, entry, sizeof(entry));
+            fossil_crabdb_image_write(&w, sorted[i]->key, key_len + 1);
+            fossil_crabdb_image_write(&w, plain ? plain : sorted[i]->value, value_len + 1);
+            fossil_crabdb_image_pad(&w);
+            free(plain);
+        }
+
+        uint64_t slot_count = fossil_crabdb_image_slot_count(n);
+        uint64_t slots_offset = w.offset;
+        if (w.ok) fossil_crabdb_image_write_slots(&w, hashes, offsets, n, slot_count);
+
+        if (w.ok) {
+            ns_hashes[ns_written] = ns->hash;
+            ns_offsets[ns_written++] = w.offset;
+        }
+        size_t name_len = strlen(ns->name);
+        fossil_crabdb_image_write_u64(&w, ns->hash);
+        fossil_crabdb_image_write_u64(&w, name_len);
+        fossil_crabdb_image_write_u64(&w, n);
+        fossil_crabdb_image_write_u64(&w, slot_count);
+        fossil_crabdb_image_write_u64(&w, slots_offset);
+        fossil_crabdb_image_write_u64(&w, entries_offset);
+        fossil_crabdb_image_write(&w, ns->name, name_len + 1);
+
+        free(sorted);
+        free(hashes);
+        free(offsets);
+    }
+
+    fossil_crabdb_image_pad(&w);
+    uint64_t ns_slot_count = fossil_crabdb_image_slot_count(ns_written);
+    uint64_t ns_slots_offset = w.offset;
+    if (w.ok) fossil_crabdb_image_write_slots(&w, ns_hashes, ns_offsets, ns_written, ns_slot_count);
+    free(ns_hashes);
+    free(ns_offsets);
+    fossil_crabdb_write_unlock(db);
+
+    memcpy(header, FOSSIL_CRABDB_IMAGE_MAGIC, 8);
+    fossil_crabdb_put_u32(header + 8, FOSSIL_CRABDB_IMAGE_VERSION);
+    fossil_crabdb_put_u32(header + 12, (uint32_t)ns_written);
+    fossil_crabdb_put_u64(header + 16, ns_slot_count);
+    fossil_crabdb_put_u64(header + 24, ns_slots_offset);
+    fossil_crabdb_put_u64(header + 32, w.offset);
+    if (w.ok && (fseek(w.file, 0, SEEK_SET) != 0 || fwrite(header, 1, sizeof(header), w.file) != sizeof(header))) {
+        w.ok = 0;
+    }
+
+    if (fclose(w.file) != 0) w.ok = 0;
+    if (!w.ok) {
+        remove(path);
+        return CRABDB_ERR_IO;
+    }
+    return CRABDB_OK;
+}
+
+static void fossil_crabdb_image_close(fossil_crabdb_image_t *image) {
+    if (!image) return;
+#ifdef _WIN32
+    if (image->base) UnmapViewOfFile(image->base);
+    if (image->mapping) CloseHandle(image->mapping);
+    if (image->file != INVALID_HANDLE_VALUE) CloseHandle(image->file);
+#else
+    if (image->base) munmap((void *)image->base, (size_t)image->size);
+#endif
+    free(image);
+}
+
+static fossil_crabdb_image_t *fossil_crabdb_image_map(const char *path) {
+    fossil_crabdb_image_t *image = (fossil_crabdb_image_t *)calloc(1, sizeof(fossil_crabdb_image_t));
+    if (!image) return cnullptr;
+
+#ifdef _WIN32
+    image->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, cnullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, cnullptr);
+    LARGE_INTEGER size;
+    if (image->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(image->file, &size) || size.QuadPart < FOSSIL_CRABDB_IMAGE_HEADER) {
+        fossil_crabdb_image_close(image);
+        return cnullptr;
+    }
+    image->size = (uint64_t)size.QuadPart;
+    image->mapping = CreateFileMappingA(image->file, cnullptr, PAGE_READONLY, 0, 0, cnullptr);
+    if (image->mapping) {
+        image->base = (const unsigned char *)MapViewOfFile(image->mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size < FOSSIL_CRABDB_IMAGE_HEADER) {
+        if (fd >= 0) close(fd);
+        fossil_crabdb_image_close(image);
+        return cnullptr;
+    }
+    image->size = (uint64_t)st.st_size;
+    void *base = mmap(cnullptr, (size_t)image->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    image->base = base == MAP_FAILED ? cnullptr : (const unsigned char *)base;
+#endif
+
+    if (!image->base || memcmp(image->base, FOSSIL_CRABDB_IMAGE_MAGIC, 8) != 0 ||
+        fossil_crabdb_get_u32(image->base + 8) != FOSSIL_CRABDB_IMAGE_VERSION ||
+        fossil_crabdb_get_u64(image->base + 32) != image->size) {
+        fossil_crabdb_image_close(image);
+        return cnullptr;
+    }
+
+    image->ns_slot_count = fossil_crabdb_get_u64(image->base + 16);
+    image->ns_slots_offset = fossil_crabdb_get_u64(image->base + 24);
+    if (!image->ns_slot_count || (image->ns_slot_count & (image->ns_slot_count - 1)) ||
+        image->ns_slots_offset > image->size ||
+        image->ns_slot_count > (image->size - image->ns_slots_offset) / FOSSIL_CRABDB_IMAGE_SLOT) {
+        fossil_crabdb_image_close(image);
+        return cnullptr;
+    }
+    return image;
+}
+
+/**
+ * Probe a slot table of the image for `key`.
+ *
+ * @return Offset of the matching record, or 0 if there is none.
+ */
+static uint64_t fossil_crabdb_image_probe(const fossil_crabdb_image_t *image, uint64_t slots_offset, uint64_t slot_count, const char *key, size_t key_len, uint64_t hash, uint64_t name_field) {
+    const unsigned char *slots = image->base + slots_offset;
+    uint64_t need = name_field + key_len + 1;
+    uint64_t mask = slot_count - 1;
+    if (need > image->size) return 0;
+
+    for (uint64_t probes = 0, at = hash & mask; probes < slot_count; probes++, at = (at + 1) & mask) {
+        const unsigned char *slot = slots + at * FOSSIL_CRABDB_IMAGE_SLOT;
+        uint64_t offset = fossil_crabdb_get_u64(slot + 8);
+        if (!offset) return 0;
+        if (fossil_crabdb_get_u64(slot) != hash || offset > image->size - need) continue;
+
+        // Namespaces keep their length as u64 before the name, entries as u32
+        const unsigned char *record = image->base + offset;
+        uint64_t length = name_field == FOSSIL_CRABDB_IMAGE_NAMESPACE ? fossil_crabdb_get_u64(record + 8) : fossil_crabdb_get_u32(record);
+        if (length == key_len && memcmp(record + name_field, key, key_len) == 0) return offset;
+    }
+    return 0;
+}
+
+/**
+ * Look a key up in a mapped image; the value points into the mapping.
+ */
+static fossil_crabdb_error_t fossil_crabdb_image_find(const fossil_crabdb_image_t *image, const char *namespace_name, const char *key, const char **value, size_t *length) {
+    uint64_t ns = fossil_crabdb_image_probe(image, image->ns_slots_offset, image->ns_slot_count,
+                                            namespace_name, strlen(namespace_name), fossil_crabdb_hash(namespace_name),
+                                            FOSSIL_CRABDB_IMAGE_NAMESPACE);
+    if (!ns) return CRABDB_ERR_NS_NOT_FOUND;
+
+    const unsigned char *record = image->base + ns;
+    uint64_t slot_count = fossil_crabdb_get_u64(record + 24);
+    uint64_t slots_offset = fossil_crabdb_get_u64(record + 32);
+    if (!slot_count || slots_offset > image->size || slot_count > (image->size - slots_offset) / FOSSIL_CRABDB_IMAGE_SLOT) {
+        return CRABDB_ERR_IO;
+    }
+
+    size_t key_len = strlen(key);
+    uint64_t entry = fossil_crabdb_image_probe(image, slots_offset, slot_count, key, key_len, fossil_crabdb_hash(key), FOSSIL_CRABDB_IMAGE_ENTRY);
+    if (!entry) return CRABDB_ERR_KEY_NOT_FOUND;
+
+    const unsigned char *kv = image->base + entry;
+    uint64_t value_len = fossil_crabdb_get_u32(kv + 4);
+    if (value_len >= image->size - entry - FOSSIL_CRABDB_IMAGE_ENTRY - key_len - 1) return CRABDB_ERR_IO;
+    *value = (const char *)kv + FOSSIL_CRABDB_IMAGE_ENTRY + key_len + 1;
+    *length = (size_t)value_len;
+    return CRABDB_OK;
+}
+
+fossil_crabdb_t* fossil_crabdb_open_mmap(const char *path) {
+    if (!path) return cnullptr;
+
+    fossil_crabdb_image_t *image = fossil_crabdb_image_map(path);
+    if (!image) return cnullptr;
+
+    fossil_crabdb_t *db = fossil_crabdb_create();
+    if (!db) {
+        fossil_crabdb_image_close(image);
+        return cnullptr;
+    }
+    db->image = image;
+    return db;
+}
+
+// *****************************************************************************
+// Database operations
+// *****************************************************************************
+
+static fossil_crabdb_namespace_t *fossil_crabdb_find_namespace(fossil_crabdb_t *db, const char *namespace_name) {
+    return (fossil_crabdb_namespace_t *)fossil_crabdb_index_find(&db->namespace_index, namespace_name, fossil_crabdb_hash(namespace_name));
+}
+
+/**
+ * Free a namespace, which must be out of the index, the list and the tree.
+ */
+static void fossil_crabdb_free_namespace(fossil_crabdb_t *db, fossil_crabdb_namespace_t *ns) {
+    free(ns->name);
+    free(ns->sub_namespaces);
+
+    for (size_t i = 0; i < ns->stripe_count; i++) {
+        fossil_crabdb_stripe_t *stripe = &ns->stripes[i];
+        fossil_crabdb_chunks_free(stripe->chunks);
+        fossil_crabdb_index_free(&stripe->index);
+        free(stripe->wheel);
+        fossil_crabdb_clock_free(stripe->clock);
+        fossil_crabdb_bloom_free(stripe->bloom);
+        fossil_crabdb_history_prune(db, stripe, UINT64_MAX);
+        if (db->locks) fossil_rwlock_erase(&stripe->lock);
+    }
+    free(ns->stripes);
+    fossil_crabdb_ordered_free(ns->ordered);
+    fossil_crabdb_codec_free(ns->codec);
+    free(ns);
+}
+
+static void fossil_crabdb_release_namespace(fossil_crabdb_t *db, void *data) {
+    fossil_crabdb_free_namespace(db, (fossil_crabdb_namespace_t *)data);
+}
+
+static fossil_crabdb_t *fossil_crabdb_alloc(size_t stripe_count, int thread_safe) {
     fossil_crabdb_t *db = (fossil_crabdb_t*) malloc(sizeof(fossil_crabdb_t));
     if (!db) {
         return cnullptr;
     }
-    db->namespaces = cnullptr;
-    return db;
+    db->namespaces = cnullptr;
+    db->stripe_count = stripe_count;
+    db->locks = cnullptr;
+    db->persist = cnullptr;
+    db->stream = cnullptr;
+    db->follower = cnullptr;
+    db->image = cnullptr;
+    fossil_crabdb_index_init(&db->namespace_index, offsetof(fossil_crabdb_namespace_t, name));
+
+    db->versions = (fossil_crabdb_versions_t *)calloc(1, sizeof(fossil_crabdb_versions_t));
+    db->metrics = fossil_crabdb_metrics_new(thread_safe ? FOSSIL_CRABDB_METER_SHARDS : 1);
+    if (!db->versions || !db->metrics) {
+        free(db->versions);
+        free(db->metrics);
+        free(db);
+        return cnullptr;
+    }
+    atomic_init(&db->versions->sequence, 0);
+    atomic_init(&db->versions->open, 0);
+    atomic_init(&db->versions->retained, 0);
+
+    if (thread_safe) {
+        db->locks = (fossil_crabdb_locks_t *)malloc(sizeof(fossil_crabdb_locks_t));
+        if (db->locks) {
+            atomic_init(&db->locks->sequence, 0);
+            db->locks->rcu = cnullptr;
+        }
+        if (!db->locks || fossil_rwlock_create(&db->locks->namespaces) != 0) {
+            free(db->locks);
+            free(db->versions);
+            free(db->metrics);
+            free(db);
+            return cnullptr;
+        }
+        if (fossil_mutex_create(&db->versions->lock) != 0) {
+            fossil_rwlock_erase(&db->locks->namespaces);
+            free(db->locks);
+            free(db->versions);
+            free(db->metrics);
+            free(db);
+            return cnullptr;
+        }
+    }
+    return db;
+}
+
+fossil_crabdb_t* fossil_crabdb_create(void) {
+    return fossil_crabdb_alloc(1, 0);
+}
+
+fossil_crabdb_t* fossil_crabdb_create_concurrent(size_t stripe_count) {
+    return fossil_crabdb_alloc(stripe_count ? stripe_count : FOSSIL_CRABDB_DEFAULT_STRIPES, 1);
+}
+
+fossil_crabdb_t* fossil_crabdb_create_read_mostly(size_t stripe_count) {
+    fossil_crabdb_t *db = fossil_crabdb_create_concurrent(stripe_count);
+    if (!db) return cnullptr;
+    db->locks->rcu = fossil_crabdb_rcu_new(db);
+    if (!db->locks->rcu) {
+        fossil_crabdb_erase(db);
+        return cnullptr;
+    }
+    db->namespace_index.rcu = db->locks->rcu;
+    return db;
+}
+
+void fossil_crabdb_erase(fossil_crabdb_t *db) {
+    if (!db) return;
+
+    fossil_crabdb_persist_close(db);
+    fossil_crabdb_stream_close(db);
+    fossil_crabdb_unfollow(db);
+    if (db->locks) {
+        fossil_crabdb_rcu_free(db->locks->rcu);
+        db->locks->rcu = cnullptr;
+    }
+
+    fossil_crabdb_namespace_t *current = db->namespaces;
+    while (current) {
+        fossil_crabdb_namespace_t *next = current->next;
+        fossil_crabdb_free_namespace(db, current);
+        current = next;
+    }
+
+    fossil_crabdb_index_free(&db->namespace_index);
+    fossil_crabdb_image_close(db->image);
+    if (db->locks) {
+        fossil_rwlock_erase(&db->locks->namespaces);
+        fossil_mutex_erase(&db->versions->lock);
+        free(db->locks);
+    }
+    free(db->versions);
+    free(db->metrics);
+    free(db);
+}
+
+static fossil_crabdb_namespace_t *fossil_crabdb_new_namespace(fossil_crabdb_t *db, const char *namespace_name, uint64_t hash) {
+    fossil_crabdb_namespace_t *ns = (fossil_crabdb_namespace_t*) calloc(1, sizeof(fossil_crabdb_namespace_t));
+    if (!ns) return cnullptr;
+
+    ns->name = _custom_fossil_strdup(namespace_name);
+    ns->hash = hash;
+    ns->stripes = (fossil_crabdb_stripe_t *)calloc(db->stripe_count, sizeof(fossil_crabdb_stripe_t));
+    if (!ns->name || !ns->stripes) {
+        free(ns->name);
+        free(ns->stripes);
+        free(ns);
+        return cnullptr;
+    }
+
+    ns->stripe_count = db->stripe_count;
+    for (size_t i = 0; i < ns->stripe_count; i++) {
+        fossil_crabdb_index_init(&ns->stripes[i].index, offsetof(fossil_crabdb_keyvalue_t, key));
+        fossil_crabdb_index_init(&ns->stripes[i].history, offsetof(fossil_crabdb_version_t, key));
+        atomic_init(&ns->stripes[i].sequence, 0);
+        if (db->locks) {
+            fossil_rwlock_create(&ns->stripes[i].lock);
+            ns->stripes[i].rcu = db->locks->rcu;
+            ns->stripes[i].index.rcu = db->locks->rcu;
+        }
+    }
+    return ns;
+}
+
+/*
+ * Namespaces form a tree addressed by '/'-separated paths. Every namespace,
+ * at any depth, is a full namespace in the index under its whole path, so
+ * resolving `tenant/app/cache` costs one hash of the path rather than a
+ * walk down the levels; the tree links only serve to find the namespaces
+ * nested in one that is being erased.
+ */
+
+/**
+ * Attach a new namespace at `path` below `parent` (null at the top level).
+ * The database lock is held exclusively.
+ */
+static fossil_crabdb_error_t fossil_crabdb_add_namespace(fossil_crabdb_t *db, fossil_crabdb_namespace_t *parent, const char *path, uint64_t hash) {
+    if (parent && parent->sub_namespace_count == parent->sub_namespace_capacity) {
+        size_t capacity = parent->sub_namespace_capacity ? parent->sub_namespace_capacity * 2 : 4;
+        fossil_crabdb_namespace_t **grown = (fossil_crabdb_namespace_t **)realloc(parent->sub_namespaces, capacity * sizeof(fossil_crabdb_namespace_t *));
+        if (!grown) return CRABDB_ERR_MEM;
+        parent->sub_namespaces = grown;
+        parent->sub_namespace_capacity = capacity;
+    }
+
+    fossil_crabdb_namespace_t *new_namespace = fossil_crabdb_new_namespace(db, path, hash);
+    if (!new_namespace || fossil_crabdb_index_insert(&db->namespace_index, hash, new_namespace) != 0) {
+        if (new_namespace) fossil_crabdb_free_namespace(db, new_namespace);
+        return CRABDB_ERR_MEM;
+    }
+
+    new_namespace->next = db->namespaces;
+    if (db->namespaces) {
+        db->namespaces->prev = new_namespace;
+    }
+    db->namespaces = new_namespace;
+
+    if (parent) {
+        new_namespace->parent = parent;
+        new_namespace->parent_slot = parent->sub_namespace_count;
+        parent->sub_namespaces[parent->sub_namespace_count++] = new_namespace;
+    }
+    return CRABDB_OK;
+}
+
+/**
+ * Remove a namespace and everything nested in it from the index, the list
+ * and the tree, and free them. The database lock is held exclusively.
+ */
+static void fossil_crabdb_drop_namespace(fossil_crabdb_t *db, fossil_crabdb_namespace_t *ns) {
+    while (ns->sub_namespace_count) {
+        fossil_crabdb_drop_namespace(db, ns->sub_namespaces[ns->sub_namespace_count - 1]);
+    }
+
+    fossil_crabdb_index_remove(&db->namespace_index, ns->name, ns->hash);
+    if (ns->prev) {
+        ns->prev->next = ns->next;
+    } else {
+        db->namespaces = ns->next;
+    }
+    if (ns->next) {
+        ns->next->prev = ns->prev;
+    }
+
+    // The last sibling takes the freed place
+    fossil_crabdb_namespace_t *parent = ns->parent;
+    if (parent) {
+        fossil_crabdb_namespace_t *last = parent->sub_namespaces[--parent->sub_namespace_count];
+        parent->sub_namespaces[ns->parent_slot] = last;
+        last->parent_slot = ns->parent_slot;
+    }
+    if (db->locks && db->locks->rcu) {
+        fossil_crabdb_defer(db->locks->rcu, ns, fossil_crabdb_release_namespace);
+    } else {
+        fossil_crabdb_free_namespace(db, ns);
+    }
+}
+
+/**
+ * Resolve the parent of `path`, null at the top level.
+ */
+static fossil_crabdb_error_t fossil_crabdb_find_parent(fossil_crabdb_t *db, const char *path, fossil_crabdb_namespace_t **parent) {
+    *parent = cnullptr;
+    const char *slash = strrchr(path, '/');
+    if (!slash) return CRABDB_OK;
+    if (slash[1] == '\0') return CRABDB_ERR_INVALID_QUERY;
+
+    size_t length = (size_t)(slash - path);
+    char *parent_path = (char *)malloc(length + 1);
+    if (!parent_path) return CRABDB_ERR_MEM;
+    memcpy(parent_path, path, length);
+    parent_path[length] = '\0';
+    *parent = fossil_crabdb_find_namespace(db, parent_path);
+    free(parent_path);
+    return *parent ? CRABDB_OK : CRABDB_ERR_NS_NOT_FOUND;
+}
+
+fossil_crabdb_error_t fossil_crabdb_create_namespace(fossil_crabdb_t *db, const char *namespace_name) {
+    if (!db || !namespace_name) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+
+    uint64_t hash = fossil_crabdb_hash(namespace_name);
+    fossil_crabdb_write_lock(db);
+    if (fossil_crabdb_index_find(&db->namespace_index, namespace_name, hash)) {
+        fossil_crabdb_write_unlock(db);
+        return CRABDB_ERR_NS_EXISTS;
+    }
+
+    fossil_crabdb_namespace_t *parent;
+    fossil_crabdb_error_t result = fossil_crabdb_find_parent(db, namespace_name, &parent);
+    if (result == CRABDB_OK) result = fossil_crabdb_add_namespace(db, parent, namespace_name, hash);
+    if (result == CRABDB_OK) result = fossil_crabdb_log(db, CRABDB_OP_CREATE_NAMESPACE, namespace_name, cnullptr, cnullptr);
+    fossil_crabdb_write_unlock(db);
+    return fossil_crabdb_after_write(db, result);
+}
+
+/**
+ * Path of `sub_namespace_name` nested in `namespace_name`, freed by the caller.
+ */
+static char *fossil_crabdb_sub_path(const char *namespace_name, const char *sub_namespace_name) {
+    size_t parent_length = strlen(namespace_name);
+    size_t sub_length = strlen(sub_namespace_name);
+    char *path = (char *)malloc(parent_length + sub_length + 2);
+    if (!path) return cnullptr;
+    memcpy(path, namespace_name, parent_length);
+    path[parent_length] = '/';
+    memcpy(path + parent_length + 1, sub_namespace_name, sub_length + 1);
+    return path;
+}
+
+fossil_crabdb_error_t fossil_crabdb_create_sub_namespace(fossil_crabdb_t *db, const char *namespace_name, const char *sub_namespace_name) {
+    if (!db || !namespace_name || !sub_namespace_name) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+    if (!*sub_namespace_name || strchr(sub_namespace_name, '/')) return CRABDB_ERR_INVALID_QUERY;
+
+    char *path = fossil_crabdb_sub_path(namespace_name, sub_namespace_name);
+    if (!path) return CRABDB_ERR_MEM;
+    uint64_t hash = fossil_crabdb_hash(path);
+
+    fossil_crabdb_write_lock(db);
+    fossil_crabdb_error_t result = CRABDB_OK;
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    if (!current) {
+        result = CRABDB_ERR_NS_NOT_FOUND;
+    } else if (fossil_crabdb_index_find(&db->namespace_index, path, hash)) {
+        result = CRABDB_ERR_SUB_NS_EXISTS;
+    } else {
+        result = fossil_crabdb_add_namespace(db, current, path, hash);
+        if (result == CRABDB_OK) result = fossil_crabdb_log(db, CRABDB_OP_CREATE_SUB_NAMESPACE, namespace_name, sub_namespace_name, cnullptr);
+    }
+
+    fossil_crabdb_write_unlock(db);
+    free(path);
+    return fossil_crabdb_after_write(db, result);
+}
+
+fossil_crabdb_error_t fossil_crabdb_erase_namespace(fossil_crabdb_t *db, const char *namespace_name) {
+    if (!db || !namespace_name) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+
+    fossil_crabdb_write_lock(db);
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    if (!current) {
+        fossil_crabdb_write_unlock(db);
+        return CRABDB_ERR_NS_NOT_FOUND;
+    }
+
+    fossil_crabdb_drop_namespace(db, current);
+    fossil_crabdb_error_t result = fossil_crabdb_log(db, CRABDB_OP_ERASE_NAMESPACE, namespace_name, cnullptr, cnullptr);
+    fossil_crabdb_write_unlock(db);
+    return fossil_crabdb_after_write(db, result);
+}
+
+fossil_crabdb_error_t fossil_crabdb_erase_sub_namespace(fossil_crabdb_t *db, const char *namespace_name, const char *sub_namespace_name) {
+    if (!db || !namespace_name || !sub_namespace_name) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+    if (strchr(sub_namespace_name, '/')) return CRABDB_ERR_SUB_NS_NOT_FOUND;
+
+    char *path = fossil_crabdb_sub_path(namespace_name, sub_namespace_name);
+    if (!path) return CRABDB_ERR_MEM;
+
+    fossil_crabdb_write_lock(db);
+    fossil_crabdb_error_t result = CRABDB_ERR_SUB_NS_NOT_FOUND;
+    fossil_crabdb_namespace_t *sub = fossil_crabdb_find_namespace(db, path);
+    if (sub) {
+        fossil_crabdb_drop_namespace(db, sub);
+        result = fossil_crabdb_log(db, CRABDB_OP_ERASE_SUB_NAMESPACE, namespace_name, sub_namespace_name, cnullptr);
+    }
+
+    fossil_crabdb_write_unlock(db);
+    free(path);
+    return fossil_crabdb_after_write(db, result);
+}
+
+/**
+ * Milliseconds-since-epoch deadline `ttl_ms` from now, 0 for no TTL.
+ */
+static uint64_t fossil_crabdb_deadline(uint64_t ttl_ms) {
+    if (!ttl_ms) return 0;
+    uint64_t now = fossil_crabdb_now_ms();
+    return ttl_ms > UINT64_MAX - now ? UINT64_MAX : now + ttl_ms;
+}
+
+/**
+ * Insert a pair expiring at `expires`, 0 for never.
+ */
+static fossil_crabdb_error_t fossil_crabdb_put(fossil_crabdb_t *db, const char *namespace_name, const char *key, const char *value, size_t value_length, uint64_t expires) {
+    if (!db || !namespace_name || !key || !value) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+
+    // Hash and measure before taking any lock to keep the critical section short
+    uint64_t hash = fossil_crabdb_hash(key);
+    size_t key_length = strlen(key);
+
+    fossil_crabdb_read_lock(db);
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    if (!current) {
+        fossil_crabdb_read_unlock(db);
+        return CRABDB_ERR_NS_NOT_FOUND;
+    }
+
+    // Compress before the partition lock too
+    fossil_crabdb_packed_t packed = { 0 };
+    if (fossil_crabdb_pack(current->codec, value, value_length, &packed) != 0) {
+        fossil_crabdb_read_unlock(db);
+        return CRABDB_ERR_MEM;
+    }
+    size_t need = fossil_crabdb_pair_blocks(key_length, packed.length) + (expires ? FOSSIL_CRABDB_TIMER_BLOCK : 0);
+
+    fossil_crabdb_stripe_t *stripe = fossil_crabdb_stripe_for(current, hash);
+    fossil_crabdb_keyvalue_t *new_kv = cnullptr;
+    fossil_crabdb_error_t result = CRABDB_OK;
+    uint64_t now = 0;
+    fossil_crabdb_stripe_write_lock(db, stripe);
+    if (stripe->wheel) fossil_crabdb_stripe_expire(current, stripe, now = fossil_crabdb_now_ms(), FOSSIL_CRABDB_EXPIRE_STEP);
+    if (current->ordered) fossil_crabdb_ordered_lock(current->ordered);
+    fossil_crabdb_keyvalue_t *existing = fossil_crabdb_stripe_find(stripe, key, hash);
+    if (existing && fossil_crabdb_expired(existing, &now)) {
+        fossil_crabdb_purge_pair(current, stripe, existing);
+        existing = cnullptr;
+    }
+    if (existing) {
+        result = CRABDB_ERR_KEY_NOT_FOUND; // Key already exists
+    } else if (fossil_crabdb_arena_reserve(stripe, need) != 0 || (expires && fossil_crabdb_wheel_reserve(stripe) != 0) ||
+               fossil_crabdb_clock_reserve(stripe->rcu, stripe->clock, 1) != 0 || fossil_crabdb_bloom_reserve(stripe, 1) != 0) {
+        result = CRABDB_ERR_MEM;
+    } else {
+        new_kv = fossil_crabdb_new_pair(stripe, key, key_length, hash, packed.data, packed.length, packed.raw_length);
+        new_kv->version = fossil_crabdb_commit(db);
+        if (current->ordered && fossil_crabdb_ordered_insert(current->ordered, new_kv) != 0) {
+            result = CRABDB_ERR_MEM;
+        } else if (fossil_crabdb_index_insert(&stripe->index, hash, new_kv) != 0) {
+            if (current->ordered) fossil_crabdb_ordered_remove(current->ordered, new_kv);
+            result = CRABDB_ERR_MEM;
+        }
+        if (result != CRABDB_OK) {
+            fossil_crabdb_free_pair(stripe, new_kv);
+            new_kv = cnullptr;
+        }
+    }
+    if (new_kv) {
+        new_kv->next = stripe->data;
+        if (stripe->data) {
+            stripe->data->prev = new_kv;
+        }
+        stripe->data = new_kv;
+        fossil_crabdb_charge_pair(stripe, new_kv);
+        if (stripe->bloom) fossil_crabdb_bloom_add(stripe->bloom, hash);
+        if (expires) {
+            fossil_crabdb_timer_arm(stripe, new_kv, expires);
+            result = fossil_crabdb_log_value(db, CRABDB_OP_INSERT_TTL, namespace_name, key, value, value_length, expires);
+        } else {
+            result = fossil_crabdb_log_value(db, CRABDB_OP_INSERT, namespace_name, key, value, value_length, 0);
+        }
+    }
+    if (current->ordered) fossil_crabdb_ordered_unlock(current->ordered);
+    if (new_kv && stripe->clock) {
+        fossil_crabdb_error_t evicted = fossil_crabdb_stripe_evict(db, current, stripe, new_kv);
+        if (result == CRABDB_OK) result = evicted;
+    }
+    fossil_crabdb_stripe_tidy(current, stripe);
+    fossil_crabdb_stripe_write_unlock(db, stripe);
+    fossil_crabdb_read_unlock(db);
+    free(packed.buffer);
+    return fossil_crabdb_after_write(db, result);
+}
+
+fossil_crabdb_error_t fossil_crabdb_insert(fossil_crabdb_t *db, const char *namespace_name, const char *key, const char *value) {
+    uint64_t began = fossil_crabdb_meter_start();
+    return fossil_crabdb_meter(db, CRABDB_STAT_INSERT, began, fossil_crabdb_put(db, namespace_name, key, value, value ? strlen(value) : 0, 0));
+}
+
+fossil_crabdb_error_t fossil_crabdb_insert_ttl(fossil_crabdb_t *db, const char *namespace_name, const char *key, const char *value, uint64_t ttl_ms) {
+    uint64_t began = fossil_crabdb_meter_start();
+    return fossil_crabdb_meter(db, CRABDB_STAT_INSERT, began, fossil_crabdb_put(db, namespace_name, key, value, value ? strlen(value) : 0, fossil_crabdb_deadline(ttl_ms)));
+}
+
+fossil_crabdb_error_t fossil_crabdb_insert_bytes(fossil_crabdb_t *db, const char *namespace_name, const char *key, const void *value, size_t length) {
+    uint64_t began = fossil_crabdb_meter_start();
+    const char *bytes = length ? (const char *)value : "";
+    return fossil_crabdb_meter(db, CRABDB_STAT_INSERT, began, fossil_crabdb_put(db, namespace_name, key, bytes, length, 0));
+}
+
+/**
+ * Run a get of a read-mostly database without taking any lock. Every
+ * pointer is checked against the sequence numbers before it is followed,
+ * and the copy is kept only if neither number moved while it was made.
+ *
+ * @return 1 when `*result` holds the outcome, 0 when the caller has to take
+ *         the locks after all.
+ */
+static int fossil_crabdb_get_lockfree(fossil_crabdb_t *db, const char *namespace_name, const char *key, uint64_t hash, char **value, size_t *value_length, fossil_crabdb_error_t *result) {
+    fossil_crabdb_reader_t *reader = fossil_crabdb_reader_enter(db->locks->rcu);
+    if (!reader) return 0;
+
+    uint64_t namespace_hash = fossil_crabdb_hash(namespace_name);
+    int done = 0;
+    for (unsigned attempt = 0; !done && attempt < FOSSIL_CRABDB_OPTIMISTIC_TRIES; attempt++) {
+        fossil_crabdb_optimistic_t read = { &db->locks->sequence, cnullptr, 0, 0 };
+        read.database_seen = atomic_load_explicit(read.database, memory_order_acquire);
+        void *found;
+        if ((read.database_seen & 1) || !fossil_crabdb_index_peek(&db->namespace_index, namespace_name, namespace_hash, &read, &found)) continue;
+        fossil_crabdb_namespace_t *current = (fossil_crabdb_namespace_t *)found;
+        if (!current) {
+            *result = CRABDB_ERR_NS_NOT_FOUND;
+            done = 1;
+            break;
+        }
+
+        // The stripes of a namespace never move; the codec and what the
+        // stripes hold only change under the locks
+        fossil_crabdb_codec_t *codec = current->codec;
+        fossil_crabdb_stripe_t *stripe = fossil_crabdb_stripe_for(current, hash);
+        read.stripe = &stripe->sequence;
+        read.stripe_seen = atomic_load_explicit(read.stripe, memory_order_acquire);
+        fossil_crabdb_bloom_t *bloom = stripe->bloom;
+        fossil_crabdb_clock_t *clock = stripe->clock;
+        if ((read.stripe_seen & 1) || !fossil_crabdb_optimistic_valid(&read)) continue;
+
+        fossil_crabdb_keyvalue_t *kv = cnullptr;
+        if (!bloom || fossil_crabdb_bloom_may_contain(bloom, hash)) {
+            if (!fossil_crabdb_index_peek(&stripe->index, key, hash, &read, &found)) continue;
+            kv = (fossil_crabdb_keyvalue_t *)found;
+        }
+
+        fossil_crabdb_error_t outcome = CRABDB_ERR_KEY_NOT_FOUND;
+        char *copy = cnullptr;
+        size_t length = 0;
+        atomic_uchar *mark = cnullptr;
+        if (kv) {
+            fossil_crabdb_timer_t *timer = kv->timer;
+            const char *data = kv->value;
+            size_t raw_length = kv->raw_length;
+            size_t clock_slot = kv->clock_slot;
+            length = kv->value_length;
+            if (!fossil_crabdb_optimistic_valid(&read)) continue;
+
+            if (!timer || timer->expires > fossil_crabdb_now_ms()) {
+                // A torn copy is caught below; decompression checks its bounds
+                copy = raw_length ? fossil_crabdb_unpack(codec, data, length, raw_length) : fossil_crabdb_memdup(data, length);
+                if (raw_length) length = raw_length;
+                if (clock) mark = &clock->referenced[clock_slot];
+                outcome = copy ? CRABDB_OK : CRABDB_ERR_MEM;
+            }
+        }
+        if (!fossil_crabdb_optimistic_valid(&read)) {
+            free(copy);
+            continue;
+        }
+
+        // Marking a bit array a writer just replaced only loses the mark
+        if (mark && !atomic_load_explicit(mark, memory_order_relaxed)) atomic_store_explicit(mark, 1, memory_order_relaxed);
+        if (copy) {
+            *value = copy;
+            if (value_length) *value_length = length;
+        }
+        *result = outcome;
+        done = 1;
+    }
+    fossil_crabdb_reader_exit(reader);
+    return done;
+}
+
+static fossil_crabdb_error_t fossil_crabdb_do_get(fossil_crabdb_t *db, const char *namespace_name, const char *key, char **value, size_t *value_length) {
+    if (!db || !namespace_name || !key || !value) return CRABDB_ERR_MEM;
+
+    if (db->image) {
+        const char *mapped;
+        size_t length;
+        fossil_crabdb_error_t result = fossil_crabdb_image_find(db->image, namespace_name, key, &mapped, &length);
+        if (result != CRABDB_OK) return result;
+        *value = fossil_crabdb_memdup(mapped, length);
+        if (value_length) *value_length = length;
+        return *value ? CRABDB_OK : CRABDB_ERR_MEM;
+    }
+
+    uint64_t hash = fossil_crabdb_hash(key);
+    fossil_crabdb_error_t result = CRABDB_OK;
+    if (db->locks && db->locks->rcu && fossil_crabdb_get_lockfree(db, namespace_name, key, hash, value, value_length, &result)) return result;
+
+    fossil_crabdb_read_lock(db);
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    if (!current) {
+        fossil_crabdb_read_unlock(db);
+        return CRABDB_ERR_NS_NOT_FOUND;
+    }
+
+    fossil_crabdb_stripe_t *stripe = fossil_crabdb_stripe_for(current, hash);
+    uint64_t now = 0;
+    fossil_crabdb_stripe_read_lock(db, stripe);
+    fossil_crabdb_keyvalue_t *kv = fossil_crabdb_stripe_find(stripe, key, hash);
+    if (!kv || fossil_crabdb_expired(kv, &now)) {
+        result = CRABDB_ERR_KEY_NOT_FOUND;
+    } else {
+        fossil_crabdb_touch(stripe, kv);
+        *value = fossil_crabdb_value_copy(current->codec, kv);
+        if (value_length) *value_length = fossil_crabdb_plain_length(kv);
+        if (!*value) result = CRABDB_ERR_MEM;
+    }
+    fossil_crabdb_stripe_read_unlock(db, stripe);
+    fossil_crabdb_read_unlock(db);
+    return result;
+}
+
+fossil_crabdb_error_t fossil_crabdb_get(fossil_crabdb_t *db, const char *namespace_name, const char *key, char **value) {
+    uint64_t began = fossil_crabdb_meter_start();
+    return fossil_crabdb_meter(db, CRABDB_STAT_GET, began, fossil_crabdb_do_get(db, namespace_name, key, value, cnullptr));
+}
+
+fossil_crabdb_error_t fossil_crabdb_get_bytes(fossil_crabdb_t *db, const char *namespace_name, const char *key, void **value, size_t *length) {
+    if (!value || !length) return CRABDB_ERR_MEM;
+    *value = cnullptr;
+    *length = 0;
+    uint64_t began = fossil_crabdb_meter_start();
+    char *bytes = cnullptr;
+    fossil_crabdb_error_t result = fossil_crabdb_do_get(db, namespace_name, key, &bytes, length);
+    *value = bytes;
+    return fossil_crabdb_meter(db, CRABDB_STAT_GET, began, result);
+}
+
+static fossil_crabdb_error_t fossil_crabdb_do_get_view(fossil_crabdb_t *db, const char *namespace_name, const char *key, fossil_crabdb_view_t *view) {
+    if (!view) return CRABDB_ERR_MEM;
+    memset(view, 0, sizeof(*view));
+    if (!db || !namespace_name || !key) return CRABDB_ERR_MEM;
+
+    if (db->image) {
+        // The mapping lives as long as the database, no guard required
+        fossil_crabdb_error_t result = fossil_crabdb_image_find(db->image, namespace_name, key, &view->data, &view->length);
+        if (result != CRABDB_OK) memset(view, 0, sizeof(*view));
+        return result;
+    }
+
+    uint64_t hash = fossil_crabdb_hash(key);
+    fossil_crabdb_read_lock(db);
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    if (!current) {
+        fossil_crabdb_read_unlock(db);
+        return CRABDB_ERR_NS_NOT_FOUND;
+    }
+
+    fossil_crabdb_stripe_t *stripe = fossil_crabdb_stripe_for(current, hash);
+    uint64_t now = 0;
+    fossil_crabdb_stripe_read_lock(db, stripe);
+    fossil_crabdb_keyvalue_t *kv = fossil_crabdb_stripe_find(stripe, key, hash);
+    if (!kv || fossil_crabdb_expired(kv, &now)) {
+        fossil_crabdb_stripe_read_unlock(db, stripe);
+        fossil_crabdb_read_unlock(db);
+        return CRABDB_ERR_KEY_NOT_FOUND;
+    }
+
+    fossil_crabdb_touch(stripe, kv);
+    if (kv->raw_length) {
+        // A compressed value is handed out as a copy, so nothing stays locked
+        view->copy = fossil_crabdb_value_copy(current->codec, kv);
+        view->data = view->copy;
+        view->length = kv->raw_length;
+        fossil_crabdb_stripe_read_unlock(db, stripe);
+        fossil_crabdb_read_unlock(db);
+        if (!view->copy) memset(view, 0, sizeof(*view));
+        return view->data ? CRABDB_OK : CRABDB_ERR_MEM;
+    }
+
+    // Both read locks stay held until fossil_crabdb_view_release
+    view->data = kv->value;
+    view->length = kv->value_length;
+    view->db = db;
+    view->guard = db->locks ? stripe : cnullptr;
+    return CRABDB_OK;
+}
+
+fossil_crabdb_error_t fossil_crabdb_get_view(fossil_crabdb_t *db, const char *namespace_name, const char *key, fossil_crabdb_view_t *view) {
+    uint64_t began = fossil_crabdb_meter_start();
+    return fossil_crabdb_meter(db, CRABDB_STAT_GET, began, fossil_crabdb_do_get_view(db, namespace_name, key, view));
+}
+
+void fossil_crabdb_view_release(fossil_crabdb_view_t *view) {
+    if (!view) return;
+
+    if (view->guard) {
+        fossil_crabdb_stripe_read_unlock(view->db, view->guard);
+        fossil_crabdb_read_unlock(view->db);
+    }
+    free(view->copy);
+    memset(view, 0, sizeof(*view));
+}
+
+/**
+ * Replace the value of a pair; with `retime` its deadline becomes `expires`
+ * (0 for never), otherwise it is left alone.
+ */
+static fossil_crabdb_error_t fossil_crabdb_set(fossil_crabdb_t *db, const char *namespace_name, const char *key, const char *value, size_t value_length, int retime, uint64_t expires) {
+    if (!db || !namespace_name || !key || !value) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+
+    uint64_t hash = fossil_crabdb_hash(key);
+    fossil_crabdb_read_lock(db);
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    if (!current) {
+        fossil_crabdb_read_unlock(db);
+        return CRABDB_ERR_NS_NOT_FOUND;
+    }
+    fossil_crabdb_packed_t packed = { 0 };
+    if (fossil_crabdb_pack(current->codec, value, value_length, &packed) != 0) {
+        fossil_crabdb_read_unlock(db);
+        return CRABDB_ERR_MEM;
+    }
+
+    fossil_crabdb_stripe_t *stripe = fossil_crabdb_stripe_for(current, hash);
+    fossil_crabdb_error_t result = CRABDB_ERR_KEY_NOT_FOUND;
+    uint64_t now = 0;
+    fossil_crabdb_stripe_write_lock(db, stripe);
+    if (stripe->wheel) fossil_crabdb_stripe_expire(current, stripe, now = fossil_crabdb_now_ms(), FOSSIL_CRABDB_EXPIRE_STEP);
+    fossil_crabdb_keyvalue_t *kv = fossil_crabdb_stripe_find(stripe, key, hash);
+    fossil_crabdb_version_t *retired = cnullptr;
+    uint64_t sequence = 0;
+    if (kv && fossil_crabdb_expired(kv, &now)) {
+        kv = cnullptr;
+    } else if (kv) {
+        int timed = retime && expires && !kv->timer;
+        size_t need = fossil_crabdb_value_need(kv, packed.length) + (timed ? FOSSIL_CRABDB_TIMER_BLOCK : 0);
+        if (fossil_crabdb_arena_reserve(stripe, need) != 0 || (timed && fossil_crabdb_wheel_reserve(stripe) != 0)) {
+            kv = cnullptr;
+            result = CRABDB_ERR_MEM;
+        } else {
+            sequence = fossil_crabdb_commit(db);
+            if (fossil_crabdb_retaining(db) && !(retired = fossil_crabdb_retire(current, stripe, kv, sequence))) {
+                kv = cnullptr;
+                result = CRABDB_ERR_MEM;
+            }
+        }
+    }
+    if (kv) {
+        if (retired) fossil_crabdb_history_push(db, stripe, retired);
+        stripe->resident -= kv->value_length;
+        fossil_crabdb_store_value(stripe, kv, packed.data, packed.length, packed.raw_length);
+        kv->version = sequence;
+        stripe->resident += kv->value_length;
+        fossil_crabdb_touch(stripe, kv);
+        if (retime) {
+            fossil_crabdb_timer_arm(stripe, kv, expires);
+            result = fossil_crabdb_log_value(db, CRABDB_OP_UPDATE_TTL, namespace_name, key, value, value_length, expires);
+        } else {
+            result = fossil_crabdb_log_value(db, CRABDB_OP_UPDATE, namespace_name, key, value, value_length, 0);
+        }
+        if (stripe->clock) {
+            fossil_crabdb_error_t evicted = fossil_crabdb_stripe_evict(db, current, stripe, kv);
+            if (result == CRABDB_OK) result = evicted;
+        }
+    }
+    fossil_crabdb_stripe_tidy(current, stripe);
+    fossil_crabdb_stripe_write_unlock(db, stripe);
+    fossil_crabdb_read_unlock(db);
+    free(packed.buffer);
+    return fossil_crabdb_after_write(db, result);
+}
+
+fossil_crabdb_error_t fossil_crabdb_update(fossil_crabdb_t *db, const char *namespace_name, const char *key, const char *value) {
+    uint64_t began = fossil_crabdb_meter_start();
+    return fossil_crabdb_meter(db, CRABDB_STAT_UPDATE, began, fossil_crabdb_set(db, namespace_name, key, value, value ? strlen(value) : 0, 0, 0));
+}
+
+fossil_crabdb_error_t fossil_crabdb_update_ttl(fossil_crabdb_t *db, const char *namespace_name, const char *key, const char *value, uint64_t ttl_ms) {
+    uint64_t began = fossil_crabdb_meter_start();
+    return fossil_crabdb_meter(db, CRABDB_STAT_UPDATE, began, fossil_crabdb_set(db, namespace_name, key, value, value ? strlen(value) : 0, 1, fossil_crabdb_deadline(ttl_ms)));
+}
+
+fossil_crabdb_error_t fossil_crabdb_update_bytes(fossil_crabdb_t *db, const char *namespace_name, const char *key, const void *value, size_t length) {
+    uint64_t began = fossil_crabdb_meter_start();
+    const char *bytes = length ? (const char *)value : "";
+    return fossil_crabdb_meter(db, CRABDB_STAT_UPDATE, began, fossil_crabdb_set(db, namespace_name, key, bytes, length, 0, 0));
+}
+
+fossil_crabdb_error_t fossil_crabdb_ttl(fossil_crabdb_t *db, const char *namespace_name, const char *key, uint64_t *remaining_ms) {
+    if (!db || !namespace_name || !key || !remaining_ms) return CRABDB_ERR_MEM;
+
+    if (db->image) {
+        const char *mapped;
+        size_t length;
+        fossil_crabdb_error_t result = fossil_crabdb_image_find(db->image, namespace_name, key, &mapped, &length);
+        if (result == CRABDB_OK) *remaining_ms = UINT64_MAX;
+        return result;
+    }
+
+    uint64_t hash = fossil_crabdb_hash(key);
+    fossil_crabdb_read_lock(db);
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    if (!current) {
+        fossil_crabdb_read_unlock(db);
+        return CRABDB_ERR_NS_NOT_FOUND;
+    }
+
+    fossil_crabdb_stripe_t *stripe = fossil_crabdb_stripe_for(current, hash);
+    fossil_crabdb_error_t result = CRABDB_OK;
+    uint64_t now = 0;
+    fossil_crabdb_stripe_read_lock(db, stripe);
+    fossil_crabdb_keyvalue_t *kv = fossil_crabdb_stripe_find(stripe, key, hash);
+    if (!kv || fossil_crabdb_expired(kv, &now)) {
+        result = CRABDB_ERR_KEY_NOT_FOUND;
+    } else {
+        *remaining_ms = kv->timer ? kv->timer->expires - now : UINT64_MAX;
+    }
+    fossil_crabdb_stripe_read_unlock(db, stripe);
+    fossil_crabdb_read_unlock(db);
+    return result;
+}
+
+size_t fossil_crabdb_expire(fossil_crabdb_t *db, size_t max_pairs) {
+    if (!db || db->image) return 0;
+
+    size_t reclaimed = 0;
+    uint64_t now = fossil_crabdb_now_ms();
+    fossil_crabdb_read_lock(db);
+    for (fossil_crabdb_namespace_t *ns = db->namespaces; ns && (!max_pairs || reclaimed < max_pairs); ns = ns->next) {
+        for (size_t i = 0; i < ns->stripe_count && (!max_pairs || reclaimed < max_pairs); i++) {
+            fossil_crabdb_stripe_t *stripe = &ns->stripes[i];
+            fossil_crabdb_stripe_write_lock(db, stripe);
+            reclaimed += fossil_crabdb_stripe_expire(ns, stripe, now, max_pairs ? max_pairs - reclaimed : 0);
+            fossil_crabdb_stripe_tidy(ns, stripe);
+            fossil_crabdb_stripe_write_unlock(db, stripe);
+        }
+    }
+    fossil_crabdb_read_unlock(db);
+    return reclaimed;
+}
+
+fossil_crabdb_error_t fossil_crabdb_set_memory_budget(fossil_crabdb_t *db, const char *namespace_name, size_t max_bytes) {
+    if (!db || !namespace_name) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+
+    fossil_crabdb_write_lock(db);
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    if (!current) {
+        fossil_crabdb_write_unlock(db);
+        return CRABDB_ERR_NS_NOT_FOUND;
+    }
+
+    fossil_crabdb_error_t result = CRABDB_OK;
+    if (!max_bytes) {
+        for (size_t i = 0; i < current->stripe_count; i++) {
+            fossil_crabdb_clock_t *clock = current->stripes[i].clock;
+            current->stripes[i].clock = cnullptr;
+            fossil_crabdb_defer(current->stripes[i].rcu, clock, fossil_crabdb_release_clock);
+        }
+        fossil_crabdb_write_unlock(db);
+        return result;
+    }
+
+    // Build every missing clock before installing any, so running out of
+    // memory leaves the namespace as it was
+    fossil_crabdb_clock_t **clocks = (fossil_crabdb_clock_t **)calloc(current->stripe_count, sizeof(*clocks));
+    if (!clocks) result = CRABDB_ERR_MEM;
+    for (size_t i = 0; result == CRABDB_OK && i < current->stripe_count; i++) {
+        fossil_crabdb_stripe_t *stripe = &current->stripes[i];
+        if (stripe->clock) continue;
+
+        clocks[i] = (fossil_crabdb_clock_t *)calloc(1, sizeof(fossil_crabdb_clock_t));
+        if (!clocks[i] || fossil_crabdb_clock_reserve(cnullptr, clocks[i], stripe->index.count) != 0) result = CRABDB_ERR_MEM;
+    }
+
+    for (size_t i = 0; i < current->stripe_count; i++) {
+        fossil_crabdb_stripe_t *stripe = &current->stripes[i];
+        if (result != CRABDB_OK) {
+            fossil_crabdb_clock_free(clocks ? clocks[i] : cnullptr);
+            continue;
+        }
+        if (clocks[i]) {
+            // Pairs already held join unreferenced, just like new ones
+            fossil_crabdb_clock_t *clock = clocks[i];
+            for (fossil_crabdb_keyvalue_t *kv = stripe->data; kv; kv = kv->next) {
+                kv->clock_slot = clock->count;
+                clock->ring[clock->count] = kv;
+                atomic_store_explicit(&clock->referenced[clock->count], 0, memory_order_relaxed);
+                clock->count++;
+            }
+            stripe->clock = clock;
+        }
+        stripe->clock->budget = max_bytes / current->stripe_count + (i < max_bytes % current->stripe_count);
+        if (!stripe->clock->budget) stripe->clock->budget = 1;
+    }
+    free(clocks);
+
+    for (size_t i = 0; result == CRABDB_OK && i < current->stripe_count; i++) {
+        result = fossil_crabdb_stripe_evict(db, current, &current->stripes[i], cnullptr);
+        fossil_crabdb_stripe_tidy(current, &current->stripes[i]);
+    }
+    fossil_crabdb_write_unlock(db);
+    return fossil_crabdb_after_write(db, result);
+}
+
+fossil_crabdb_error_t fossil_crabdb_memory_stats(fossil_crabdb_t *db, const char *namespace_name, fossil_crabdb_memory_stats_t *stats) {
+    if (!db || !namespace_name || !stats) return CRABDB_ERR_MEM;
+    memset(stats, 0, sizeof(*stats));
+
+    if (db->image) return CRABDB_OK;
+
+    fossil_crabdb_read_lock(db);
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    if (!current) {
+        fossil_crabdb_read_unlock(db);
+        return CRABDB_ERR_NS_NOT_FOUND;
+    }
+
+    for (size_t i = 0; i < current->stripe_count; i++) {
+        fossil_crabdb_stripe_t *stripe = &current->stripes[i];
+        fossil_crabdb_stripe_read_lock(db, stripe);
+        stats->resident_bytes += stripe->resident;
+        stats->pairs += stripe->index.count;
+        stats->evictions += stripe->evictions;
+        stats->arena_bytes += stripe->allocated;
+        stats->bloom_bytes += fossil_crabdb_bloom_bytes(stripe->bloom);
+        stats->versions += stripe->retained;
+        if (stripe->clock) stats->budget_bytes += stripe->clock->budget;
+        fossil_crabdb_stripe_read_unlock(db, stripe);
+    }
+    if (current->codec) stats->dictionary_bytes = current->codec->dictionary_length;
+    fossil_crabdb_read_unlock(db);
+    return CRABDB_OK;
+}
+
+/**
+ * Add the probe lengths of the live entries of one table: the slots a
+ * lookup inspects from the home slot of the hash up to the entry.
+ */
+static void fossil_crabdb_table_probes(const fossil_crabdb_slot_t *table, size_t capacity, uint64_t *total, size_t *longest) {
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < capacity; i++) {
+        if (!table[i].entry || table[i].entry == FOSSIL_CRABDB_TOMBSTONE) continue;
+        size_t probe = ((i - ((size_t)table[i].hash & mask)) & mask) + 1;
+        *total += probe;
+        if (probe > *longest) *longest = probe;
+    }
+}
+
+static void fossil_crabdb_op_stats(const fossil_crabdb_metrics_t *metrics, fossil_crabdb_stat_op_t op, fossil_crabdb_op_stats_t *out) {
+    uint64_t buckets[FOSSIL_CRABDB_HISTOGRAM_BUCKETS] = {0};
+    uint64_t total_ns = 0;
+    for (size_t s = 0; s < metrics->shard_count; s++) {
+        const fossil_crabdb_meter_t *meter = &metrics->meters[s * CRABDB_STAT_OP_COUNT + op];
+        out->calls += atomic_load_explicit(&meter->calls, memory_order_relaxed);
+        out->errors += atomic_load_explicit(&meter->errors, memory_order_relaxed);
+        total_ns += atomic_load_explicit(&meter->total_ns, memory_order_relaxed);
+        uint64_t max_ns = atomic_load_explicit(&meter->max_ns, memory_order_relaxed);
+        if (max_ns > out->max_ns) out->max_ns = max_ns;
+        for (size_t b = 0; b < FOSSIL_CRABDB_HISTOGRAM_BUCKETS; b++) {
+            buckets[b] += atomic_load_explicit(&meter->buckets[b], memory_order_relaxed);
+        }
+    }
+
+    // The bucket counts, not the racy sample counters, define the population
+    for (size_t b = 0; b < FOSSIL_CRABDB_HISTOGRAM_BUCKETS; b++) out->samples += buckets[b];
+    if (!out->samples) return;
+    out->mean_ns = total_ns / out->samples;
+
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    uint64_t *targets[] = {&out->p50_ns, &out->p90_ns, &out->p99_ns, &out->p999_ns};
+    uint64_t seen = 0;
+    size_t q = 0;
+    for (size_t b = 0; b < FOSSIL_CRABDB_HISTOGRAM_BUCKETS && q < 4; b++) {
+        seen += buckets[b];
+        while (q < 4 && (double)seen >= quantiles[q] * (double)out->samples) {
+            uint64_t value = fossil_crabdb_histogram_value(b);
+            *targets[q++] = value < out->max_ns ? value : out->max_ns;
+        }
+    }
+}
+
+fossil_crabdb_error_t fossil_crabdb_stats(fossil_crabdb_t *db, fossil_crabdb_stats_t *stats) {
+    if (!db || !stats) return CRABDB_ERR_MEM;
+    memset(stats, 0, sizeof(*stats));
+
+    for (int op = 0; op < CRABDB_STAT_OP_COUNT; op++) {
+        fossil_crabdb_op_stats(db->metrics, (fossil_crabdb_stat_op_t)op, &stats->ops[op]);
+    }
+    if (db->image) return CRABDB_OK;
+
+    uint64_t probes = 0;
+    fossil_crabdb_read_lock(db);
+    for (fossil_crabdb_namespace_t *ns = db->namespaces; ns; ns = ns->next) {
+        stats->namespaces++;
+        for (size_t i = 0; i < ns->stripe_count; i++) {
+            fossil_crabdb_stripe_t *stripe = &ns->stripes[i];
+            fossil_crabdb_stripe_read_lock(db, stripe);
+            stats->pairs += stripe->index.count;
+            stats->resident_bytes += stripe->resident;
+            stats->arena_bytes += stripe->allocated;
+            stats->index_slots += stripe->index.capacity + stripe->index.old_capacity;
+            fossil_crabdb_table_probes(stripe->index.slots, stripe->index.capacity, &probes, &stats->max_probe);
+            fossil_crabdb_table_probes(stripe->index.old_slots, stripe->index.old_capacity, &probes, &stats->max_probe);
+            fossil_crabdb_stripe_read_unlock(db, stripe);
+        }
+    }
+    fossil_crabdb_read_unlock(db);
+
+    if (stats->index_slots) stats->load_factor = (double)stats->pairs / (double)stats->index_slots;
+    if (stats->pairs) stats->mean_probe = (double)probes / (double)stats->pairs;
+    return CRABDB_OK;
+}
+
+size_t fossil_crabdb_stats_format(const fossil_crabdb_stats_t *stats, char *buffer, size_t size) {
+    static const char *const names[CRABDB_STAT_OP_COUNT] = {"get", "insert", "update", "delete", "multi_get", "write_batch", "scan"};
+    static const char *const quantiles[] = {"0.5", "0.9", "0.99", "0.999"};
+    if (!stats) {
+        if (size) buffer[0] = '\0';
+        return 0;
+    }
+
+    size_t length = 0;
+#define FOSSIL_CRABDB_EMIT(...) do { \
+        int n = snprintf(length < size ? buffer + length : cnullptr, length < size ? size - length : 0, __VA_ARGS__); \
+        if (n > 0) length += (size_t)n; \
+    } while (0)
+
+    FOSSIL_CRABDB_EMIT("# TYPE crabdb_ops_total counter\n");
+    for (int op = 0; op < CRABDB_STAT_OP_COUNT; op++) {
+        FOSSIL_CRABDB_EMIT("crabdb_ops_total{op=\"%s\"} %llu\n", names[op], (unsigned long long)stats->ops[op].calls);
+    }
+    FOSSIL_CRABDB_EMIT("# TYPE crabdb_errors_total counter\n");
+    for (int op = 0; op < CRABDB_STAT_OP_COUNT; op++) {
+        FOSSIL_CRABDB_EMIT("crabdb_errors_total{op=\"%s\"} %llu\n", names[op], (unsigned long long)stats->ops[op].errors);
+    }
+    FOSSIL_CRABDB_EMIT("# TYPE crabdb_latency_seconds summary\n");
+    for (int op = 0; op < CRABDB_STAT_OP_COUNT; op++) {
+        const fossil_crabdb_op_stats_t *o = &stats->ops[op];
+        const uint64_t values[] = {o->p50_ns, o->p90_ns, o->p99_ns, o->p999_ns};
+        for (int q = 0; q < 4; q++) {
+            FOSSIL_CRABDB_EMIT("crabdb_latency_seconds{op=\"%s\",quantile=\"%s\"} %.9f\n", names[op], quantiles[q], (double)values[q] * 1e-9);
+        }
+        FOSSIL_CRABDB_EMIT("crabdb_latency_seconds_sum{op=\"%s\"} %.9f\n", names[op], (double)(o->mean_ns * o->samples) * 1e-9);
+        FOSSIL_CRABDB_EMIT("crabdb_latency_seconds_count{op=\"%s\"} %llu\n", names[op], (unsigned long long)o->samples);
+    }
+    FOSSIL_CRABDB_EMIT("# TYPE crabdb_namespaces gauge\ncrabdb_namespaces %llu\n", (unsigned long long)stats->namespaces);
+    FOSSIL_CRABDB_EMIT("# TYPE crabdb_pairs gauge\ncrabdb_pairs %llu\n", (unsigned long long)stats->pairs);
+    FOSSIL_CRABDB_EMIT("# TYPE crabdb_resident_bytes gauge\ncrabdb_resident_bytes %llu\n", (unsigned long long)stats->resident_bytes);
+    FOSSIL_CRABDB_EMIT("# TYPE crabdb_arena_bytes gauge\ncrabdb_arena_bytes %llu\n", (unsigned long long)stats->arena_bytes);
+    FOSSIL_CRABDB_EMIT("# TYPE crabdb_index_slots gauge\ncrabdb_index_slots %llu\n", (unsigned long long)stats->index_slots);
+    FOSSIL_CRABDB_EMIT("# TYPE crabdb_index_load_factor gauge\ncrabdb_index_load_factor %.4f\n", stats->load_factor);
+    FOSSIL_CRABDB_EMIT("# TYPE crabdb_index_probe_mean gauge\ncrabdb_index_probe_mean %.4f\n", stats->mean_probe);
+    FOSSIL_CRABDB_EMIT("# TYPE crabdb_index_probe_max gauge\ncrabdb_index_probe_max %llu\n", (unsigned long long)stats->max_probe);
+#undef FOSSIL_CRABDB_EMIT
+    return length;
+}
+
+fossil_crabdb_error_t fossil_crabdb_compact(fossil_crabdb_t *db, const char *namespace_name) {
+    if (!db || !namespace_name) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_OK;
+
+    fossil_crabdb_read_lock(db);
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    if (!current) {
+        fossil_crabdb_read_unlock(db);
+        return CRABDB_ERR_NS_NOT_FOUND;
+    }
+
+    // One partition at a time, so the rest of the namespace stays available
+    fossil_crabdb_error_t result = CRABDB_OK;
+    for (size_t i = 0; i < current->stripe_count; i++) {
+        fossil_crabdb_stripe_t *stripe = &current->stripes[i];
+        fossil_crabdb_stripe_write_lock(db, stripe);
+        if (stripe->garbage && fossil_crabdb_stripe_compact(current, stripe) != 0) result = CRABDB_ERR_MEM;
+        fossil_crabdb_stripe_write_unlock(db, stripe);
+    }
+    fossil_crabdb_read_unlock(db);
+    return result;
+}
+
+static fossil_crabdb_error_t fossil_crabdb_do_delete(fossil_crabdb_t *db, const char *namespace_name, const char *key) {
+    if (!db || !namespace_name || !key) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+
+    uint64_t hash = fossil_crabdb_hash(key);
+    fossil_crabdb_read_lock(db);
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    if (!current) {
+        fossil_crabdb_read_unlock(db);
+        return CRABDB_ERR_NS_NOT_FOUND;
+    }
+
+    fossil_crabdb_stripe_t *stripe = fossil_crabdb_stripe_for(current, hash);
+    fossil_crabdb_error_t result = CRABDB_ERR_KEY_NOT_FOUND;
+    uint64_t now = 0;
+    fossil_crabdb_stripe_write_lock(db, stripe);
+    if (stripe->wheel) fossil_crabdb_stripe_expire(current, stripe, now = fossil_crabdb_now_ms(), FOSSIL_CRABDB_EXPIRE_STEP);
+    fossil_crabdb_keyvalue_t *kv = fossil_crabdb_stripe_find(stripe, key, hash);
+    fossil_crabdb_version_t *retired = cnullptr;
+    if (kv && !fossil_crabdb_expired(kv, &now)) {
+        uint64_t sequence = fossil_crabdb_commit(db);
+        if (fossil_crabdb_retaining(db) && !(retired = fossil_crabdb_retire(current, stripe, kv, sequence))) {
+            kv = cnullptr;
+            result = CRABDB_ERR_MEM;
+        }
+    }
+    if (kv) {
+        fossil_crabdb_index_remove(&stripe->index, key, hash);
+        if (retired) fossil_crabdb_history_push(db, stripe, retired);
+        if (current->ordered) fossil_crabdb_ordered_lock(current->ordered);
+        fossil_crabdb_unlink_pair(current, stripe, kv);
+        if (current->ordered) fossil_crabdb_ordered_unlock(current->ordered);
+        // A pair found past its deadline is reclaimed but was already gone
+        if (!fossil_crabdb_expired(kv, &now)) {
+            result = fossil_crabdb_log(db, CRABDB_OP_DELETE, namespace_name, key, cnullptr);
+        }
+        fossil_crabdb_free_pair(stripe, kv);
+    }
+    fossil_crabdb_stripe_tidy(current, stripe);
+    fossil_crabdb_stripe_write_unlock(db, stripe);
+    fossil_crabdb_read_unlock(db);
+    return fossil_crabdb_after_write(db, result);
+}
+
+fossil_crabdb_error_t fossil_crabdb_delete(fossil_crabdb_t *db, const char *namespace_name, const char *key) {
+    uint64_t began = fossil_crabdb_meter_start();
+    return fossil_crabdb_meter(db, CRABDB_STAT_DELETE, began, fossil_crabdb_do_delete(db, namespace_name, key));
+}
+
+static fossil_crabdb_error_t fossil_crabdb_do_multi_get(fossil_crabdb_t *db, const char *namespace_name, const char *const *keys, size_t count, char **values) {
+    if (!db || !namespace_name || (count && (!keys || !values))) return CRABDB_ERR_MEM;
+    for (size_t i = 0; i < count; i++) {
+        values[i] = cnullptr;
+        if (!keys[i]) return CRABDB_ERR_MEM;
+    }
+
+    if (db->image) {
+        fossil_crabdb_error_t result = CRABDB_OK;
+        for (size_t i = 0; i < count; i++) {
+            const char *mapped;
+            size_t length;
+            fossil_crabdb_error_t found = fossil_crabdb_image_find(db->image, namespace_name, keys[i], &mapped, &length);
+            if (found == CRABDB_OK) {
+                values[i] = fossil_crabdb_memdup(mapped, length);
+                if (!values[i]) found = CRABDB_ERR_MEM;
+            }
+            if (found != CRABDB_OK && result != CRABDB_ERR_MEM) result = found;
+        }
+        return result;
+    }
+
+    // Hash everything up front and order the keys by partition so each
+    // partition is visited (and locked) once
+    uint64_t *hashes = (uint64_t *)malloc((count ? count : 1) * sizeof(uint64_t));
+    size_t *order = (size_t *)malloc((count ? count : 1) * sizeof(size_t));
+    size_t *starts = (size_t *)calloc(db->stripe_count + 1, sizeof(size_t));
+    if (!hashes || !order || !starts) {
+        free(hashes);
+        free(order);
+        free(starts);
+        return CRABDB_ERR_MEM;
+    }
+    for (size_t i = 0; i < count; i++) {
+        hashes[i] = fossil_crabdb_hash(keys[i]);
+        starts[(size_t)(hashes[i] >> 32) % db->stripe_count + 1]++;
+    }
+    for (size_t s = 0; s < db->stripe_count; s++) {
+        starts[s + 1] += starts[s];
+    }
+    for (size_t i = 0; i < count; i++) {
+        order[starts[(size_t)(hashes[i] >> 32) % db->stripe_count]++] = i;
+    }
+
+    fossil_crabdb_error_t result = CRABDB_OK;
+    uint64_t now = 0;
+    fossil_crabdb_read_lock(db);
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    if (!current) {
+        result = CRABDB_ERR_NS_NOT_FOUND;
+    }
+
+    // After the placement pass starts[s] is the end of partition s
+    for (size_t s = 0, n = 0; current && s < current->stripe_count; s++) {
+        if (n == starts[s]) continue;
+
+        fossil_crabdb_stripe_t *stripe = &current->stripes[s];
+        size_t mask = stripe->index.capacity - 1;
+        fossil_crabdb_stripe_read_lock(db, stripe);
+        for (; n < starts[s]; n++) {
+            if (n + 4 < starts[s] && stripe->index.slots) {
+                FOSSIL_CRABDB_PREFETCH(&stripe->index.slots[(size_t)hashes[order[n + 4]] & mask]);
+            }
+            size_t i = order[n];
+            fossil_crabdb_keyvalue_t *kv = fossil_crabdb_stripe_find(stripe, keys[i], hashes[i]);
+            if (!kv || fossil_crabdb_expired(kv, &now)) {
+                if (result == CRABDB_OK) result = CRABDB_ERR_KEY_NOT_FOUND;
+            } else {
+                fossil_crabdb_touch(stripe, kv);
+                if (!(values[i] = fossil_crabdb_value_copy(current->codec, kv))) result = CRABDB_ERR_MEM;
+            }
+        }
+        fossil_crabdb_stripe_read_unlock(db, stripe);
+    }
+    fossil_crabdb_read_unlock(db);
+
+    free(hashes);
+    free(order);
+    free(starts);
+    return result;
+}
+
+fossil_crabdb_error_t fossil_crabdb_multi_get(fossil_crabdb_t *db, const char *namespace_name, const char *const *keys, size_t count, char **values) {
+    uint64_t began = fossil_crabdb_meter_start();
+    return fossil_crabdb_meter(db, CRABDB_STAT_MULTI_GET, began, fossil_crabdb_do_multi_get(db, namespace_name, keys, count, values));
+}
+
+/**
+ * Per-entry state of a write batch, prepared before any lock is taken.
+ */
+typedef struct {
+    uint64_t hash; /**< Hash of the entry key */
+    size_t prev; /**< Previous entry of the batch with the same key, or SIZE_MAX */
+    size_t key_length; /**< Length of the entry key */
+    size_t value_length; /**< Length of the entry value, 0 for a delete */
+    fossil_crabdb_packed_t packed; /**< Entry value as it is to be stored */
+    fossil_crabdb_keyvalue_t *kv; /**< New pair of an insert, once carved out */
+    fossil_crabdb_version_t *retired; /**< Copy of the pair the entry replaces, kept for open snapshots */
+} fossil_crabdb_batch_state_t;
+
+static fossil_crabdb_error_t fossil_crabdb_do_write_batch(fossil_crabdb_t *db, const char *namespace_name, const fossil_crabdb_batch_entry_t *entries, size_t count) {
+    if (!db || !namespace_name || (count && !entries)) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+    for (size_t i = 0; i < count; i++) {
+        if (!entries[i].key || (entries[i].op != CRABDB_BATCH_DELETE && !entries[i].value)) return CRABDB_ERR_MEM;
+        if (entries[i].op != CRABDB_BATCH_INSERT && entries[i].op != CRABDB_BATCH_UPDATE && entries[i].op != CRABDB_BATCH_DELETE) {
+            return CRABDB_ERR_INVALID_QUERY;
+        }
+    }
+
+    // Everything that can be worked out without the locks is, and every
+    // allocation in the locked section happens before the first change
+    fossil_crabdb_error_t result = CRABDB_OK;
+    fossil_crabdb_batch_state_t *state = (fossil_crabdb_batch_state_t *)calloc(count ? count : 1, sizeof(fossil_crabdb_batch_state_t));
+    size_t *inserts = (size_t *)calloc(db->stripe_count, sizeof(size_t));
+    size_t *bytes = (size_t *)calloc(db->stripe_count, sizeof(size_t));
+    size_t *retires = (size_t *)calloc(db->stripe_count, sizeof(size_t));
+    unsigned char *touched = (unsigned char *)calloc(db->stripe_count, 1);
+    unsigned char *record_data = cnullptr;
+    size_t record_size = 0;
+    fossil_crabdb_index_t seen;
+    fossil_crabdb_index_init(&seen, offsetof(fossil_crabdb_batch_entry_t, key));
+    if (!state || !inserts || !bytes || !retires || !touched || fossil_crabdb_index_prepare(&seen, count) != 0) result = CRABDB_ERR_MEM;
+
+    for (size_t i = 0; result == CRABDB_OK && i < count; i++) {
+        const fossil_crabdb_batch_entry_t *entry = &entries[i];
+        state[i].hash = fossil_crabdb_hash(entry->key);
+        state[i].prev = SIZE_MAX;
+        state[i].key_length = strlen(entry->key);
+        state[i].value_length = entry->op == CRABDB_BATCH_DELETE ? 0 : strlen(entry->value);
+
+        fossil_crabdb_slot_t *slot = fossil_crabdb_index_find_slot(&seen, entry->key, state[i].hash);
+        if (slot) {
+            state[i].prev = (size_t)((const fossil_crabdb_batch_entry_t *)slot->entry - entries);
+            slot->entry = (void *)entry;
+        } else if (fossil_crabdb_index_insert(&seen, state[i].hash, (void *)entry) != 0) {
+            result = CRABDB_ERR_MEM;
+            break;
+        }
+
+        size_t s = (size_t)(state[i].hash >> 32) % db->stripe_count;
+        touched[s] = 1;
+        if (entry->op != CRABDB_BATCH_INSERT && state[i].prev == SIZE_MAX) retires[s]++;
+        if (entry->op == CRABDB_BATCH_INSERT) inserts[s]++;
+    }
+    fossil_crabdb_index_free(&seen);
+
+    if (result == CRABDB_OK && (db->persist || db->stream)) {
+        record_data = fossil_crabdb_encode_batch(entries, count, &record_size);
+        if (!record_data) result = CRABDB_ERR_MEM;
+    }
+
+    fossil_crabdb_namespace_t *current = cnullptr;
+    if (result == CRABDB_OK) {
+        fossil_crabdb_read_lock(db);
+        current = fossil_crabdb_find_namespace(db, namespace_name);
+        if (!current) {
+            fossil_crabdb_read_unlock(db);
+            result = CRABDB_ERR_NS_NOT_FOUND;
+        }
+    }
+
+    if (current) {
+        // Values are compressed, and their space worked out, before the
+        // partition locks are taken
+        for (size_t i = 0; result == CRABDB_OK && i < count; i++) {
+            if (entries[i].op == CRABDB_BATCH_DELETE) continue;
+            if (fossil_crabdb_pack(current->codec, entries[i].value, state[i].value_length, &state[i].packed) != 0) {
+                result = CRABDB_ERR_MEM;
+                break;
+            }
+            size_t s = (size_t)(state[i].hash >> 32) % db->stripe_count;
+            if (entries[i].op == CRABDB_BATCH_INSERT) {
+                bytes[s] += fossil_crabdb_pair_blocks(state[i].key_length, state[i].packed.length);
+            } else {
+                bytes[s] += fossil_crabdb_value_block(state[i].packed.length);
+            }
+        }
+
+        // Ascending partition order keeps concurrent batches deadlock free
+        for (size_t s = 0; s < current->stripe_count; s++) {
+            if (touched[s]) fossil_crabdb_stripe_write_lock(db, &current->stripes[s]);
+        }
+        if (current->ordered) fossil_crabdb_ordered_lock(current->ordered);
+
+        // Validate the whole batch in order, taking earlier entries into
+        // account; expired pairs in the way are reclaimed first
+        uint64_t now = 0;
+        for (size_t i = 0; result == CRABDB_OK && i < count; i++) {
+            int exists;
+            if (state[i].prev != SIZE_MAX) {
+                exists = entries[state[i].prev].op != CRABDB_BATCH_DELETE;
+            } else {
+                fossil_crabdb_stripe_t *stripe = fossil_crabdb_stripe_for(current, state[i].hash);
+                fossil_crabdb_keyvalue_t *kv = fossil_crabdb_stripe_find(stripe, entries[i].key, state[i].hash);
+                if (kv && fossil_crabdb_expired(kv, &now)) {
+                    fossil_crabdb_purge_pair(current, stripe, kv);
+                    kv = cnullptr;
+                }
+                exists = kv != cnullptr;
+            }
+            if (entries[i].op == CRABDB_BATCH_INSERT ? exists : !exists) {
+                result = CRABDB_ERR_KEY_NOT_FOUND;
+            }
+        }
+
+        for (size_t s = 0; result == CRABDB_OK && s < current->stripe_count; s++) {
+            fossil_crabdb_stripe_t *stripe = &current->stripes[s];
+            if (fossil_crabdb_index_prepare(&stripe->index, inserts[s]) != 0 ||
+                fossil_crabdb_clock_reserve(stripe->rcu, stripe->clock, inserts[s]) != 0 ||
+                fossil_crabdb_bloom_reserve(stripe, inserts[s]) != 0 ||
+                (bytes[s] && fossil_crabdb_arena_reserve(stripe, bytes[s]) != 0)) {
+                result = CRABDB_ERR_MEM;
+            }
+        }
+
+        // The whole batch commits under one sequence; while snapshots are
+        // open, the first entry to touch each existing pair copies it
+        uint64_t sequence = 0;
+        if (result == CRABDB_OK) {
+            sequence = fossil_crabdb_commit(db);
+            if (fossil_crabdb_retaining(db)) {
+                for (size_t s = 0; result == CRABDB_OK && s < current->stripe_count; s++) {
+                    if (fossil_crabdb_index_prepare(&current->stripes[s].history, retires[s]) != 0) result = CRABDB_ERR_MEM;
+                }
+                for (size_t i = 0; result == CRABDB_OK && i < count; i++) {
+                    if (entries[i].op == CRABDB_BATCH_INSERT || state[i].prev != SIZE_MAX) continue;
+                    fossil_crabdb_stripe_t *stripe = fossil_crabdb_stripe_for(current, state[i].hash);
+                    state[i].retired = fossil_crabdb_version_new(current->codec, fossil_crabdb_stripe_find(stripe, entries[i].key, state[i].hash), sequence);
+                    if (!state[i].retired) result = CRABDB_ERR_MEM;
+                }
+            }
+        }
+
+        // New pairs enter the ordered index first, next to any pair of the
+        // same key that a later entry deletes; this is the last step that
+        // can fail and it is undone on failure
+        for (size_t i = 0; result == CRABDB_OK && i < count; i++) {
+            if (entries[i].op != CRABDB_BATCH_INSERT) continue;
+            fossil_crabdb_stripe_t *stripe = fossil_crabdb_stripe_for(current, state[i].hash);
+            state[i].kv = fossil_crabdb_new_pair(stripe, entries[i].key, state[i].key_length, state[i].hash, state[i].packed.data, state[i].packed.length, state[i].packed.raw_length);
+            if (current->ordered && fossil_crabdb_ordered_insert(current->ordered, state[i].kv) != 0) {
+                fossil_crabdb_free_pair(stripe, state[i].kv);
+                while (i--) {
+                    if (entries[i].op != CRABDB_BATCH_INSERT) continue;
+                    fossil_crabdb_ordered_remove(current->ordered, state[i].kv);
+                    fossil_crabdb_free_pair(fossil_crabdb_stripe_for(current, state[i].hash), state[i].kv);
+                }
+                result = CRABDB_ERR_MEM;
+                break;
+            }
+        }
+
+        for (size_t i = 0; result == CRABDB_OK && i < count; i++) {
+            fossil_crabdb_stripe_t *stripe = fossil_crabdb_stripe_for(current, state[i].hash);
+            if (entries[i].op == CRABDB_BATCH_INSERT) {
+                fossil_crabdb_keyvalue_t *kv = state[i].kv;
+                kv->version = sequence;
+                fossil_crabdb_index_insert(&stripe->index, kv->hash, kv);
+                kv->next = stripe->data;
+                if (stripe->data) {
+                    stripe->data->prev = kv;
+                }
+                stripe->data = kv;
+                fossil_crabdb_charge_pair(stripe, kv);
+                if (stripe->bloom) fossil_crabdb_bloom_add(stripe->bloom, kv->hash);
+            } else if (entries[i].op == CRABDB_BATCH_UPDATE) {
+                fossil_crabdb_keyvalue_t *kv = (fossil_crabdb_keyvalue_t *)fossil_crabdb_index_find(&stripe->index, entries[i].key, state[i].hash);
+                if (state[i].retired) fossil_crabdb_history_push(db, stripe, state[i].retired);
+                state[i].retired = cnullptr;
+                stripe->resident -= kv->value_length;
+                fossil_crabdb_store_value(stripe, kv, state[i].packed.data, state[i].packed.length, state[i].packed.raw_length);
+                kv->version = sequence;
+                stripe->resident += kv->value_length;
+                fossil_crabdb_touch(stripe, kv);
+            } else {
+                fossil_crabdb_keyvalue_t *kv = (fossil_crabdb_keyvalue_t *)fossil_crabdb_index_remove(&stripe->index, entries[i].key, state[i].hash);
+                if (state[i].retired) fossil_crabdb_history_push(db, stripe, state[i].retired);
+                state[i].retired = cnullptr;
+                fossil_crabdb_unlink_pair(current, stripe, kv);
+                fossil_crabdb_free_pair(stripe, kv);
+            }
+        }
+
+        if (result == CRABDB_OK && record_data) {
+            fossil_crabdb_record_t record = { 0, CRABDB_OP_BATCH, { namespace_name, (const char *)record_data, cnullptr },
+                                              { (uint32_t)strlen(namespace_name), (uint32_t)record_size, 0 }, 0 };
+            result = fossil_crabdb_log_record(db, &record);
+        }
+
+        if (current->ordered) fossil_crabdb_ordered_unlock(current->ordered);
+        for (size_t s = current->stripe_count; s-- > 0;) {
+            if (!touched[s]) continue;
+            if (result == CRABDB_OK && current->stripes[s].clock) {
+                result = fossil_crabdb_stripe_evict(db, current, &current->stripes[s], cnullptr);
+            }
+            fossil_crabdb_stripe_tidy(current, &current->stripes[s]);
+            fossil_crabdb_stripe_write_unlock(db, &current->stripes[s]);
+        }
+        fossil_crabdb_read_unlock(db);
+    }
+
+    for (size_t i = 0; state && i < count; i++) {
+        free(state[i].retired);
+        free(state[i].packed.buffer);
+    }
+    free(state);
+    free(inserts);
+    free(bytes);
+    free(retires);
+    free(touched);
+    free(record_data);
+    return fossil_crabdb_after_write(db, result);
+}
+
+fossil_crabdb_error_t fossil_crabdb_write_batch(fossil_crabdb_t *db, const char *namespace_name, const fossil_crabdb_batch_entry_t *entries, size_t count) {
+    uint64_t began = fossil_crabdb_meter_start();
+    return fossil_crabdb_meter(db, CRABDB_STAT_WRITE_BATCH, began, fossil_crabdb_do_write_batch(db, namespace_name, entries, count));
+}
+
+fossil_crabdb_error_t fossil_crabdb_create_ordered_index(fossil_crabdb_t *db, const char *namespace_name) {
+    if (!db || !namespace_name) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+
+    fossil_crabdb_write_lock(db);
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    if (!current || current->ordered) {
+        fossil_crabdb_write_unlock(db);
+        return current ? CRABDB_OK : CRABDB_ERR_NS_NOT_FOUND;
+    }
+
+    size_t count = fossil_crabdb_namespace_size(current);
+    fossil_crabdb_keyvalue_t **sorted = (fossil_crabdb_keyvalue_t **)malloc(sizeof(*sorted) * (count + 1));
+    fossil_crabdb_ordered_t *ordered = (fossil_crabdb_ordered_t *)calloc(1, sizeof(fossil_crabdb_ordered_t));
+    fossil_crabdb_error_t result = CRABDB_OK;
+    if (!sorted || !ordered) {
+        result = CRABDB_ERR_MEM;
+    } else {
+        size_t n = 0;
+        for (size_t i = 0; i < current->stripe_count; i++) {
+            for (fossil_crabdb_keyvalue_t *kv = current->stripes[i].data; kv; kv = kv->next) {
+                sorted[n++] = kv;
+            }
+        }
+        qsort(sorted, n, sizeof(*sorted), fossil_crabdb_compare_keys);
+
+        if (db->locks) ordered->locked = fossil_mutex_create(&ordered->lock) == 0;
+        if ((db->locks && !ordered->locked) || fossil_crabdb_ordered_build(ordered, sorted, n) != 0) {
+            result = CRABDB_ERR_MEM;
+        }
+    }
+
+    if (result == CRABDB_OK) {
+        current->ordered = ordered;
+        ordered = cnullptr;
+        result = fossil_crabdb_log(db, CRABDB_OP_ORDERED_INDEX, namespace_name, cnullptr, cnullptr);
+    }
+    fossil_crabdb_write_unlock(db);
+
+    fossil_crabdb_ordered_free(ordered);
+    free(sorted);
+    return fossil_crabdb_after_write(db, result);
+}
+
+fossil_crabdb_error_t fossil_crabdb_create_bloom_filter(fossil_crabdb_t *db, const char *namespace_name, size_t bits_per_key) {
+    if (!db || !namespace_name) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+    if (!bits_per_key) bits_per_key = FOSSIL_CRABDB_BLOOM_DEFAULT_BITS;
+    if (bits_per_key > FOSSIL_CRABDB_BLOOM_MAX_BITS) bits_per_key = FOSSIL_CRABDB_BLOOM_MAX_BITS;
+
+    fossil_crabdb_write_lock(db);
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    if (!current || current->stripes[0].bloom) {
+        fossil_crabdb_write_unlock(db);
+        return current ? CRABDB_OK : CRABDB_ERR_NS_NOT_FOUND;
+    }
+
+    // Build every filter before installing any, so running out of memory
+    // leaves the namespace as it was
+    fossil_crabdb_error_t result = CRABDB_OK;
+    fossil_crabdb_bloom_t **filters = (fossil_crabdb_bloom_t **)calloc(current->stripe_count, sizeof(*filters));
+    if (!filters) result = CRABDB_ERR_MEM;
+    for (size_t i = 0; result == CRABDB_OK && i < current->stripe_count; i++) {
+        fossil_crabdb_stripe_t *stripe = &current->stripes[i];
+        filters[i] = fossil_crabdb_bloom_layer(bits_per_key, stripe->index.count * 2, cnullptr);
+        if (!filters[i]) {
+            result = CRABDB_ERR_MEM;
+            break;
+        }
+        for (fossil_crabdb_keyvalue_t *kv = stripe->data; kv; kv = kv->next) {
+            fossil_crabdb_bloom_add(filters[i], kv->hash);
+        }
+    }
+
+    for (size_t i = 0; filters && i < current->stripe_count; i++) {
+        if (result == CRABDB_OK) {
+            current->stripes[i].bloom = filters[i];
+        } else {
+            fossil_crabdb_bloom_free(filters[i]);
+        }
+    }
+    free(filters);
+
+    if (result == CRABDB_OK) {
+        char bits[24];
+        snprintf(bits, sizeof(bits), "%zu", bits_per_key);
+        result = fossil_crabdb_log(db, CRABDB_OP_BLOOM_FILTER, namespace_name, bits, cnullptr);
+    }
+    fossil_crabdb_write_unlock(db);
+    return fossil_crabdb_after_write(db, result);
+}
+
+/**
+ * New form of one pair in a recode, SIZE_MAX `offset` when it stays as is.
+ */
+typedef struct {
+    size_t offset; /**< Start of the value in the recode buffer */
+    size_t length; /**< Bytes to store */
+    size_t raw_length; /**< Length once decompressed, 0 when stored as is */
+} fossil_crabdb_recoded_t;
+
+/**
+ * Store every value of a namespace the way `codec` would, then make it the
+ * namespace codec. All values are encoded anew before the first one
+ * changes, so running out of memory leaves the namespace as it was. The
+ * caller holds the database lock exclusively.
+ */
+static fossil_crabdb_error_t fossil_crabdb_recode(fossil_crabdb_t *db, fossil_crabdb_namespace_t *ns, fossil_crabdb_codec_t *codec) {
+    size_t count = fossil_crabdb_namespace_size(ns);
+    fossil_crabdb_recoded_t *forms = (fossil_crabdb_recoded_t *)malloc((count + 1) * sizeof(*forms));
+    size_t *needs = (size_t *)calloc(ns->stripe_count, sizeof(size_t));
+    fossil_crabdb_packed_t packed = { 0 };
+    char *buffer = cnullptr;
+    size_t used = 0, size = 0, n = 0;
+    fossil_crabdb_error_t result = forms && needs ? CRABDB_OK : CRABDB_ERR_MEM;
+
+    for (size_t s = 0; result == CRABDB_OK && s < ns->stripe_count; s++) {
+        for (fossil_crabdb_keyvalue_t *kv = ns->stripes[s].data; kv; kv = kv->next, n++) {
+            char *plain = kv->raw_length ? fossil_crabdb_value_copy(ns->codec, kv) : cnullptr;
+            if ((kv->raw_length && !plain) || fossil_crabdb_pack(codec, plain ? plain : kv->value, fossil_crabdb_plain_length(kv), &packed) != 0) {
+                free(plain);
+                result = CRABDB_ERR_MEM;
+                break;
+            }
+            if (!kv->raw_length && !packed.raw_length) {
+                forms[n].offset = SIZE_MAX;
+                continue;
+            }
+            if (used + packed.length > size) {
+                size_t grown_size = size ? size * 2 : FOSSIL_CRABDB_CHUNK_SIZE;
+                while (grown_size < used + packed.length) grown_size *= 2;
+                char *grown = (char *)realloc(buffer, grown_size);
+                if (!grown) {
+                    free(plain);
+                    result = CRABDB_ERR_MEM;
+                    break;
+                }
+                buffer = grown;
+                size = grown_size;
+            }
+            memcpy(buffer + used, packed.data, packed.length);
+            forms[n].offset = used;
+            forms[n].length = packed.length;
+            forms[n].raw_length = packed.raw_length;
+            used += packed.length;
+            needs[s] += fossil_crabdb_value_need(kv, packed.length);
+            free(plain);
+        }
+    }
+    for (size_t s = 0; result == CRABDB_OK && s < ns->stripe_count; s++) {
+        if (needs[s] && fossil_crabdb_arena_reserve(&ns->stripes[s], needs[s]) != 0) result = CRABDB_ERR_MEM;
+    }
+
+    if (result == CRABDB_OK) {
+        n = 0;
+        for (size_t s = 0; s < ns->stripe_count; s++) {
+            fossil_crabdb_stripe_t *stripe = &ns->stripes[s];
+            for (fossil_crabdb_keyvalue_t *kv = stripe->data; kv; kv = kv->next, n++) {
+                if (forms[n].offset == SIZE_MAX) continue;
+                stripe->resident -= kv->value_length;
+                fossil_crabdb_store_value(stripe, kv, buffer + forms[n].offset, forms[n].length, forms[n].raw_length);
+                stripe->resident += kv->value_length;
+            }
+            fossil_crabdb_stripe_tidy(ns, stripe);
+        }
+        fossil_crabdb_codec_t *stale = ns->codec;
+        ns->codec = codec;
+        fossil_crabdb_defer(db->locks ? db->locks->rcu : cnullptr, stale, fossil_crabdb_release_codec);
+    }
+
+    free(forms);
+    free(needs);
+    free(buffer);
+    free(packed.buffer);
+    return result;
+}
+
+/**
+ * Compress the values of a namespace from `threshold` bytes on against
+ * `dictionary`, or store them as is for a threshold of 0, and log it. The
+ * caller holds the database lock exclusively.
+ */
+static fossil_crabdb_error_t fossil_crabdb_install_codec(fossil_crabdb_t *db, fossil_crabdb_namespace_t *ns, size_t threshold, const char *dictionary, size_t dictionary_length) {
+    fossil_crabdb_codec_t *codec = cnullptr;
+    if (threshold) {
+        codec = fossil_crabdb_codec_new(threshold, dictionary, dictionary_length);
+        if (!codec) return CRABDB_ERR_MEM;
+    }
+    fossil_crabdb_error_t result = fossil_crabdb_recode(db, ns, codec);
+    if (result != CRABDB_OK) {
+        fossil_crabdb_codec_free(codec);
+        return result;
+    }
+
+    char digits[24];
+    int length = snprintf(digits, sizeof(digits), "%zu", threshold);
+    fossil_crabdb_record_t record = { 0, CRABDB_OP_COMPRESSION, { ns->name, digits, codec ? (const char *)codec->dictionary : cnullptr },
+                                      { (uint32_t)strlen(ns->name), (uint32_t)length, codec ? (uint32_t)codec->dictionary_length : 0 }, 0 };
+    return db->persist || db->stream ? fossil_crabdb_log_record(db, &record) : CRABDB_OK;
+}
+
+static fossil_crabdb_error_t fossil_crabdb_use_compression(fossil_crabdb_t *db, const char *namespace_name, size_t threshold, const char *dictionary, size_t dictionary_length) {
+    if (!db || !namespace_name) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+    if (dictionary_length > FOSSIL_CRABDB_DICT_MAX) return CRABDB_ERR_INVALID_QUERY;
+
+    fossil_crabdb_write_lock(db);
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    fossil_crabdb_error_t result = current ? fossil_crabdb_install_codec(db, current, threshold, dictionary, dictionary_length) : CRABDB_ERR_NS_NOT_FOUND;
+    fossil_crabdb_write_unlock(db);
+    return fossil_crabdb_after_write(db, result);
+}
+
+fossil_crabdb_error_t fossil_crabdb_set_compression(fossil_crabdb_t *db, const char *namespace_name, size_t threshold) {
+    if (!db || !namespace_name) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+
+    fossil_crabdb_write_lock(db);
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    fossil_crabdb_error_t result = CRABDB_ERR_NS_NOT_FOUND;
+    if (current) {
+        // A trained dictionary outlives a change of threshold
+        const fossil_crabdb_codec_t *codec = current->codec;
+        result = fossil_crabdb_install_codec(db, current, threshold, codec ? (const char *)codec->dictionary : cnullptr, codec ? codec->dictionary_length : 0);
+    }
+    fossil_crabdb_write_unlock(db);
+    return fossil_crabdb_after_write(db, result);
+}
+
+fossil_crabdb_error_t fossil_crabdb_train_dictionary(fossil_crabdb_t *db, const char *namespace_name, size_t dictionary_size) {
+    if (!db || !namespace_name) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+    if (!dictionary_size) dictionary_size = FOSSIL_CRABDB_DICT_DEFAULT;
+    if (dictionary_size > FOSSIL_CRABDB_DICT_MAX) dictionary_size = FOSSIL_CRABDB_DICT_MAX;
+
+    fossil_crabdb_write_lock(db);
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    if (!current || !current->codec) {
+        fossil_crabdb_write_unlock(db);
+        return current ? CRABDB_ERR_INVALID_QUERY : CRABDB_ERR_NS_NOT_FOUND;
+    }
+
+    // Sample evenly across the values the codec would compress
+    size_t threshold = current->codec->threshold;
+    size_t eligible = 0;
+    for (size_t s = 0; s < current->stripe_count; s++) {
+        for (fossil_crabdb_keyvalue_t *kv = current->stripes[s].data; kv; kv = kv->next) {
+            if (fossil_crabdb_plain_length(kv) >= threshold) eligible++;
+        }
+    }
+    size_t stride = eligible / FOSSIL_CRABDB_TRAIN_SAMPLES + 1;
+    char **samples = (char **)calloc(FOSSIL_CRABDB_TRAIN_SAMPLES, sizeof(char *));
+    size_t *lengths = (size_t *)calloc(FOSSIL_CRABDB_TRAIN_SAMPLES, sizeof(size_t));
+    unsigned char *dictionary = (unsigned char *)malloc(dictionary_size);
+    fossil_crabdb_error_t result = samples && lengths && dictionary ? CRABDB_OK : CRABDB_ERR_MEM;
+    size_t count = 0, seen = 0;
+    for (size_t s = 0; result == CRABDB_OK && s < current->stripe_count; s++) {
+        for (fossil_crabdb_keyvalue_t *kv = current->stripes[s].data; kv && count < FOSSIL_CRABDB_TRAIN_SAMPLES; kv = kv->next) {
+            size_t length = fossil_crabdb_plain_length(kv);
+            if (length < threshold || seen++ % stride) continue;
+            if (!(samples[count] = fossil_crabdb_value_copy(current->codec, kv))) {
+                result = CRABDB_ERR_MEM;
+                break;
+            }
+            lengths[count++] = length < FOSSIL_CRABDB_TRAIN_SAMPLE_BYTES ? length : FOSSIL_CRABDB_TRAIN_SAMPLE_BYTES;
+        }
+    }
+
+    if (result == CRABDB_OK) {
+        size_t trained = fossil_crabdb_train(samples, lengths, count, dictionary, dictionary_size);
+        result = trained == SIZE_MAX ? CRABDB_ERR_MEM : fossil_crabdb_install_codec(db, current, threshold, (const char *)dictionary, trained);
+    }
+    fossil_crabdb_write_unlock(db);
+
+    for (size_t i = 0; i < count; i++) {
+        free(samples[i]);
+    }
+    free(samples);
+    free(lengths);
+    free(dictionary);
+    return fossil_crabdb_after_write(db, result);
+}
+
+struct fossil_crabdb_cursor_t {
+    fossil_crabdb_t *db; /**< Database being scanned */
+    fossil_crabdb_namespace_t *ns; /**< Namespace of an ordered scan, its partitions read-locked */
+    fossil_crabdb_namespace_t *walk; /**< Namespace a full scan is in, null once exhausted */
+    fossil_crabdb_keyvalue_t *kv; /**< Next pair of the partition a full scan holds */
+    int all; /**< A full scan, which read-locks the database until closed */
+    int held; /**< A full scan holds the read guard of partition `stripe` of `walk` */
+    fossil_crabdb_bnode_t *leaf; /**< Current leaf, null once exhausted */
+    size_t position; /**< Next entry of the leaf, one past it when reversed; next copy of a snapshot scan */
+    int reverse; /**< Walking in descending order */
+    uint64_t now; /**< Clock reading used to skip expired pairs, 0 until needed */
+    char *lower; /**< Inclusive lower bound, null if unbounded */
+    char *upper; /**< Exclusive upper bound, null if unbounded */
+    fossil_crabdb_snapshot_t *snapshot; /**< Snapshot being scanned, null for an ordered scan */
+    char *name; /**< Namespace of a snapshot scan, looked up again for every partition */
+    size_t stripe; /**< Next partition a snapshot scan copies; partition a full scan is at */
+    struct fossil_crabdb_copy_t *copies; /**< Pairs copied out of the current partition */
+    size_t copy_count; /**< Pairs copied */
+    size_t copy_capacity; /**< Room in `copies` */
+    char *buffer; /**< Keys and values of the copied pairs; the last value decompressed by an ordered scan */
+    size_t buffer_used; /**< Bytes of `buffer` in use */
+    size_t buffer_size; /**< Size of `buffer` */
+};
+
+typedef struct fossil_crabdb_copy_t {
+    size_t key; /**< Offset of the key in the cursor buffer */
+    size_t value; /**< Offset of the value in the cursor buffer */
+    size_t value_length; /**< Length of the value */
+} fossil_crabdb_copy_t;
+
+/**
+ * Open a cursor over `[lower, upper)`, taking ownership of both bounds.
+ */
+static fossil_crabdb_error_t fossil_crabdb_open_cursor(fossil_crabdb_t *db, const char *namespace_name, char *lower, char *upper, fossil_crabdb_scan_dir_t direction, fossil_crabdb_cursor_t **cursor) {
+    fossil_crabdb_cursor_t *scan = (fossil_crabdb_cursor_t *)calloc(1, sizeof(fossil_crabdb_cursor_t));
+    if (!scan) {
+        free(lower);
+        free(upper);
+        return CRABDB_ERR_MEM;
+    }
+    scan->db = db;
+    scan->reverse = direction == CRABDB_SCAN_REVERSE;
+    scan->lower = lower;
+    scan->upper = upper;
+
+    fossil_crabdb_read_lock(db);
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    if (!current || !current->ordered) {
+        fossil_crabdb_read_unlock(db);
+        free(scan->lower);
+        free(scan->upper);
+        free(scan);
+        return current ? CRABDB_ERR_NO_INDEX : CRABDB_ERR_NS_NOT_FOUND;
+    }
+
+    // Every writer holds a partition lock, so this freezes the whole namespace
+    for (size_t i = 0; i < current->stripe_count; i++) {
+        fossil_crabdb_stripe_read_lock(db, &current->stripes[i]);
+    }
+    scan->ns = current;
+
+    fossil_crabdb_bnode_t *root = current->ordered->root;
+    const char *bound = scan->reverse ? scan->upper : scan->lower;
+    if (!root) {
+        scan->leaf = cnullptr;
+    } else if (bound) {
+        scan->leaf = fossil_crabdb_bnode_descend(root, bound, 1);
+        scan->position = fossil_crabdb_bnode_search(scan->leaf, bound, 0);
+    } else {
+        scan->leaf = root;
+        while (!scan->leaf->leaf) {
+            scan->leaf = scan->leaf->n.children[scan->reverse ? scan->leaf->count - 1 : 0];
+        }
+        scan->position = scan->reverse ? scan->leaf->count : 0;
+    }
+
+    *cursor = scan;
+    return CRABDB_OK;
+}
+
+static fossil_crabdb_error_t fossil_crabdb_do_scan_range(fossil_crabdb_t *db, const char *namespace_name, const char *start, const char *end, fossil_crabdb_scan_dir_t direction, fossil_crabdb_cursor_t **cursor) {
+    if (!cursor) return CRABDB_ERR_MEM;
+    *cursor = cnullptr;
+    if (!db || !namespace_name) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_NO_INDEX;
+
+    char *lower = start ? _custom_fossil_strdup(start) : cnullptr;
+    char *upper = end ? _custom_fossil_strdup(end) : cnullptr;
+    if ((start && !lower) || (end && !upper)) {
+        free(lower);
+        free(upper);
+        return CRABDB_ERR_MEM;
+    }
+    return fossil_crabdb_open_cursor(db, namespace_name, lower, upper, direction, cursor);
+}
+
+fossil_crabdb_error_t fossil_crabdb_scan_range(fossil_crabdb_t *db, const char *namespace_name, const char *start, const char *end, fossil_crabdb_scan_dir_t direction, fossil_crabdb_cursor_t **cursor) {
+    uint64_t began = fossil_crabdb_meter_start();
+    return fossil_crabdb_meter(db, CRABDB_STAT_SCAN, began, fossil_crabdb_do_scan_range(db, namespace_name, start, end, direction, cursor));
+}
+
+static fossil_crabdb_error_t fossil_crabdb_do_scan_prefix(fossil_crabdb_t *db, const char *namespace_name, const char *prefix, fossil_crabdb_scan_dir_t direction, fossil_crabdb_cursor_t **cursor) {
+    if (!cursor) return CRABDB_ERR_MEM;
+    *cursor = cnullptr;
+    if (!db || !namespace_name || !prefix) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_NO_INDEX;
+
+    char *lower = _custom_fossil_strdup(prefix);
+    char *upper = _custom_fossil_strdup(prefix);
+    if (!lower || !upper) {
+        free(lower);
+        free(upper);
+        return CRABDB_ERR_MEM;
+    }
+
+    // The keys with the prefix end before the prefix with its last
+    // incrementable byte bumped; with none left the range is unbounded
+    size_t length = strlen(upper);
+    while (length && (unsigned char)upper[length - 1] == 0xff) length--;
+    if (length) {
+        upper[length - 1] = (char)((unsigned char)upper[length - 1] + 1);
+        upper[length] = '\0';
+    } else {
+        free(upper);
+        upper = cnullptr;
+    }
+    return fossil_crabdb_open_cursor(db, namespace_name, lower, upper, direction, cursor);
+}
+
+fossil_crabdb_error_t fossil_crabdb_scan_prefix(fossil_crabdb_t *db, const char *namespace_name, const char *prefix, fossil_crabdb_scan_dir_t direction, fossil_crabdb_cursor_t **cursor) {
+    uint64_t began = fossil_crabdb_meter_start();
+    return fossil_crabdb_meter(db, CRABDB_STAT_SCAN, began, fossil_crabdb_do_scan_prefix(db, namespace_name, prefix, direction, cursor));
+}
+
+static fossil_crabdb_error_t fossil_crabdb_do_scan_all(fossil_crabdb_t *db, fossil_crabdb_cursor_t **cursor) {
+    if (!cursor) return CRABDB_ERR_MEM;
+    *cursor = cnullptr;
+    if (!db) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_NO_INDEX;
+
+    fossil_crabdb_cursor_t *scan = (fossil_crabdb_cursor_t *)calloc(1, sizeof(fossil_crabdb_cursor_t));
+    if (!scan) return CRABDB_ERR_MEM;
+    scan->db = db;
+    scan->all = 1;
+
+    // Keeps the namespace list still; partitions are guarded one at a time
+    fossil_crabdb_read_lock(db);
+    scan->walk = db->namespaces;
+    *cursor = scan;
+    return CRABDB_OK;
+}
+
+fossil_crabdb_error_t fossil_crabdb_scan_all(fossil_crabdb_t *db, fossil_crabdb_cursor_t **cursor) {
+    uint64_t began = fossil_crabdb_meter_start();
+    return fossil_crabdb_meter(db, CRABDB_STAT_SCAN, began, fossil_crabdb_do_scan_all(db, cursor));
+}
+
+/**
+ * Next live pair of a full scan, moving the read guard from partition to
+ * partition and from namespace to namespace as each runs out.
+ *
+ * @return The pair, or null once every namespace is done.
+ */
+static fossil_crabdb_keyvalue_t *fossil_crabdb_scan_step(fossil_crabdb_cursor_t *cursor) {
+    fossil_crabdb_t *db = cursor->db;
+    for (;;) {
+        while (cursor->kv) {
+            fossil_crabdb_keyvalue_t *kv = cursor->kv;
+            cursor->kv = kv->next;
+            if (cursor->kv) FOSSIL_CRABDB_PREFETCH(cursor->kv);
+            if (!fossil_crabdb_expired(kv, &cursor->now)) return kv;
+        }
+        if (!cursor->walk) return cnullptr;
+
+        if (cursor->held) {
+            fossil_crabdb_stripe_read_unlock(db, &cursor->walk->stripes[cursor->stripe++]);
+            cursor->held = 0;
+        }
+        if (cursor->stripe == cursor->walk->stripe_count) {
+            cursor->walk = cursor->walk->next;
+            cursor->stripe = 0;
+            continue;
+        }
+        fossil_crabdb_stripe_t *stripe = &cursor->walk->stripes[cursor->stripe];
+        fossil_crabdb_stripe_read_lock(db, stripe);
+        cursor->held = 1;
+        cursor->kv = stripe->data;
+    }
+}
+
+/**
+ * End a full scan early, letting go of the partition it holds.
+ */
+static void fossil_crabdb_scan_stop(fossil_crabdb_cursor_t *cursor) {
+    if (cursor->held) fossil_crabdb_stripe_read_unlock(cursor->db, &cursor->walk->stripes[cursor->stripe]);
+    cursor->held = 0;
+    cursor->kv = cnullptr;
+    cursor->walk = cnullptr;
+}
+
+/**
+ * Make `size` bytes of cursor buffer available, keeping what is in use.
+ */
+static int fossil_crabdb_cursor_room(fossil_crabdb_cursor_t *cursor, size_t size) {
+    if (size <= cursor->buffer_size) return 0;
+    size_t grown_size = cursor->buffer_size ? cursor->buffer_size : 4096;
+    while (grown_size < size) grown_size *= 2;
+    char *buffer = (char *)realloc(cursor->buffer, grown_size);
+    if (!buffer) return -1;
+    cursor->buffer = buffer;
+    cursor->buffer_size = grown_size;
+    return 0;
+}
+
+/**
+ * Copy a pair into the cursor buffer, decompressing a value with a
+ * nonzero `raw_length`.
+ */
+static int fossil_crabdb_cursor_copy(fossil_crabdb_cursor_t *cursor, const fossil_crabdb_codec_t *codec, const char *key, const char *value, size_t value_length, size_t raw_length) {
+    size_t key_length = strlen(key);
+    size_t plain_length = raw_length ? raw_length : value_length;
+    size_t need = key_length + plain_length + 2;
+    if (cursor->copy_count == cursor->copy_capacity) {
+        size_t capacity = cursor->copy_capacity ? cursor->copy_capacity * 2 : 64;
+        fossil_crabdb_copy_t *copies = (fossil_crabdb_copy_t *)realloc(cursor->copies, capacity * sizeof(fossil_crabdb_copy_t));
+        if (!copies) return -1;
+        cursor->copies = copies;
+        cursor->copy_capacity = capacity;
+    }
+    if (fossil_crabdb_cursor_room(cursor, cursor->buffer_used + need) != 0) return -1;
+
+    fossil_crabdb_copy_t *copy = &cursor->copies[cursor->copy_count];
+    copy->key = cursor->buffer_used;
+    memcpy(cursor->buffer + copy->key, key, key_length + 1);
+    copy->value = copy->key + key_length + 1;
+    if (!raw_length) {
+        memcpy(cursor->buffer + copy->value, value, value_length + 1);
+    } else if (fossil_crabdb_lz_decompress(codec, (const unsigned char *)value, value_length, (unsigned char *)cursor->buffer + copy->value, raw_length) == 0) {
+        cursor->buffer[copy->value + raw_length] = '\0';
+    } else {
+        return -1;
+    }
+    copy->value_length = plain_length;
+    cursor->copy_count++;
+    cursor->buffer_used += need;
+    return 0;
+}
+
+/**
+ * Copy what the snapshot sees of the next partition that has anything,
+ * holding its read guard only meanwhile.
+ *
+ * @return 0 once every partition is done, the namespace is gone or memory runs out.
+ */
+static int fossil_crabdb_snapshot_fill(fossil_crabdb_cursor_t *cursor) {
+    fossil_crabdb_t *db = cursor->db;
+    uint64_t sequence = cursor->snapshot->sequence;
+    cursor->copy_count = 0;
+    cursor->buffer_used = 0;
+    cursor->position = 0;
+
+    while (!cursor->copy_count && cursor->stripe < db->stripe_count) {
+        fossil_crabdb_read_lock(db);
+        fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, cursor->name);
+        if (!current) {
+            fossil_crabdb_read_unlock(db);
+            return 0;
+        }
+        fossil_crabdb_stripe_t *stripe = &current->stripes[cursor->stripe++];
+        int failed = 0;
+        fossil_crabdb_stripe_read_lock(db, stripe);
+        for (const fossil_crabdb_keyvalue_t *kv = stripe->data; kv && !failed; kv = kv->next) {
+            if (kv->version <= sequence && !fossil_crabdb_expired(kv, &cursor->now)) {
+                failed = fossil_crabdb_cursor_copy(cursor, current->codec, kv->key, kv->value, kv->value_length, kv->raw_length);
+            }
+        }
+        // Keys whose current pair is newer than the snapshot, or gone since
+        for (int table = 0; stripe->retained && table < 2 && !failed; table++) {
+            const fossil_crabdb_slot_t *slots = table ? stripe->history.old_slots : stripe->history.slots;
+            size_t capacity = table ? stripe->history.old_capacity : stripe->history.capacity;
+            for (size_t i = 0; slots && i < capacity && !failed; i++) {
+                if (!slots[i].entry || slots[i].entry == FOSSIL_CRABDB_TOMBSTONE) continue;
+                const fossil_crabdb_version_t *newest = (const fossil_crabdb_version_t *)slots[i].entry;
+                const fossil_crabdb_keyvalue_t *kv = fossil_crabdb_stripe_find(stripe, newest->key, newest->hash);
+                if (kv && kv->version <= sequence) continue;
+                const fossil_crabdb_version_t *version = fossil_crabdb_version_at(newest, sequence, &cursor->now);
+                if (version) failed = fossil_crabdb_cursor_copy(cursor, cnullptr, version->key, version->value, version->value_length, 0);
+            }
+        }
+        fossil_crabdb_stripe_read_unlock(db, stripe);
+        fossil_crabdb_read_unlock(db);
+        if (failed) return 0;
+    }
+    return cursor->copy_count != 0;
+}
+
+/**
+ * Hand out a pair in place, decompressing its value into the cursor
+ * buffer, which the next call reuses.
+ *
+ * @return 0 if the value cannot be decompressed.
+ */
+static int fossil_crabdb_cursor_yield(fossil_crabdb_cursor_t *cursor, const fossil_crabdb_codec_t *codec, const fossil_crabdb_keyvalue_t *kv, const char **key, const char **value, size_t *value_length) {
+    if (key) *key = kv->key;
+    if (kv->raw_length && value) {
+        if (fossil_crabdb_cursor_room(cursor, kv->raw_length + 1) != 0 ||
+            fossil_crabdb_lz_decompress(codec, (const unsigned char *)kv->value, kv->value_length, (unsigned char *)cursor->buffer, kv->raw_length) != 0) {
+            return 0;
+        }
+        cursor->buffer[kv->raw_length] = '\0';
+        *value = cursor->buffer;
+    } else if (value) {
+        *value = kv->value;
+    }
+    if (value_length) *value_length = fossil_crabdb_plain_length(kv);
+    return 1;
+}
+
+int fossil_crabdb_cursor_next(fossil_crabdb_cursor_t *cursor, const char **key, const char **value, size_t *value_length) {
+    if (!cursor) return 0;
+
+    if (cursor->all) {
+        fossil_crabdb_keyvalue_t *kv = fossil_crabdb_scan_step(cursor);
+        if (!kv) return 0;
+        if (!fossil_crabdb_cursor_yield(cursor, cursor->walk->codec, kv, key, value, value_length)) {
+            fossil_crabdb_scan_stop(cursor);
+            return 0;
+        }
+        return 1;
+    }
+
+    if (cursor->snapshot) {
+        if (cursor->position == cursor->copy_count && !fossil_crabdb_snapshot_fill(cursor)) return 0;
+        const fossil_crabdb_copy_t *copy = &cursor->copies[cursor->position++];
+        if (key) *key = cursor->buffer + copy->key;
+        if (value) *value = cursor->buffer + copy->value;
+        if (value_length) *value_length = copy->value_length;
+        return 1;
+    }
+
+    fossil_crabdb_keyvalue_t *kv;
+    do {
+        if (cursor->reverse) {
+            while (cursor->leaf && cursor->position == 0) {
+                cursor->leaf = cursor->leaf->l.prev;
+                cursor->position = cursor->leaf ? cursor->leaf->count : 0;
+            }
+            if (!cursor->leaf) return 0;
+            kv = cursor->leaf->l.entries[--cursor->position];
+            if (cursor->position >= 2) FOSSIL_CRABDB_PREFETCH(cursor->leaf->l.entries[cursor->position - 2]);
+            if (cursor->lower && strcmp(kv->key, cursor->lower) < 0) {
+                cursor->leaf = cnullptr;
+                return 0;
+            }
+        } else {
+            while (cursor->leaf && cursor->position == cursor->leaf->count) {
+                cursor->leaf = cursor->leaf->l.next;
+                cursor->position = 0;
+            }
+            if (!cursor->leaf) return 0;
+            kv = cursor->leaf->l.entries[cursor->position++];
+            if (cursor->position + 1 < cursor->leaf->count) FOSSIL_CRABDB_PREFETCH(cursor->leaf->l.entries[cursor->position + 1]);
+            if (cursor->upper && strcmp(kv->key, cursor->upper) >= 0) {
+                cursor->leaf = cnullptr;
+                return 0;
+            }
+        }
+    } while (fossil_crabdb_expired(kv, &cursor->now));
+
+    if (!fossil_crabdb_cursor_yield(cursor, cursor->ns->codec, kv, key, value, value_length)) {
+        cursor->leaf = cnullptr;
+        return 0;
+    }
+    return 1;
+}
+
+const char *fossil_crabdb_cursor_namespace(const fossil_crabdb_cursor_t *cursor) {
+    if (!cursor) return cnullptr;
+    if (cursor->all) return cursor->walk ? cursor->walk->name : cnullptr;
+    return cursor->ns ? cursor->ns->name : cursor->name;
+}
+
+void fossil_crabdb_cursor_close(fossil_crabdb_cursor_t *cursor) {
+    if (!cursor) return;
+
+    if (cursor->ns) {
+        for (size_t i = cursor->ns->stripe_count; i-- > 0;) {
+            fossil_crabdb_stripe_read_unlock(cursor->db, &cursor->ns->stripes[i]);
+        }
+        fossil_crabdb_read_unlock(cursor->db);
+    }
+    if (cursor->all) {
+        fossil_crabdb_scan_stop(cursor);
+        fossil_crabdb_read_unlock(cursor->db);
+    }
+    free(cursor->lower);
+    free(cursor->upper);
+    free(cursor->name);
+    free(cursor->copies);
+    free(cursor->buffer);
+    free(cursor);
+}
+
+fossil_crabdb_error_t fossil_crabdb_snapshot_begin(fossil_crabdb_t *db, fossil_crabdb_snapshot_t **snapshot) {
+    if (!snapshot) return CRABDB_ERR_MEM;
+    *snapshot = cnullptr;
+    if (!db) return CRABDB_ERR_MEM;
+
+    fossil_crabdb_snapshot_t *view = (fossil_crabdb_snapshot_t *)calloc(1, sizeof(fossil_crabdb_snapshot_t));
+    if (!view) return CRABDB_ERR_MEM;
+    view->db = db;
+
+    // Counted open before the sequence is read, see fossil_crabdb_retaining
+    fossil_crabdb_versions_t *versions = db->versions;
+    fossil_crabdb_versions_lock(db);
+    atomic_fetch_add(&versions->open, 1);
+    view->sequence = atomic_load(&versions->sequence);
+    view->next = versions->snapshots;
+    if (versions->snapshots) versions->snapshots->prev = view;
+    versions->snapshots = view;
+    fossil_crabdb_versions_unlock(db);
+
+    *snapshot = view;
+    return CRABDB_OK;
+}
+
+fossil_crabdb_error_t fossil_crabdb_snapshot_get(fossil_crabdb_snapshot_t *snapshot, const char *namespace_name, const char *key, char **value) {
+    if (!snapshot || !namespace_name || !key || !value) return CRABDB_ERR_MEM;
+
+    // A mapped image never changes, so it reads the same at any point
+    fossil_crabdb_t *db = snapshot->db;
+    if (db->image) return fossil_crabdb_do_get(db, namespace_name, key, value, cnullptr);
+
+    uint64_t hash = fossil_crabdb_hash(key);
+    fossil_crabdb_read_lock(db);
+    fossil_crabdb_namespace_t *current = fossil_crabdb_find_namespace(db, namespace_name);
+    if (!current) {
+        fossil_crabdb_read_unlock(db);
+        return CRABDB_ERR_NS_NOT_FOUND;
+    }
+
+    fossil_crabdb_stripe_t *stripe = fossil_crabdb_stripe_for(current, hash);
+    fossil_crabdb_error_t result = CRABDB_OK;
+    const char *found;
+    size_t length, raw_length;
+    uint64_t now = 0;
+    fossil_crabdb_stripe_read_lock(db, stripe);
+    if (!fossil_crabdb_stripe_find_at(stripe, key, hash, snapshot->sequence, &now, &found, &length, &raw_length)) {
+        result = CRABDB_ERR_KEY_NOT_FOUND;
+    } else {
+        *value = fossil_crabdb_unpack(current->codec, found, length, raw_length);
+        if (!*value) result = CRABDB_ERR_MEM;
+    }
+    fossil_crabdb_stripe_read_unlock(db, stripe);
+    fossil_crabdb_read_unlock(db);
+    return result;
+}
+
+fossil_crabdb_error_t fossil_crabdb_snapshot_scan(fossil_crabdb_snapshot_t *snapshot, const char *namespace_name, fossil_crabdb_cursor_t **cursor) {
+    if (!cursor) return CRABDB_ERR_MEM;
+    *cursor = cnullptr;
+    if (!snapshot || !namespace_name) return CRABDB_ERR_MEM;
+
+    fossil_crabdb_t *db = snapshot->db;
+    if (db->image) return CRABDB_ERR_NO_INDEX;
+
+    fossil_crabdb_read_lock(db);
+    int found = fossil_crabdb_find_namespace(db, namespace_name) != cnullptr;
+    fossil_crabdb_read_unlock(db);
+    if (!found) return CRABDB_ERR_NS_NOT_FOUND;
+
+    fossil_crabdb_cursor_t *scan = (fossil_crabdb_cursor_t *)calloc(1, sizeof(fossil_crabdb_cursor_t));
+    if (!scan) return CRABDB_ERR_MEM;
+    scan->db = db;
+    scan->snapshot = snapshot;
+    scan->name = _custom_fossil_strdup(namespace_name);
+    if (!scan->name) {
+        free(scan);
+        return CRABDB_ERR_MEM;
+    }
+    *cursor = scan;
+    return CRABDB_OK;
+}
+
+void fossil_crabdb_snapshot_end(fossil_crabdb_snapshot_t *snapshot) {
+    if (!snapshot) return;
+
+    fossil_crabdb_t *db = snapshot->db;
+    fossil_crabdb_versions_t *versions = db->versions;
+    fossil_crabdb_versions_lock(db);
+    if (snapshot->prev) {
+        snapshot->prev->next = snapshot->next;
+    } else {
+        versions->snapshots = snapshot->next;
+    }
+    if (snapshot->next) snapshot->next->prev = snapshot->prev;
+    // Closed before the sequence is read: a write drawing a later number
+    // keeps nothing unless another snapshot is still open
+    atomic_fetch_sub(&versions->open, 1);
+    uint64_t horizon = atomic_load(&versions->sequence);
+    for (const fossil_crabdb_snapshot_t *open = versions->snapshots; open; open = open->next) {
+        if (open->sequence < horizon) horizon = open->sequence;
+    }
+    fossil_crabdb_versions_unlock(db);
+    free(snapshot);
+
+    if (!atomic_load(&versions->retained)) return;
+
+    // One partition at a time, like compaction
+    fossil_crabdb_read_lock(db);
+    for (fossil_crabdb_namespace_t *ns = db->namespaces; ns; ns = ns->next) {
+        for (size_t i = 0; i < ns->stripe_count; i++) {
+            fossil_crabdb_stripe_t *stripe = &ns->stripes[i];
+            fossil_crabdb_stripe_write_lock(db, stripe);
+            if (stripe->retained) fossil_crabdb_history_prune(db, stripe, horizon);
+            fossil_crabdb_stripe_write_unlock(db, stripe);
+        }
+    }
+    fossil_crabdb_read_unlock(db);
+}
+
+// *****************************************************************************
+// Bulk loading
+// *****************************************************************************
+
+/*
+ * A bulk load runs in two parallel phases under the exclusive database
+ * lock. First the mapped file is cut into chunks at line boundaries and
+ * each worker decodes one chunk into its own buffer, hashes the keys and
+ * sorts the records by partition. Once the namespaces are resolved, each
+ * worker takes one partition index and inserts the records that fall in it
+ * across every chunk, in file order. Partition `s` of every namespace
+ * belongs to a single worker, so no partition lock is taken; the ordered
+ * indexes, which span partitions, are rebuilt afterwards in one pass.
+ */
+
+#define FOSSIL_CRABDB_LOAD_CHUNK_MIN (256 * 1024)
+#define FOSSIL_CRABDB_LOAD_CHUNKS_PER_THREAD 4
+
+typedef struct fossil_crabdb_load_name_t {
+    char *name; /**< Namespace path, in the chunk text */
+    uint64_t hash; /**< Hash of the path */
+    fossil_crabdb_namespace_t *ns; /**< Namespace once resolved */
+} fossil_crabdb_load_name_t;
+
+typedef struct {
+    uint64_t hash; /**< Hash of the key */
+    const char *key; /**< Decoded key, in the chunk text */
+    const char *value; /**< Decoded value, in the chunk text */
+    size_t key_length; /**< Length of the key */
+    size_t value_length; /**< Length of the value */
+    fossil_crabdb_load_name_t *name; /**< Namespace of the record */
+} fossil_crabdb_load_record_t;
+
+typedef struct {
+    const char *begin; /**< First byte of the chunk in the mapping */
+    const char *end; /**< One past its last byte */
+    size_t stripe_count; /**< Partitions to sort the records into */
+    char *text; /**< Decoded fields, each NUL-terminated */
+    fossil_crabdb_load_record_t *records; /**< Records sorted by partition */
+    size_t record_count; /**< Records in the chunk */
+    size_t *stripe_start; /**< First record of each partition, plus the end */
+    fossil_crabdb_load_name_t **names; /**< Distinct namespace paths */
+    size_t name_count; /**< Paths in use */
+    size_t name_capacity; /**< Paths allocated */
+    fossil_crabdb_index_t name_index; /**< Paths by name */
+    fossil_crabdb_error_t result; /**< Outcome of the parse */
+} fossil_crabdb_load_chunk_t;
+
+typedef struct {
+    fossil_crabdb_t *db; /**< Database being loaded */
+    fossil_crabdb_load_chunk_t *chunks; /**< Parsed chunks, in file order */
+    size_t chunk_count; /**< Number of chunks */
+    size_t stripe; /**< Partition index this worker fills */
+    uint64_t sequence; /**< Commit sequence of the load */
+    int retaining; /**< Replaced values must be kept for snapshots */
+    fossil_crabdb_error_t result; /**< Outcome of the inserts */
+} fossil_crabdb_load_part_t;
+
+static size_t fossil_crabdb_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? (size_t)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t)count : 1;
+#endif
+}
+
+/**
+ * Run `task` over `count` arguments of `size` bytes on up to `threads`
+ * workers and wait for all of them. Tasks the pool cannot take run inline.
+ */
+static void fossil_crabdb_run_tasks(fossil_xtask_func_t task, void *args, size_t size, size_t count, size_t threads) {
+    fossil_xthread_pool_t pool;
+    if (threads > count) threads = count;
+    if (threads < 2 || threads > INT32_MAX || count >= INT32_MAX ||
+        fossil_thread_pool_create(&pool, (int32_t)threads, (int32_t)count + 1) != 0) {
+        for (size_t i = 0; i < count; i++) task((unsigned char *)args + i * size);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        void *arg = (unsigned char *)args + i * size;
+        if (fossil_thread_pool_add_task(&pool, task, arg) != 0) task(arg);
+    }
+    // Erasing the pool drains the queue and joins the workers
+    fossil_thread_pool_erase(&pool);
+}
+
+/**
+ * Decode one field into `out`, resolving escapes.
+ *
+ * @return Bytes written, or SIZE_MAX for an unknown escape.
+ */
+static size_t fossil_crabdb_load_field(const char *begin, const char *end, char *out) {
+    const char *escape = (const char *)memchr(begin, '\\', (size_t)(end - begin));
+    if (!escape) {
+        memcpy(out, begin, (size_t)(end - begin));
+        out[end - begin] = '\0';
+        return (size_t)(end - begin);
+    }
+
+    char *start = out;
+    memcpy(out, begin, (size_t)(escape - begin));
+    out += escape - begin;
+    for (const char *p = escape; p < end; p++) {
+        if (*p != '\\') {
+            *out++ = *p;
+            continue;
+        }
+        if (++p == end) return SIZE_MAX;
+        switch (*p) {
+            case 't': *out++ = '\t'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case '\\': *out++ = '\\'; break;
+            default: return SIZE_MAX;
+        }
+    }
+    *out = '\0';
+    return (size_t)(out - start);
+}
+
+static fossil_crabdb_load_name_t *fossil_crabdb_load_name(fossil_crabdb_load_chunk_t *chunk, char *name) {
+    uint64_t hash = fossil_crabdb_hash(name);
+    fossil_crabdb_load_name_t *entry = (fossil_crabdb_load_name_t *)fossil_crabdb_index_find(&chunk->name_index, name, hash);
+    if (entry) return entry;
+
+    if (chunk->name_count == chunk->name_capacity) {
+        size_t capacity = chunk->name_capacity ? chunk->name_capacity * 2 : 4;
+        fossil_crabdb_load_name_t **grown = (fossil_crabdb_load_name_t **)realloc(chunk->names, capacity * sizeof(*grown));
+        if (!grown) return cnullptr;
+        chunk->names = grown;
+        chunk->name_capacity = capacity;
+    }
+    entry = (fossil_crabdb_load_name_t *)malloc(sizeof(fossil_crabdb_load_name_t));
+    if (!entry) return cnullptr;
+    entry->name = name;
+    entry->hash = hash;
+    entry->ns = cnullptr;
+    if (fossil_crabdb_index_insert(&chunk->name_index, hash, entry) != 0) {
+        free(entry);
+        return cnullptr;
+    }
+    chunk->names[chunk->name_count++] = entry;
+    return entry;
+}
+
+/**
+ * Parse a chunk of TSV lines and sort its records by partition.
+ */
+static void fossil_crabdb_load_parse(void *arg) {
+    fossil_crabdb_load_chunk_t *chunk = (fossil_crabdb_load_chunk_t *)arg;
+    size_t length = (size_t)(chunk->end - chunk->begin);
+    size_t capacity = length / 32 + 16;
+    fossil_crabdb_load_record_t *parsed = (fossil_crabdb_load_record_t *)malloc(capacity * sizeof(*parsed));
+    chunk->text = (char *)malloc(length + 1);
+    chunk->stripe_start = (size_t *)calloc(chunk->stripe_count + 1, sizeof(size_t));
+    if (!parsed || !chunk->text || !chunk->stripe_start) {
+        free(parsed);
+        chunk->result = CRABDB_ERR_MEM;
+        return;
+    }
+
+    // Three separators end every line and each one becomes a terminator,
+    // so the decoded text never outgrows the chunk plus a final terminator
+    char *out = chunk->text;
+    size_t count = 0;
+    for (const char *line = chunk->begin; line < chunk->end && chunk->result == CRABDB_OK;) {
+        const char *newline = (const char *)memchr(line, '\n', (size_t)(chunk->end - line));
+        const char *end = newline ? newline : chunk->end;
+        const char *next = newline ? newline + 1 : chunk->end;
+        if (end > line && end[-1] == '\r') end--;
+        if (end == line) {
+            line = next;
+            continue;
+        }
+
+        const char *tab1 = (const char *)memchr(line, '\t', (size_t)(end - line));
+        const char *tab2 = tab1 ? (const char *)memchr(tab1 + 1, '\t', (size_t)(end - tab1 - 1)) : cnullptr;
+        if (!tab2 || tab1 == line || memchr(tab2 + 1, '\t', (size_t)(end - tab2 - 1))) {
+            chunk->result = CRABDB_ERR_INVALID_QUERY;
+            break;
+        }
+        if (count == capacity) {
+            capacity *= 2;
+            fossil_crabdb_load_record_t *grown = (fossil_crabdb_load_record_t *)realloc(parsed, capacity * sizeof(*parsed));
+            if (!grown) {
+                chunk->result = CRABDB_ERR_MEM;
+                break;
+            }
+            parsed = grown;
+        }
+
+        fossil_crabdb_load_record_t *record = &parsed[count];
+        char *name = out;
+        size_t name_length = fossil_crabdb_load_field(line, tab1, out);
+        if (name_length == SIZE_MAX) {
+            chunk->result = CRABDB_ERR_INVALID_QUERY;
+            break;
+        }
+        out += name_length + 1;
+        record->key = out;
+        record->key_length = fossil_crabdb_load_field(tab1 + 1, tab2, out);
+        if (record->key_length == SIZE_MAX) {
+            chunk->result = CRABDB_ERR_INVALID_QUERY;
+            break;
+        }
+        out += record->key_length + 1;
+        record->value = out;
+        record->value_length = fossil_crabdb_load_field(tab2 + 1, end, out);
+        if (record->value_length == SIZE_MAX) {
+            chunk->result = CRABDB_ERR_INVALID_QUERY;
+            break;
+        }
+        out += record->value_length + 1;
+
+        record->hash = fossil_crabdb_hash(record->key);
+        record->name = fossil_crabdb_load_name(chunk, name);
+        if (!record->name) {
+            chunk->result = CRABDB_ERR_MEM;
+            break;
+        }
+        chunk->stripe_start[(size_t)(record->hash >> 32) % chunk->stripe_count + 1]++;
+        count++;
+        line = next;
+    }
+
+    // A stable counting sort keeps file order within each partition
+    if (chunk->result == CRABDB_OK && count) {
+        chunk->records = (fossil_crabdb_load_record_t *)malloc(count * sizeof(*parsed));
+        if (!chunk->records) chunk->result = CRABDB_ERR_MEM;
+    }
+    if (chunk->result == CRABDB_OK && count) {
+        for (size_t s = 0; s < chunk->stripe_count; s++) {
+            chunk->stripe_start[s + 1] += chunk->stripe_start[s];
+        }
+        for (size_t i = 0; i < count; i++) {
+            size_t s = (size_t)(parsed[i].hash >> 32) % chunk->stripe_count;
+            chunk->records[chunk->stripe_start[s]++] = parsed[i];
+        }
+        // Each start was advanced to the next partition's; shift them back
+        memmove(chunk->stripe_start + 1, chunk->stripe_start, chunk->stripe_count * sizeof(size_t));
+        chunk->stripe_start[0] = 0;
+        chunk->record_count = count;
+    }
+    free(parsed);
+}
+
+/**
+ * Whether a namespace path is well formed: no empty segment anywhere.
+ */
+static int fossil_crabdb_valid_path(const char *path) {
+    if (!*path || *path == '/') return 0;
+    for (const char *p = path; *p; p++) {
+        if (*p == '/' && (p[1] == '/' || p[1] == '\0')) return 0;
+    }
+    return 1;
 }
 
-void fossil_crabdb_erase(fossil_crabdb_t *db) {
-    if (!db) return;
+/**
+ * Find the namespace at `path`, creating it and any missing parents. The
+ * database lock is held exclusively.
+ */
+static fossil_crabdb_error_t fossil_crabdb_ensure_namespace(fossil_crabdb_t *db, const char *path, uint64_t hash, fossil_crabdb_namespace_t **ns) {
+    *ns = (fossil_crabdb_namespace_t *)fossil_crabdb_index_find(&db->namespace_index, path, hash);
+    if (*ns) return CRABDB_OK;
 
-    fossil_crabdb_namespace_t *current = db->namespaces;
-    while (current) {
-        fossil_crabdb_namespace_t *next = current->next;
-        free(current->name);
+    fossil_crabdb_namespace_t *parent = cnullptr;
+    const char *slash = strrchr(path, '/');
+    if (slash) {
+        size_t length = (size_t)(slash - path);
+        char *parent_path = (char *)malloc(length + 1);
+        if (!parent_path) return CRABDB_ERR_MEM;
+        memcpy(parent_path, path, length);
+        parent_path[length] = '\0';
+        fossil_crabdb_error_t result = fossil_crabdb_ensure_namespace(db, parent_path, fossil_crabdb_hash(parent_path), &parent);
+        free(parent_path);
+        if (result != CRABDB_OK) return result;
+    }
 
-        for (size_t i = 0; i < current->sub_namespace_count; i++) {
-            free(current->sub_namespaces[i].name);
-        }
-        free(current->sub_namespaces);
+    fossil_crabdb_error_t result = fossil_crabdb_add_namespace(db, parent, path, hash);
+    if (result == CRABDB_OK) *ns = (fossil_crabdb_namespace_t *)fossil_crabdb_index_find(&db->namespace_index, path, hash);
+    return result;
+}
+
+/**
+ * Fill one partition index of every namespace from all chunks.
+ */
+static void fossil_crabdb_load_part(void *arg) {
+    fossil_crabdb_load_part_t *part = (fossil_crabdb_load_part_t *)arg;
+    size_t s = part->stripe;
+    uint64_t now = 0;
+    fossil_crabdb_packed_t packed = { 0 };
+
+    for (size_t c = 0; c < part->chunk_count && part->result == CRABDB_OK; c++) {
+        const fossil_crabdb_load_chunk_t *chunk = &part->chunks[c];
+        for (size_t i = chunk->stripe_start[s]; i < chunk->stripe_start[s + 1]; i++) {
+            const fossil_crabdb_load_record_t *record = &chunk->records[i];
+            fossil_crabdb_stripe_t *stripe = &record->name->ns->stripes[s];
+            fossil_crabdb_keyvalue_t *kv = fossil_crabdb_stripe_find(stripe, record->key, record->hash);
+            if (fossil_crabdb_pack(record->name->ns->codec, record->value, record->value_length, &packed) != 0) {
+                part->result = CRABDB_ERR_MEM;
+                break;
+            }
+
+            if (kv) {
+                // Replaced in place; an expired pair is simply revived
+                fossil_crabdb_version_t *retired = cnullptr;
+                if (fossil_crabdb_arena_reserve(stripe, fossil_crabdb_value_need(kv, packed.length)) != 0 ||
+                    (part->retaining && !fossil_crabdb_expired(kv, &now) && !(retired = fossil_crabdb_retire(record->name->ns, stripe, kv, part->sequence)))) {
+                    part->result = CRABDB_ERR_MEM;
+                    break;
+                }
+                if (retired) fossil_crabdb_history_push(part->db, stripe, retired);
+                if (kv->timer) fossil_crabdb_timer_arm(stripe, kv, 0);
+                stripe->resident -= kv->value_length;
+                fossil_crabdb_store_value(stripe, kv, packed.data, packed.length, packed.raw_length);
+                stripe->resident += kv->value_length;
+                kv->version = part->sequence;
+                fossil_crabdb_touch(stripe, kv);
+                continue;
+            }
 
-        fossil_crabdb_keyvalue_t *kv = current->data;
-        while (kv) {
-            fossil_crabdb_keyvalue_t *kv_next = kv->next;
-            free(kv->key);
-            free(kv->value);
-            free(kv);
-            kv = kv_next;
+            if (fossil_crabdb_arena_reserve(stripe, fossil_crabdb_pair_blocks(record->key_length, packed.length)) != 0 ||
+                fossil_crabdb_index_prepare(&stripe->index, 1) != 0 ||
+                fossil_crabdb_clock_reserve(stripe->rcu, stripe->clock, 1) != 0 || fossil_crabdb_bloom_reserve(stripe, 1) != 0) {
+                part->result = CRABDB_ERR_MEM;
+                break;
+            }
+            kv = fossil_crabdb_new_pair(stripe, record->key, record->key_length, record->hash, packed.data, packed.length, packed.raw_length);
+            kv->version = part->sequence;
+            fossil_crabdb_index_insert(&stripe->index, record->hash, kv);
+            kv->next = stripe->data;
+            if (stripe->data) {
+                stripe->data->prev = kv;
+            }
+            stripe->data = kv;
+            fossil_crabdb_charge_pair(stripe, kv);
+            if (stripe->bloom) fossil_crabdb_bloom_add(stripe->bloom, record->hash);
         }
+    }
+    free(packed.buffer);
+}
 
-        free(current);
-        current = next;
+/**
+ * Rebuild the ordered index of a namespace the load wrote to. If that runs
+ * out of memory the index is dropped rather than left missing pairs.
+ */
+static fossil_crabdb_error_t fossil_crabdb_load_reorder(fossil_crabdb_namespace_t *ns) {
+    size_t count = fossil_crabdb_namespace_size(ns);
+    fossil_crabdb_keyvalue_t **sorted = (fossil_crabdb_keyvalue_t **)malloc(sizeof(*sorted) * (count + 1));
+    fossil_crabdb_ordered_t rebuilt = { 0 };
+    int built = 0;
+    if (sorted) {
+        size_t n = 0;
+        for (size_t i = 0; i < ns->stripe_count; i++) {
+            for (fossil_crabdb_keyvalue_t *kv = ns->stripes[i].data; kv; kv = kv->next) {
+                sorted[n++] = kv;
+            }
+        }
+        qsort(sorted, n, sizeof(*sorted), fossil_crabdb_compare_keys);
+        built = fossil_crabdb_ordered_build(&rebuilt, sorted, n) == 0;
+        free(sorted);
     }
 
-    free(db);
+    if (!built) {
+        fossil_crabdb_ordered_free(ns->ordered);
+        ns->ordered = cnullptr;
+        return CRABDB_ERR_MEM;
+    }
+    fossil_crabdb_bnode_free(ns->ordered->root);
+    ns->ordered->root = rebuilt.root;
+    return CRABDB_OK;
 }
 
-fossil_crabdb_error_t fossil_crabdb_create_namespace(fossil_crabdb_t *db, const char *namespace_name) {
-    if (!db || !namespace_name) return CRABDB_ERR_MEM;
+fossil_crabdb_error_t fossil_crabdb_bulk_load(fossil_crabdb_t *db, const char *path, fossil_crabdb_load_format_t format) {
+    if (!db || !path) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+    if (format != CRABDB_LOAD_TSV) return CRABDB_ERR_INVALID_QUERY;
 
-    fossil_crabdb_namespace_t *current = db->namespaces;
-    while (current) {
-        if (strcmp(current->name, namespace_name) == 0) {
-            return CRABDB_ERR_NS_EXISTS;
-        }
-        current = current->next;
+    // Map the whole input; an empty file loads nothing
+    const char *base = cnullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, cnullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, cnullptr);
+    HANDLE mapping = cnullptr;
+    LARGE_INTEGER file_size;
+    if (file == INVALID_HANDLE_VALUE) return CRABDB_ERR_IO;
+    if (!GetFileSizeEx(file, &file_size) || (uint64_t)file_size.QuadPart > SIZE_MAX) {
+        CloseHandle(file);
+        return CRABDB_ERR_IO;
+    }
+    size = (size_t)file_size.QuadPart;
+    if (!size) {
+        CloseHandle(file);
+        return CRABDB_OK;
+    }
+    mapping = CreateFileMappingA(file, cnullptr, PAGE_READONLY, 0, 0, cnullptr);
+    if (mapping) base = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!base) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        return CRABDB_ERR_IO;
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (uint64_t)st.st_size > SIZE_MAX) {
+        if (fd >= 0) close(fd);
+        return CRABDB_ERR_IO;
     }
+    size = (size_t)st.st_size;
+    void *mapped = size ? mmap(cnullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : cnullptr;
+    close(fd);
+    if (!size) return CRABDB_OK;
+    if (mapped == MAP_FAILED) return CRABDB_ERR_IO;
+    base = (const char *)mapped;
+#endif
 
-    fossil_crabdb_namespace_t *new_namespace = (fossil_crabdb_namespace_t*) malloc(sizeof(fossil_crabdb_namespace_t));
-    if (!new_namespace) return CRABDB_ERR_MEM;
+    // Cut the input at line boundaries into a few chunks per worker
+    size_t threads = fossil_crabdb_cpu_count();
+    size_t chunk_count = size / FOSSIL_CRABDB_LOAD_CHUNK_MIN + 1;
+    if (chunk_count > threads * FOSSIL_CRABDB_LOAD_CHUNKS_PER_THREAD) chunk_count = threads * FOSSIL_CRABDB_LOAD_CHUNKS_PER_THREAD;
+    fossil_crabdb_error_t result = CRABDB_OK;
+    fossil_crabdb_load_chunk_t *chunks = (fossil_crabdb_load_chunk_t *)calloc(chunk_count, sizeof(fossil_crabdb_load_chunk_t));
+    fossil_crabdb_load_part_t *parts = (fossil_crabdb_load_part_t *)calloc(db->stripe_count, sizeof(fossil_crabdb_load_part_t));
+    fossil_crabdb_index_t touched;
+    fossil_crabdb_index_init(&touched, offsetof(fossil_crabdb_namespace_t, name));
+    if (!chunks || !parts) result = CRABDB_ERR_MEM;
 
-    new_namespace->name = _custom_fossil_strdup(namespace_name);
-    new_namespace->sub_namespaces = cnullptr;
-    new_namespace->sub_namespace_count = 0;
-    new_namespace->next = db->namespaces;
-    new_namespace->data = cnullptr;
-    db->namespaces = new_namespace;
+    for (size_t c = 0, offset = 0; result == CRABDB_OK && c < chunk_count; c++) {
+        size_t cut = c + 1 == chunk_count ? size : size / chunk_count * (c + 1);
+        if (cut < offset) cut = offset;
+        if (cut > offset && cut < size) {
+            const char *newline = (const char *)memchr(base + cut - 1, '\n', size - cut + 1);
+            cut = newline ? (size_t)(newline - base) + 1 : size;
+        }
+        chunks[c].begin = base + offset;
+        chunks[c].end = base + cut;
+        chunks[c].stripe_count = db->stripe_count;
+        chunks[c].result = CRABDB_OK;
+        fossil_crabdb_index_init(&chunks[c].name_index, offsetof(fossil_crabdb_load_name_t, name));
+        offset = cut;
+    }
 
-    return CRABDB_OK;
-}
+    if (result == CRABDB_OK) {
+        fossil_crabdb_run_tasks(fossil_crabdb_load_parse, chunks, sizeof(*chunks), chunk_count, threads);
+        for (size_t c = 0; c < chunk_count; c++) {
+            if (chunks[c].result != CRABDB_OK) {
+                result = chunks[c].result;
+                break;
+            }
+            for (size_t n = 0; n < chunks[c].name_count; n++) {
+                if (!fossil_crabdb_valid_path(chunks[c].names[n]->name)) result = CRABDB_ERR_INVALID_QUERY;
+            }
+        }
+    }
 
-fossil_crabdb_error_t fossil_crabdb_create_sub_namespace(fossil_crabdb_t *db, const char *namespace_name, const char *sub_namespace_name) {
-    if (!db || !namespace_name || !sub_namespace_name) return CRABDB_ERR_MEM;
+    fossil_crabdb_write_lock(db);
+    if (result == CRABDB_OK) {
+        // Nothing has changed until here; creating namespaces is the first step
+        for (size_t c = 0; result == CRABDB_OK && c < chunk_count; c++) {
+            for (size_t n = 0; result == CRABDB_OK && n < chunks[c].name_count; n++) {
+                fossil_crabdb_load_name_t *name = chunks[c].names[n];
+                result = fossil_crabdb_ensure_namespace(db, name->name, name->hash, &name->ns);
+                if (result == CRABDB_OK && !fossil_crabdb_index_find(&touched, name->name, name->hash) &&
+                    fossil_crabdb_index_insert(&touched, name->hash, name->ns) != 0) {
+                    result = CRABDB_ERR_MEM;
+                }
+            }
+        }
+    }
 
-    fossil_crabdb_namespace_t *current = db->namespaces;
-    while (current) {
-        if (strcmp(current->name, namespace_name) == 0) {
-            for (size_t i = 0; i < current->sub_namespace_count; i++) {
-                if (strcmp(current->sub_namespaces[i].name, sub_namespace_name) == 0) {
-                    return CRABDB_ERR_SUB_NS_EXISTS;
+    if (result == CRABDB_OK && touched.count) {
+        // One sequence covers the load, as for a write batch
+        uint64_t sequence = fossil_crabdb_commit(db);
+        int retaining = fossil_crabdb_retaining(db);
+        for (size_t s = 0; s < db->stripe_count; s++) {
+            parts[s].db = db;
+            parts[s].chunks = chunks;
+            parts[s].chunk_count = chunk_count;
+            parts[s].stripe = s;
+            parts[s].sequence = sequence;
+            parts[s].retaining = retaining;
+            parts[s].result = CRABDB_OK;
+        }
+        fossil_crabdb_run_tasks(fossil_crabdb_load_part, parts, sizeof(*parts), db->stripe_count, threads);
+        for (size_t s = 0; s < db->stripe_count; s++) {
+            if (parts[s].result != CRABDB_OK) result = parts[s].result;
+        }
+
+        // Whatever went in is indexed and accounted for, even after a failure
+        for (fossil_crabdb_namespace_t *ns = db->namespaces; ns; ns = ns->next) {
+            if (!fossil_crabdb_index_find(&touched, ns->name, ns->hash)) continue;
+            if (ns->ordered && fossil_crabdb_load_reorder(ns) != CRABDB_OK) result = CRABDB_ERR_MEM;
+            for (size_t s = 0; s < ns->stripe_count; s++) {
+                if (ns->stripes[s].clock) {
+                    fossil_crabdb_error_t evicted = fossil_crabdb_stripe_evict(db, ns, &ns->stripes[s], cnullptr);
+                    if (result == CRABDB_OK) result = evicted;
                 }
+                fossil_crabdb_stripe_tidy(ns, &ns->stripes[s]);
             }
+        }
+    }
+
+    if (db->persist && touched.count) {
+        fossil_crabdb_error_t written = fossil_crabdb_write_snapshot(db, db->persist);
+        if (result == CRABDB_OK) result = written;
+    }
+    if (db->stream && touched.count) fossil_crabdb_stream_contents(db, db->stream);
+    fossil_crabdb_write_unlock(db);
+
+    for (size_t c = 0; chunks && c < chunk_count; c++) {
+        for (size_t n = 0; n < chunks[c].name_count; n++) {
+            free(chunks[c].names[n]);
+        }
+        free(chunks[c].names);
+        fossil_crabdb_index_free(&chunks[c].name_index);
+        free(chunks[c].text);
+        free(chunks[c].records);
+        free(chunks[c].stripe_start);
+    }
+    free(chunks);
+    free(parts);
+    fossil_crabdb_index_free(&touched);
+#ifdef _WIN32
+    UnmapViewOfFile(base);
+    CloseHandle(mapping);
+    CloseHandle(file);
+#else
+    munmap((void *)base, size);
+#endif
+    return fossil_crabdb_after_write(db, result);
+}
+
+// *****************************************************************************
+// Dumps
+// *****************************************************************************
+
+/*
+ * Dump layout, integers little endian and lengths as LEB128 varints:
+ *
+ *     magic[8]
+ *     namespace 'N' | varint path_len | path | u8 flags |
+ *               [varint bits_per_key] (flags & BLOOM) |
+ *               [varint threshold | varint dict_len | dict] (flags & CODEC)
+ *     pair      'P' | varint key_len | key | varint value_len | value
+ *               'T' | u64 expires | varint key_len | key | varint value_len | value
+ *     end       'E' | varint pair_count | u32 crc32 of every byte before it
+ *
+ * Every namespace comes before those nested in it and is followed by its
+ * pairs. Values are written decompressed, so a restore compresses them
+ * with the settings of the namespace they go into. Both directions go
+ * through one fixed buffer, grown only for a record larger than it.
+ */
 
-            current->sub_namespaces = (fossil_crabdb_namespace_t*) realloc(current->sub_namespaces, sizeof(fossil_crabdb_namespace_t) * (current->sub_namespace_count + 1));
-            if (!current->sub_namespaces) return CRABDB_ERR_MEM;
+#define FOSSIL_CRABDB_DUMP_MAGIC "CRABDMP1"
+#define FOSSIL_CRABDB_DUMP_BUFFER (1024 * 1024)
+#define FOSSIL_CRABDB_DUMP_ORDERED 0x01
+#define FOSSIL_CRABDB_DUMP_BLOOM 0x02
+#define FOSSIL_CRABDB_DUMP_CODEC 0x04
 
-            current->sub_namespaces[current->sub_namespace_count].name = _custom_fossil_strdup(sub_namespace_name);
-            current->sub_namespaces[current->sub_namespace_count].sub_namespaces = cnullptr;
-            current->sub_namespaces[current->sub_namespace_count].sub_namespace_count = 0;
-            current->sub_namespaces[current->sub_namespace_count].next = cnullptr;
-            current->sub_namespaces[current->sub_namespace_count].data = cnullptr;
+typedef struct {
+    fossil_fstream_t *stream; /**< Destination */
+    unsigned char *buffer; /**< Bytes not yet written */
+    size_t used; /**< Bytes of `buffer` in use */
+    uint32_t crc; /**< Running checksum of everything handed to the stream, before finishing */
+    uint64_t pairs; /**< Pairs written */
+    int ok; /**< No write has failed */
+} fossil_crabdb_dump_writer_t;
+
+static void fossil_crabdb_dump_out(fossil_crabdb_dump_writer_t *w, const void *data, size_t size) {
+    w->crc = fossil_crabdb_crc32_extend(w->crc, (const unsigned char *)data, size);
+    if (w->ok && size && fossil_fstream_write(w->stream, data, 1, size) != size) w->ok = 0;
+}
+
+static void fossil_crabdb_dump_flush(fossil_crabdb_dump_writer_t *w) {
+    fossil_crabdb_dump_out(w, w->buffer, w->used);
+    w->used = 0;
+}
 
-            current->sub_namespace_count++;
-            return CRABDB_OK;
+static void fossil_crabdb_dump_write(fossil_crabdb_dump_writer_t *w, const void *data, size_t size) {
+    if (!size) return;
+    if (size > FOSSIL_CRABDB_DUMP_BUFFER - w->used) {
+        fossil_crabdb_dump_flush(w);
+        // Too big to be worth a copy
+        if (size > FOSSIL_CRABDB_DUMP_BUFFER / 2) {
+            fossil_crabdb_dump_out(w, data, size);
+            return;
         }
-        current = current->next;
     }
+    memcpy(w->buffer + w->used, data, size);
+    w->used += size;
+}
 
-    return CRABDB_ERR_NS_NOT_FOUND;
+static void fossil_crabdb_dump_varint(fossil_crabdb_dump_writer_t *w, uint64_t v) {
+    unsigned char out[10];
+    size_t n = 0;
+    do {
+        out[n] = (unsigned char)(v & 0x7f);
+        v >>= 7;
+        if (v) out[n] |= 0x80;
+        n++;
+    } while (v);
+    fossil_crabdb_dump_write(w, out, n);
 }
 
-fossil_crabdb_error_t fossil_crabdb_erase_namespace(fossil_crabdb_t *db, const char *namespace_name) {
-    if (!db || !namespace_name) return CRABDB_ERR_MEM;
+static void fossil_crabdb_dump_bytes(fossil_crabdb_dump_writer_t *w, const void *data, size_t size) {
+    fossil_crabdb_dump_varint(w, size);
+    fossil_crabdb_dump_write(w, data, size);
+}
 
-    fossil_crabdb_namespace_t *prev = cnullptr;
-    fossil_crabdb_namespace_t *current = db->namespaces;
+/**
+ * Write a namespace, its pairs, then the namespaces nested in it. Each
+ * partition is read-guarded while its pairs are written.
+ */
+static void fossil_crabdb_dump_namespace(fossil_crabdb_t *db, fossil_crabdb_dump_writer_t *w, fossil_crabdb_namespace_t *ns, uint64_t *now) {
+    unsigned char flags = (unsigned char)((ns->ordered ? FOSSIL_CRABDB_DUMP_ORDERED : 0) | (ns->stripes[0].bloom ? FOSSIL_CRABDB_DUMP_BLOOM : 0) |
+                                          (ns->codec ? FOSSIL_CRABDB_DUMP_CODEC : 0));
+    fossil_crabdb_dump_write(w, "N", 1);
+    fossil_crabdb_dump_bytes(w, ns->name, strlen(ns->name));
+    fossil_crabdb_dump_write(w, &flags, 1);
+    if (ns->stripes[0].bloom) fossil_crabdb_dump_varint(w, ns->stripes[0].bloom->bits_per_key);
+    if (ns->codec) {
+        fossil_crabdb_dump_varint(w, ns->codec->threshold);
+        fossil_crabdb_dump_bytes(w, ns->codec->dictionary, ns->codec->dictionary_length);
+    }
 
-    while (current) {
-        if (strcmp(current->name, namespace_name) == 0) {
-            if (prev) {
-                prev->next = current->next;
+    char *plain = cnullptr;
+    size_t plain_size = 0;
+    for (size_t i = 0; w->ok && i < ns->stripe_count; i++) {
+        fossil_crabdb_stripe_t *stripe = &ns->stripes[i];
+        fossil_crabdb_stripe_read_lock(db, stripe);
+        for (fossil_crabdb_keyvalue_t *kv = stripe->data; w->ok && kv; kv = kv->next) {
+            if (fossil_crabdb_expired(kv, now)) continue;
+            const char *value = kv->value;
+            if (kv->raw_length) {
+                if (kv->raw_length > plain_size) {
+                    char *grown = (char *)realloc(plain, kv->raw_length);
+                    if (!grown) {
+                        w->ok = 0;
+                        break;
+                    }
+                    plain = grown;
+                    plain_size = kv->raw_length;
+                }
+                if (fossil_crabdb_lz_decompress(ns->codec, (const unsigned char *)kv->value, kv->value_length, (unsigned char *)plain, kv->raw_length) != 0) {
+                    w->ok = 0;
+                    break;
+                }
+                value = plain;
+            }
+            if (kv->timer) {
+                unsigned char expires[8];
+                fossil_crabdb_put_u64(expires, kv->timer->expires);
+                fossil_crabdb_dump_write(w, "T", 1);
+                fossil_crabdb_dump_write(w, expires, sizeof(expires));
             } else {
-                db->namespaces = current->next;
+                fossil_crabdb_dump_write(w, "P", 1);
             }
+            fossil_crabdb_dump_bytes(w, kv->key, kv->key_length);
+            fossil_crabdb_dump_bytes(w, value, fossil_crabdb_plain_length(kv));
+            w->pairs++;
+        }
+        fossil_crabdb_stripe_read_unlock(db, stripe);
+    }
+    free(plain);
 
-            free(current->name);
+    for (size_t i = 0; w->ok && i < ns->sub_namespace_count; i++) {
+        fossil_crabdb_dump_namespace(db, w, ns->sub_namespaces[i], now);
+    }
+}
 
-            for (size_t i = 0; i < current->sub_namespace_count; i++) {
-                free(current->sub_namespaces[i].name);
-            }
-            free(current->sub_namespaces);
+fossil_crabdb_error_t fossil_crabdb_dump(fossil_crabdb_t *db, fossil_fstream_t *stream) {
+    if (!db || !stream || !stream->file) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
 
-            fossil_crabdb_keyvalue_t *kv = current->data;
-            while (kv) {
-                fossil_crabdb_keyvalue_t *kv_next = kv->next;
-                free(kv->key);
-                free(kv->value);
-                free(kv);
-                kv = kv_next;
-            }
+    fossil_crabdb_crc_init();
+    fossil_crabdb_dump_writer_t w = { stream, (unsigned char *)malloc(FOSSIL_CRABDB_DUMP_BUFFER), 0, 0xffffffffU, 0, 1 };
+    if (!w.buffer) return CRABDB_ERR_MEM;
+
+    // Namespaces stay put; writers wait only on the partition being written
+    fossil_crabdb_read_lock(db);
+    fossil_crabdb_dump_write(&w, FOSSIL_CRABDB_DUMP_MAGIC, FOSSIL_CRABDB_MAGIC_SIZE);
+    uint64_t now = 0;
+    for (fossil_crabdb_namespace_t *ns = db->namespaces; w.ok && ns; ns = ns->next) {
+        if (!ns->parent) fossil_crabdb_dump_namespace(db, &w, ns, &now);
+    }
+    fossil_crabdb_read_unlock(db);
+
+    fossil_crabdb_dump_write(&w, "E", 1);
+    fossil_crabdb_dump_varint(&w, w.pairs);
+    fossil_crabdb_dump_flush(&w);
+    unsigned char crc[4];
+    fossil_crabdb_put_u32(crc, w.crc ^ 0xffffffffU);
+    fossil_crabdb_dump_out(&w, crc, sizeof(crc));
+    if (w.ok && fflush(stream->file) != 0) w.ok = 0;
 
-            free(current);
-            return CRABDB_OK;
+    free(w.buffer);
+    return w.ok ? CRABDB_OK : CRABDB_ERR_IO;
+}
+
+typedef struct {
+    fossil_fstream_t *stream; /**< Source */
+    unsigned char *buffer; /**< Bytes read and not yet consumed, from `start` */
+    size_t start; /**< First unconsumed byte */
+    size_t end; /**< One past the last byte read */
+    size_t size; /**< Size of `buffer` */
+    uint32_t crc; /**< Running checksum of the consumed bytes */
+    int failed; /**< A read failed */
+} fossil_crabdb_dump_reader_t;
+
+/**
+ * Have at least `size` unconsumed bytes in the buffer.
+ *
+ * @return 0, or -1 at the end of the stream or on a failure.
+ */
+static int fossil_crabdb_dump_fill(fossil_crabdb_dump_reader_t *r, size_t size) {
+    if (r->end - r->start >= size) return 0;
+    memmove(r->buffer, r->buffer + r->start, r->end - r->start);
+    r->end -= r->start;
+    r->start = 0;
+    if (size > r->size) {
+        size_t grown_size = r->size * 2 > size ? r->size * 2 : size;
+        unsigned char *grown = (unsigned char *)realloc(r->buffer, grown_size);
+        if (!grown) {
+            r->failed = 1;
+            return -1;
         }
-        prev = current;
-        current = current->next;
+        r->buffer = grown;
+        r->size = grown_size;
+    }
+    while (r->end < size) {
+        size_t got = fossil_fstream_read(r->stream, r->buffer + r->end, 1, r->size - r->end);
+        if (ferror(r->stream->file)) r->failed = 1;
+        if (r->failed || !got) return -1;
+        r->end += got;
     }
+    return 0;
+}
 
-    return CRABDB_ERR_NS_NOT_FOUND;
+/**
+ * Decode a varint `*at` bytes past the first unconsumed byte.
+ */
+static int fossil_crabdb_dump_get_varint(fossil_crabdb_dump_reader_t *r, size_t *at, uint64_t *v) {
+    *v = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (fossil_crabdb_dump_fill(r, *at + 1) != 0) return -1;
+        unsigned char byte = r->buffer[r->start + (*at)++];
+        *v |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return 0;
+    }
+    return -1;
 }
 
-fossil_crabdb_error_t fossil_crabdb_erase_sub_namespace(fossil_crabdb_t *db, const char *namespace_name, const char *sub_namespace_name) {
-    if (!db || !namespace_name || !sub_namespace_name) return CRABDB_ERR_MEM;
+/**
+ * Read a length-prefixed field, leaving `*at` past it and `*offset` at its
+ * first byte.
+ */
+static int fossil_crabdb_dump_get_bytes(fossil_crabdb_dump_reader_t *r, size_t *at, size_t *offset, size_t *size) {
+    uint64_t length;
+    if (fossil_crabdb_dump_get_varint(r, at, &length) != 0 || length > SIZE_MAX / 2) return -1;
+    *offset = *at;
+    *size = (size_t)length;
+    *at += *size;
+    return fossil_crabdb_dump_fill(r, *at);
+}
 
-    fossil_crabdb_namespace_t *current = db->namespaces;
-    while (current) {
-        if (strcmp(current->name, namespace_name) == 0) {
-            for (size_t i = 0; i < current->sub_namespace_count; i++) {
-                if (strcmp(current->sub_namespaces[i].name, sub_namespace_name) == 0) {
-                    free(current->sub_namespaces[i].name);
+static void fossil_crabdb_dump_consume(fossil_crabdb_dump_reader_t *r, size_t size) {
+    r->crc = fossil_crabdb_crc32_extend(r->crc, r->buffer + r->start, size);
+    r->start += size;
+}
 
-                    for (size_t j = i; j < current->sub_namespace_count - 1; j++) {
-                        current->sub_namespaces[j] = current->sub_namespaces[j + 1];
-                    }
+/**
+ * Build the indexes of a namespace once its pairs are in.
+ */
+static fossil_crabdb_error_t fossil_crabdb_restore_indexes(fossil_crabdb_t *db, const char *name, unsigned flags, size_t bits_per_key) {
+    fossil_crabdb_error_t result = CRABDB_OK;
+    if (flags & FOSSIL_CRABDB_DUMP_ORDERED) result = fossil_crabdb_create_ordered_index(db, name);
+    if (result == CRABDB_OK && (flags & FOSSIL_CRABDB_DUMP_BLOOM)) result = fossil_crabdb_create_bloom_filter(db, name, bits_per_key);
+    return result;
+}
+
+fossil_crabdb_error_t fossil_crabdb_restore(fossil_crabdb_t *db, fossil_fstream_t *stream) {
+    if (!db || !stream || !stream->file) return CRABDB_ERR_MEM;
+    if (db->image) return CRABDB_ERR_READ_ONLY;
+
+    fossil_crabdb_crc_init();
+    fossil_crabdb_dump_reader_t r = { stream, (unsigned char *)malloc(FOSSIL_CRABDB_DUMP_BUFFER), 0, 0, FOSSIL_CRABDB_DUMP_BUFFER, 0xffffffffU, 0 };
+    if (!r.buffer) return CRABDB_ERR_MEM;
+
+    fossil_crabdb_error_t result = CRABDB_OK;
+    if (fossil_crabdb_dump_fill(&r, FOSSIL_CRABDB_MAGIC_SIZE) != 0 || memcmp(r.buffer, FOSSIL_CRABDB_DUMP_MAGIC, FOSSIL_CRABDB_MAGIC_SIZE) != 0) {
+        result = CRABDB_ERR_IO;
+    } else {
+        fossil_crabdb_dump_consume(&r, FOSSIL_CRABDB_MAGIC_SIZE);
+    }
+
+    // The namespace whose pairs are coming, its indexes built when they end
+    char *name = cnullptr;
+    unsigned flags = 0;
+    size_t bits_per_key = 0;
+    uint64_t pairs = 0;
+    uint64_t now = fossil_crabdb_now_ms();
+    int ended = 0;
+    while (result == CRABDB_OK && !ended) {
+        size_t at = 1;
+        if (fossil_crabdb_dump_fill(&r, 1) != 0) {
+            result = CRABDB_ERR_IO;
+            break;
+        }
+        unsigned char tag = r.buffer[r.start];
 
-                    current->sub_namespaces = (fossil_crabdb_namespace_t*) realloc(current->sub_namespaces, sizeof(fossil_crabdb_namespace_t) * (current->sub_namespace_count - 1));
-                    current->sub_namespace_count--;
+        if (tag == 'N') {
+            size_t path, path_length;
+            uint64_t bits = 0, threshold = 0;
+            size_t dictionary = 0, dictionary_length = 0;
+            if (fossil_crabdb_dump_get_bytes(&r, &at, &path, &path_length) != 0 || fossil_crabdb_dump_fill(&r, at + 1) != 0) {
+                result = CRABDB_ERR_IO;
+                break;
+            }
+            unsigned next_flags = r.buffer[r.start + at++];
+            if (((next_flags & FOSSIL_CRABDB_DUMP_BLOOM) && fossil_crabdb_dump_get_varint(&r, &at, &bits) != 0) ||
+                ((next_flags & FOSSIL_CRABDB_DUMP_CODEC) && (fossil_crabdb_dump_get_varint(&r, &at, &threshold) != 0 ||
+                                                             fossil_crabdb_dump_get_bytes(&r, &at, &dictionary, &dictionary_length) != 0))) {
+                result = CRABDB_ERR_IO;
+                break;
+            }
 
-                    return CRABDB_OK;
+            if (name) result = fossil_crabdb_restore_indexes(db, name, flags, bits_per_key);
+            free(name);
+            name = (char *)fossil_crabdb_memdup((const char *)r.buffer + r.start + path, path_length);
+            flags = next_flags;
+            bits_per_key = (size_t)bits;
+            if (!name) result = CRABDB_ERR_MEM;
+            if (result == CRABDB_OK) {
+                result = fossil_crabdb_create_namespace(db, name);
+                if (result == CRABDB_ERR_NS_EXISTS) result = CRABDB_OK;
+            }
+            if (result == CRABDB_OK && (flags & FOSSIL_CRABDB_DUMP_CODEC)) {
+                result = fossil_crabdb_use_compression(db, name, (size_t)threshold, (const char *)r.buffer + r.start + dictionary, dictionary_length);
+            }
+            fossil_crabdb_dump_consume(&r, at);
+        } else if (tag == 'P' || tag == 'T') {
+            uint64_t expires = 0;
+            size_t key, key_length, value, value_length;
+            if (tag == 'T') {
+                if (fossil_crabdb_dump_fill(&r, at + 8) != 0) {
+                    result = CRABDB_ERR_IO;
+                    break;
                 }
+                expires = fossil_crabdb_get_u64(r.buffer + r.start + at);
+                at += 8;
+            }
+            if (!name || fossil_crabdb_dump_get_bytes(&r, &at, &key, &key_length) != 0 || fossil_crabdb_dump_get_bytes(&r, &at, &value, &value_length) != 0) {
+                result = CRABDB_ERR_IO;
+                break;
+            }
+            fossil_crabdb_dump_consume(&r, at);
+
+            pairs++;
+            if (expires && expires <= now) continue;
+
+            // The byte after the key belongs to the value length, decoded by now
+            char *data = (char *)r.buffer + r.start - at;
+            data[key + key_length] = '\0';
+            // A pair already there is replaced
+            result = fossil_crabdb_put(db, name, data + key, data + value, value_length, expires);
+            if (result == CRABDB_ERR_KEY_NOT_FOUND) result = fossil_crabdb_set(db, name, data + key, data + value, value_length, 1, expires);
+        } else if (tag == 'E') {
+            uint64_t count;
+            if (fossil_crabdb_dump_get_varint(&r, &at, &count) != 0) {
+                result = CRABDB_ERR_IO;
+                break;
+            }
+            fossil_crabdb_dump_consume(&r, at);
+            if (fossil_crabdb_dump_fill(&r, 4) != 0 || count != pairs || fossil_crabdb_get_u32(r.buffer + r.start) != (r.crc ^ 0xffffffffU)) {
+                result = CRABDB_ERR_IO;
+                break;
             }
+            if (name) result = fossil_crabdb_restore_indexes(db, name, flags, bits_per_key);
+            ended = 1;
+        } else {
+            result = CRABDB_ERR_IO;
         }
-        current = current->next;
     }
 
-    return CRABDB_ERR_SUB_NS_NOT_FOUND;
+    free(name);
+    free(r.buffer);
+    return result;
 }
 
-fossil_crabdb_error_t fossil_crabdb_insert(fossil_crabdb_t *db, const char *namespace_name, const char *key, const char *value) {
-    if (!db || !namespace_name || !key || !value) return CRABDB_ERR_MEM;
+// *****************************************************************************
+// Asynchronous operations
+// *****************************************************************************
 
-    fossil_crabdb_namespace_t *current = db->namespaces;
-    while (current) {
-        if (strcmp(current->name, namespace_name) == 0) {
-            fossil_crabdb_keyvalue_t *kv = current->data;
-            while (kv) {
-                if (strcmp(kv->key, key) == 0) {
-                    return CRABDB_ERR_KEY_NOT_FOUND; // Key already exists
-                }
-                kv = kv->next;
-            }
+/*
+ * Submitters append requests to the queue under its mutex and schedule one
+ * drain task on the pool when none is pending. The drain task takes the
+ * whole queue at once and walks it in runs: adjacent gets on a namespace go
+ * through one multi-get, adjacent writes through one write batch, and each
+ * run is completed with one trip through the mutex. Only one drain task of
+ * a queue runs at a time, which keeps the submission order.
+ */
 
-            fossil_crabdb_keyvalue_t *new_kv = (fossil_crabdb_keyvalue_t*) malloc(sizeof(fossil_crabdb_keyvalue_t));
-            if (!new_kv) return CRABDB_ERR_MEM;
+#define FOSSIL_CRABDB_ASYNC_RUN 64 // Requests coalesced into one call at most
 
-            new_kv->key = _custom_fossil_strdup(key);
-            new_kv->value = _custom_fossil_strdup(value);
-            new_kv->next = current->data;
-            current->data = new_kv;
+typedef enum {
+    CRABDB_ASYNC_GET,
+    CRABDB_ASYNC_INSERT,
+    CRABDB_ASYNC_UPDATE,
+    CRABDB_ASYNC_DELETE,
+    CRABDB_ASYNC_QUERY
+} fossil_crabdb_async_op_t;
 
-            return CRABDB_OK;
-        }
-        current = current->next;
+struct fossil_crabdb_request_t {
+    struct fossil_crabdb_request_t *next; /**< Next request in the queue */
+    fossil_crabdb_async_t *async; /**< Queue the request was submitted to */
+    fossil_crabdb_async_op_t op; /**< Operation to run */
+    const char *args[3]; /**< Namespace, key and value, or the query; in `text` */
+    fossil_crabdb_callback_t callback; /**< Called on completion, may be null */
+    void *user; /**< Passed to the callback */
+    int handle; /**< Whether the submitter holds the request */
+    fossil_crabdb_error_t result; /**< Result, once done */
+    char *value; /**< Value found by a get, until taken */
+    atomic_int done; /**< Set once the request has completed */
+    char text[]; /**< Copies of the arguments */
+};
+
+struct fossil_crabdb_async_t {
+    fossil_crabdb_t *db; /**< Database the operations run on */
+    fossil_xthread_pool_t *pool; /**< Pool running the drain task */
+    fossil_xmutex_t lock; /**< Guards the queue and completions */
+    fossil_xcond_t changed; /**< Signalled when requests complete or draining stops */
+    fossil_crabdb_request_t *head; /**< Oldest queued request */
+    fossil_crabdb_request_t *tail; /**< Newest queued request */
+    int draining; /**< Whether a drain task is scheduled or running */
+};
+
+fossil_crabdb_async_t *fossil_crabdb_async_create(fossil_crabdb_t *db, fossil_xthread_pool_t *pool) {
+    if (!db || !pool) return cnullptr;
+
+    fossil_crabdb_async_t *async = (fossil_crabdb_async_t *)calloc(1, sizeof(fossil_crabdb_async_t));
+    if (!async) return cnullptr;
+    if (fossil_mutex_create(&async->lock) != 0) {
+        free(async);
+        return cnullptr;
+    }
+    if (fossil_cond_create(&async->changed) != 0) {
+        fossil_mutex_erase(&async->lock);
+        free(async);
+        return cnullptr;
     }
+    async->db = db;
+    async->pool = pool;
+    return async;
+}
 
-    return CRABDB_ERR_NS_NOT_FOUND;
+void fossil_crabdb_async_erase(fossil_crabdb_async_t *async) {
+    if (!async) return;
+
+    fossil_mutex_lock(&async->lock);
+    while (async->draining) fossil_cond_wait(&async->changed, &async->lock);
+    fossil_mutex_unlock(&async->lock);
+    fossil_cond_erase(&async->changed);
+    fossil_mutex_erase(&async->lock);
+    free(async);
 }
 
-fossil_crabdb_error_t fossil_crabdb_get(fossil_crabdb_t *db, const char *namespace_name, const char *key, char **value) {
-    if (!db || !namespace_name || !key || !value) return CRABDB_ERR_MEM;
+static int fossil_crabdb_async_writes(fossil_crabdb_async_op_t op) {
+    return op == CRABDB_ASYNC_INSERT || op == CRABDB_ASYNC_UPDATE || op == CRABDB_ASYNC_DELETE;
+}
 
-    fossil_crabdb_namespace_t *current = db->namespaces;
-    while (current) {
-        if (strcmp(current->name, namespace_name) == 0) {
-            fossil_crabdb_keyvalue_t *kv = current->data;
-            while (kv) {
-                if (strcmp(kv->key, key) == 0) {
-                    *value = _custom_fossil_strdup(kv->value);
-                    return CRABDB_OK;
-                }
-                kv = kv->next;
+/**
+ * Whether `next` can join a run that starts with `first`: both gets or both
+ * writes, on the same namespace.
+ */
+static int fossil_crabdb_async_joins(const fossil_crabdb_request_t *first, const fossil_crabdb_request_t *next) {
+    int gets = first->op == CRABDB_ASYNC_GET && next->op == CRABDB_ASYNC_GET;
+    int writes = fossil_crabdb_async_writes(first->op) && fossil_crabdb_async_writes(next->op);
+    return (gets || writes) && strcmp(first->args[0], next->args[0]) == 0;
+}
+
+/**
+ * Run one request on its own.
+ */
+static void fossil_crabdb_async_run(fossil_crabdb_t *db, fossil_crabdb_request_t *request) {
+    const char *const *a = request->args;
+    switch (request->op) {
+        case CRABDB_ASYNC_GET: request->result = fossil_crabdb_get(db, a[0], a[1], &request->value); break;
+        case CRABDB_ASYNC_INSERT: request->result = fossil_crabdb_insert(db, a[0], a[1], a[2]); break;
+        case CRABDB_ASYNC_UPDATE: request->result = fossil_crabdb_update(db, a[0], a[1], a[2]); break;
+        case CRABDB_ASYNC_DELETE: request->result = fossil_crabdb_delete(db, a[0], a[1]); break;
+        case CRABDB_ASYNC_QUERY: request->result = fossil_crabdb_execute_query(db, a[0]); break;
+    }
+}
+
+/**
+ * Run `count` adjacent requests of one kind on one namespace as a single
+ * call where that gives every request the result it would have had alone.
+ */
+static void fossil_crabdb_async_run_all(fossil_crabdb_t *db, fossil_crabdb_request_t **run, size_t count) {
+    if (count > 1 && run[0]->op == CRABDB_ASYNC_GET) {
+        const char *keys[FOSSIL_CRABDB_ASYNC_RUN];
+        char *values[FOSSIL_CRABDB_ASYNC_RUN];
+        for (size_t i = 0; i < count; i++) keys[i] = run[i]->args[1];
+        fossil_crabdb_error_t result = fossil_crabdb_multi_get(db, run[0]->args[0], keys, count, values);
+        for (size_t i = 0; i < count; i++) {
+            run[i]->value = values[i];
+            if (values[i]) {
+                run[i]->result = CRABDB_OK;
+            } else if (result == CRABDB_ERR_KEY_NOT_FOUND) {
+                run[i]->result = CRABDB_ERR_KEY_NOT_FOUND;
+            } else {
+                fossil_crabdb_async_run(db, run[i]);
             }
-            return CRABDB_ERR_KEY_NOT_FOUND;
         }
-        current = current->next;
+        return;
     }
 
-    return CRABDB_ERR_NS_NOT_FOUND;
+    if (count > 1) {
+        fossil_crabdb_batch_entry_t entries[FOSSIL_CRABDB_ASYNC_RUN];
+        for (size_t i = 0; i < count; i++) {
+            entries[i].op = run[i]->op == CRABDB_ASYNC_INSERT ? CRABDB_BATCH_INSERT :
+                            run[i]->op == CRABDB_ASYNC_UPDATE ? CRABDB_BATCH_UPDATE : CRABDB_BATCH_DELETE;
+            entries[i].key = run[i]->args[1];
+            entries[i].value = run[i]->args[2];
+        }
+        // A failed batch applied nothing, so its entries can be replayed alone
+        if (fossil_crabdb_write_batch(db, run[0]->args[0], entries, count) == CRABDB_OK) {
+            for (size_t i = 0; i < count; i++) run[i]->result = CRABDB_OK;
+            return;
+        }
+    }
+    for (size_t i = 0; i < count; i++) fossil_crabdb_async_run(db, run[i]);
 }
 
-fossil_crabdb_error_t fossil_crabdb_update(fossil_crabdb_t *db, const char *namespace_name, const char *key, const char *value) {
-    if (!db || !namespace_name || !key || !value) return CRABDB_ERR_MEM;
+static void fossil_crabdb_async_drain(void *arg) {
+    fossil_crabdb_async_t *async = (fossil_crabdb_async_t *)arg;
+    fossil_crabdb_request_t *run[FOSSIL_CRABDB_ASYNC_RUN];
 
-    fossil_crabdb_namespace_t *current = db->namespaces;
-    while (current) {
-        if (strcmp(current->name, namespace_name) == 0) {
-            fossil_crabdb_keyvalue_t *kv = current->data;
-            while (kv) {
-                if (strcmp(kv->key, key) == 0) {
-                    free(kv->value);
-                    kv->value = _custom_fossil_strdup(value);
-                    return CRABDB_OK;
+    for (;;) {
+        fossil_mutex_lock(&async->lock);
+        fossil_crabdb_request_t *request = async->head;
+        async->head = async->tail = cnullptr;
+        if (!request) {
+            async->draining = 0;
+            fossil_cond_broadcast(&async->changed);
+            fossil_mutex_unlock(&async->lock);
+            return;
+        }
+        fossil_mutex_unlock(&async->lock);
+
+        while (request) {
+            size_t count = 0;
+            do {
+                run[count++] = request;
+                request = request->next;
+            } while (request && count < FOSSIL_CRABDB_ASYNC_RUN && fossil_crabdb_async_joins(run[0], request));
+            fossil_crabdb_async_run_all(async->db, run, count);
+
+            for (size_t i = 0; i < count; i++) {
+                if (run[i]->callback) run[i]->callback(run[i]->result, run[i]->value, run[i]->user);
+            }
+
+            // A request with a handle may be freed as soon as it is done
+            fossil_mutex_lock(&async->lock);
+            for (size_t i = 0; i < count; i++) {
+                if (run[i]->handle) {
+                    atomic_store_explicit(&run[i]->done, 1, memory_order_release);
+                } else {
+                    free(run[i]->value);
+                    free(run[i]);
                 }
-                kv = kv->next;
             }
-            return CRABDB_ERR_KEY_NOT_FOUND;
+            fossil_cond_broadcast(&async->changed);
+            fossil_mutex_unlock(&async->lock);
         }
-        current = current->next;
     }
+}
+
+static fossil_crabdb_error_t fossil_crabdb_async_submit(fossil_crabdb_async_t *async, fossil_crabdb_async_op_t op, const char *const *args, size_t arg_count,
+                                                        fossil_crabdb_callback_t callback, void *user, fossil_crabdb_request_t **request) {
+    if (request) *request = cnullptr;
+    if (!async) return CRABDB_ERR_MEM;
+
+    size_t lengths[3];
+    size_t size = 0;
+    for (size_t i = 0; i < arg_count; i++) {
+        if (!args[i]) return CRABDB_ERR_MEM;
+        lengths[i] = strlen(args[i]) + 1;
+        size += lengths[i];
+    }
+    fossil_crabdb_request_t *submitted = (fossil_crabdb_request_t *)calloc(1, sizeof(fossil_crabdb_request_t) + size);
+    if (!submitted) return CRABDB_ERR_MEM;
+
+    char *text = submitted->text;
+    for (size_t i = 0; i < arg_count; i++) {
+        memcpy(text, args[i], lengths[i]);
+        submitted->args[i] = text;
+        text += lengths[i];
+    }
+    submitted->async = async;
+    submitted->op = op;
+    submitted->callback = callback;
+    submitted->user = user;
+    submitted->handle = request != cnullptr;
+    atomic_init(&submitted->done, 0);
+    if (request) *request = submitted;
+
+    fossil_mutex_lock(&async->lock);
+    if (async->tail) {
+        async->tail->next = submitted;
+    } else {
+        async->head = submitted;
+    }
+    async->tail = submitted;
+    int schedule = !async->draining;
+    async->draining = 1;
+    fossil_mutex_unlock(&async->lock);
 
-    return CRABDB_ERR_NS_NOT_FOUND;
+    // With the pool queue full the submitter drains the queue itself
+    if (schedule && fossil_thread_pool_add_task(async->pool, fossil_crabdb_async_drain, async) != 0) {
+        fossil_crabdb_async_drain(async);
+    }
+    return CRABDB_OK;
 }
 
-fossil_crabdb_error_t fossil_crabdb_delete(fossil_crabdb_t *db, const char *namespace_name, const char *key) {
-    if (!db || !namespace_name || !key) return CRABDB_ERR_MEM;
+fossil_crabdb_error_t fossil_crabdb_async_insert(fossil_crabdb_async_t *async, const char *namespace_name, const char *key, const char *value, fossil_crabdb_callback_t callback, void *user, fossil_crabdb_request_t **request) {
+    const char *args[] = {namespace_name, key, value};
+    return fossil_crabdb_async_submit(async, CRABDB_ASYNC_INSERT, args, 3, callback, user, request);
+}
 
-    fossil_crabdb_namespace_t *current = db->namespaces;
-    while (current) {
-        if (strcmp(current->name, namespace_name) == 0) {
-            fossil_crabdb_keyvalue_t *prev = cnullptr;
-            fossil_crabdb_keyvalue_t *kv = current->data;
-            while (kv) {
-                if (strcmp(kv->key, key) == 0) {
-                    if (prev) {
-                        prev->next = kv->next;
-                    } else {
-                        current->data = kv->next;
-                    }
-                    free(kv->key);
-                    free(kv->value);
-                    free(kv);
-                    return CRABDB_OK;
-                }
-                prev = kv;
-                kv = kv->next;
-            }
-            return CRABDB_ERR_KEY_NOT_FOUND;
+fossil_crabdb_error_t fossil_crabdb_async_get(fossil_crabdb_async_t *async, const char *namespace_name, const char *key, fossil_crabdb_callback_t callback, void *user, fossil_crabdb_request_t **request) {
+    const char *args[] = {namespace_name, key};
+    return fossil_crabdb_async_submit(async, CRABDB_ASYNC_GET, args, 2, callback, user, request);
+}
+
+fossil_crabdb_error_t fossil_crabdb_async_update(fossil_crabdb_async_t *async, const char *namespace_name, const char *key, const char *value, fossil_crabdb_callback_t callback, void *user, fossil_crabdb_request_t **request) {
+    const char *args[] = {namespace_name, key, value};
+    return fossil_crabdb_async_submit(async, CRABDB_ASYNC_UPDATE, args, 3, callback, user, request);
+}
+
+fossil_crabdb_error_t fossil_crabdb_async_delete(fossil_crabdb_async_t *async, const char *namespace_name, const char *key, fossil_crabdb_callback_t callback, void *user, fossil_crabdb_request_t **request) {
+    const char *args[] = {namespace_name, key};
+    return fossil_crabdb_async_submit(async, CRABDB_ASYNC_DELETE, args, 2, callback, user, request);
+}
+
+fossil_crabdb_error_t fossil_crabdb_async_execute_query(fossil_crabdb_async_t *async, const char *query, fossil_crabdb_callback_t callback, void *user, fossil_crabdb_request_t **request) {
+    const char *args[] = {query};
+    return fossil_crabdb_async_submit(async, CRABDB_ASYNC_QUERY, args, 1, callback, user, request);
+}
+
+int fossil_crabdb_request_poll(const fossil_crabdb_request_t *request) {
+    return request && atomic_load_explicit(&request->done, memory_order_acquire);
+}
+
+fossil_crabdb_error_t fossil_crabdb_request_wait(fossil_crabdb_request_t *request, char **value) {
+    if (value) *value = cnullptr;
+    if (!request) return CRABDB_ERR_MEM;
+
+    // A request still pending keeps its queue alive, a done one never looks at it
+    if (!atomic_load_explicit(&request->done, memory_order_acquire)) {
+        fossil_crabdb_async_t *async = request->async;
+        fossil_mutex_lock(&async->lock);
+        while (!atomic_load_explicit(&request->done, memory_order_acquire)) {
+            fossil_cond_wait(&async->changed, &async->lock);
         }
-        current = current->next;
+        fossil_mutex_unlock(&async->lock);
     }
+    if (value) {
+        *value = request->value;
+        request->value = cnullptr;
+    }
+    return request->result;
+}
 
-    return CRABDB_ERR_NS_NOT_FOUND;
+void fossil_crabdb_request_free(fossil_crabdb_request_t *request) {
+    if (!request) return;
+    fossil_crabdb_request_wait(request, cnullptr);
+    free(request->value);
+    free(request);
 }
 
-static fossil_crabdb_error_t parse_and_execute(fossil_crabdb_t *db, char *command, char **tokens, int token_count) {
-    if (strcmp(command, "create_namespace") == 0) {
-        if (token_count == 1) {
-            return fossil_crabdb_create_namespace(db, tokens[0]);
-        }
-    } else if (strcmp(command, "create_sub_namespace") == 0) {
-        if (token_count == 2) {
-            return fossil_crabdb_create_sub_namespace(db, tokens[0], tokens[1]);
-        }
-    } else if (strcmp(command, "erase_namespace") == 0) {
-        if (token_count == 1) {
-            return fossil_crabdb_erase_namespace(db, tokens[0]);
-        }
-    } else if (strcmp(command, "erase_sub_namespace") == 0) {
-        if (token_count == 2) {
-            return fossil_crabdb_erase_sub_namespace(db, tokens[0], tokens[1]);
-        }
-    } else if (strcmp(command, "insert") == 0) {
-        if (token_count == 3) {
-            return fossil_crabdb_insert(db, tokens[0], tokens[1], tokens[2]);
+// *****************************************************************************
+// Query interface
+// *****************************************************************************
+
+/*
+ * Queries are compiled once into a statement: the command is resolved to an
+ * opcode and every argument becomes either a decoded literal, stored in the
+ * statement's own text buffer, or a reference to a bind parameter. Executing
+ * a statement only substitutes bindings and dispatches on the opcode.
+ */
+
+#define FOSSIL_CRABDB_QUERY_MAX_ARGS 3
+
+typedef enum {
+    CRABDB_QUERY_CREATE_NAMESPACE,
+    CRABDB_QUERY_CREATE_SUB_NAMESPACE,
+    CRABDB_QUERY_ERASE_NAMESPACE,
+    CRABDB_QUERY_ERASE_SUB_NAMESPACE,
+    CRABDB_QUERY_INSERT,
+    CRABDB_QUERY_GET,
+    CRABDB_QUERY_UPDATE,
+    CRABDB_QUERY_DELETE
+} fossil_crabdb_query_op_t;
+
+static const struct {
+    const char *name;
+    fossil_crabdb_query_op_t op;
+    size_t arg_count;
+} fossil_crabdb_query_commands[] = {
+    { "create_namespace", CRABDB_QUERY_CREATE_NAMESPACE, 1 },
+    { "create_sub_namespace", CRABDB_QUERY_CREATE_SUB_NAMESPACE, 2 },
+    { "erase_namespace", CRABDB_QUERY_ERASE_NAMESPACE, 1 },
+    { "erase_sub_namespace", CRABDB_QUERY_ERASE_SUB_NAMESPACE, 2 },
+    { "insert", CRABDB_QUERY_INSERT, 3 },
+    { "get", CRABDB_QUERY_GET, 2 },
+    { "update", CRABDB_QUERY_UPDATE, 3 },
+    { "delete", CRABDB_QUERY_DELETE, 2 }
+};
+
+struct fossil_crabdb_stmt_t {
+    fossil_crabdb_t *db; /**< Database the statement runs against */
+    fossil_crabdb_query_op_t op; /**< Compiled command */
+    size_t arg_count; /**< Number of arguments */
+    const char *args[FOSSIL_CRABDB_QUERY_MAX_ARGS]; /**< Literal arguments, null for parameters */
+    size_t params[FOSSIL_CRABDB_QUERY_MAX_ARGS]; /**< Parameter position of each argument, 0 for literals */
+    size_t param_count; /**< Highest parameter position */
+    const char *bindings[FOSSIL_CRABDB_QUERY_MAX_ARGS]; /**< Borrowed values bound to each position */
+    char *text; /**< Storage for decoded literals */
+    char *result; /**< Value read by the last get */
+    size_t result_size; /**< Capacity of the result buffer */
+    int has_result; /**< The result buffer holds a value */
+};
+
+typedef struct {
+    const char *p; /**< Next character to scan */
+    char *out; /**< Next free byte of the literal storage */
+} fossil_crabdb_lexer_t;
+
+static void fossil_crabdb_lex_space(fossil_crabdb_lexer_t *lex) {
+    while (isspace((unsigned char)*lex->p)) lex->p++;
+}
+
+/**
+ * Scan one argument into `stmt`.
+ *
+ * @return 0 on success, -1 on a syntax error.
+ */
+static int fossil_crabdb_lex_argument(fossil_crabdb_lexer_t *lex, fossil_crabdb_stmt_t *stmt, size_t *next_param) {
+    if (stmt->arg_count == FOSSIL_CRABDB_QUERY_MAX_ARGS) return -1;
+    size_t arg = stmt->arg_count++;
+    fossil_crabdb_lex_space(lex);
+
+    if (*lex->p == '?') {
+        lex->p++;
+        size_t position = 0;
+        if (isdigit((unsigned char)*lex->p)) {
+            while (isdigit((unsigned char)*lex->p)) {
+                position = position * 10 + (size_t)(*lex->p++ - '0');
+                if (position > FOSSIL_CRABDB_QUERY_MAX_ARGS) return -1;
+            }
+        } else {
+            position = *next_param;
         }
-    } else if (strcmp(command, "get") == 0) {
-        if (token_count == 2) {
-            char *value;
-            fossil_crabdb_error_t err = fossil_crabdb_get(db, tokens[0], tokens[1], &value);
-            if (err == CRABDB_OK) {
-                printf("Value: %s\n", value);
-                free(value);
+        if (position == 0 || position > FOSSIL_CRABDB_QUERY_MAX_ARGS) return -1;
+
+        stmt->params[arg] = position;
+        *next_param = position + 1;
+        if (position > stmt->param_count) stmt->param_count = position;
+        return 0;
+    }
+
+    stmt->args[arg] = lex->out;
+    if (*lex->p == '"' || *lex->p == '\'') {
+        char quote = *lex->p++;
+        while (*lex->p != quote) {
+            char c = *lex->p++;
+            if (c == '\0') return -1;
+            if (c == '\\') {
+                c = *lex->p++;
+                switch (c) {
+                    case 'n': c = '\n'; break;
+                    case 't': c = '\t'; break;
+                    case '\\': case '"': case '\'': break;
+                    default: return -1;
+                }
             }
-            return err;
+            *lex->out++ = c;
         }
-    } else if (strcmp(command, "update") == 0) {
-        if (token_count == 3) {
-            return fossil_crabdb_update(db, tokens[0], tokens[1], tokens[2]);
+        lex->p++;
+    } else {
+        const char *start = lex->p;
+        while (*lex->p && *lex->p != ',' && *lex->p != ')') lex->p++;
+        const char *end = lex->p;
+        while (end > start && isspace((unsigned char)end[-1])) end--;
+        if (end == start) return -1;
+        memcpy(lex->out, start, (size_t)(end - start));
+        lex->out += end - start;
+    }
+    *lex->out++ = '\0';
+    return 0;
+}
+
+static fossil_crabdb_error_t fossil_crabdb_compile(fossil_crabdb_stmt_t *stmt, const char *query) {
+    fossil_crabdb_lexer_t lex = { query, stmt->text };
+    fossil_crabdb_lex_space(&lex);
+
+    const char *name = lex.p;
+    while (isalnum((unsigned char)*lex.p) || *lex.p == '_') lex.p++;
+    size_t name_length = (size_t)(lex.p - name);
+
+    size_t command = sizeof(fossil_crabdb_query_commands) / sizeof(fossil_crabdb_query_commands[0]);
+    for (size_t i = 0; i < command; i++) {
+        if (strlen(fossil_crabdb_query_commands[i].name) == name_length &&
+            memcmp(fossil_crabdb_query_commands[i].name, name, name_length) == 0) {
+            command = i;
+            break;
         }
-    } else if (strcmp(command, "delete") == 0) {
-        if (token_count == 2) {
-            return fossil_crabdb_delete(db, tokens[0], tokens[1]);
+    }
+    if (command == sizeof(fossil_crabdb_query_commands) / sizeof(fossil_crabdb_query_commands[0])) {
+        return CRABDB_ERR_INVALID_QUERY;
+    }
+
+    fossil_crabdb_lex_space(&lex);
+    if (*lex.p++ != '(') return CRABDB_ERR_INVALID_QUERY;
+
+    size_t next_param = 1;
+    fossil_crabdb_lex_space(&lex);
+    if (*lex.p != ')') {
+        for (;;) {
+            if (fossil_crabdb_lex_argument(&lex, stmt, &next_param) != 0) return CRABDB_ERR_INVALID_QUERY;
+            fossil_crabdb_lex_space(&lex);
+            if (*lex.p == ')') break;
+            if (*lex.p++ != ',') return CRABDB_ERR_INVALID_QUERY;
         }
     }
-    return CRABDB_ERR_INVALID_QUERY;
+    lex.p++;
+
+    fossil_crabdb_lex_space(&lex);
+    if (*lex.p == ';') lex.p++;
+    fossil_crabdb_lex_space(&lex);
+    if (*lex.p != '\0' || stmt->arg_count != fossil_crabdb_query_commands[command].arg_count) {
+        return CRABDB_ERR_INVALID_QUERY;
+    }
+
+    stmt->op = fossil_crabdb_query_commands[command].op;
+    return CRABDB_OK;
 }
 
-fossil_crabdb_error_t fossil_crabdb_execute_query(fossil_crabdb_t *db, const char *query) {
+fossil_crabdb_error_t fossil_crabdb_prepare(fossil_crabdb_t *db, const char *query, fossil_crabdb_stmt_t **stmt) {
+    if (!stmt) return CRABDB_ERR_INVALID_QUERY;
+    *stmt = cnullptr;
     if (!db || !query) return CRABDB_ERR_INVALID_QUERY;
 
-    char *query_copy = _custom_fossil_strdup(query);
-    if (!query_copy) return CRABDB_ERR_MEM;
+    fossil_crabdb_stmt_t *compiled = (fossil_crabdb_stmt_t *)calloc(1, sizeof(fossil_crabdb_stmt_t));
+    if (!compiled) return CRABDB_ERR_MEM;
 
-    char *command = strtok(query_copy, "(");
-    if (!command) {
-        free(query_copy);
-        return CRABDB_ERR_INVALID_QUERY;
+    // Decoded literals never outgrow the query plus one terminator per argument
+    compiled->db = db;
+    compiled->text = (char *)malloc(strlen(query) + FOSSIL_CRABDB_QUERY_MAX_ARGS + 1);
+    if (!compiled->text) {
+        free(compiled);
+        return CRABDB_ERR_MEM;
     }
 
-    char *args = strtok(cnullptr, ")");
-    if (!args) {
-        free(query_copy);
-        return CRABDB_ERR_INVALID_QUERY;
+    fossil_crabdb_error_t result = fossil_crabdb_compile(compiled, query);
+    if (result != CRABDB_OK) {
+        fossil_crabdb_finalize(compiled);
+        return result;
+    }
+    *stmt = compiled;
+    return CRABDB_OK;
+}
+
+fossil_crabdb_error_t fossil_crabdb_bind(fossil_crabdb_stmt_t *stmt, size_t index, const char *value) {
+    if (!stmt || index == 0 || index > stmt->param_count) return CRABDB_ERR_INVALID_QUERY;
+    stmt->bindings[index - 1] = value;
+    return CRABDB_OK;
+}
+
+size_t fossil_crabdb_stmt_param_count(const fossil_crabdb_stmt_t *stmt) {
+    return stmt ? stmt->param_count : 0;
+}
+
+static fossil_crabdb_error_t fossil_crabdb_stmt_get(fossil_crabdb_stmt_t *stmt, const char *namespace_name, const char *key) {
+    fossil_crabdb_view_t view;
+    fossil_crabdb_error_t result = fossil_crabdb_get_view(stmt->db, namespace_name, key, &view);
+    if (result != CRABDB_OK) return result;
+
+    // Copy out of the store into a buffer that is only ever grown
+    if (view.length + 1 > stmt->result_size) {
+        size_t size = stmt->result_size ? stmt->result_size : 64;
+        while (size < view.length + 1) size *= 2;
+        char *grown = (char *)realloc(stmt->result, size);
+        if (!grown) {
+            fossil_crabdb_view_release(&view);
+            return CRABDB_ERR_MEM;
+        }
+        stmt->result = grown;
+        stmt->result_size = size;
     }
+    memcpy(stmt->result, view.data, view.length + 1);
+    stmt->has_result = 1;
+    fossil_crabdb_view_release(&view);
+    return CRABDB_OK;
+}
 
-    // Trim spaces from the command
-    while (isspace((unsigned char)*command)) command++;
-    char *end = command + strlen(command) - 1;
-    while (end > command && isspace((unsigned char)*end)) end--;
-    end[1] = '\0';
+fossil_crabdb_error_t fossil_crabdb_stmt_execute(fossil_crabdb_stmt_t *stmt) {
+    if (!stmt) return CRABDB_ERR_INVALID_QUERY;
+    stmt->has_result = 0;
+
+    const char *a[FOSSIL_CRABDB_QUERY_MAX_ARGS] = { cnullptr, cnullptr, cnullptr };
+    for (size_t i = 0; i < stmt->arg_count; i++) {
+        a[i] = stmt->params[i] ? stmt->bindings[stmt->params[i] - 1] : stmt->args[i];
+        if (!a[i]) return CRABDB_ERR_INVALID_QUERY; // Unbound parameter
+    }
 
-    // Tokenize the arguments
-    char *token;
-    char *tokens[10]; // Assuming a max of 10 arguments
-    int token_count = 0;
-    token = strtok(args, ",");
-    while (token) {
-        while (isspace((unsigned char)*token)) token++;
-        char *end = token + strlen(token) - 1;
-        while (end > token && isspace((unsigned char)*end)) end--;
-        end[1] = '\0';
-        tokens[token_count++] = token;
-        token = strtok(cnullptr, ",");
+    switch (stmt->op) {
+        case CRABDB_QUERY_CREATE_NAMESPACE: return fossil_crabdb_create_namespace(stmt->db, a[0]);
+        case CRABDB_QUERY_CREATE_SUB_NAMESPACE: return fossil_crabdb_create_sub_namespace(stmt->db, a[0], a[1]);
+        case CRABDB_QUERY_ERASE_NAMESPACE: return fossil_crabdb_erase_namespace(stmt->db, a[0]);
+        case CRABDB_QUERY_ERASE_SUB_NAMESPACE: return fossil_crabdb_erase_sub_namespace(stmt->db, a[0], a[1]);
+        case CRABDB_QUERY_INSERT: return fossil_crabdb_insert(stmt->db, a[0], a[1], a[2]);
+        case CRABDB_QUERY_GET: return fossil_crabdb_stmt_get(stmt, a[0], a[1]);
+        case CRABDB_QUERY_UPDATE: return fossil_crabdb_update(stmt->db, a[0], a[1], a[2]);
+        case CRABDB_QUERY_DELETE: return fossil_crabdb_delete(stmt->db, a[0], a[1]);
     }
+    return CRABDB_ERR_INVALID_QUERY;
+}
+
+const char *fossil_crabdb_stmt_result(const fossil_crabdb_stmt_t *stmt) {
+    return stmt && stmt->has_result ? stmt->result : cnullptr;
+}
 
-    fossil_crabdb_error_t result = parse_and_execute(db, command, tokens, token_count);
+void fossil_crabdb_finalize(fossil_crabdb_stmt_t *stmt) {
+    if (!stmt) return;
+    free(stmt->text);
+    free(stmt->result);
+    free(stmt);
+}
+
+fossil_crabdb_error_t fossil_crabdb_execute_query(fossil_crabdb_t *db, const char *query) {
+    fossil_crabdb_stmt_t *stmt;
+    fossil_crabdb_error_t result = fossil_crabdb_prepare(db, query, &stmt);
+    if (result != CRABDB_OK) return result;
 
-    free(query_copy);
+    result = fossil_crabdb_stmt_execute(stmt);
+    if (result == CRABDB_OK && stmt->op == CRABDB_QUERY_GET) {
+        printf("Value: %s\n", stmt->result);
+    }
+    fossil_crabdb_finalize(stmt);
     return result;
 }
@@ -59,12 +59,48 @@ fossil_tofu_type_t string_to_tofu_type(const char *str) {
     return FOSSIL_TOFU_TYPE_GHOST; // Default to ghost type if not found
 }
 
+// Helper function to start a fossil_tofu_t of the given type
+static fossil_tofu_t tofu_of_type(fossil_tofu_type_t type) {
+    fossil_tofu_t tofu;
+    memset(&tofu, 0, sizeof(tofu));
+    tofu.type = type;
+    return tofu;
+}
+
+// Helper function to copy `length` bytes into a new NUL terminated string
+static char *tofu_copy_chars(const char *value, size_t length) {
+    char *copy = (char *) malloc(length + 1);
+    if (copy == NULL) {
+        return NULL;
+    }
+    memcpy(copy, value, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+// Helper function to store `length` bytes as a string of the given type, inside
+// the tofu when they fit and in a new heap string otherwise. The unused inline
+// bytes stay zero, which lets equal inline strings be compared as bytes.
+static fossil_tofu_t tofu_of_chars(fossil_tofu_type_t type, const char *value, size_t length) {
+    fossil_tofu_t tofu = tofu_of_type(type);
+    if (value == NULL) {
+        tofu.type = FOSSIL_TOFU_TYPE_GHOST;
+    } else if (length <= FOSSIL_TOFU_INLINE_MAX) {
+        memcpy((char *)&tofu, value, length);
+        tofu.flags = FOSSIL_TOFU_FLAG_INLINE;
+    } else {
+        tofu.value.c_string_val = tofu_copy_chars(value, length);
+        if (tofu.value.c_string_val == NULL) {
+            tofu.type = FOSSIL_TOFU_TYPE_GHOST;
+        }
+    }
+    return tofu;
+}
+
 // Function to create fossil_tofu_t based on type and value strings
 fossil_tofu_t fossil_tofu_create(char* type, char* value) {
     fossil_tofu_type_t tofu_type = string_to_tofu_type(type);
-    fossil_tofu_t tofu;
-    tofu.type = tofu_type;
-    tofu.is_cached = false;
+    fossil_tofu_t tofu = tofu_of_type(tofu_type);
 
     switch (tofu_type) {
         case FOSSIL_TOFU_TYPE_INT:
@@ -86,8 +122,9 @@ fossil_tofu_t fossil_tofu_create(char* type, char* value) {
             tofu.value.double_val = strtod(value, NULL);
             break;
         case FOSSIL_TOFU_TYPE_BSTR:
-            tofu.value.byte_string_val = (char *) malloc(strlen(value) + 1);
-            strcpy(tofu.value.byte_string_val, value);
+        case FOSSIL_TOFU_TYPE_CSTR:
+        case FOSSIL_TOFU_TYPE_BCHAR:
+            tofu = tofu_of_chars(tofu_type, value, strlen(value));
             break;
         case FOSSIL_TOFU_TYPE_WSTR:
             // Assuming wide string conversion is handled appropriately
@@ -95,13 +132,6 @@ fossil_tofu_t fossil_tofu_create(char* type, char* value) {
             tofu.value.wide_string_val = (wchar_t *) malloc((wcslen((wchar_t *)value) + 1) * sizeof(wchar_t));
             wcscpy(tofu.value.wide_string_val, (wchar_t *)value);
             break;
-        case FOSSIL_TOFU_TYPE_CSTR:
-            tofu.value.c_string_val = _custom_fossil_strdup(value);
-            break;
-        case FOSSIL_TOFU_TYPE_BCHAR:
-            tofu.value.byte_val = (uint8_t *) malloc(strlen(value) + 1);
-            memcpy(tofu.value.byte_val, value, strlen(value) + 1);
-            break;
         case FOSSIL_TOFU_TYPE_CCHAR:
             tofu.value.char_val = value[0];
             break;
@@ -121,11 +151,104 @@ fossil_tofu_t fossil_tofu_create(char* type, char* value) {
     return tofu;
 }
 
-// Memorization (caching) function for fossil_tofu_t
+fossil_tofu_t fossil_tofu_from_int64(int64_t value) {
+    fossil_tofu_t tofu = tofu_of_type(FOSSIL_TOFU_TYPE_INT);
+    tofu.value.int_val = value;
+    return tofu;
+}
+
+fossil_tofu_t fossil_tofu_from_uint64(uint64_t value) {
+    fossil_tofu_t tofu = tofu_of_type(FOSSIL_TOFU_TYPE_UINT);
+    tofu.value.uint_val = value;
+    return tofu;
+}
+
+fossil_tofu_t fossil_tofu_from_hex(uint64_t value) {
+    fossil_tofu_t tofu = tofu_of_type(FOSSIL_TOFU_TYPE_HEX);
+    tofu.value.uint_val = value;
+    return tofu;
+}
+
+fossil_tofu_t fossil_tofu_from_octal(uint64_t value) {
+    fossil_tofu_t tofu = tofu_of_type(FOSSIL_TOFU_TYPE_OCTAL);
+    tofu.value.uint_val = value;
+    return tofu;
+}
+
+fossil_tofu_t fossil_tofu_from_float(float value) {
+    fossil_tofu_t tofu = tofu_of_type(FOSSIL_TOFU_TYPE_FLOAT);
+    tofu.value.float_val = value;
+    return tofu;
+}
+
+fossil_tofu_t fossil_tofu_from_double(double value) {
+    fossil_tofu_t tofu = tofu_of_type(FOSSIL_TOFU_TYPE_DOUBLE);
+    tofu.value.double_val = value;
+    return tofu;
+}
+
+fossil_tofu_t fossil_tofu_from_bool(bool value) {
+    fossil_tofu_t tofu = tofu_of_type(FOSSIL_TOFU_TYPE_BOOL);
+    tofu.value.bool_val = value ? 1 : 0;
+    return tofu;
+}
+
+fossil_tofu_t fossil_tofu_from_char(char value) {
+    fossil_tofu_t tofu = tofu_of_type(FOSSIL_TOFU_TYPE_CCHAR);
+    tofu.value.char_val = value;
+    return tofu;
+}
+
+fossil_tofu_t fossil_tofu_from_wchar(wchar_t value) {
+    fossil_tofu_t tofu = tofu_of_type(FOSSIL_TOFU_TYPE_WCHAR);
+    tofu.value.wchar_val = value;
+    return tofu;
+}
+
+fossil_tofu_t fossil_tofu_from_cstr_len(const char *value, size_t length) {
+    return tofu_of_chars(FOSSIL_TOFU_TYPE_CSTR, value, length);
+}
+
+fossil_tofu_t fossil_tofu_from_cstr(const char *value) {
+    return fossil_tofu_from_cstr_len(value, value ? strlen(value) : 0);
+}
+
+fossil_tofu_t fossil_tofu_from_bstr(const char *value) {
+    return tofu_of_chars(FOSSIL_TOFU_TYPE_BSTR, value, value ? strlen(value) : 0);
+}
+
+fossil_tofu_t fossil_tofu_from_wstr(const wchar_t *value) {
+    fossil_tofu_t tofu = tofu_of_type(FOSSIL_TOFU_TYPE_WSTR);
+    if (value != NULL) {
+        size_t size = (wcslen(value) + 1) * sizeof(wchar_t);
+        tofu.value.wide_string_val = (wchar_t *) malloc(size);
+        if (tofu.value.wide_string_val != NULL) {
+            memcpy(tofu.value.wide_string_val, value, size);
+        }
+    }
+    if (tofu.value.wide_string_val == NULL) {
+        tofu.type = FOSSIL_TOFU_TYPE_GHOST;
+    }
+    return tofu;
+}
+
+// Memorization (caching) function for fossil_tofu_t, now only a flag
 void fossil_tofu_memorize(fossil_tofu_t *tofu) {
-    if (!tofu->is_cached) {
-        tofu->cached_value = tofu->value;
-        tofu->is_cached = true;
+    tofu->flags |= FOSSIL_TOFU_FLAG_CACHED;
+}
+
+bool fossil_tofu_is_cached(const fossil_tofu_t *tofu) {
+    return (tofu->flags & FOSSIL_TOFU_FLAG_CACHED) != 0;
+}
+
+const char *fossil_tofu_cstr(const fossil_tofu_t *tofu) {
+    switch (tofu->type) {
+        case FOSSIL_TOFU_TYPE_BSTR:
+        case FOSSIL_TOFU_TYPE_CSTR:
+        case FOSSIL_TOFU_TYPE_BCHAR:
+            return (tofu->flags & FOSSIL_TOFU_FLAG_INLINE) ? (const char *)tofu : tofu->value.c_string_val;
+        default:
+            return NULL;
     }
 }
 
@@ -151,16 +274,16 @@ void fossil_tofu_print(fossil_tofu_t tofu) {
             printf("double: %lf\n", tofu.value.double_val);
             break;
         case FOSSIL_TOFU_TYPE_BSTR:
-            printf("bstr: %s\n", tofu.value.byte_string_val);
+            printf("bstr: %s\n", fossil_tofu_cstr(&tofu));
             break;
         case FOSSIL_TOFU_TYPE_WSTR:
             wprintf(L"wstr: %ls\n", tofu.value.wide_string_val);
             break;
         case FOSSIL_TOFU_TYPE_CSTR:
-            printf("cstr: %s\n", tofu.value.c_string_val);
+            printf("cstr: %s\n", fossil_tofu_cstr(&tofu));
             break;
         case FOSSIL_TOFU_TYPE_BCHAR:
-            printf("bchar: %s\n", (char *)tofu.value.byte_val);
+            printf("bchar: %s\n", fossil_tofu_cstr(&tofu));
             break;
         case FOSSIL_TOFU_TYPE_CCHAR:
             printf("cchar: %c\n", tofu.value.char_val);
@@ -184,17 +307,15 @@ void fossil_tofu_print(fossil_tofu_t tofu) {
 void fossil_tofu_erase(fossil_tofu_t *tofu) {
     switch (tofu->type) {
         case FOSSIL_TOFU_TYPE_BSTR:
-            free(tofu->value.byte_string_val);
+        case FOSSIL_TOFU_TYPE_CSTR:
+        case FOSSIL_TOFU_TYPE_BCHAR:
+            if (!(tofu->flags & FOSSIL_TOFU_FLAG_INLINE)) {
+                free(tofu->value.c_string_val);
+            }
             break;
         case FOSSIL_TOFU_TYPE_WSTR:
             free(tofu->value.wide_string_val);
             break;
-        case FOSSIL_TOFU_TYPE_CSTR:
-            free(tofu->value.c_string_val);
-            break;
-        case FOSSIL_TOFU_TYPE_BCHAR:
-            free(tofu->value.byte_val);
-            break;
         default:
             // No dynamic memory to free for other types
             break;
@@ -203,14 +324,15 @@ void fossil_tofu_erase(fossil_tofu_t *tofu) {
 
 // Utility function to convert fossil_tofu_type_t to string representation
 const char* fossil_tofu_type_to_string(fossil_tofu_type_t type) {
-    if (type >= 0 && type < FOSSIL_TOFU_TYPE_BOOL) {
+    if (type >= 0 && type <= FOSSIL_TOFU_TYPE_BOOL) {
         return tofu_type_strings[type];
     } else {
         return "unknown";
     }
 }
 
-bool fossil_tofu_compare(fossil_tofu_t *tofu1, fossil_tofu_t *tofu2) {
+// Helper function shared by fossil_tofu_compare and fossil_tofu_equals
+static inline bool tofu_equal(const fossil_tofu_t *tofu1, const fossil_tofu_t *tofu2) {
     if (tofu1->type != tofu2->type) {
         return false;
     }
@@ -228,13 +350,14 @@ bool fossil_tofu_compare(fossil_tofu_t *tofu1, fossil_tofu_t *tofu2) {
         case FOSSIL_TOFU_TYPE_DOUBLE:
             return tofu1->value.double_val == tofu2->value.double_val;
         case FOSSIL_TOFU_TYPE_BSTR:
-            return strcmp(tofu1->value.byte_string_val, tofu2->value.byte_string_val) == 0;
-        case FOSSIL_TOFU_TYPE_WSTR:
-            return wcscmp(tofu1->value.wide_string_val, tofu2->value.wide_string_val) == 0;
         case FOSSIL_TOFU_TYPE_CSTR:
-            return strcmp(tofu1->value.c_string_val, tofu2->value.c_string_val) == 0;
         case FOSSIL_TOFU_TYPE_BCHAR:
-            return strcmp((char *)tofu1->value.byte_val, (char *)tofu2->value.byte_val) == 0;
+            if (tofu1->flags & tofu2->flags & FOSSIL_TOFU_FLAG_INLINE) {
+                return memcmp(tofu1, tofu2, FOSSIL_TOFU_INLINE_MAX + 1) == 0;
+            }
+            return strcmp(fossil_tofu_cstr(tofu1), fossil_tofu_cstr(tofu2)) == 0;
+        case FOSSIL_TOFU_TYPE_WSTR:
+            return wcscmp(tofu1->value.wide_string_val, tofu2->value.wide_string_val) == 0;
         case FOSSIL_TOFU_TYPE_CCHAR:
             return tofu1->value.char_val == tofu2->value.char_val;
         case FOSSIL_TOFU_TYPE_WCHAR:
@@ -246,89 +369,41 @@ bool fossil_tofu_compare(fossil_tofu_t *tofu1, fossil_tofu_t *tofu2) {
     }
 }
 
+bool fossil_tofu_compare(fossil_tofu_t *tofu1, fossil_tofu_t *tofu2) {
+    return tofu_equal(tofu1, tofu2);
+}
+
 // Utility function to check if two fossil_tofu_t objects are equal
 bool fossil_tofu_equals(fossil_tofu_t tofu1, fossil_tofu_t tofu2) {
-    if (tofu1.type != tofu2.type) {
-        return false;
-    }
-
-    switch (tofu1.type) {
-        case FOSSIL_TOFU_TYPE_INT:
-            return tofu1.value.int_val == tofu2.value.int_val;
-        case FOSSIL_TOFU_TYPE_UINT:
-            return tofu1.value.uint_val == tofu2.value.uint_val;
-        case FOSSIL_TOFU_TYPE_HEX:
-        case FOSSIL_TOFU_TYPE_OCTAL:
-            return tofu1.value.uint_val == tofu2.value.uint_val;
-        case FOSSIL_TOFU_TYPE_FLOAT:
-            return tofu1.value.float_val == tofu2.value.float_val;
-        case FOSSIL_TOFU_TYPE_DOUBLE:
-            return tofu1.value.double_val == tofu2.value.double_val;
-        case FOSSIL_TOFU_TYPE_BSTR:
-            return strcmp(tofu1.value.byte_string_val, tofu2.value.byte_string_val) == 0;
-        case FOSSIL_TOFU_TYPE_WSTR:
-            return wcscmp(tofu1.value.wide_string_val, tofu2.value.wide_string_val) == 0;
-        case FOSSIL_TOFU_TYPE_CSTR:
-            return strcmp(tofu1.value.c_string_val, tofu2.value.c_string_val) == 0;
-        case FOSSIL_TOFU_TYPE_BCHAR:
-            return strcmp((char *)tofu1.value.byte_val, (char *)tofu2.value.byte_val) == 0;
-        case FOSSIL_TOFU_TYPE_CCHAR:
-            return tofu1.value.char_val == tofu2.value.char_val;
-        case FOSSIL_TOFU_TYPE_WCHAR:
-            return tofu1.value.wchar_val == tofu2.value.wchar_val;
-        case FOSSIL_TOFU_TYPE_BOOL:
-            return tofu1.value.bool_val == tofu2.value.bool_val;
-        default:
-            return false;
-    }
+    return tofu_equal(&tofu1, &tofu2);
 }
 
-// Utility function to copy a fossil_tofu_t object
+// Utility function to copy a fossil_tofu_t object; inline strings copy with the struct
 fossil_tofu_t fossil_tofu_copy(fossil_tofu_t tofu) {
-    fossil_tofu_t copy;
-    copy.type = tofu.type;
-    copy.is_cached = tofu.is_cached;
+    fossil_tofu_t copy = tofu;
 
     switch (tofu.type) {
         case FOSSIL_TOFU_TYPE_INT:
-            copy.value.int_val = tofu.value.int_val;
-            break;
         case FOSSIL_TOFU_TYPE_UINT:
-            copy.value.uint_val = tofu.value.uint_val;
-            break;
         case FOSSIL_TOFU_TYPE_HEX:
         case FOSSIL_TOFU_TYPE_OCTAL:
-            copy.value.uint_val = tofu.value.uint_val;
-            break;
         case FOSSIL_TOFU_TYPE_FLOAT:
-            copy.value.float_val = tofu.value.float_val;
-            break;
         case FOSSIL_TOFU_TYPE_DOUBLE:
-            copy.value.double_val = tofu.value.double_val;
+        case FOSSIL_TOFU_TYPE_CCHAR:
+        case FOSSIL_TOFU_TYPE_WCHAR:
+        case FOSSIL_TOFU_TYPE_BOOL:
             break;
         case FOSSIL_TOFU_TYPE_BSTR:
-            copy.value.byte_string_val = _custom_fossil_strdup(tofu.value.byte_string_val);
+        case FOSSIL_TOFU_TYPE_CSTR:
+        case FOSSIL_TOFU_TYPE_BCHAR:
+            if (!(tofu.flags & FOSSIL_TOFU_FLAG_INLINE)) {
+                copy.value.c_string_val = _custom_fossil_strdup(tofu.value.c_string_val);
+            }
             break;
         case FOSSIL_TOFU_TYPE_WSTR:
             copy.value.wide_string_val = (wchar_t *) malloc((wcslen(tofu.value.wide_string_val) + 1) * sizeof(wchar_t));
             wcscpy(copy.value.wide_string_val, tofu.value.wide_string_val);
             break;
-        case FOSSIL_TOFU_TYPE_CSTR:
-            copy.value.c_string_val = _custom_fossil_strdup(tofu.value.c_string_val);
-            break;
-        case FOSSIL_TOFU_TYPE_BCHAR:
-            copy.value.byte_val = (uint8_t *) malloc(strlen((char *)tofu.value.byte_val) + 1);
-            memcpy(copy.value.byte_val, tofu.value.byte_val, strlen((char *)tofu.value.byte_val) + 1);
-            break;
-        case FOSSIL_TOFU_TYPE_CCHAR:
-            copy.value.char_val = tofu.value.char_val;
-            break;
-        case FOSSIL_TOFU_TYPE_WCHAR:
-            copy.value.wchar_val = tofu.value.wchar_val;
-            break;
-        case FOSSIL_TOFU_TYPE_BOOL:
-            copy.value.bool_val = tofu.value.bool_val;
-            break;
         default:
             // Handle unknown type or ghost type
             copy.type = FOSSIL_TOFU_TYPE_GHOST;
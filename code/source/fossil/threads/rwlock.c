@@ -0,0 +1,81 @@
+/*
+==============================================================================
+Author: Michael Gene Brockus (Dreamer)
+Email: michaelbrockus@gmail.com
+Organization: Fossil Logic
+Description: 
+    This file is part of the Fossil Logic project, where innovation meets
+    excellence in software development. Michael Gene Brockus, also known as
+    "Dreamer," is a dedicated contributor to this project. For any inquiries,
+    feel free to contact Michael at michaelbrockus@gmail.com.
+==============================================================================
+*/
+#define _GNU_SOURCE // for pthread_rwlock_t
+#include "fossil/threads/rwlock.h"
+#include "fossil/common/common.h"
+
+int32_t fossil_rwlock_create(fossil_xrwlock_t *lock) {
+    if (!lock) return FOSSIL_ERROR;
+
+#ifdef _WIN32
+    InitializeSRWLock(lock);
+    return FOSSIL_SUCCESS;
+#else
+    return pthread_rwlock_init(lock, cnullptr) == 0 ? FOSSIL_SUCCESS : FOSSIL_ERROR;
+#endif
+}
+
+int32_t fossil_rwlock_erase(fossil_xrwlock_t *lock) {
+    if (!lock) return FOSSIL_ERROR;
+
+#ifdef _WIN32
+    // Slim reader-writer locks hold no resources
+    return FOSSIL_SUCCESS;
+#else
+    return pthread_rwlock_destroy(lock) == 0 ? FOSSIL_SUCCESS : FOSSIL_ERROR;
+#endif
+}
+
+int32_t fossil_rwlock_read_lock(fossil_xrwlock_t *lock) {
+    if (!lock) return FOSSIL_ERROR;
+
+#ifdef _WIN32
+    AcquireSRWLockShared(lock);
+    return FOSSIL_SUCCESS;
+#else
+    return pthread_rwlock_rdlock(lock) == 0 ? FOSSIL_SUCCESS : FOSSIL_ERROR;
+#endif
+}
+
+int32_t fossil_rwlock_write_lock(fossil_xrwlock_t *lock) {
+    if (!lock) return FOSSIL_ERROR;
+
+#ifdef _WIN32
+    AcquireSRWLockExclusive(lock);
+    return FOSSIL_SUCCESS;
+#else
+    return pthread_rwlock_wrlock(lock) == 0 ? FOSSIL_SUCCESS : FOSSIL_ERROR;
+#endif
+}
+
+int32_t fossil_rwlock_read_unlock(fossil_xrwlock_t *lock) {
+    if (!lock) return FOSSIL_ERROR;
+
+#ifdef _WIN32
+    ReleaseSRWLockShared(lock);
+    return FOSSIL_SUCCESS;
+#else
+    return pthread_rwlock_unlock(lock) == 0 ? FOSSIL_SUCCESS : FOSSIL_ERROR;
+#endif
+}
+
+int32_t fossil_rwlock_write_unlock(fossil_xrwlock_t *lock) {
+    if (!lock) return FOSSIL_ERROR;
+
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(lock);
+    return FOSSIL_SUCCESS;
+#else
+    return pthread_rwlock_unlock(lock) == 0 ? FOSSIL_SUCCESS : FOSSIL_ERROR;
+#endif
+}
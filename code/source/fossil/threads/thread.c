@@ -18,6 +18,7 @@ Description:
 #ifdef _WIN32
 DWORD WINAPI thread_start_routine(LPVOID arg) {
     fossil_xtask_t task = *(fossil_xtask_t*)arg;
+    free(arg);
     fossil_xtask_func_t task_func = task.task_func;
     fossil_xtask_arg_t task_arg = task.arg;
     if (task_func) {
@@ -28,6 +29,7 @@ DWORD WINAPI thread_start_routine(LPVOID arg) {
 #else
 void* thread_start_routine(void *arg) {
     fossil_xtask_t task = *(fossil_xtask_t*)arg;
+    free(arg);
     fossil_xtask_func_t task_func = task.task_func;
     fossil_xtask_arg_t task_arg = task.arg;
     if (task_func) {
@@ -51,12 +53,26 @@ int32_t fossil_thread_create(fossil_xthread_t *thread, fossil_xthread_attr_t *at
         used_attr = &default_attr;
     }
 
+    // The task outlives this call, so hand the new thread its own copy
+    fossil_xtask_t *task_copy = (fossil_xtask_t *)malloc(sizeof(fossil_xtask_t));
+    if (!task_copy) {
+        if (!attr) {
+            fossil_thread_attr_erase(&default_attr);
+        }
+        return FOSSIL_ERROR;
+    }
+    *task_copy = task;
+
     // Create the thread using the provided attributes and start routine
     #ifdef _WIN32
-    *thread = CreateThread(NULL, used_attr->stack_size, thread_start_routine, (LPVOID)&task, 0, NULL);
+    *thread = CreateThread(NULL, used_attr->stack_size, thread_start_routine, (LPVOID)task_copy, 0, NULL);
+    if (*thread == NULL) {
+        free(task_copy);
+    }
     #else
-    int32_t result = pthread_create(thread, used_attr, thread_start_routine, (void *)&task);
+    int32_t result = pthread_create(thread, used_attr, thread_start_routine, (void *)task_copy);
     if (result != 0) {
+        free(task_copy);
         if (!attr) {
             fossil_thread_attr_erase(&default_attr);
         }
@@ -0,0 +1,1109 @@
+/*
+==============================================================================
+Author: Michael Gene Brockus (Dreamer)
+Email: michaelbrockus@gmail.com
+Organization: Fossil Logic
+Description:
+    This file is part of the Fossil Logic project, where innovation meets
+    excellence in software development. Michael Gene Brockus, also known as
+    "Dreamer," is a dedicated contributor to this project. For any inquiries,
+    feel free to contact Michael at michaelbrockus@gmail.com.
+==============================================================================
+*/
+#include <fossil/core/bluecrab.h>
+#include <fossil/threads/mutexs.h>
+#include <fossil/threads/thread.h>
+#include <fossil/threads/threadpool.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// * * * * * * * * * * * * * * * * * * * * * * * *
+// * Fossil Logic Benchmark Utilities
+// * * * * * * * * * * * * * * * * * * * * * * * *
+
+static double bench_now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint64_t bench_rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t bench_rand(void) {
+    // xorshift64*, good enough to spread lookups over the key space
+    bench_rng_state ^= bench_rng_state >> 12;
+    bench_rng_state ^= bench_rng_state << 25;
+    bench_rng_state ^= bench_rng_state >> 27;
+    return bench_rng_state * 2685821657736338717ULL;
+}
+
+// * * * * * * * * * * * * * * * * * * * * * * * *
+// * Fossil Logic Benchmark Blue CrabDB
+// * * * * * * * * * * * * * * * * * * * * * * * *
+
+/**
+ * Average `fossil_crabdb_get` latency as the namespace grows from 1K keys up
+ * to `max_keys`; with a hash index the figures should stay flat. The view
+ * column borrows the value instead of copying it.
+ */
+static int bench_lookup(size_t max_keys) {
+    const size_t lookups = 1000000;
+    char key[32];
+
+    printf("%-12s %-14s %-14s %-14s\n", "keys", "insert ns/op", "get ns/op", "view ns/op");
+    for (size_t n = 1000; n <= max_keys; n *= 10) {
+        fossil_crabdb_t *db = fossil_crabdb_create();
+        if (!db || fossil_crabdb_create_namespace(db, "bench") != CRABDB_OK) return 1;
+
+        double start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            snprintf(key, sizeof(key), "key:%zu", i);
+            if (fossil_crabdb_insert(db, "bench", key, "value") != CRABDB_OK) return 1;
+        }
+        double insert_time = bench_now() - start;
+
+        start = bench_now();
+        for (size_t i = 0; i < lookups; i++) {
+            char *value;
+            snprintf(key, sizeof(key), "key:%zu", (size_t)(bench_rand() % n));
+            if (fossil_crabdb_get(db, "bench", key, &value) != CRABDB_OK) return 1;
+            free(value);
+        }
+        double get_time = bench_now() - start;
+
+        start = bench_now();
+        for (size_t i = 0; i < lookups; i++) {
+            fossil_crabdb_view_t view;
+            snprintf(key, sizeof(key), "key:%zu", (size_t)(bench_rand() % n));
+            if (fossil_crabdb_get_view(db, "bench", key, &view) != CRABDB_OK) return 1;
+            fossil_crabdb_view_release(&view);
+        }
+        double view_time = bench_now() - start;
+
+        printf("%-12zu %-14.1f %-14.1f %-14.1f\n", n, insert_time * 1e9 / (double)n,
+               get_time * 1e9 / (double)lookups, view_time * 1e9 / (double)lookups);
+        fossil_crabdb_erase(db);
+    }
+    return 0;
+}
+
+/**
+ * Time to rebuild a database from its write-ahead log alone and from a
+ * checkpointed snapshot, for datasets from 10K pairs up to `max_keys`.
+ */
+static int bench_recovery(size_t max_keys) {
+    const char *path = "bench_bluecrab_recovery";
+    char key[32];
+
+    printf("%-12s %-14s %-14s\n", "keys", "wal replay ms", "snapshot ms");
+    for (size_t n = 10000; n <= max_keys; n *= 10) {
+        remove("bench_bluecrab_recovery.wal");
+        remove("bench_bluecrab_recovery.snapshot");
+
+        fossil_crabdb_t *db = fossil_crabdb_create();
+        if (!db || fossil_crabdb_persist_open(db, path, CRABDB_SYNC_OS, 0, 0) != CRABDB_OK) return 1;
+        fossil_crabdb_create_namespace(db, "bench");
+        for (size_t i = 0; i < n; i++) {
+            snprintf(key, sizeof(key), "key:%zu", i);
+            if (fossil_crabdb_insert(db, "bench", key, "value-value-value-value") != CRABDB_OK) return 1;
+        }
+        fossil_crabdb_erase(db);
+
+        db = fossil_crabdb_create();
+        double start = bench_now();
+        if (fossil_crabdb_persist_open(db, path, CRABDB_SYNC_OS, 0, 0) != CRABDB_OK) return 1;
+        double wal_time = bench_now() - start;
+        if (fossil_crabdb_checkpoint(db) != CRABDB_OK) return 1;
+        fossil_crabdb_erase(db);
+
+        db = fossil_crabdb_create();
+        start = bench_now();
+        if (fossil_crabdb_persist_open(db, path, CRABDB_SYNC_OS, 0, 0) != CRABDB_OK) return 1;
+        double snapshot_time = bench_now() - start;
+        fossil_crabdb_erase(db);
+
+        printf("%-12zu %-14.1f %-14.1f\n", n, wal_time * 1e3, snapshot_time * 1e3);
+    }
+
+    remove("bench_bluecrab_recovery.wal");
+    remove("bench_bluecrab_recovery.snapshot");
+    return 0;
+}
+
+typedef struct {
+    fossil_crabdb_t *db;
+    fossil_xmutex_t *global;   // when set, every operation runs under this mutex
+    size_t keys;
+    size_t ops;
+    unsigned write_percent;
+    uint64_t seed;
+} bench_worker_t;
+
+static void bench_concurrency_worker(void *arg) {
+    bench_worker_t *w = (bench_worker_t *)arg;
+    char key[32];
+
+    for (size_t i = 0; i < w->ops; i++) {
+        w->seed ^= w->seed >> 12;
+        w->seed ^= w->seed << 25;
+        w->seed ^= w->seed >> 27;
+        uint64_t r = w->seed * 2685821657736338717ULL;
+        snprintf(key, sizeof(key), "key:%zu", (size_t)((r >> 8) % w->keys));
+
+        if (w->global) fossil_mutex_lock(w->global);
+        if ((r & 0x7f) % 100 < w->write_percent) {
+            fossil_crabdb_update(w->db, "bench", key, "value-updated");
+        } else {
+            char *value;
+            if (fossil_crabdb_get(w->db, "bench", key, &value) == CRABDB_OK) free(value);
+        }
+        if (w->global) fossil_mutex_unlock(w->global);
+    }
+}
+
+static double bench_concurrency_run(fossil_crabdb_t *db, fossil_xmutex_t *global, size_t keys, size_t threads, unsigned write_percent) {
+    const size_t total_ops = 2000000;
+    fossil_xthread_t handles[64];
+    bench_worker_t workers[64];
+
+    double start = bench_now();
+    for (size_t t = 0; t < threads; t++) {
+        workers[t] = (bench_worker_t){ db, global, keys, total_ops / threads, write_percent, bench_rand() | 1 };
+        fossil_xtask_t task = { bench_concurrency_worker, &workers[t] };
+        if (fossil_thread_create(&handles[t], cnullptr, task) != FOSSIL_SUCCESS) return 0.0;
+    }
+    for (size_t t = 0; t < threads; t++) {
+        fossil_thread_join(handles[t], cnullptr);
+    }
+    return (double)total_ops / (bench_now() - start) / 1e6;
+}
+
+/**
+ * Throughput of a striped database against a single global lock for 1 to 64
+ * threads, under a read-mostly (95/5) and a write-heavy (50/50) mix.
+ */
+static int bench_concurrency(size_t keys) {
+    static const size_t thread_counts[] = { 1, 2, 4, 8, 16, 32, 64 };
+    static const unsigned write_mix[] = { 5, 50 };
+    char key[32];
+
+    fossil_crabdb_t *striped = fossil_crabdb_create_concurrent(0);
+    fossil_crabdb_t *plain = fossil_crabdb_create();
+    fossil_xmutex_t global;
+    if (!striped || !plain || fossil_mutex_create(&global) != FOSSIL_SUCCESS) return 1;
+    fossil_crabdb_create_namespace(striped, "bench");
+    fossil_crabdb_create_namespace(plain, "bench");
+    for (size_t i = 0; i < keys; i++) {
+        snprintf(key, sizeof(key), "key:%zu", i);
+        if (fossil_crabdb_insert(striped, "bench", key, "value") != CRABDB_OK) return 1;
+        if (fossil_crabdb_insert(plain, "bench", key, "value") != CRABDB_OK) return 1;
+    }
+
+    printf("%-8s %-8s %-16s %-16s\n", "writes", "threads", "striped Mops/s", "global Mops/s");
+    for (size_t m = 0; m < sizeof(write_mix) / sizeof(write_mix[0]); m++) {
+        for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+            double striped_rate = bench_concurrency_run(striped, cnullptr, keys, thread_counts[t], write_mix[m]);
+            double global_rate = bench_concurrency_run(plain, &global, keys, thread_counts[t], write_mix[m]);
+            printf("%-7u%% %-8zu %-16.2f %-16.2f\n", write_mix[m], thread_counts[t], striped_rate, global_rate);
+        }
+    }
+
+    fossil_mutex_erase(&global);
+    fossil_crabdb_erase(striped);
+    fossil_crabdb_erase(plain);
+    return 0;
+}
+
+/**
+ * Per-key cost of loading and reading groups of 100 to 10,000 related keys
+ * one call at a time versus through `fossil_crabdb_write_batch` and
+ * `fossil_crabdb_multi_get`.
+ */
+static int bench_batch(size_t max_keys) {
+    const size_t total = max_keys < 1000000 ? max_keys : 1000000;
+
+    printf("%-12s %-14s %-14s %-14s %-14s\n", "batch", "insert ns/key", "batch ns/key", "get ns/key", "multi ns/key");
+    for (size_t batch = 100; batch <= 10000; batch *= 10) {
+        size_t rounds = total / batch ? total / batch : 1;
+        char **keys = (char **)malloc(batch * sizeof(char *));
+        char **values = (char **)malloc(batch * sizeof(char *));
+        fossil_crabdb_batch_entry_t *entries = (fossil_crabdb_batch_entry_t *)malloc(batch * sizeof(fossil_crabdb_batch_entry_t));
+        if (!keys || !values || !entries) return 1;
+        for (size_t i = 0; i < batch; i++) {
+            keys[i] = (char *)malloc(32);
+            if (!keys[i]) return 1;
+        }
+
+        fossil_crabdb_t *single = fossil_crabdb_create();
+        fossil_crabdb_t *batched = fossil_crabdb_create();
+        if (!single || !batched) return 1;
+        fossil_crabdb_create_namespace(single, "bench");
+        fossil_crabdb_create_namespace(batched, "bench");
+
+        double insert_time = 0.0, batch_time = 0.0, get_time = 0.0, multi_time = 0.0;
+        for (size_t r = 0; r < rounds; r++) {
+            for (size_t i = 0; i < batch; i++) {
+                snprintf(keys[i], 32, "key:%zu:%zu", r, i);
+                entries[i] = (fossil_crabdb_batch_entry_t){ CRABDB_BATCH_INSERT, keys[i], "value" };
+            }
+
+            double start = bench_now();
+            for (size_t i = 0; i < batch; i++) {
+                if (fossil_crabdb_insert(single, "bench", keys[i], "value") != CRABDB_OK) return 1;
+            }
+            insert_time += bench_now() - start;
+
+            start = bench_now();
+            if (fossil_crabdb_write_batch(batched, "bench", entries, batch) != CRABDB_OK) return 1;
+            batch_time += bench_now() - start;
+
+            start = bench_now();
+            for (size_t i = 0; i < batch; i++) {
+                if (fossil_crabdb_get(single, "bench", keys[i], &values[i]) != CRABDB_OK) return 1;
+                free(values[i]);
+            }
+            get_time += bench_now() - start;
+
+            start = bench_now();
+            if (fossil_crabdb_multi_get(batched, "bench", (const char *const *)keys, batch, values) != CRABDB_OK) return 1;
+            for (size_t i = 0; i < batch; i++) free(values[i]);
+            multi_time += bench_now() - start;
+        }
+
+        double n = (double)(rounds * batch);
+        printf("%-12zu %-14.1f %-14.1f %-14.1f %-14.1f\n", batch, insert_time * 1e9 / n, batch_time * 1e9 / n,
+               get_time * 1e9 / n, multi_time * 1e9 / n);
+
+        fossil_crabdb_erase(single);
+        fossil_crabdb_erase(batched);
+        for (size_t i = 0; i < batch; i++) free(keys[i]);
+        free(keys);
+        free(values);
+        free(entries);
+    }
+    return 0;
+}
+
+/**
+ * Cost of running an `update` through the query interface: parsing the
+ * string on every call versus executing one prepared statement with a bound
+ * key.
+ */
+static int bench_query(size_t max_keys) {
+    const size_t keys = max_keys < 100000 ? max_keys : 100000;
+    const size_t runs = 1000000;
+    char key[32];
+    char query[64];
+
+    fossil_crabdb_t *db = fossil_crabdb_create();
+    if (!db || fossil_crabdb_create_namespace(db, "bench") != CRABDB_OK) return 1;
+    for (size_t i = 0; i < keys; i++) {
+        snprintf(key, sizeof(key), "key:%zu", i);
+        if (fossil_crabdb_insert(db, "bench", key, "value") != CRABDB_OK) return 1;
+    }
+
+    double start = bench_now();
+    for (size_t i = 0; i < runs; i++) {
+        snprintf(query, sizeof(query), "update(bench, key:%zu, value)", (size_t)(bench_rand() % keys));
+        if (fossil_crabdb_execute_query(db, query) != CRABDB_OK) return 1;
+    }
+    double parsed_time = bench_now() - start;
+
+    fossil_crabdb_stmt_t *stmt;
+    if (fossil_crabdb_prepare(db, "update(bench, ?, value)", &stmt) != CRABDB_OK) return 1;
+    start = bench_now();
+    for (size_t i = 0; i < runs; i++) {
+        snprintf(key, sizeof(key), "key:%zu", (size_t)(bench_rand() % keys));
+        fossil_crabdb_bind(stmt, 1, key);
+        if (fossil_crabdb_stmt_execute(stmt) != CRABDB_OK) return 1;
+    }
+    double prepared_time = bench_now() - start;
+    fossil_crabdb_finalize(stmt);
+
+    printf("%-14s %-14s\n", "parsed ns/op", "prepared ns/op");
+    printf("%-14.1f %-14.1f\n", parsed_time * 1e9 / (double)runs, prepared_time * 1e9 / (double)runs);
+    fossil_crabdb_erase(db);
+    return 0;
+}
+
+/**
+ * Cost per returned pair of walking a prefix of 100 to 10,000 keys through
+ * an ordered cursor, against fetching the same keys one `get` at a time.
+ */
+static int bench_scan(size_t max_keys) {
+    const size_t keys = max_keys < 1000000 ? max_keys : 1000000;
+    char key[32];
+
+    fossil_crabdb_t *db = fossil_crabdb_create();
+    if (!db || fossil_crabdb_create_namespace(db, "bench") != CRABDB_OK) return 1;
+    for (size_t i = 0; i < keys; i++) {
+        snprintf(key, sizeof(key), "key:%07zu", i);
+        if (fossil_crabdb_insert(db, "bench", key, "value") != CRABDB_OK) return 1;
+    }
+
+    double start = bench_now();
+    if (fossil_crabdb_create_ordered_index(db, "bench") != CRABDB_OK) return 1;
+    printf("ordered index build: %.1f ms for %zu keys\n", (bench_now() - start) * 1e3, keys);
+
+    printf("%-12s %-16s %-16s\n", "range", "cursor ns/key", "get ns/key");
+    for (size_t width = 100; width <= 10000 && width <= keys; width *= 10) {
+        const size_t runs = 100;
+        size_t found = 0;
+        char prefix[32];
+        int digits = width == 100 ? 5 : width == 1000 ? 4 : 3;
+
+        start = bench_now();
+        for (size_t r = 0; r < runs; r++) {
+            fossil_crabdb_cursor_t *cursor;
+            const char *k, *v;
+            size_t len;
+            snprintf(prefix, sizeof(prefix), "key:%0*zu", digits, (size_t)(bench_rand() % (keys / width)));
+            if (fossil_crabdb_scan_prefix(db, "bench", prefix, CRABDB_SCAN_FORWARD, &cursor) != CRABDB_OK) return 1;
+            while (fossil_crabdb_cursor_next(cursor, &k, &v, &len)) found++;
+            fossil_crabdb_cursor_close(cursor);
+        }
+        double cursor_time = bench_now() - start;
+
+        start = bench_now();
+        for (size_t r = 0; r < runs; r++) {
+            size_t first = (size_t)(bench_rand() % (keys / width)) * width;
+            for (size_t i = first; i < first + width; i++) {
+                char *value;
+                snprintf(key, sizeof(key), "key:%07zu", i);
+                if (fossil_crabdb_get(db, "bench", key, &value) != CRABDB_OK) return 1;
+                free(value);
+                found++;
+            }
+        }
+        double get_time = bench_now() - start;
+
+        printf("%-12zu %-16.1f %-16.1f\n", width, cursor_time * 1e9 / (double)(runs * width),
+               get_time * 1e9 / (double)(runs * width));
+        if (found != 2 * runs * width) return 1;
+    }
+
+    fossil_crabdb_erase(db);
+    return 0;
+}
+
+/**
+ * Per-key cost of inserting with and without a TTL and of reclaiming expired
+ * pairs with `fossil_crabdb_expire`, from 10K keys up to `max_keys`. The TTL
+ * column includes the expiry that inserts do along the way. With a timing
+ * wheel all three should stay flat as the namespace grows.
+ */
+static int bench_ttl(size_t max_keys) {
+    char key[32];
+
+    printf("%-12s %-14s %-14s %-14s\n", "keys", "insert ns/op", "ttl ns/op", "expire ns/op");
+    for (size_t n = 10000; n <= max_keys; n *= 10) {
+        fossil_crabdb_t *plain = fossil_crabdb_create();
+        fossil_crabdb_t *timed = fossil_crabdb_create();
+        if (!plain || !timed) return 1;
+        fossil_crabdb_create_namespace(plain, "bench");
+        fossil_crabdb_create_namespace(timed, "bench");
+
+        double start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            snprintf(key, sizeof(key), "key:%zu", i);
+            if (fossil_crabdb_insert(plain, "bench", key, "value") != CRABDB_OK) return 1;
+        }
+        double insert_time = bench_now() - start;
+
+        start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            snprintf(key, sizeof(key), "key:%zu", i);
+            if (fossil_crabdb_insert_ttl(timed, "bench", key, "value", 1 + bench_rand() % 200) != CRABDB_OK) return 1;
+        }
+        double ttl_time = bench_now() - start;
+
+        // Let every deadline pass, then time only the reclaiming
+        double deadline = bench_now() + 0.25;
+        while (bench_now() < deadline) {}
+        start = bench_now();
+        size_t reclaimed = fossil_crabdb_expire(timed, 0);
+        double expire_time = bench_now() - start;
+
+        printf("%-12zu %-14.1f %-14.1f %-14.1f\n", n, insert_time * 1e9 / (double)n,
+               ttl_time * 1e9 / (double)n, reclaimed ? expire_time * 1e9 / (double)reclaimed : 0.0);
+        fossil_crabdb_erase(plain);
+        fossil_crabdb_erase(timed);
+    }
+    return 0;
+}
+
+/**
+ * Hit ratio and per-operation cost of a read-mostly workload over `max_keys`
+ * keys, 90% of reads going to a hot 10% of them, with a memory budget of 10%
+ * and 50% of the dataset and without one. A miss inserts the key again, as a
+ * cache would.
+ */
+static int bench_eviction(size_t max_keys) {
+    static const unsigned budgets[] = { 10, 50, 100 };
+    const size_t keys = max_keys < 1000000 ? max_keys : 1000000;
+    const size_t ops = 2000000;
+    const char *value = "value-value-value-value-value-value";
+    char key[32];
+
+    printf("%-10s %-12s %-12s %-14s\n", "budget", "hit ratio", "ns/op", "evictions");
+    for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++) {
+        fossil_crabdb_t *db = fossil_crabdb_create();
+        fossil_crabdb_memory_stats_t stats;
+        if (!db || fossil_crabdb_create_namespace(db, "bench") != CRABDB_OK) return 1;
+        for (size_t i = 0; i < keys; i++) {
+            snprintf(key, sizeof(key), "key:%zu", i);
+            if (fossil_crabdb_insert(db, "bench", key, value) != CRABDB_OK) return 1;
+        }
+        if (fossil_crabdb_memory_stats(db, "bench", &stats) != CRABDB_OK) return 1;
+        if (budgets[b] < 100) {
+            fossil_crabdb_set_memory_budget(db, "bench", stats.resident_bytes / 100 * budgets[b]);
+        }
+
+        size_t hits = 0;
+        double start = bench_now();
+        for (size_t i = 0; i < ops; i++) {
+            uint64_t r = bench_rand();
+            size_t k = (r & 0xff) < 230 ? (size_t)((r >> 8) % (keys / 10)) : (size_t)((r >> 8) % keys);
+            char *found;
+            snprintf(key, sizeof(key), "key:%zu", k);
+            if (fossil_crabdb_get(db, "bench", key, &found) == CRABDB_OK) {
+                free(found);
+                hits++;
+            } else if (fossil_crabdb_insert(db, "bench", key, value) != CRABDB_OK) {
+                return 1;
+            }
+        }
+        double elapsed = bench_now() - start;
+
+        if (fossil_crabdb_memory_stats(db, "bench", &stats) != CRABDB_OK) return 1;
+        char label[16];
+        snprintf(label, sizeof(label), budgets[b] < 100 ? "%u%%" : "none", budgets[b]);
+        printf("%-10s %-12.3f %-12.1f %-14llu\n", label, (double)hits / (double)ops,
+               elapsed * 1e9 / (double)ops, (unsigned long long)stats.evictions);
+        fossil_crabdb_erase(db);
+    }
+    return 0;
+}
+
+/**
+ * Per-key cost of filling a namespace, reading it back, rewriting every
+ * value with one of a different size and dropping the namespace, from 10K
+ * keys up to `max_keys`. Rewrites include the compaction they trigger.
+ */
+static int bench_arena(size_t max_keys) {
+    char key[32];
+
+    printf("%-12s %-14s %-14s %-14s %-14s\n", "keys", "insert ns/op", "get ns/op", "rewrite ns/op", "drop ns/key");
+    for (size_t n = 10000; n <= max_keys; n *= 10) {
+        fossil_crabdb_t *db = fossil_crabdb_create();
+        if (!db || fossil_crabdb_create_namespace(db, "bench") != CRABDB_OK) return 1;
+
+        double start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            snprintf(key, sizeof(key), "key:%zu", i);
+            if (fossil_crabdb_insert(db, "bench", key, "value") != CRABDB_OK) return 1;
+        }
+        double insert_time = bench_now() - start;
+
+        start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            char *value;
+            snprintf(key, sizeof(key), "key:%zu", (size_t)(bench_rand() % n));
+            if (fossil_crabdb_get(db, "bench", key, &value) != CRABDB_OK) return 1;
+            free(value);
+        }
+        double get_time = bench_now() - start;
+
+        start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            snprintf(key, sizeof(key), "key:%zu", i);
+            if (fossil_crabdb_update(db, "bench", key, "a longer value in a new block") != CRABDB_OK) return 1;
+        }
+        double rewrite_time = bench_now() - start;
+
+        start = bench_now();
+        if (fossil_crabdb_erase_namespace(db, "bench") != CRABDB_OK) return 1;
+        double drop_time = bench_now() - start;
+
+        printf("%-12zu %-14.1f %-14.1f %-14.1f %-14.2f\n", n, insert_time * 1e9 / (double)n, get_time * 1e9 / (double)n,
+               rewrite_time * 1e9 / (double)n, drop_time * 1e9 / (double)n);
+        fossil_crabdb_erase(db);
+    }
+    return 0;
+}
+
+/**
+ * Latency of `fossil_crabdb_get` for keys that are missing, without and
+ * with a Bloom filter, and for present keys with the filter, from 10K keys
+ * up to `max_keys`.
+ */
+static int bench_bloom(size_t max_keys) {
+    const size_t lookups = 1000000;
+    char key[32];
+
+    printf("%-12s %-14s %-14s %-14s %-14s\n", "keys", "miss ns/op", "filtered ns/op", "hit ns/op", "filter bytes");
+    for (size_t n = 10000; n <= max_keys; n *= 10) {
+        fossil_crabdb_t *db = fossil_crabdb_create();
+        if (!db || fossil_crabdb_create_namespace(db, "bench") != CRABDB_OK) return 1;
+        for (size_t i = 0; i < n; i++) {
+            snprintf(key, sizeof(key), "key:%zu", i);
+            if (fossil_crabdb_insert(db, "bench", key, "value") != CRABDB_OK) return 1;
+        }
+
+        double start = bench_now();
+        for (size_t i = 0; i < lookups; i++) {
+            char *value;
+            snprintf(key, sizeof(key), "absent:%zu", (size_t)(bench_rand() % n));
+            if (fossil_crabdb_get(db, "bench", key, &value) != CRABDB_ERR_KEY_NOT_FOUND) return 1;
+        }
+        double miss_time = bench_now() - start;
+
+        if (fossil_crabdb_create_bloom_filter(db, "bench", 0) != CRABDB_OK) return 1;
+        start = bench_now();
+        for (size_t i = 0; i < lookups; i++) {
+            char *value;
+            snprintf(key, sizeof(key), "absent:%zu", (size_t)(bench_rand() % n));
+            if (fossil_crabdb_get(db, "bench", key, &value) != CRABDB_ERR_KEY_NOT_FOUND) return 1;
+        }
+        double filtered_time = bench_now() - start;
+
+        start = bench_now();
+        for (size_t i = 0; i < lookups; i++) {
+            char *value;
+            snprintf(key, sizeof(key), "key:%zu", (size_t)(bench_rand() % n));
+            if (fossil_crabdb_get(db, "bench", key, &value) != CRABDB_OK) return 1;
+            free(value);
+        }
+        double hit_time = bench_now() - start;
+
+        fossil_crabdb_memory_stats_t stats;
+        if (fossil_crabdb_memory_stats(db, "bench", &stats) != CRABDB_OK) return 1;
+        printf("%-12zu %-14.1f %-14.1f %-14.1f %-14zu\n", n, miss_time * 1e9 / (double)lookups,
+               filtered_time * 1e9 / (double)lookups, hit_time * 1e9 / (double)lookups, stats.bloom_bytes);
+        fossil_crabdb_erase(db);
+    }
+    return 0;
+}
+
+/**
+ * Cost MVCC adds to writers: updates with no snapshot open against updates
+ * that must keep the old value for one, then a full snapshot scan and the
+ * time `fossil_crabdb_snapshot_end` takes to reclaim what was kept.
+ */
+static int bench_snapshot(size_t max_keys) {
+    char key[32];
+
+    printf("%-12s %-14s %-14s %-14s %-14s\n", "keys", "update ns/op", "kept ns/op", "scan ns/pair", "reclaim ms");
+    for (size_t n = 10000; n <= max_keys; n *= 10) {
+        fossil_crabdb_t *db = fossil_crabdb_create();
+        if (!db || fossil_crabdb_create_namespace(db, "bench") != CRABDB_OK) return 1;
+        for (size_t i = 0; i < n; i++) {
+            snprintf(key, sizeof(key), "key:%zu", i);
+            if (fossil_crabdb_insert(db, "bench", key, "value") != CRABDB_OK) return 1;
+        }
+
+        double start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            snprintf(key, sizeof(key), "key:%zu", i);
+            if (fossil_crabdb_update(db, "bench", key, "value-updated") != CRABDB_OK) return 1;
+        }
+        double update_time = bench_now() - start;
+
+        fossil_crabdb_snapshot_t *snapshot;
+        if (fossil_crabdb_snapshot_begin(db, &snapshot) != CRABDB_OK) return 1;
+        start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            snprintf(key, sizeof(key), "key:%zu", i);
+            if (fossil_crabdb_update(db, "bench", key, "value-kept") != CRABDB_OK) return 1;
+        }
+        double kept_time = bench_now() - start;
+
+        fossil_crabdb_cursor_t *cursor;
+        size_t pairs = 0;
+        start = bench_now();
+        if (fossil_crabdb_snapshot_scan(snapshot, "bench", &cursor) != CRABDB_OK) return 1;
+        while (fossil_crabdb_cursor_next(cursor, cnullptr, cnullptr, cnullptr)) pairs++;
+        fossil_crabdb_cursor_close(cursor);
+        double scan_time = bench_now() - start;
+        if (pairs != n) return 1;
+
+        start = bench_now();
+        fossil_crabdb_snapshot_end(snapshot);
+        double reclaim_time = bench_now() - start;
+
+        printf("%-12zu %-14.1f %-14.1f %-14.1f %-14.2f\n", n, update_time * 1e9 / (double)n, kept_time * 1e9 / (double)n,
+               scan_time * 1e9 / (double)n, reclaim_time * 1e3);
+        fossil_crabdb_erase(db);
+    }
+    return 0;
+}
+
+/**
+ * Nested namespaces: the cost of creating up to `max_namespaces` siblings
+ * under one parent, then of a lookup in a namespace 1 to 16 levels deep.
+ */
+static int bench_tree(size_t max_namespaces) {
+    const size_t lookups = 1000000;
+    char path[256];
+
+    printf("%-12s %-14s\n", "siblings", "create ns/op");
+    for (size_t n = 1000; n <= max_namespaces; n *= 10) {
+        fossil_crabdb_t *db = fossil_crabdb_create();
+        if (!db || fossil_crabdb_create_namespace(db, "tenant") != CRABDB_OK) return 1;
+        double start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            snprintf(path, sizeof(path), "tenant/app%zu", i);
+            if (fossil_crabdb_create_namespace(db, path) != CRABDB_OK) return 1;
+        }
+        printf("%-12zu %-14.1f\n", n, (bench_now() - start) * 1e9 / (double)n);
+        fossil_crabdb_erase(db);
+    }
+
+    printf("\n%-12s %-14s\n", "depth", "get ns/op");
+    for (size_t depth = 1; depth <= 16; depth *= 2) {
+        fossil_crabdb_t *db = fossil_crabdb_create();
+        if (!db) return 1;
+        size_t length = 0;
+        for (size_t level = 0; level < depth; level++) {
+            length += (size_t)snprintf(path + length, sizeof(path) - length, level ? "/level%zu" : "level%zu", level);
+            if (fossil_crabdb_create_namespace(db, path) != CRABDB_OK) return 1;
+        }
+        if (fossil_crabdb_insert(db, path, "key", "value") != CRABDB_OK) return 1;
+
+        double start = bench_now();
+        for (size_t i = 0; i < lookups; i++) {
+            char *value;
+            if (fossil_crabdb_get(db, path, "key", &value) != CRABDB_OK) return 1;
+            free(value);
+        }
+        printf("%-12zu %-14.1f\n", depth, (bench_now() - start) * 1e9 / (double)lookups);
+        fossil_crabdb_erase(db);
+    }
+    return 0;
+}
+
+/**
+ * Pairs per second loaded from a TSV file by `fossil_crabdb_bulk_load`,
+ * into a single-partition database and into a partitioned one, against
+ * inserting the same pairs one call at a time.
+ */
+static int bench_load(size_t max_keys) {
+    const char *path = "bench_bluecrab_load.tsv";
+    char key[32];
+    char value[32];
+
+    printf("%-12s %-14s %-14s %-14s\n", "keys", "insert Mp/s", "load Mp/s", "parallel Mp/s");
+    for (size_t n = 100000; n <= max_keys; n *= 10) {
+        FILE *file = fopen(path, "wb");
+        if (!file) return 1;
+        for (size_t i = 0; i < n; i++) {
+            fprintf(file, "bench\tkey:%zu\tvalue:%zu\n", i, (size_t)(bench_rand() % 1000000));
+        }
+        fclose(file);
+
+        fossil_crabdb_t *db = fossil_crabdb_create();
+        if (!db || fossil_crabdb_create_namespace(db, "bench") != CRABDB_OK) return 1;
+        double start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            snprintf(key, sizeof(key), "key:%zu", i);
+            snprintf(value, sizeof(value), "value:%zu", i);
+            if (fossil_crabdb_insert(db, "bench", key, value) != CRABDB_OK) return 1;
+        }
+        double insert_s = bench_now() - start;
+        fossil_crabdb_erase(db);
+
+        db = fossil_crabdb_create();
+        start = bench_now();
+        if (!db || fossil_crabdb_bulk_load(db, path, CRABDB_LOAD_TSV) != CRABDB_OK) return 1;
+        double load_s = bench_now() - start;
+        fossil_crabdb_erase(db);
+
+        db = fossil_crabdb_create_concurrent(0);
+        start = bench_now();
+        if (!db || fossil_crabdb_bulk_load(db, path, CRABDB_LOAD_TSV) != CRABDB_OK) return 1;
+        double parallel_s = bench_now() - start;
+        fossil_crabdb_erase(db);
+
+        printf("%-12zu %-14.2f %-14.2f %-14.2f\n", n, (double)n / insert_s / 1e6, (double)n / load_s / 1e6, (double)n / parallel_s / 1e6);
+    }
+    remove(path);
+    return 0;
+}
+
+/**
+ * `fossil_crabdb_get` latency as timed by the caller next to what the
+ * built-in meters sampled, and the cost of one `fossil_crabdb_stats` scrape,
+ * for namespaces from 10K keys up to `max_keys`.
+ */
+static int bench_stats(size_t max_keys) {
+    const size_t lookups = 1000000;
+    char key[32];
+
+    printf("%-12s %-14s %-14s %-14s %-14s\n", "keys", "get ns/op", "metered mean", "metered p99", "scrape ms");
+    for (size_t n = 10000; n <= max_keys; n *= 10) {
+        fossil_crabdb_t *db = fossil_crabdb_create();
+        if (!db || fossil_crabdb_create_namespace(db, "bench") != CRABDB_OK) return 1;
+        for (size_t i = 0; i < n; i++) {
+            snprintf(key, sizeof(key), "key:%zu", i);
+            if (fossil_crabdb_insert(db, "bench", key, "value") != CRABDB_OK) return 1;
+        }
+
+        double start = bench_now();
+        for (size_t i = 0; i < lookups; i++) {
+            char *value;
+            snprintf(key, sizeof(key), "key:%zu", (size_t)(bench_rand() % n));
+            if (fossil_crabdb_get(db, "bench", key, &value) != CRABDB_OK) return 1;
+            free(value);
+        }
+        double get_time = bench_now() - start;
+
+        fossil_crabdb_stats_t stats;
+        start = bench_now();
+        if (fossil_crabdb_stats(db, &stats) != CRABDB_OK) return 1;
+        double scrape_time = bench_now() - start;
+
+        printf("%-12zu %-14.1f %-14llu %-14llu %-14.3f\n", n, get_time * 1e9 / (double)lookups,
+               (unsigned long long)stats.ops[CRABDB_STAT_GET].mean_ns, (unsigned long long)stats.ops[CRABDB_STAT_GET].p99_ns, scrape_time * 1e3);
+        fossil_crabdb_erase(db);
+    }
+    return 0;
+}
+
+/**
+ * Inserts and gets on a thread-safe database called directly next to the
+ * same operations submitted to an asynchronous queue, which coalesces them
+ * into write batches and multi-gets, for `max_keys` pairs.
+ */
+static int bench_async(size_t max_keys) {
+    char key[32];
+
+    printf("%-12s %-14s %-14s %-14s %-14s\n", "keys", "insert Mop/s", "async Mop/s", "get Mop/s", "async Mop/s");
+    for (size_t n = 10000; n <= max_keys; n *= 10) {
+        fossil_crabdb_t *db = fossil_crabdb_create_concurrent(0);
+        if (!db || fossil_crabdb_create_namespace(db, "bench") != CRABDB_OK) return 1;
+        double start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            snprintf(key, sizeof(key), "key:%zu", i);
+            if (fossil_crabdb_insert(db, "bench", key, "value") != CRABDB_OK) return 1;
+        }
+        double insert_s = bench_now() - start;
+        start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            char *value;
+            snprintf(key, sizeof(key), "key:%zu", (size_t)(bench_rand() % n));
+            if (fossil_crabdb_get(db, "bench", key, &value) != CRABDB_OK) return 1;
+            free(value);
+        }
+        double get_s = bench_now() - start;
+        fossil_crabdb_erase(db);
+
+        fossil_xthread_pool_t pool;
+        if (fossil_thread_pool_create(&pool, 2, 64) != 0) return 1;
+        db = fossil_crabdb_create_concurrent(0);
+        if (!db || fossil_crabdb_create_namespace(db, "bench") != CRABDB_OK) return 1;
+        fossil_crabdb_async_t *async = fossil_crabdb_async_create(db, &pool);
+        fossil_crabdb_request_t *last = cnullptr;
+        start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            snprintf(key, sizeof(key), "key:%zu", i);
+            if (fossil_crabdb_async_insert(async, "bench", key, "value", cnullptr, cnullptr, i + 1 == n ? &last : cnullptr) != CRABDB_OK) return 1;
+        }
+        if (fossil_crabdb_request_wait(last, cnullptr) != CRABDB_OK) return 1;
+        double async_insert_s = bench_now() - start;
+        fossil_crabdb_request_free(last);
+        start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            snprintf(key, sizeof(key), "key:%zu", (size_t)(bench_rand() % n));
+            if (fossil_crabdb_async_get(async, "bench", key, cnullptr, cnullptr, i + 1 == n ? &last : cnullptr) != CRABDB_OK) return 1;
+        }
+        if (fossil_crabdb_request_wait(last, cnullptr) != CRABDB_OK) return 1;
+        double async_get_s = bench_now() - start;
+        fossil_crabdb_request_free(last);
+        fossil_crabdb_async_erase(async);
+        fossil_thread_pool_erase(&pool);
+        fossil_crabdb_erase(db);
+
+        printf("%-12zu %-14.2f %-14.2f %-14.2f %-14.2f\n", n, (double)n / insert_s / 1e6, (double)n / async_insert_s / 1e6,
+               (double)n / get_s / 1e6, (double)n / async_get_s / 1e6);
+    }
+    return 0;
+}
+
+/**
+ * Resident bytes per pair and get latency for JSON-like records stored as
+ * is, compressed on their own and compressed against a dictionary trained
+ * on the namespace, from 10K keys up to `max_keys`. The insert column for
+ * the dictionary row includes training and recoding.
+ */
+static int bench_compression(size_t max_keys) {
+    static const char *const modes[] = { "plain", "lz", "dictionary" };
+    char key[32];
+    char record[256];
+
+    printf("%-12s %-12s %-14s %-14s %-14s\n", "keys", "mode", "bytes/pair", "insert ns/op", "get ns/op");
+    for (size_t n = 10000; n <= max_keys; n *= 10) {
+        for (int mode = 0; mode < 3; mode++) {
+            fossil_crabdb_t *db = fossil_crabdb_create();
+            if (!db || fossil_crabdb_create_namespace(db, "bench") != CRABDB_OK) return 1;
+            if (mode > 0 && fossil_crabdb_set_compression(db, "bench", 64) != CRABDB_OK) return 1;
+
+            double start = bench_now();
+            for (size_t i = 0; i < n; i++) {
+                snprintf(key, sizeof(key), "key:%zu", i);
+                snprintf(record, sizeof(record),
+                         "{\"id\":%zu,\"name\":\"user%zu\",\"email\":\"user%zu@example.com\",\"active\":%s,"
+                         "\"roles\":[\"reader\",\"writer\"],\"address\":{\"street\":\"%zu Main Street\",\"city\":\"Springfield\"}}",
+                         i, i, i, i % 3 ? "true" : "false", (size_t)(bench_rand() % 10000));
+                if (fossil_crabdb_insert(db, "bench", key, record) != CRABDB_OK) return 1;
+            }
+            if (mode == 2 && fossil_crabdb_train_dictionary(db, "bench", 0) != CRABDB_OK) return 1;
+            double insert_s = bench_now() - start;
+
+            start = bench_now();
+            for (size_t i = 0; i < n; i++) {
+                char *value;
+                snprintf(key, sizeof(key), "key:%zu", (size_t)(bench_rand() % n));
+                if (fossil_crabdb_get(db, "bench", key, &value) != CRABDB_OK) return 1;
+                free(value);
+            }
+            double get_s = bench_now() - start;
+
+            fossil_crabdb_memory_stats_t stats;
+            if (fossil_crabdb_memory_stats(db, "bench", &stats) != CRABDB_OK) return 1;
+            printf("%-12zu %-12s %-14.1f %-14.1f %-14.1f\n", n, modes[mode],
+                   (double)(stats.resident_bytes + stats.dictionary_bytes) / (double)n,
+                   insert_s * 1e9 / (double)n, get_s * 1e9 / (double)n);
+            fossil_crabdb_erase(db);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Throughput of a striped database against a read-mostly one, whose gets
+ * take no locks, for 1 to 64 threads under a read-only and a 95/5 mix.
+ */
+static int bench_read_mostly(size_t keys) {
+    static const size_t thread_counts[] = { 1, 2, 4, 8, 16, 32, 64 };
+    static const unsigned write_mix[] = { 0, 5 };
+    char key[32];
+
+    fossil_crabdb_t *striped = fossil_crabdb_create_concurrent(0);
+    fossil_crabdb_t *read_mostly = fossil_crabdb_create_read_mostly(0);
+    if (!striped || !read_mostly) return 1;
+    fossil_crabdb_create_namespace(striped, "bench");
+    fossil_crabdb_create_namespace(read_mostly, "bench");
+    for (size_t i = 0; i < keys; i++) {
+        snprintf(key, sizeof(key), "key:%zu", i);
+        if (fossil_crabdb_insert(striped, "bench", key, "value") != CRABDB_OK) return 1;
+        if (fossil_crabdb_insert(read_mostly, "bench", key, "value") != CRABDB_OK) return 1;
+    }
+
+    printf("%-8s %-8s %-16s %-18s\n", "writes", "threads", "striped Mops/s", "read-mostly Mops/s");
+    for (size_t m = 0; m < sizeof(write_mix) / sizeof(write_mix[0]); m++) {
+        for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+            double striped_rate = bench_concurrency_run(striped, cnullptr, keys, thread_counts[t], write_mix[m]);
+            double read_mostly_rate = bench_concurrency_run(read_mostly, cnullptr, keys, thread_counts[t], write_mix[m]);
+            printf("%-7u%% %-8zu %-16.2f %-18.2f\n", write_mix[m], thread_counts[t], striped_rate, read_mostly_rate);
+        }
+    }
+
+    fossil_crabdb_erase(striped);
+    fossil_crabdb_erase(read_mostly);
+    return 0;
+}
+
+/**
+ * End-to-end rate of a follower process applying the change stream of a
+ * leader that inserts `n` keys and then updates half of them, with the
+ * largest lag seen between polls.
+ */
+static int bench_replication(size_t max_keys) {
+#ifndef _WIN32
+    char key[32];
+
+    printf("%-12s %-14s %-14s %-16s %-14s\n", "keys", "changes", "kchanges/s", "changes/batch", "max lag KB");
+    for (size_t n = 10000; n <= max_keys; n *= 10) {
+        int fds[2];
+        if (pipe(fds) != 0) return 1;
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) return 1;
+        if (pid == 0) {
+            close(fds[0]);
+            fossil_crabdb_t *leader = fossil_crabdb_create();
+            int failed = fossil_crabdb_create_namespace(leader, "bench") != CRABDB_OK || fossil_crabdb_stream_open(leader, fds[1]) != CRABDB_OK;
+            close(fds[1]);
+            for (size_t i = 0; !failed && i < n; i++) {
+                snprintf(key, sizeof(key), "key:%zu", i);
+                failed = fossil_crabdb_insert(leader, "bench", key, "value") != CRABDB_OK;
+            }
+            for (size_t i = 0; !failed && i < n; i += 2) {
+                snprintf(key, sizeof(key), "key:%zu", i);
+                failed = fossil_crabdb_update(leader, "bench", key, "value-updated") != CRABDB_OK;
+            }
+            fossil_crabdb_erase(leader);
+            _exit(failed);
+        }
+        close(fds[1]);
+
+        fossil_crabdb_t *follower = fossil_crabdb_create_concurrent(0);
+        fossil_crabdb_follower_stats_t stats;
+        uint64_t max_lag = 0;
+        if (!follower || fossil_crabdb_follow(follower, fds[0]) != CRABDB_OK) return 1;
+        close(fds[0]);
+        double start = bench_now();
+        do {
+            fossil_crabdb_follower_stats(follower, &stats);
+            if (stats.lag_bytes > max_lag) max_lag = stats.lag_bytes;
+        } while (fossil_crabdb_follower_poll(follower, 100) == CRABDB_OK);
+        double elapsed = bench_now() - start;
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+        fossil_crabdb_follower_stats(follower, &stats);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !stats.closed) return 1;
+        uint64_t changes = stats.applied;
+        printf("%-12zu %-14llu %-14.1f %-16.1f %-14.1f\n", n, (unsigned long long)changes, (double)changes / elapsed / 1e3,
+               stats.batches ? (double)changes / (double)stats.batches : 0.0, (double)max_lag / 1024.0);
+        fossil_crabdb_erase(follower);
+    }
+    return 0;
+#else
+    (void)max_keys;
+    fprintf(stderr, "the replication benchmark needs fork\n");
+    return 1;
+#endif
+}
+
+/**
+ * Export and import throughput in MB/s of pair data for databases from
+ * 100K pairs up to `max_keys`: one `fossil_crabdb_get` per key, a walk with
+ * `fossil_crabdb_scan_all`, and a `fossil_crabdb_dump` to a file read back
+ * by `fossil_crabdb_restore`.
+ */
+static int bench_dump(size_t max_keys) {
+    const char *path = "bench_bluecrab.dump";
+    char key[32];
+    char value[128];
+
+    printf("%-12s %-10s %-12s %-12s %-12s %-12s\n", "keys", "dump MB", "get MB/s", "scan MB/s", "dump MB/s", "restore MB/s");
+    for (size_t n = 100000; n <= max_keys; n *= 10) {
+        fossil_crabdb_t *db = fossil_crabdb_create();
+        if (!db) return 1;
+        double bytes = 0;
+        for (size_t ns = 0; ns < 4; ns++) {
+            char name[16];
+            snprintf(name, sizeof(name), "bench%zu", ns);
+            if (fossil_crabdb_create_namespace(db, name) != CRABDB_OK) return 1;
+            for (size_t i = ns; i < n; i += 4) {
+                int key_length = snprintf(key, sizeof(key), "key:%zu", i);
+                int value_length = snprintf(value, sizeof(value), "value:%zu:%016llx%016llx%016llx", i,
+                                            (unsigned long long)bench_rand(), (unsigned long long)bench_rand(), (unsigned long long)bench_rand());
+                if (fossil_crabdb_insert(db, name, key, value) != CRABDB_OK) return 1;
+                bytes += key_length + value_length;
+            }
+        }
+        double mb = bytes / 1e6;
+
+        double start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            char name[16];
+            char *copy = cnullptr;
+            snprintf(name, sizeof(name), "bench%zu", i % 4);
+            snprintf(key, sizeof(key), "key:%zu", i);
+            if (fossil_crabdb_get(db, name, key, &copy) != CRABDB_OK) return 1;
+            free(copy);
+        }
+        double get_s = bench_now() - start;
+
+        fossil_crabdb_cursor_t *cursor = cnullptr;
+        const char *k;
+        size_t length;
+        size_t seen = 0;
+        start = bench_now();
+        if (fossil_crabdb_scan_all(db, &cursor) != CRABDB_OK) return 1;
+        while (fossil_crabdb_cursor_next(cursor, &k, cnullptr, &length)) seen++;
+        fossil_crabdb_cursor_close(cursor);
+        double scan_s = bench_now() - start;
+        if (seen != n) return 1;
+
+        fossil_fstream_t stream;
+        if (fossil_fstream_open(&stream, path, "wb") != 0) return 1;
+        start = bench_now();
+        if (fossil_crabdb_dump(db, &stream) != CRABDB_OK) return 1;
+        fossil_fstream_close(&stream);
+        double dump_s = bench_now() - start;
+        fossil_crabdb_erase(db);
+
+        FILE *file = fopen(path, "rb");
+        if (!file) return 1;
+        fseek(file, 0, SEEK_END);
+        double file_mb = (double)ftell(file) / 1e6;
+        fclose(file);
+
+        db = fossil_crabdb_create();
+        if (!db || fossil_fstream_open(&stream, path, "rb") != 0) return 1;
+        start = bench_now();
+        if (fossil_crabdb_restore(db, &stream) != CRABDB_OK) return 1;
+        double restore_s = bench_now() - start;
+        fossil_fstream_close(&stream);
+        fossil_crabdb_erase(db);
+
+        printf("%-12zu %-10.1f %-12.1f %-12.1f %-12.1f %-12.1f\n", n, file_mb, mb / get_s, mb / scan_s, mb / dump_s, mb / restore_s);
+    }
+    remove(path);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *suite = argc > 1 ? argv[1] : "lookup";
+    size_t max_keys = argc > 2 ? (size_t)strtoull(argv[2], cnullptr, 10) : 10000000;
+
+    if (strcmp(suite, "lookup") == 0) {
+        return bench_lookup(max_keys);
+    } else if (strcmp(suite, "recovery") == 0) {
+        return bench_recovery(max_keys);
+    } else if (strcmp(suite, "concurrency") == 0) {
+        return bench_concurrency(max_keys);
+    } else if (strcmp(suite, "batch") == 0) {
+        return bench_batch(max_keys);
+    } else if (strcmp(suite, "query") == 0) {
+        return bench_query(max_keys);
+    } else if (strcmp(suite, "scan") == 0) {
+        return bench_scan(max_keys);
+    } else if (strcmp(suite, "ttl") == 0) {
+        return bench_ttl(max_keys);
+    } else if (strcmp(suite, "eviction") == 0) {
+        return bench_eviction(max_keys);
+    } else if (strcmp(suite, "arena") == 0) {
+        return bench_arena(max_keys);
+    } else if (strcmp(suite, "bloom") == 0) {
+        return bench_bloom(max_keys);
+    } else if (strcmp(suite, "snapshot") == 0) {
+        return bench_snapshot(max_keys);
+    } else if (strcmp(suite, "load") == 0) {
+        return bench_load(max_keys);
+    } else if (strcmp(suite, "tree") == 0) {
+        return bench_tree(max_keys);
+    } else if (strcmp(suite, "stats") == 0) {
+        return bench_stats(max_keys);
+    } else if (strcmp(suite, "async") == 0) {
+        return bench_async(max_keys);
+    } else if (strcmp(suite, "compression") == 0) {
+        return bench_compression(max_keys);
+    } else if (strcmp(suite, "read_mostly") == 0) {
+        return bench_read_mostly(max_keys);
+    } else if (strcmp(suite, "replication") == 0) {
+        return bench_replication(max_keys);
+    } else if (strcmp(suite, "dump") == 0) {
+        return bench_dump(max_keys);
+    }
+
+    fprintf(stderr, "unknown benchmark suite: %s\n", suite);
+    return 1;
+}
@@ -0,0 +1,145 @@
+/*
+==============================================================================
+Author: Michael Gene Brockus (Dreamer)
+Email: michaelbrockus@gmail.com
+Organization: Fossil Logic
+Description:
+    This file is part of the Fossil Logic project, where innovation meets
+    excellence in software development. Michael Gene Brockus, also known as
+    "Dreamer," is a dedicated contributor to this project. For any inquiries,
+    feel free to contact Michael at michaelbrockus@gmail.com.
+==============================================================================
+*/
+#include <fossil/generic/tofu.h>
+#include <fossil/generic/mapof.h>
+#include <fossil/structure/dlist.h>
+#include <fossil/structure/set.h>
+#include <fossil/structure/vector.h>
+#include <time.h>
+
+// * * * * * * * * * * * * * * * * * * * * * * * *
+// * Fossil Logic Benchmark Utilities
+// * * * * * * * * * * * * * * * * * * * * * * * *
+
+static double bench_now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// * * * * * * * * * * * * * * * * * * * * * * * *
+// * Fossil Logic Benchmark Tofu
+// * * * * * * * * * * * * * * * * * * * * * * * *
+
+/**
+ * Bytes each container spends per element, and the time per element of a
+ * search that misses, so walks the whole container, for containers from
+ * 1K up to `max_elements` ints. Set inserts check for duplicates, so the
+ * set is built in quadratic time; keep `max_elements` near 100K.
+ */
+static int bench_scan(size_t max_elements) {
+    printf("sizeof(fossil_tofu_t) %zu, vector slot %zu, set node %zu, dlist node %zu, map entry %zu\n",
+           sizeof(fossil_tofu_t), sizeof(fossil_tofu_t), sizeof(fossil_set_node_t), sizeof(fossil_dlist_node_t), 2 * sizeof(fossil_tofu_t));
+    printf("%-12s %-14s %-14s %-14s %-14s\n", "elements", "vector ns/el", "set ns/el", "dlist ns/el", "map ns/el");
+    for (size_t n = 1000; n <= max_elements; n *= 10) {
+        const size_t rounds = max_elements * 100 / n;
+        fossil_vector_t *vector = fossil_vector_create("int");
+        fossil_set_t *set = fossil_set_create("int");
+        fossil_dlist_t *dlist = fossil_dlist_create("int");
+        fossil_tofu_mapof_t map = fossil_tofu_mapof_create(16);
+        if (!vector || !set || !dlist) return 1;
+        for (size_t i = 0; i < n; i++) {
+            fossil_tofu_t tofu = fossil_tofu_from_int64((int64_t)i);
+            fossil_vector_push_back(vector, tofu);
+            fossil_set_insert(set, tofu);
+            fossil_dlist_insert(dlist, tofu);
+            fossil_tofu_mapof_add(&map, tofu, tofu);
+        }
+        fossil_tofu_t missing = fossil_tofu_from_int64(-1);
+
+        double start = bench_now();
+        for (size_t r = 0; r < rounds; r++) {
+            if (fossil_vector_search(vector, missing) != -1) return 1;
+        }
+        double vector_s = bench_now() - start;
+
+        start = bench_now();
+        for (size_t r = 0; r < rounds; r++) {
+            if (fossil_set_contains(set, missing)) return 1;
+        }
+        double set_s = bench_now() - start;
+
+        start = bench_now();
+        for (size_t r = 0; r < rounds; r++) {
+            if (fossil_dlist_search(dlist, missing) == 0) return 1;
+        }
+        double dlist_s = bench_now() - start;
+
+        start = bench_now();
+        for (size_t r = 0; r < rounds; r++) {
+            if (fossil_tofu_mapof_contains(&map, missing)) return 1;
+        }
+        double map_s = bench_now() - start;
+
+        double scanned = (double)n * (double)rounds;
+        printf("%-12zu %-14.2f %-14.2f %-14.2f %-14.2f\n", n, vector_s * 1e9 / scanned, set_s * 1e9 / scanned,
+               dlist_s * 1e9 / scanned, map_s * 1e9 / scanned);
+
+        fossil_vector_erase(vector);
+        fossil_set_erase(set);
+        fossil_dlist_erase(dlist);
+        fossil_tofu_mapof_erase(&map);
+    }
+    return 0;
+}
+
+/**
+ * Strings built, compared and erased per second, for strings short enough
+ * to be stored inside the tofu and for longer ones.
+ */
+static int bench_strings(size_t count) {
+    static const char *samples[] = { "key:1234", "user@host.io", "a somewhat longer string value" };
+    printf("%-34s %-14s %-14s\n", "string", "build Mops/s", "equals Mops/s");
+    for (size_t s = 0; s < sizeof(samples) / sizeof(samples[0]); s++) {
+        fossil_tofu_t *tofus = (fossil_tofu_t *)malloc(count * sizeof(fossil_tofu_t));
+        if (!tofus) return 1;
+
+        double start = bench_now();
+        for (size_t i = 0; i < count; i++) {
+            tofus[i] = fossil_tofu_from_cstr(samples[s]);
+        }
+        double build_s = bench_now() - start;
+
+        size_t equal = 0;
+        start = bench_now();
+        for (size_t i = 1; i < count; i++) {
+            equal += fossil_tofu_equals(tofus[i - 1], tofus[i]);
+        }
+        double equals_s = bench_now() - start;
+        if (equal != count - 1) return 1;
+
+        start = bench_now();
+        for (size_t i = 0; i < count; i++) {
+            fossil_tofu_erase(&tofus[i]);
+        }
+        build_s += bench_now() - start;
+        free(tofus);
+
+        printf("%-34s %-14.1f %-14.1f\n", samples[s], (double)count / build_s / 1e6, (double)count / equals_s / 1e6);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *suite = argc > 1 ? argv[1] : "scan";
+    size_t max_elements = argc > 2 ? (size_t)strtoull(argv[2], cnullptr, 10) : 100000;
+
+    if (strcmp(suite, "scan") == 0) {
+        return bench_scan(max_elements);
+    } else if (strcmp(suite, "strings") == 0) {
+        return bench_strings(max_elements);
+    }
+
+    fprintf(stderr, "unknown benchmark suite: %s\n", suite);
+    return 1;
+}
@@ -0,0 +1,460 @@
+/*
+==============================================================================
+Author: Michael Gene Brockus (Dreamer)
+Email: michaelbrockus@gmail.com
+Organization: Fossil Logic
+Description:
+    This file is part of the Fossil Logic project, where innovation meets
+    excellence in software development. Michael Gene Brockus, also known as
+    "Dreamer," is a dedicated contributor to this project. For any inquiries,
+    feel free to contact Michael at michaelbrockus@gmail.com.
+==============================================================================
+*/
+#include <fossil/core/bluecrab.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// * * * * * * * * * * * * * * * * * * * * * * * *
+// * Fossil Logic Benchmark Utilities
+// * * * * * * * * * * * * * * * * * * * * * * * *
+
+/*
+ * YCSB core workloads against Blue CrabDB, through the C API and through
+ * the BlueCrabDB wrapper:
+ *
+ *     A  50% read, 50% update
+ *     B  95% read, 5% update
+ *     C  100% read
+ *     D  95% read of recent inserts, 5% insert
+ *     E  95% short range scan, 5% insert
+ *     F  50% read, 50% read-modify-write
+ *
+ * Keys are drawn from a scrambled Zipfian (theta 0.99) or a uniform
+ * distribution; workload D favours the newest keys either way. Every
+ * operation is timed, and each run reports its throughput and the
+ * p50/p99/p999 latency per operation type. The results are printed as one
+ * JSON document on stdout so they can be compared across releases.
+ *
+ *     bench_ycsb [--workloads ABCDEF] [--distributions zipfian,uniform]
+ *                [--apis c,cpp] [--records N] [--operations N]
+ *                [--value-size BYTES] [--threads N] [--scan-length N]
+ */
+
+namespace {
+
+constexpr double ZIPFIAN_THETA = 0.99;
+constexpr const char *NAMESPACE = "usertable";
+constexpr const char *KEY_END = "user~";
+
+enum Op { OP_READ, OP_UPDATE, OP_INSERT, OP_SCAN, OP_RMW, OP_COUNT };
+constexpr const char *OP_NAMES[OP_COUNT] = { "read", "update", "insert", "scan", "read_modify_write" };
+
+struct Workload {
+    char name;
+    unsigned read; // Percent of each operation; the rest are inserts
+    unsigned update;
+    unsigned scan;
+    unsigned rmw;
+    bool latest; // Reads favour the newest keys
+};
+
+constexpr Workload WORKLOADS[] = {
+    { 'A', 50, 50, 0, 0, false },
+    { 'B', 95, 5, 0, 0, false },
+    { 'C', 100, 0, 0, 0, false },
+    { 'D', 95, 0, 0, 0, true },
+    { 'E', 0, 0, 95, 0, false },
+    { 'F', 50, 0, 0, 50, false },
+};
+
+struct Options {
+    std::string workloads = "ABCDEF";
+    std::string distributions = "zipfian,uniform";
+    std::string apis = "c,cpp";
+    uint64_t records = 100000;
+    uint64_t operations = 1000000;
+    size_t value_size = 100;
+    size_t threads = 4;
+    size_t scan_length = 100;
+};
+
+uint64_t splitmix(uint64_t &state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+double uniform01(uint64_t &state) {
+    return (double)(splitmix(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+uint64_t fnv64(uint64_t value) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < 8; i++) {
+        hash ^= value & 0xff;
+        hash *= 1099511628211ULL;
+        value >>= 8;
+    }
+    return hash;
+}
+
+/**
+ * Zipfian generator of Gray et al., as used by YCSB: item 0 is the most
+ * popular and the constants are worked out once for `items`.
+ */
+class Zipfian {
+public:
+    explicit Zipfian(uint64_t items) : items_(items) {
+        for (uint64_t i = 1; i <= items; i++) zetan_ += 1.0 / std::pow((double)i, ZIPFIAN_THETA);
+        double zeta2 = 1.0 + 1.0 / std::pow(2.0, ZIPFIAN_THETA);
+        alpha_ = 1.0 / (1.0 - ZIPFIAN_THETA);
+        eta_ = (1.0 - std::pow(2.0 / (double)items, 1.0 - ZIPFIAN_THETA)) / (1.0 - zeta2 / zetan_);
+        half_pow_theta_ = 1.0 + std::pow(0.5, ZIPFIAN_THETA);
+    }
+
+    uint64_t next(uint64_t &state) const {
+        double u = uniform01(state);
+        double uz = u * zetan_;
+        if (uz < 1.0) return 0;
+        if (uz < half_pow_theta_) return 1;
+        uint64_t item = (uint64_t)((double)items_ * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+        return item < items_ ? item : items_ - 1;
+    }
+
+private:
+    uint64_t items_;
+    double zetan_ = 0.0;
+    double alpha_ = 0.0;
+    double eta_ = 0.0;
+    double half_pow_theta_ = 0.0;
+};
+
+/**
+ * Record numbers become keys through a hash, so neighbouring inserts land
+ * far apart in key order, as in YCSB.
+ */
+void make_key(char *out, size_t size, uint64_t record) {
+    std::snprintf(out, size, "user%019llu", (unsigned long long)(fnv64(record) % 10000000000000000000ULL));
+}
+
+void fill_value(std::string &value, uint64_t &state) {
+    for (size_t i = 0; i < value.size(); i += 8) {
+        uint64_t r = splitmix(state);
+        for (size_t j = i; j < value.size() && j < i + 8; j++, r >>= 8) {
+            value[j] = (char)('a' + (r & 0xff) % 26);
+        }
+    }
+}
+
+// * * * * * * * * * * * * * * * * * * * * * * * *
+// * Fossil Logic Benchmark Stores
+// * * * * * * * * * * * * * * * * * * * * * * * *
+
+/**
+ * The C API on a thread-safe database.
+ */
+class CStore {
+public:
+    CStore() : db_(fossil_crabdb_create_concurrent(0)) {
+        fossil_crabdb_create_namespace(db_, NAMESPACE);
+        fossil_crabdb_create_ordered_index(db_, NAMESPACE);
+    }
+    ~CStore() { fossil_crabdb_erase(db_); }
+    CStore(const CStore&) = delete;
+    CStore& operator=(const CStore&) = delete;
+
+    bool ready() const { return db_ != nullptr; }
+
+    bool read(const char *key) {
+        char *value = nullptr;
+        fossil_crabdb_error_t error = fossil_crabdb_get(db_, NAMESPACE, key, &value);
+        free(value);
+        return error == CRABDB_OK;
+    }
+
+    bool update(const char *key, const std::string &value) {
+        return fossil_crabdb_update(db_, NAMESPACE, key, value.c_str()) == CRABDB_OK;
+    }
+
+    bool insert(const char *key, const std::string &value) {
+        return fossil_crabdb_insert(db_, NAMESPACE, key, value.c_str()) == CRABDB_OK;
+    }
+
+    bool scan(const char *start, size_t length) {
+        fossil_crabdb_cursor_t *cursor = nullptr;
+        if (fossil_crabdb_scan_range(db_, NAMESPACE, start, KEY_END, CRABDB_SCAN_FORWARD, &cursor) != CRABDB_OK) return false;
+        const char *key;
+        const char *value;
+        size_t value_length;
+        for (size_t i = 0; i < length && fossil_crabdb_cursor_next(cursor, &key, &value, &value_length); i++) {
+        }
+        fossil_crabdb_cursor_close(cursor);
+        return true;
+    }
+
+private:
+    fossil_crabdb_t *db_;
+};
+
+/**
+ * The BlueCrabDB wrapper on a thread-safe database.
+ */
+class CppStore {
+public:
+    CppStore() : db_(0) {
+        db_.create_namespace(NAMESPACE);
+        db_.create_ordered_index(NAMESPACE);
+    }
+
+    bool ready() const { return true; }
+
+    bool read(const char *key) {
+        std::string value;
+        return db_.get(NAMESPACE, key, value) == CRABDB_OK;
+    }
+
+    bool update(const char *key, const std::string &value) {
+        return db_.update(NAMESPACE, key, value) == CRABDB_OK;
+    }
+
+    bool insert(const char *key, const std::string &value) {
+        return db_.insert(NAMESPACE, key, value) == CRABDB_OK;
+    }
+
+    bool scan(const char *start, size_t length) {
+        fossil::BlueCrabDB::Cursor cursor;
+        if (db_.scan_range(NAMESPACE, start, KEY_END, cursor) != CRABDB_OK) return false;
+        std::string_view key;
+        std::string_view value;
+        for (size_t i = 0; i < length && cursor.next(key, value); i++) {
+        }
+        return true;
+    }
+
+private:
+    fossil::BlueCrabDB db_;
+};
+
+// * * * * * * * * * * * * * * * * * * * * * * * *
+// * Fossil Logic Benchmark YCSB
+// * * * * * * * * * * * * * * * * * * * * * * * *
+
+struct Result {
+    double load_seconds = 0.0;
+    double run_seconds = 0.0;
+    uint64_t failures = 0;
+    std::vector<uint64_t> latencies[OP_COUNT]; // Nanoseconds
+};
+
+struct Shared {
+    const Options *options;
+    const Workload *workload;
+    const Zipfian *zipfian; // Null for the uniform distribution
+    std::atomic<uint64_t> claimed; // Records handed out to inserters
+    std::atomic<uint64_t> inserted; // Records readers may pick, all present
+};
+
+/**
+ * Pick an existing record. Under the Zipfian distribution the popular
+ * records are scattered over the key space; workload D favours the newest.
+ */
+uint64_t choose(const Shared &shared, uint64_t &state) {
+    uint64_t count = shared.inserted.load(std::memory_order_acquire);
+    uint64_t pick = shared.zipfian ? shared.zipfian->next(state) % count : splitmix(state) % count;
+    if (shared.workload->latest) return count - 1 - pick;
+    return shared.zipfian ? fnv64(pick) % count : pick;
+}
+
+/**
+ * Publish an inserted record once every earlier one is in, so readers only
+ * ever pick records that exist.
+ */
+void acknowledge(Shared &shared, uint64_t record) {
+    uint64_t expected = record;
+    while (!shared.inserted.compare_exchange_weak(expected, record + 1, std::memory_order_release, std::memory_order_relaxed)) {
+        expected = record;
+        std::this_thread::yield();
+    }
+}
+
+template <typename Store>
+void run_thread(Store &store, Shared &shared, uint64_t operations, uint64_t seed, Result &result) {
+    const Workload &w = *shared.workload;
+    std::string value(shared.options->value_size, 'x');
+    char key[32];
+    uint64_t state = seed;
+
+    for (uint64_t i = 0; i < operations; i++) {
+        unsigned roll = (unsigned)(splitmix(state) % 100);
+        Op op = roll < w.read ? OP_READ
+              : roll < w.read + w.update ? OP_UPDATE
+              : roll < w.read + w.update + w.scan ? OP_SCAN
+              : roll < w.read + w.update + w.scan + w.rmw ? OP_RMW
+              : OP_INSERT;
+        uint64_t record = op == OP_INSERT ? shared.claimed.fetch_add(1, std::memory_order_relaxed) : choose(shared, state);
+        size_t scan_length = op == OP_SCAN ? 1 + (size_t)(splitmix(state) % shared.options->scan_length) : 0;
+        if (op != OP_READ && op != OP_SCAN) fill_value(value, state);
+        make_key(key, sizeof(key), record);
+
+        auto start = std::chrono::steady_clock::now();
+        bool ok;
+        switch (op) {
+            case OP_READ: ok = store.read(key); break;
+            case OP_UPDATE: ok = store.update(key, value); break;
+            case OP_SCAN: ok = store.scan(key, scan_length); break;
+            case OP_RMW: ok = store.read(key) && store.update(key, value); break;
+            default: ok = store.insert(key, value); break;
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        if (op == OP_INSERT) acknowledge(shared, record);
+        if (!ok) result.failures++;
+        result.latencies[op].push_back((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+}
+
+/**
+ * Load the records, then run the workload's operations split over the
+ * threads, each with its own latency log.
+ */
+template <typename Store>
+bool run_workload(const Options &options, const Workload &workload, const Zipfian *zipfian, Result &total) {
+    Store store;
+    if (!store.ready()) return false;
+
+    std::string value(options.value_size, 'x');
+    char key[32];
+    uint64_t state = 42;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t record = 0; record < options.records; record++) {
+        fill_value(value, state);
+        make_key(key, sizeof(key), record);
+        if (!store.insert(key, value)) return false;
+    }
+    total.load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    Shared shared{ &options, &workload, zipfian, { options.records }, { options.records } };
+    std::vector<Result> results(options.threads);
+    std::vector<std::thread> threads;
+    start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < options.threads; t++) {
+        uint64_t operations = options.operations / options.threads + (t < options.operations % options.threads ? 1 : 0);
+        threads.emplace_back([&, t, operations] {
+            run_thread(store, shared, operations, 0x5eed0000ULL + t, results[t]);
+        });
+    }
+    for (std::thread &thread : threads) thread.join();
+    total.run_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (Result &result : results) {
+        total.failures += result.failures;
+        for (int op = 0; op < OP_COUNT; op++) {
+            total.latencies[op].insert(total.latencies[op].end(), result.latencies[op].begin(), result.latencies[op].end());
+        }
+    }
+    return true;
+}
+
+uint64_t percentile(std::vector<uint64_t> &sorted, double fraction) {
+    size_t rank = (size_t)std::ceil(fraction * (double)sorted.size());
+    return sorted[rank ? rank - 1 : 0];
+}
+
+void print_run(const Options &options, const Workload &workload, const char *distribution, const char *api, Result &result, bool first) {
+    std::printf("%s\n    {\"workload\": \"%c\", \"distribution\": \"%s\", \"api\": \"%s\", \"threads\": %zu, "
+                "\"records\": %llu, \"operations\": %llu, \"value_size\": %zu,\n"
+                "     \"load_ops_per_sec\": %.1f, \"ops_per_sec\": %.1f, \"failures\": %llu,\n"
+                "     \"latency_ns\": {",
+                first ? "" : ",", workload.name, distribution, api, options.threads,
+                (unsigned long long)options.records, (unsigned long long)options.operations, options.value_size,
+                (double)options.records / result.load_seconds, (double)options.operations / result.run_seconds,
+                (unsigned long long)result.failures);
+    bool first_op = true;
+    for (int op = 0; op < OP_COUNT; op++) {
+        std::vector<uint64_t> &latencies = result.latencies[op];
+        if (latencies.empty()) continue;
+        std::sort(latencies.begin(), latencies.end());
+        std::printf("%s\"%s\": {\"count\": %zu, \"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}",
+                    first_op ? "" : ", ", OP_NAMES[op], latencies.size(),
+                    (unsigned long long)percentile(latencies, 0.50), (unsigned long long)percentile(latencies, 0.99),
+                    (unsigned long long)percentile(latencies, 0.999), (unsigned long long)latencies.back());
+        first_op = false;
+    }
+    std::printf("}}");
+    std::fflush(stdout);
+}
+
+bool parse_options(int argc, char **argv, Options &options) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char *name = argv[i];
+        const char *value = argv[i + 1];
+        if (std::strcmp(name, "--workloads") == 0) {
+            options.workloads = value;
+        } else if (std::strcmp(name, "--distributions") == 0) {
+            options.distributions = value;
+        } else if (std::strcmp(name, "--apis") == 0) {
+            options.apis = value;
+        } else if (std::strcmp(name, "--records") == 0) {
+            options.records = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(name, "--operations") == 0) {
+            options.operations = std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(name, "--value-size") == 0) {
+            options.value_size = (size_t)std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(name, "--threads") == 0) {
+            options.threads = (size_t)std::strtoull(value, nullptr, 10);
+        } else if (std::strcmp(name, "--scan-length") == 0) {
+            options.scan_length = (size_t)std::strtoull(value, nullptr, 10);
+        } else {
+            return false;
+        }
+    }
+    return argc % 2 == 1 && options.records && options.threads && options.scan_length;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::fprintf(stderr, "usage: %s [--workloads ABCDEF] [--distributions zipfian,uniform] [--apis c,cpp] "
+                             "[--records N] [--operations N] [--value-size BYTES] [--threads N] [--scan-length N]\n", argv[0]);
+        return 1;
+    }
+
+    const Zipfian zipfian(options.records);
+    bool first = true;
+    std::printf("{\"benchmark\": \"bluecrab_ycsb\", \"runs\": [");
+    for (const Workload &workload : WORKLOADS) {
+        if (options.workloads.find(workload.name) == std::string::npos) continue;
+        for (const char *distribution : { "zipfian", "uniform" }) {
+            if (options.distributions.find(distribution) == std::string::npos) continue;
+            const Zipfian *keys = std::strcmp(distribution, "zipfian") == 0 ? &zipfian : nullptr;
+            for (const char *api : { "c", "cpp" }) {
+                // Match whole entries so "c" does not select "cpp"
+                std::string apis = "," + options.apis + ",";
+                if (apis.find("," + std::string(api) + ",") == std::string::npos) continue;
+
+                Result result;
+                bool ok = std::strcmp(api, "c") == 0 ? run_workload<CStore>(options, workload, keys, result)
+                                                     : run_workload<CppStore>(options, workload, keys, result);
+                if (!ok) {
+                    std::fprintf(stderr, "workload %c could not load its records\n", workload.name);
+                    return 1;
+                }
+                print_run(options, workload, distribution, api, result, first);
+                first = false;
+            }
+        }
+    }
+    std::printf("\n]}\n");
+    return 0;
+}
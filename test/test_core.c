@@ -22,10 +22,18 @@ Description:
 #include <fossil/core/random.h>
 #include <fossil/core/regex.h>
 #include <fossil/core/smartptr.h>
+#include <fossil/threads/thread.h>
+#include <fossil/threads/threadpool.h>
 
 #include <fossil/unittest.h> // basic test tools
 #include <fossil/xassume.h>  // extra asserts
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 // * * * * * * * * * * * * * * * * * * * * * * * *
 // * Fossil Logic Test Utilities
 // * * * * * * * * * * * * * * * * * * * * * * * *
@@ -520,6 +528,1477 @@ FOSSIL_TEST(test_erase_sub_namespace) {
     ASSUME_ITS_EQUAL_I32(CRABDB_ERR_SUB_NS_NOT_FOUND, result);
 }
 
+FOSSIL_TEST(test_crabdb_namespace_tree) {
+    ASSUME_NOT_CNULL(db);
+    remove("crabdb_tree_test.wal");
+    remove("crabdb_tree_test.snapshot");
+
+    char *value = xnull;
+    fossil_crabdb_persist_open(db, "crabdb_tree_test", CRABDB_SYNC_OS, 0, 0);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_create_namespace(db, "tenant"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_create_sub_namespace(db, "tenant", "app"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_create_namespace(db, "tenant/app/cache"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_EXISTS, fossil_crabdb_create_namespace(db, "tenant/app"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_NOT_FOUND, fossil_crabdb_create_namespace(db, "tenant/missing/cache"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_INVALID_QUERY, fossil_crabdb_create_namespace(db, "tenant/"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_INVALID_QUERY, fossil_crabdb_create_sub_namespace(db, "tenant", "a/b"));
+
+    // Every level holds its own data under its full path
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "tenant", "key", "top"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "tenant/app", "key", "middle"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "tenant/app/cache", "key", "bottom"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(db, "tenant/app", "key", &value));
+    ASSUME_ITS_EQUAL_CSTR("middle", value);
+    free(value);
+
+    // Many siblings, then erasing a subtree takes everything below it
+    char name[32];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(name, sizeof(name), "tenant/app/n%d", i);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_create_namespace(db, name));
+    }
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_erase_namespace(db, "tenant/app/n10"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_create_namespace(db, "tenant/other"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "tenant/other", "key", "kept"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_erase_sub_namespace(db, "tenant", "app"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_NOT_FOUND, fossil_crabdb_get(db, "tenant/app/cache", "key", &value));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_NOT_FOUND, fossil_crabdb_insert(db, "tenant/app/n5", "key", "value"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_create_namespace(db, "tenant/app"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_create_namespace(db, "tenant/app/cache"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "tenant/app/cache", "key", "again"));
+
+    // The tree survives both log replay and a checkpoint
+    fossil_crabdb_persist_close(db);
+    fossil_crabdb_t *recovered = fossil_crabdb_create();
+    fossil_crabdb_persist_open(recovered, "crabdb_tree_test", CRABDB_SYNC_OS, 0, 0);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_checkpoint(recovered));
+    fossil_crabdb_erase(recovered);
+
+    recovered = fossil_crabdb_create();
+    fossil_crabdb_persist_open(recovered, "crabdb_tree_test", CRABDB_SYNC_OS, 0, 0);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(recovered, "tenant/app/cache", "key", &value));
+    ASSUME_ITS_EQUAL_CSTR("again", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(recovered, "tenant/other", "key", &value));
+    ASSUME_ITS_EQUAL_CSTR("kept", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_get(recovered, "tenant/app", "key", &value));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_SUB_NS_EXISTS, fossil_crabdb_create_sub_namespace(recovered, "tenant", "other"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_erase_namespace(recovered, "tenant"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_NOT_FOUND, fossil_crabdb_get(recovered, "tenant/other", "key", &value));
+
+    fossil_crabdb_erase(recovered);
+    remove("crabdb_tree_test.wal");
+    remove("crabdb_tree_test.snapshot");
+}
+
+FOSSIL_TEST(test_crabdb_many_keys) {
+    ASSUME_NOT_CNULL(db);
+
+    fossil_crabdb_create_namespace(db, "namespace1");
+
+    char key[32];
+    char *value = xnull;
+    for (int i = 0; i < 5000; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "namespace1", key, key));
+    }
+
+    for (int i = 0; i < 5000; i += 2) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_delete(db, "namespace1", key));
+    }
+
+    for (int i = 0; i < 5000; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        fossil_crabdb_error_t result = fossil_crabdb_get(db, "namespace1", key, &value);
+        if (i % 2 == 0) {
+            ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, result);
+        } else {
+            ASSUME_ITS_EQUAL_I32(CRABDB_OK, result);
+            ASSUME_ITS_EQUAL_CSTR(key, value);
+            free(value);
+        }
+    }
+}
+
+FOSSIL_TEST(test_crabdb_many_namespaces) {
+    ASSUME_NOT_CNULL(db);
+
+    char name[32];
+    for (int i = 0; i < 500; i++) {
+        snprintf(name, sizeof(name), "namespace%d", i);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_create_namespace(db, name));
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, name, "key", name));
+    }
+
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_EXISTS, fossil_crabdb_create_namespace(db, "namespace42"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_erase_namespace(db, "namespace42"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_NOT_FOUND, fossil_crabdb_insert(db, "namespace42", "key", "value"));
+
+    char *value = xnull;
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(db, "namespace499", "key", &value));
+    ASSUME_ITS_EQUAL_CSTR("namespace499", value);
+    free(value);
+}
+
+FOSSIL_TEST(test_crabdb_persist_recovery) {
+    ASSUME_NOT_CNULL(db);
+    remove("crabdb_persist_test.wal");
+    remove("crabdb_persist_test.snapshot");
+
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_persist_open(db, "crabdb_persist_test", CRABDB_SYNC_ALWAYS, 0, 0));
+    fossil_crabdb_create_namespace(db, "namespace1");
+    fossil_crabdb_insert(db, "namespace1", "key1", "value1");
+    fossil_crabdb_insert(db, "namespace1", "key2", "value2");
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_checkpoint(db));
+    fossil_crabdb_update(db, "namespace1", "key1", "value3");
+    fossil_crabdb_delete(db, "namespace1", "key2");
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_persist_close(db));
+
+    fossil_crabdb_t *recovered = fossil_crabdb_create();
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_persist_open(recovered, "crabdb_persist_test", CRABDB_SYNC_OS, 0, 0));
+
+    char *value = xnull;
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(recovered, "namespace1", "key1", &value));
+    ASSUME_ITS_EQUAL_CSTR("value3", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_get(recovered, "namespace1", "key2", &value));
+
+    fossil_crabdb_erase(recovered);
+    remove("crabdb_persist_test.wal");
+    remove("crabdb_persist_test.snapshot");
+}
+
+FOSSIL_TEST(test_crabdb_persist_torn_tail) {
+    ASSUME_NOT_CNULL(db);
+    remove("crabdb_torn_test.wal");
+    remove("crabdb_torn_test.snapshot");
+
+    fossil_crabdb_persist_open(db, "crabdb_torn_test", CRABDB_SYNC_GROUP, 10, 0);
+    fossil_crabdb_create_namespace(db, "namespace1");
+    fossil_crabdb_insert(db, "namespace1", "key1", "value1");
+    fossil_crabdb_persist_close(db);
+
+    // Simulate a crash in the middle of appending a record
+    FILE *wal = fopen("crabdb_torn_test.wal", "ab");
+    ASSUME_NOT_CNULL(wal);
+    fwrite("\x40\x00\x00\x00garbage", 1, 11, wal);
+    fclose(wal);
+
+    fossil_crabdb_t *recovered = fossil_crabdb_create();
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_persist_open(recovered, "crabdb_torn_test", CRABDB_SYNC_ALWAYS, 0, 0));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(recovered, "namespace1", "key2", "value2"));
+    fossil_crabdb_erase(recovered);
+
+    recovered = fossil_crabdb_create();
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_persist_open(recovered, "crabdb_torn_test", CRABDB_SYNC_ALWAYS, 0, 0));
+    char *value = xnull;
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(recovered, "namespace1", "key2", &value));
+    ASSUME_ITS_EQUAL_CSTR("value2", value);
+    free(value);
+
+    fossil_crabdb_erase(recovered);
+    remove("crabdb_torn_test.wal");
+    remove("crabdb_torn_test.snapshot");
+}
+
+FOSSIL_TEST(test_crabdb_export_and_mmap) {
+    ASSUME_NOT_CNULL(db);
+
+    char key[32];
+    fossil_crabdb_create_namespace(db, "namespace1");
+    fossil_crabdb_create_namespace(db, "namespace2");
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        fossil_crabdb_insert(db, "namespace1", key, key);
+    }
+    fossil_crabdb_insert(db, "namespace2", "key1", "other");
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_export(db, "crabdb_image_test.img"));
+
+    fossil_crabdb_t *mapped = fossil_crabdb_open_mmap("crabdb_image_test.img");
+    ASSUME_NOT_CNULL(mapped);
+
+    char *value = xnull;
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(mapped, "namespace1", "key42", &value));
+    ASSUME_ITS_EQUAL_CSTR("key42", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(mapped, "namespace2", "key1", &value));
+    ASSUME_ITS_EQUAL_CSTR("other", value);
+    free(value);
+
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_get(mapped, "namespace1", "key100", &value));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_NOT_FOUND, fossil_crabdb_get(mapped, "namespace3", "key1", &value));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_READ_ONLY, fossil_crabdb_insert(mapped, "namespace1", "key100", "value"));
+
+    fossil_crabdb_erase(mapped);
+    remove("crabdb_image_test.img");
+}
+
+FOSSIL_TEST(test_crabdb_write_batch) {
+    ASSUME_NOT_CNULL(db);
+    remove("crabdb_batch_test.wal");
+    remove("crabdb_batch_test.snapshot");
+
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_persist_open(db, "crabdb_batch_test", CRABDB_SYNC_OS, 0, 0));
+    fossil_crabdb_create_namespace(db, "namespace1");
+    fossil_crabdb_insert(db, "namespace1", "key1", "value1");
+
+    fossil_crabdb_batch_entry_t batch[] = {
+        { CRABDB_BATCH_INSERT, "key2", "value2" },
+        { CRABDB_BATCH_UPDATE, "key1", "value3" },
+        { CRABDB_BATCH_INSERT, "key3", "value3" },
+        { CRABDB_BATCH_DELETE, "key3", xnull },
+    };
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_write_batch(db, "namespace1", batch, 4));
+
+    // The last entry fails, so none of the batch may be applied
+    fossil_crabdb_batch_entry_t failing[] = {
+        { CRABDB_BATCH_INSERT, "key4", "value4" },
+        { CRABDB_BATCH_DELETE, "key1", xnull },
+        { CRABDB_BATCH_UPDATE, "key1", "value5" },
+    };
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_write_batch(db, "namespace1", failing, 3));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_NOT_FOUND, fossil_crabdb_write_batch(db, "namespace2", batch, 4));
+    fossil_crabdb_persist_close(db);
+
+    fossil_crabdb_t *recovered = fossil_crabdb_create();
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_persist_open(recovered, "crabdb_batch_test", CRABDB_SYNC_OS, 0, 0));
+
+    const char *keys[] = { "key1", "key2", "key3", "key4" };
+    char *values[4];
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_multi_get(recovered, "namespace1", keys, 4, values));
+    ASSUME_ITS_EQUAL_CSTR("value3", values[0]);
+    ASSUME_ITS_EQUAL_CSTR("value2", values[1]);
+    ASSUME_ITS_CNULL(values[2]);
+    ASSUME_ITS_CNULL(values[3]);
+    free(values[0]);
+    free(values[1]);
+
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_multi_get(recovered, "namespace1", keys, 2, values));
+    free(values[0]);
+    free(values[1]);
+
+    fossil_crabdb_erase(recovered);
+    remove("crabdb_batch_test.wal");
+    remove("crabdb_batch_test.snapshot");
+}
+
+FOSSIL_TEST(test_crabdb_prepared_query) {
+    ASSUME_NOT_CNULL(db);
+
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_execute_query(db, "create_namespace(namespace1)"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_execute_query(db, " insert ( namespace1 , key1, 'hello, \\'world\\'' ) ;"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_INVALID_QUERY, fossil_crabdb_execute_query(db, "insert(namespace1, key2)"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_INVALID_QUERY, fossil_crabdb_execute_query(db, "select(namespace1)"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_INVALID_QUERY, fossil_crabdb_execute_query(db, "get(namespace1, 'key1"));
+
+    char *value = xnull;
+    fossil_crabdb_get(db, "namespace1", "key1", &value);
+    ASSUME_ITS_EQUAL_CSTR("hello, 'world'", value);
+    free(value);
+
+    fossil_crabdb_stmt_t *insert = xnull;
+    fossil_crabdb_stmt_t *get = xnull;
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_prepare(db, "insert(namespace1, ?, ?)", &insert));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_prepare(db, "get(namespace1, ?1)", &get));
+    ASSUME_ITS_EQUAL_I32(2, (int32_t)fossil_crabdb_stmt_param_count(insert));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_INVALID_QUERY, fossil_crabdb_stmt_execute(insert)); // unbound
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_INVALID_QUERY, fossil_crabdb_bind(insert, 3, "value"));
+
+    char key[32];
+    for (int i = 0; i < 10; i++) {
+        snprintf(key, sizeof(key), "key%d", i + 2);
+        fossil_crabdb_bind(insert, 1, key);
+        fossil_crabdb_bind(insert, 2, key);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_stmt_execute(insert));
+
+        fossil_crabdb_bind(get, 1, key);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_stmt_execute(get));
+        ASSUME_ITS_EQUAL_CSTR(key, fossil_crabdb_stmt_result(get));
+    }
+
+    fossil_crabdb_bind(get, 1, "missing");
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_stmt_execute(get));
+    ASSUME_ITS_CNULL(fossil_crabdb_stmt_result(get));
+
+    fossil_crabdb_finalize(insert);
+    fossil_crabdb_finalize(get);
+}
+
+FOSSIL_TEST(test_crabdb_ordered_scan) {
+    ASSUME_NOT_CNULL(db);
+    remove("crabdb_ordered_test.wal");
+    remove("crabdb_ordered_test.snapshot");
+
+    char key[32];
+    const char *k;
+    const char *v;
+    const char *prev;
+    fossil_crabdb_cursor_t *cursor = xnull;
+    fossil_crabdb_persist_open(db, "crabdb_ordered_test", CRABDB_SYNC_OS, 0, 0);
+    fossil_crabdb_create_namespace(db, "namespace1");
+
+    // Half the keys exist before the index, half arrive afterwards
+    for (int i = 0; i < 5000; i++) {
+        snprintf(key, sizeof(key), "key%05d", (i * 7919) % 5000);
+        fossil_crabdb_insert(db, "namespace1", key, key);
+        if (i == 2500) {
+            ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NO_INDEX, fossil_crabdb_scan_prefix(db, "namespace1", "", CRABDB_SCAN_FORWARD, &cursor));
+            ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_create_ordered_index(db, "namespace1"));
+        }
+    }
+    for (int i = 0; i < 5000; i += 3) {
+        snprintf(key, sizeof(key), "key%05d", i);
+        fossil_crabdb_delete(db, "namespace1", key);
+    }
+    fossil_crabdb_batch_entry_t batch[] = {
+        { CRABDB_BATCH_DELETE, "key00001", xnull },
+        { CRABDB_BATCH_INSERT, "key00001", "again" },
+        { CRABDB_BATCH_INSERT, "key00000", "back" },
+    };
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_write_batch(db, "namespace1", batch, 3));
+
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_scan_prefix(db, "namespace1", "", CRABDB_SCAN_FORWARD, &cursor));
+    int count = 0;
+    prev = "";
+    while (fossil_crabdb_cursor_next(cursor, &k, &v, xnull)) {
+        ASSUME_ITS_TRUE(strcmp(prev, k) < 0);
+        prev = k;
+        count++;
+    }
+    ASSUME_ITS_EQUAL_I32(5000 - 1667 + 1, count);
+    fossil_crabdb_cursor_close(cursor);
+
+    // key0120x minus the multiples of three
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_scan_prefix(db, "namespace1", "key0120", CRABDB_SCAN_REVERSE, &cursor));
+    ASSUME_ITS_TRUE(fossil_crabdb_cursor_next(cursor, &k, &v, xnull));
+    ASSUME_ITS_EQUAL_CSTR("key01208", k);
+    count = 1;
+    while (fossil_crabdb_cursor_next(cursor, &k, xnull, xnull)) count++;
+    ASSUME_ITS_EQUAL_CSTR("key01201", k);
+    ASSUME_ITS_EQUAL_I32(6, count);
+    fossil_crabdb_cursor_close(cursor);
+
+    fossil_crabdb_persist_close(db);
+    fossil_crabdb_t *recovered = fossil_crabdb_create();
+    fossil_crabdb_persist_open(recovered, "crabdb_ordered_test", CRABDB_SYNC_OS, 0, 0);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_scan_range(recovered, "namespace1", "key00000", "key00003", CRABDB_SCAN_FORWARD, &cursor));
+    size_t length = 0;
+    ASSUME_ITS_TRUE(fossil_crabdb_cursor_next(cursor, &k, &v, &length));
+    ASSUME_ITS_EQUAL_CSTR("back", v);
+    ASSUME_ITS_EQUAL_I32(4, (int32_t)length);
+    ASSUME_ITS_TRUE(fossil_crabdb_cursor_next(cursor, &k, &v, xnull));
+    ASSUME_ITS_EQUAL_CSTR("again", v);
+    ASSUME_ITS_TRUE(fossil_crabdb_cursor_next(cursor, &k, &v, xnull));
+    ASSUME_ITS_EQUAL_CSTR("key00002", k);
+    ASSUME_ITS_FALSE(fossil_crabdb_cursor_next(cursor, &k, &v, xnull));
+    fossil_crabdb_cursor_close(cursor);
+
+    fossil_crabdb_erase(recovered);
+    remove("crabdb_ordered_test.wal");
+    remove("crabdb_ordered_test.snapshot");
+}
+
+static void crabdb_wait_ms(uint64_t ms) {
+    struct timespec start, now;
+    timespec_get(&start, TIME_UTC);
+    do {
+        timespec_get(&now, TIME_UTC);
+    } while ((uint64_t)(now.tv_sec - start.tv_sec) * 1000 + (uint64_t)((now.tv_nsec - start.tv_nsec) / 1000000) < ms);
+}
+
+FOSSIL_TEST(test_crabdb_ttl) {
+    ASSUME_NOT_CNULL(db);
+    remove("crabdb_ttl_test.wal");
+    remove("crabdb_ttl_test.snapshot");
+
+    char key[32];
+    char *value = xnull;
+    uint64_t remaining = 0;
+    fossil_crabdb_persist_open(db, "crabdb_ttl_test", CRABDB_SYNC_OS, 0, 0);
+    fossil_crabdb_create_namespace(db, "namespace1");
+
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert_ttl(db, "namespace1", "short", "gone", 5));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert_ttl(db, "namespace1", "long", "kept", 600000));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "namespace1", "plain", "kept"));
+    for (int i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "session%d", i);
+        fossil_crabdb_insert_ttl(db, "namespace1", key, "token", (uint64_t)(i % 50) + 1);
+    }
+
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_ttl(db, "namespace1", "long", &remaining));
+    ASSUME_ITS_TRUE(remaining > 590000 && remaining <= 600000);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_ttl(db, "namespace1", "plain", &remaining));
+    ASSUME_ITS_TRUE(remaining == UINT64_MAX);
+
+    // Expired pairs read as absent before anything reclaims them
+    crabdb_wait_ms(60);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_get(db, "namespace1", "short", &value));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_update(db, "namespace1", "short", "again"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "namespace1", "short", "again"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_update_ttl(db, "namespace1", "long", "renewed", 0));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_ttl(db, "namespace1", "long", &remaining));
+    ASSUME_ITS_TRUE(remaining == UINT64_MAX);
+
+    ASSUME_ITS_TRUE(fossil_crabdb_expire(db, 0) > 0);
+    ASSUME_ITS_EQUAL_I32(0, (int32_t)fossil_crabdb_expire(db, 0));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_get(db, "namespace1", "session49", &value));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert_ttl(db, "namespace1", "resume", "later", 600000));
+
+    // Deadlines are absolute, so they survive recovery
+    fossil_crabdb_persist_close(db);
+    fossil_crabdb_t *recovered = fossil_crabdb_create();
+    fossil_crabdb_persist_open(recovered, "crabdb_ttl_test", CRABDB_SYNC_OS, 0, 0);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_ttl(recovered, "namespace1", "resume", &remaining));
+    ASSUME_ITS_TRUE(remaining > 590000 && remaining <= 600000);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_get(recovered, "namespace1", "session0", &value));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(recovered, "namespace1", "long", &value));
+    ASSUME_ITS_EQUAL_CSTR("renewed", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(recovered, "namespace1", "short", &value));
+    ASSUME_ITS_EQUAL_CSTR("again", value);
+    free(value);
+
+    fossil_crabdb_erase(recovered);
+    remove("crabdb_ttl_test.wal");
+    remove("crabdb_ttl_test.snapshot");
+}
+
+FOSSIL_TEST(test_crabdb_memory_budget) {
+    ASSUME_NOT_CNULL(db);
+    remove("crabdb_budget_test.wal");
+    remove("crabdb_budget_test.snapshot");
+
+    char key[32];
+    char *value = xnull;
+    fossil_crabdb_memory_stats_t stats;
+    fossil_crabdb_persist_open(db, "crabdb_budget_test", CRABDB_SYNC_OS, 0, 0);
+    fossil_crabdb_create_namespace(db, "namespace1");
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "namespace1", "hot", "always read"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_set_memory_budget(db, "namespace1", 64 * 1024));
+
+    for (int i = 0; i < 5000; i++) {
+        snprintf(key, sizeof(key), "cold%d", i);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "namespace1", key, "a value of some sixty-four bytes, give or take a few characters"));
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(db, "namespace1", "hot", &value));
+        free(value);
+    }
+
+    // Usage stays within one pair of the budget and recently read pairs stay
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(db, "namespace1", &stats));
+    ASSUME_ITS_EQUAL_I32(64 * 1024, (int32_t)stats.budget_bytes);
+    ASSUME_ITS_TRUE(stats.resident_bytes <= stats.budget_bytes + 256);
+    ASSUME_ITS_TRUE(stats.resident_bytes > stats.budget_bytes / 2);
+    ASSUME_ITS_TRUE(stats.evictions > 0);
+    ASSUME_ITS_EQUAL_I32(5001, (int32_t)(stats.pairs + stats.evictions));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(db, "namespace1", "cold4999", &value));
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_get(db, "namespace1", "cold0", &value));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(db, "namespace1", "hot", &value));
+    ASSUME_ITS_EQUAL_CSTR("always read", value);
+    free(value);
+
+    // Evictions were logged, so recovery holds the same pairs
+    size_t pairs = stats.pairs;
+    fossil_crabdb_persist_close(db);
+    fossil_crabdb_t *recovered = fossil_crabdb_create();
+    fossil_crabdb_persist_open(recovered, "crabdb_budget_test", CRABDB_SYNC_OS, 0, 0);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(recovered, "namespace1", &stats));
+    ASSUME_ITS_EQUAL_I32((int32_t)pairs, (int32_t)stats.pairs);
+    ASSUME_ITS_EQUAL_I32(0, (int32_t)stats.budget_bytes);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(recovered, "namespace1", "hot", &value));
+    free(value);
+
+    // Shrinking the budget evicts right away, removing it stops eviction
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_set_memory_budget(recovered, "namespace1", 4096));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(recovered, "namespace1", &stats));
+    ASSUME_ITS_TRUE(stats.resident_bytes <= 4096);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_set_memory_budget(recovered, "namespace1", 0));
+    pairs = stats.pairs;
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(recovered, "namespace1", "extra", "value"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(recovered, "namespace1", &stats));
+    ASSUME_ITS_EQUAL_I32((int32_t)pairs + 1, (int32_t)stats.pairs);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_NOT_FOUND, fossil_crabdb_set_memory_budget(recovered, "missing", 4096));
+
+    fossil_crabdb_erase(recovered);
+    remove("crabdb_budget_test.wal");
+    remove("crabdb_budget_test.snapshot");
+}
+
+FOSSIL_TEST(test_crabdb_arena_compaction) {
+    ASSUME_NOT_CNULL(db);
+
+    char key[32];
+    char *value = xnull;
+    fossil_crabdb_memory_stats_t before, after;
+    fossil_crabdb_create_namespace(db, "namespace1");
+    fossil_crabdb_create_ordered_index(db, "namespace1");
+    for (int i = 0; i < 2000; i++) {
+        snprintf(key, sizeof(key), "key%04d", i);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "namespace1", key, "short"));
+    }
+    for (int i = 0; i < 2000; i++) {
+        snprintf(key, sizeof(key), "key%04d", i);
+        if (i % 2) {
+            ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_delete(db, "namespace1", key));
+        } else {
+            ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_update_ttl(db, "namespace1", key, "a value that no longer fits the old block", 600000));
+        }
+    }
+
+    // Compaction returns the garbage and every index follows the moved pairs
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(db, "namespace1", &before));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_compact(db, "namespace1"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(db, "namespace1", &after));
+    ASSUME_ITS_TRUE(after.arena_bytes < before.arena_bytes);
+    ASSUME_ITS_EQUAL_I32(1000, (int32_t)after.pairs);
+    ASSUME_ITS_EQUAL_I32((int32_t)before.resident_bytes, (int32_t)after.resident_bytes);
+
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(db, "namespace1", "key1998", &value));
+    ASSUME_ITS_EQUAL_CSTR("a value that no longer fits the old block", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_get(db, "namespace1", "key1999", &value));
+
+    fossil_crabdb_cursor_t *cursor;
+    const char *k, *v;
+    size_t length, seen = 0;
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_scan_prefix(db, "namespace1", "key", CRABDB_SCAN_FORWARD, &cursor));
+    while (fossil_crabdb_cursor_next(cursor, &k, &v, &length)) {
+        snprintf(key, sizeof(key), "key%04zu", seen * 2);
+        ASSUME_ITS_EQUAL_CSTR(key, k);
+        seen++;
+    }
+    fossil_crabdb_cursor_close(cursor);
+    ASSUME_ITS_EQUAL_I32(1000, (int32_t)seen);
+
+    // Pairs keep working after they moved
+    uint64_t remaining = 0;
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_ttl(db, "namespace1", "key0000", &remaining));
+    ASSUME_ITS_TRUE(remaining > 590000 && remaining <= 600000);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_update(db, "namespace1", "key0000", "x"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_delete(db, "namespace1", "key0002"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_erase_namespace(db, "namespace1"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_NOT_FOUND, fossil_crabdb_compact(db, "namespace1"));
+}
+
+FOSSIL_TEST(test_crabdb_bloom_filter) {
+    ASSUME_NOT_CNULL(db);
+    remove("crabdb_bloom_test.wal");
+    remove("crabdb_bloom_test.snapshot");
+
+    char key[32];
+    char *value = xnull;
+    fossil_crabdb_memory_stats_t stats;
+    fossil_crabdb_persist_open(db, "crabdb_bloom_test", CRABDB_SYNC_OS, 0, 0);
+    fossil_crabdb_create_namespace(db, "namespace1");
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "namespace1", key, "value"));
+    }
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_create_bloom_filter(db, "namespace1", 0));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_create_bloom_filter(db, "namespace1", 0));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_NOT_FOUND, fossil_crabdb_create_bloom_filter(db, "missing", 0));
+
+    // The filter grows with the keys written after it was enabled
+    fossil_crabdb_batch_entry_t batch[] = {
+        { CRABDB_BATCH_INSERT, "batched", "value" },
+        { CRABDB_BATCH_DELETE, "key0", xnull }
+    };
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_write_batch(db, "namespace1", batch, 2));
+    for (int i = 100; i < 5000; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "namespace1", key, "value"));
+    }
+    for (int i = 1; i < 5000; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(db, "namespace1", key, &value));
+        free(value);
+    }
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(db, "namespace1", "batched", &value));
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_get(db, "namespace1", "key0", &value));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_get(db, "namespace1", "absent", &value));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_update(db, "namespace1", "absent", "value"));
+
+    // Compaction drops deleted keys from the filter and keeps the rest
+    for (int i = 1; i < 5000; i += 2) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_delete(db, "namespace1", key));
+    }
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_compact(db, "namespace1"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(db, "namespace1", &stats));
+    ASSUME_ITS_TRUE(stats.bloom_bytes > 0);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(db, "namespace1", "key4998", &value));
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_get(db, "namespace1", "key4999", &value));
+
+    // The filter is logged and recovered with the namespace
+    fossil_crabdb_persist_close(db);
+    fossil_crabdb_t *recovered = fossil_crabdb_create();
+    fossil_crabdb_persist_open(recovered, "crabdb_bloom_test", CRABDB_SYNC_OS, 0, 0);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(recovered, "namespace1", &stats));
+    ASSUME_ITS_TRUE(stats.bloom_bytes > 0);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_checkpoint(recovered));
+    fossil_crabdb_erase(recovered);
+
+    recovered = fossil_crabdb_create();
+    fossil_crabdb_persist_open(recovered, "crabdb_bloom_test", CRABDB_SYNC_OS, 0, 0);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(recovered, "namespace1", &stats));
+    ASSUME_ITS_TRUE(stats.bloom_bytes > 0);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(recovered, "namespace1", "batched", &value));
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_get(recovered, "namespace1", "key1", &value));
+
+    fossil_crabdb_erase(recovered);
+    remove("crabdb_bloom_test.wal");
+    remove("crabdb_bloom_test.snapshot");
+}
+
+FOSSIL_TEST(test_crabdb_snapshot) {
+    ASSUME_NOT_CNULL(db);
+
+    char key[32];
+    char *value = xnull;
+    const char *scanned_key;
+    const char *scanned_value;
+    fossil_crabdb_snapshot_t *snapshot = xnull;
+    fossil_crabdb_cursor_t *cursor = xnull;
+    fossil_crabdb_memory_stats_t stats;
+    fossil_crabdb_create_namespace(db, "namespace1");
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        fossil_crabdb_insert(db, "namespace1", key, "old");
+    }
+
+    // Writers carry on while the snapshot keeps its view
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_snapshot_begin(db, &snapshot));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_update(db, "namespace1", "key0", "new"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_update(db, "namespace1", "key0", "newer"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_delete(db, "namespace1", "key1"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "namespace1", "added", "new"));
+    fossil_crabdb_batch_entry_t batch[] = {
+        { CRABDB_BATCH_UPDATE, "key2", "new" },
+        { CRABDB_BATCH_DELETE, "key2", xnull },
+        { CRABDB_BATCH_INSERT, "key2", "newest" }
+    };
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_write_batch(db, "namespace1", batch, 3));
+
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_snapshot_get(snapshot, "namespace1", "key0", &value));
+    ASSUME_ITS_EQUAL_CSTR("old", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_snapshot_get(snapshot, "namespace1", "key1", &value));
+    ASSUME_ITS_EQUAL_CSTR("old", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_snapshot_get(snapshot, "namespace1", "key2", &value));
+    ASSUME_ITS_EQUAL_CSTR("old", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_snapshot_get(snapshot, "namespace1", "added", &value));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_NOT_FOUND, fossil_crabdb_snapshot_get(snapshot, "missing", "key0", &value));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(db, "namespace1", "key2", &value));
+    ASSUME_ITS_EQUAL_CSTR("newest", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(db, "namespace1", &stats));
+    ASSUME_ITS_TRUE(stats.versions >= 3);
+
+    // A scan sees exactly the pairs as they were, each once
+    size_t seen = 0;
+    int stale = 0;
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_snapshot_scan(snapshot, "namespace1", &cursor));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "namespace1", "during", "new"));
+    while (fossil_crabdb_cursor_next(cursor, &scanned_key, &scanned_value, xnull)) {
+        if (strcmp(scanned_value, "old") != 0) stale = 1;
+        seen++;
+    }
+    fossil_crabdb_cursor_close(cursor);
+    ASSUME_ITS_EQUAL_U64(100, seen);
+    ASSUME_ITS_FALSE(stale);
+
+    // Ending the last snapshot reclaims every retired version
+    fossil_crabdb_snapshot_end(snapshot);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(db, "namespace1", &stats));
+    ASSUME_ITS_EQUAL_U64(0, stats.versions);
+
+    // With no snapshot open, writes keep nothing
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_update(db, "namespace1", "key3", "new"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(db, "namespace1", &stats));
+    ASSUME_ITS_EQUAL_U64(0, stats.versions);
+}
+
+FOSSIL_TEST(test_crabdb_bulk_load) {
+    ASSUME_NOT_CNULL(db);
+
+    char *value = xnull;
+    FILE *file = fopen("crabdb_load_test.tsv", "wb");
+    ASSUME_NOT_CNULL(file);
+    fputs("namespace1\tkey1\tloaded\r\n"
+          "\n"
+          "tenant/app\tline\tone\\ttwo\\nthree\\\\\n"
+          "tenant/app\tdup\tfirst\n"
+          "tenant/app\tdup\tsecond\n"
+          "tenant/app\tempty\t", file);
+    fclose(file);
+
+    // Existing pairs are replaced, missing namespaces appear with their parents
+    fossil_crabdb_create_namespace(db, "namespace1");
+    fossil_crabdb_insert(db, "namespace1", "key1", "value1");
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_bulk_load(db, "crabdb_load_test.tsv", CRABDB_LOAD_TSV));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(db, "namespace1", "key1", &value));
+    ASSUME_ITS_EQUAL_CSTR("loaded", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(db, "tenant/app", "line", &value));
+    ASSUME_ITS_EQUAL_CSTR("one\ttwo\nthree\\", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(db, "tenant/app", "dup", &value));
+    ASSUME_ITS_EQUAL_CSTR("second", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(db, "tenant/app", "empty", &value));
+    ASSUME_ITS_EQUAL_CSTR("", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_EXISTS, fossil_crabdb_create_namespace(db, "tenant"));
+
+    // A malformed line anywhere leaves the database untouched
+    file = fopen("crabdb_load_test.tsv", "wb");
+    fputs("namespace1\tkey1\tchanged\nnew\tkey\tvalue\nnamespace1\tkey2\n", file);
+    fclose(file);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_INVALID_QUERY, fossil_crabdb_bulk_load(db, "crabdb_load_test.tsv", CRABDB_LOAD_TSV));
+    file = fopen("crabdb_load_test.tsv", "wb");
+    fputs("new//path\tkey\tvalue\n", file);
+    fclose(file);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_INVALID_QUERY, fossil_crabdb_bulk_load(db, "crabdb_load_test.tsv", CRABDB_LOAD_TSV));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(db, "namespace1", "key1", &value));
+    ASSUME_ITS_EQUAL_CSTR("loaded", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_NOT_FOUND, fossil_crabdb_create_sub_namespace(db, "new", "path"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_IO, fossil_crabdb_bulk_load(db, "crabdb_load_missing.tsv", CRABDB_LOAD_TSV));
+
+    // Enough lines for several chunks, loaded into the partitions of a
+    // thread-safe database whose ordered index is rebuilt to match
+    fossil_crabdb_t *shared = fossil_crabdb_create_concurrent(8);
+    fossil_crabdb_create_namespace(shared, "bulk");
+    fossil_crabdb_create_ordered_index(shared, "bulk");
+    fossil_crabdb_insert(shared, "bulk", "key00000", "old");
+    file = fopen("crabdb_load_test.tsv", "wb");
+    for (int i = 0; i < 50000; i++) {
+        fprintf(file, "bulk\tkey%05d\tvalue-%d-padding-to-make-the-file-longer\n", i, i);
+    }
+    fclose(file);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_bulk_load(shared, "crabdb_load_test.tsv", CRABDB_LOAD_TSV));
+
+    fossil_crabdb_memory_stats_t stats;
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(shared, "bulk", &stats));
+    ASSUME_ITS_EQUAL_U64(50000, stats.pairs);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(shared, "bulk", "key00000", &value));
+    ASSUME_ITS_EQUAL_CSTR("value-0-padding-to-make-the-file-longer", value);
+    free(value);
+
+    fossil_crabdb_cursor_t *cursor = xnull;
+    const char *key;
+    const char *scanned;
+    size_t length;
+    size_t seen = 0;
+    int sorted = 1;
+    char previous[16] = "";
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_scan_prefix(shared, "bulk", "key", CRABDB_SCAN_FORWARD, &cursor));
+    while (fossil_crabdb_cursor_next(cursor, &key, &scanned, &length)) {
+        if (strcmp(previous, key) >= 0) sorted = 0;
+        snprintf(previous, sizeof(previous), "%s", key);
+        seen++;
+    }
+    fossil_crabdb_cursor_close(cursor);
+    ASSUME_ITS_EQUAL_U64(50000, seen);
+    ASSUME_ITS_TRUE(sorted);
+    fossil_crabdb_erase(shared);
+    remove("crabdb_load_test.tsv");
+}
+
+FOSSIL_TEST(test_crabdb_stats) {
+    ASSUME_NOT_CNULL(db);
+
+    fossil_crabdb_stats_t stats;
+    char *value = xnull;
+    char key[32];
+    fossil_crabdb_create_namespace(db, "namespace1");
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "namespace1", key, "value"));
+    }
+    for (int i = 0; i < 200; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        if (fossil_crabdb_get(db, "namespace1", key, &value) == CRABDB_OK) free(value);
+    }
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_delete(db, "namespace1", "key0"));
+
+    // Every call is counted, misses as errors, and a sample of them timed
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_stats(db, &stats));
+    ASSUME_ITS_EQUAL_U64(200, stats.ops[CRABDB_STAT_GET].calls);
+    ASSUME_ITS_EQUAL_U64(100, stats.ops[CRABDB_STAT_GET].errors);
+    ASSUME_ITS_EQUAL_U64(100, stats.ops[CRABDB_STAT_INSERT].calls);
+    ASSUME_ITS_EQUAL_U64(1, stats.ops[CRABDB_STAT_DELETE].calls);
+    ASSUME_ITS_TRUE(stats.ops[CRABDB_STAT_GET].samples > 0);
+    ASSUME_ITS_TRUE(stats.ops[CRABDB_STAT_GET].p50_ns <= stats.ops[CRABDB_STAT_GET].p99_ns);
+    ASSUME_ITS_TRUE(stats.ops[CRABDB_STAT_GET].p99_ns <= stats.ops[CRABDB_STAT_GET].max_ns);
+
+    // The storage figures describe the pairs held
+    ASSUME_ITS_EQUAL_U64(1, stats.namespaces);
+    ASSUME_ITS_EQUAL_U64(99, stats.pairs);
+    ASSUME_ITS_TRUE(stats.resident_bytes > 0);
+    ASSUME_ITS_TRUE(stats.load_factor > 0.0 && stats.load_factor <= 1.0);
+    ASSUME_ITS_TRUE(stats.mean_probe >= 1.0);
+    ASSUME_ITS_TRUE(stats.max_probe >= 1);
+
+    // The text form is sized like snprintf and cut to fit a short buffer
+    size_t length = fossil_crabdb_stats_format(&stats, xnull, 0);
+    char *text = (char *)malloc(length + 1);
+    ASSUME_NOT_CNULL(text);
+    ASSUME_ITS_EQUAL_U64(length, fossil_crabdb_stats_format(&stats, text, length + 1));
+    ASSUME_NOT_CNULL(strstr(text, "crabdb_ops_total{op=\"get\"} 200\n"));
+    ASSUME_NOT_CNULL(strstr(text, "crabdb_pairs 99\n"));
+    char cut[16];
+    ASSUME_ITS_EQUAL_U64(length, fossil_crabdb_stats_format(&stats, cut, sizeof(cut)));
+    ASSUME_ITS_EQUAL_U64(sizeof(cut) - 1, strlen(cut));
+    free(text);
+}
+
+typedef struct {
+    int completed;
+    int failed;
+    int found;
+} crabdb_async_tally_t;
+
+static void crabdb_async_count(fossil_crabdb_error_t result, const char *value, void *user) {
+    crabdb_async_tally_t *tally = (crabdb_async_tally_t *)user;
+    tally->completed++;
+    if (result != CRABDB_OK) tally->failed++;
+    if (value && strcmp(value, "value") == 0) tally->found++;
+}
+
+FOSSIL_TEST(test_crabdb_async) {
+    ASSUME_NOT_CNULL(db);
+
+    fossil_xthread_pool_t pool;
+    crabdb_async_tally_t tally = {0, 0, 0};
+    fossil_crabdb_request_t *request = xnull;
+    char *value = xnull;
+    char key[32];
+    ASSUME_ITS_EQUAL_I32(0, fossil_thread_pool_create(&pool, 2, 16));
+    fossil_crabdb_async_t *async = fossil_crabdb_async_create(db, &pool);
+    ASSUME_NOT_CNULL(async);
+    fossil_crabdb_create_namespace(db, "namespace1");
+
+    // Adjacent submissions coalesce, and a duplicate insert still fails
+    // alone without holding back the rest of its batch
+    for (int i = 0; i < 200; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_async_insert(async, "namespace1", key, "value", crabdb_async_count, &tally, xnull));
+    }
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_async_insert(async, "namespace1", "key7", "again", crabdb_async_count, &tally, xnull));
+    for (int i = 0; i < 210; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_async_get(async, "namespace1", key, crabdb_async_count, &tally, xnull));
+    }
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_async_update(async, "namespace1", "key1", "changed", xnull, xnull, xnull));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_async_delete(async, "namespace1", "key2", xnull, xnull, xnull));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_async_execute_query(async, "insert(namespace1, queried, 'yes')", xnull, xnull, xnull));
+
+    // Handles complete in submission order and hand over the value
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_async_get(async, "namespace1", "key1", xnull, xnull, &request));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_request_wait(request, &value));
+    ASSUME_ITS_TRUE(fossil_crabdb_request_poll(request));
+    ASSUME_ITS_EQUAL_CSTR("changed", value);
+    free(value);
+    fossil_crabdb_request_free(request);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_async_get(async, "namespace1", "key2", xnull, xnull, &request));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_request_wait(request, &value));
+    ASSUME_ITS_TRUE(value == xnull);
+    fossil_crabdb_request_free(request);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_async_get(async, "namespace1", "queried", xnull, xnull, &request));
+
+    // Erasing the queue waits for everything still queued
+    fossil_crabdb_async_erase(async);
+    ASSUME_ITS_TRUE(fossil_crabdb_request_poll(request));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_request_wait(request, xnull));
+    fossil_crabdb_request_free(request);
+    fossil_thread_pool_erase(&pool);
+    ASSUME_ITS_EQUAL_I32(411, tally.completed);
+    ASSUME_ITS_EQUAL_I32(11, tally.failed);
+    ASSUME_ITS_EQUAL_I32(200, tally.found);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(db, "namespace1", "key7", &value));
+    ASSUME_ITS_EQUAL_CSTR("value", value);
+    free(value);
+}
+
+FOSSIL_TEST(test_crabdb_bytes) {
+    ASSUME_NOT_CNULL(db);
+    remove("crabdb_bytes_test.wal");
+    remove("crabdb_bytes_test.snapshot");
+
+    static const char small[] = { 'a', '\0', 'b', '\0', 'c' };
+    char large[300];
+    for (size_t i = 0; i < sizeof(large); i++) large[i] = (char)(i % 7);
+    void *value = xnull;
+    size_t length = 0;
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_persist_open(db, "crabdb_bytes_test", CRABDB_SYNC_OS, 0, 0));
+    fossil_crabdb_create_namespace(db, "namespace1");
+
+    // Embedded NUL bytes survive the round trip
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert_bytes(db, "namespace1", "key1", small, sizeof(small)));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get_bytes(db, "namespace1", "key1", &value, &length));
+    ASSUME_ITS_EQUAL_I32((int32_t)sizeof(small), (int32_t)length);
+    ASSUME_ITS_TRUE(memcmp(small, value, length) == 0);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert_bytes(db, "namespace1", "empty", xnull, 0));
+
+    // Growing past the inline room and shrinking back keep every byte
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_update_bytes(db, "namespace1", "key1", large, sizeof(large)));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get_bytes(db, "namespace1", "key1", &value, &length));
+    ASSUME_ITS_EQUAL_I32((int32_t)sizeof(large), (int32_t)length);
+    ASSUME_ITS_TRUE(memcmp(large, value, length) == 0);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert_bytes(db, "namespace1", "key2", large, sizeof(large)));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_update_bytes(db, "namespace1", "key2", small, sizeof(small)));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_persist_close(db));
+
+    // Replay restores the lengths the log recorded
+    fossil_crabdb_t *recovered = fossil_crabdb_create();
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_persist_open(recovered, "crabdb_bytes_test", CRABDB_SYNC_OS, 0, 0));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get_bytes(recovered, "namespace1", "key1", &value, &length));
+    ASSUME_ITS_EQUAL_I32((int32_t)sizeof(large), (int32_t)length);
+    ASSUME_ITS_TRUE(memcmp(large, value, length) == 0);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get_bytes(recovered, "namespace1", "key2", &value, &length));
+    ASSUME_ITS_EQUAL_I32((int32_t)sizeof(small), (int32_t)length);
+    ASSUME_ITS_TRUE(memcmp(small, value, length) == 0);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get_bytes(recovered, "namespace1", "empty", &value, &length));
+    ASSUME_ITS_EQUAL_I32(0, (int32_t)length);
+    free(value);
+
+    fossil_crabdb_erase(recovered);
+    remove("crabdb_bytes_test.wal");
+    remove("crabdb_bytes_test.snapshot");
+}
+
+FOSSIL_TEST(test_crabdb_compression) {
+    ASSUME_NOT_CNULL(db);
+    remove("crabdb_compression_test.wal");
+    remove("crabdb_compression_test.snapshot");
+
+    char key[32];
+    char record[256];
+    char *value = xnull;
+    const char *k = xnull;
+    const char *v = xnull;
+    size_t length = 0;
+    fossil_crabdb_view_t view;
+    fossil_crabdb_snapshot_t *snapshot = xnull;
+    fossil_crabdb_cursor_t *cursor = xnull;
+    fossil_crabdb_memory_stats_t stats;
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_persist_open(db, "crabdb_compression_test", CRABDB_SYNC_OS, 0, 0));
+    fossil_crabdb_create_namespace(db, "namespace1");
+    fossil_crabdb_create_ordered_index(db, "namespace1");
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_INVALID_QUERY, fossil_crabdb_train_dictionary(db, "namespace1", 0));
+    for (int i = 0; i < 500; i++) {
+        snprintf(key, sizeof(key), "user%03d", i);
+        snprintf(record, sizeof(record),
+                 "{\"id\":%d,\"name\":\"user%d\",\"email\":\"user%d@example.com\",\"active\":true,"
+                 "\"roles\":[\"reader\",\"writer\"],\"address\":{\"street\":\"%d Main Street\",\"city\":\"Springfield\"}}",
+                 i, i, i, i * 7);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "namespace1", key, record));
+    }
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(db, "namespace1", &stats));
+    size_t plain = stats.resident_bytes;
+
+    // Turning compression on recodes the pairs already stored
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_set_compression(db, "namespace1", 64));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_train_dictionary(db, "namespace1", 0));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(db, "namespace1", &stats));
+    ASSUME_ITS_TRUE(stats.dictionary_bytes > 0);
+    ASSUME_ITS_TRUE(stats.resident_bytes + stats.dictionary_bytes < plain);
+    ASSUME_ITS_EQUAL_I32(500, (int32_t)stats.pairs);
+
+    // Every read path hands back the value as written
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(db, "namespace1", "user499", &value));
+    ASSUME_ITS_EQUAL_CSTR(record, value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get_bytes(db, "namespace1", "user499", (void **)&value, &length));
+    ASSUME_ITS_EQUAL_I32((int32_t)strlen(record), (int32_t)length);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get_view(db, "namespace1", "user499", &view));
+    ASSUME_ITS_EQUAL_CSTR(record, view.data);
+    ASSUME_ITS_EQUAL_I32((int32_t)strlen(record), (int32_t)view.length);
+    fossil_crabdb_view_release(&view);
+    const char *keys[] = { "user000", "user499" };
+    char *values[2] = { xnull, xnull };
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_multi_get(db, "namespace1", keys, 2, values));
+    ASSUME_ITS_TRUE(strncmp("{\"id\":0,", values[0], 8) == 0);
+    ASSUME_ITS_EQUAL_CSTR(record, values[1]);
+    free(values[0]);
+    free(values[1]);
+    int count = 0;
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_scan_prefix(db, "namespace1", "user", CRABDB_SCAN_FORWARD, &cursor));
+    while (fossil_crabdb_cursor_next(cursor, &k, &v, &length)) {
+        ASSUME_ITS_TRUE(strstr(v, "Springfield") != xnull);
+        ASSUME_ITS_EQUAL_I32((int32_t)strlen(v), (int32_t)length);
+        count++;
+    }
+    fossil_crabdb_cursor_close(cursor);
+    ASSUME_ITS_EQUAL_I32(500, count);
+
+    // Snapshots keep superseded values readable
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_snapshot_begin(db, &snapshot));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_update(db, "namespace1", "user499", "short"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_snapshot_get(snapshot, "namespace1", "user499", &value));
+    ASSUME_ITS_EQUAL_CSTR(record, value);
+    free(value);
+    fossil_crabdb_snapshot_end(snapshot);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(db, "namespace1", "user499", &value));
+    ASSUME_ITS_EQUAL_CSTR("short", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_persist_close(db));
+
+    // Replay restores the dictionary before the values that use it
+    fossil_crabdb_t *recovered = fossil_crabdb_create();
+    size_t dictionary = stats.dictionary_bytes;
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_persist_open(recovered, "crabdb_compression_test", CRABDB_SYNC_OS, 0, 0));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(recovered, "namespace1", &stats));
+    ASSUME_ITS_EQUAL_I32((int32_t)dictionary, (int32_t)stats.dictionary_bytes);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(recovered, "namespace1", "user000", &value));
+    ASSUME_ITS_TRUE(strncmp("{\"id\":0,", value, 8) == 0);
+    free(value);
+
+    // Turning it off stores everything as is again
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_set_compression(recovered, "namespace1", 0));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(recovered, "namespace1", &stats));
+    ASSUME_ITS_EQUAL_I32(0, (int32_t)stats.dictionary_bytes);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(recovered, "namespace1", "user001", &value));
+    ASSUME_ITS_TRUE(strncmp("{\"id\":1,", value, 8) == 0);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_NOT_FOUND, fossil_crabdb_set_compression(recovered, "missing", 64));
+
+    fossil_crabdb_erase(recovered);
+    remove("crabdb_compression_test.wal");
+    remove("crabdb_compression_test.snapshot");
+}
+
+FOSSIL_TEST(test_crabdb_dump) {
+    ASSUME_NOT_CNULL(db);
+    remove("crabdb_dump_test.dump");
+
+    char key[32];
+    char record[160];
+    char *value = xnull;
+    const char *k = xnull;
+    const char *v = xnull;
+    size_t length = 0;
+    uint64_t remaining = 0;
+    fossil_crabdb_cursor_t *cursor = xnull;
+    fossil_crabdb_memory_stats_t stats;
+    fossil_fstream_t stream;
+    fossil_crabdb_create_namespace(db, "namespace1");
+    fossil_crabdb_create_sub_namespace(db, "namespace1", "child");
+    fossil_crabdb_create_namespace(db, "empty");
+    fossil_crabdb_create_ordered_index(db, "namespace1");
+    fossil_crabdb_create_bloom_filter(db, "namespace1/child", 10);
+    fossil_crabdb_set_compression(db, "namespace1/child", 32);
+    for (int i = 0; i < 300; i++) {
+        snprintf(key, sizeof(key), "key%03d", i);
+        snprintf(record, sizeof(record), "{\"id\":%d,\"name\":\"user%d\",\"city\":\"Springfield\",\"active\":true}", i, i);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "namespace1", key, record));
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(db, "namespace1/child", key, record));
+    }
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_train_dictionary(db, "namespace1/child", 0));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(db, "namespace1/child", &stats));
+    size_t compressed = stats.resident_bytes;
+    size_t dictionary = stats.dictionary_bytes;
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert_bytes(db, "namespace1", "binary", "a\0b", 3));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert_ttl(db, "namespace1", "session", "token", 600000));
+
+    // A full scan visits every pair once, compressed ones decompressed
+    int count = 0;
+    int children = 0;
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_scan_all(db, &cursor));
+    while (fossil_crabdb_cursor_next(cursor, &k, &v, &length)) {
+        if (strcmp("namespace1/child", fossil_crabdb_cursor_namespace(cursor)) == 0) {
+            ASSUME_ITS_TRUE(strstr(v, "Springfield") != xnull);
+            children++;
+        }
+        count++;
+    }
+    ASSUME_ITS_CNULL(fossil_crabdb_cursor_namespace(cursor));
+    fossil_crabdb_cursor_close(cursor);
+    ASSUME_ITS_EQUAL_I32(602, count);
+    ASSUME_ITS_EQUAL_I32(300, children);
+
+    ASSUME_ITS_EQUAL_I32(0, fossil_fstream_open(&stream, "crabdb_dump_test.dump", "wb"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_dump(db, &stream));
+    fossil_fstream_close(&stream);
+
+    // Restoring rebuilds namespaces, settings, values and deadlines
+    fossil_crabdb_t *restored = fossil_crabdb_create();
+    fossil_crabdb_create_namespace(restored, "namespace1");
+    fossil_crabdb_insert(restored, "namespace1", "key000", "stale");
+    ASSUME_ITS_EQUAL_I32(0, fossil_fstream_open(&stream, "crabdb_dump_test.dump", "rb"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_restore(restored, &stream));
+    fossil_fstream_close(&stream);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(restored, "namespace1", "key000", &value));
+    ASSUME_ITS_TRUE(strncmp("{\"id\":0,", value, 8) == 0);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(restored, "namespace1/child", "key299", &value));
+    ASSUME_ITS_EQUAL_CSTR(record, value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get_bytes(restored, "namespace1", "binary", (void **)&value, &length));
+    ASSUME_ITS_EQUAL_I32(3, (int32_t)length);
+    ASSUME_ITS_TRUE(memcmp("a\0b", value, 3) == 0);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_ttl(restored, "namespace1", "session", &remaining));
+    ASSUME_ITS_TRUE(remaining > 0 && remaining <= 600000);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_memory_stats(restored, "namespace1/child", &stats));
+    ASSUME_ITS_EQUAL_I32(300, (int32_t)stats.pairs);
+    ASSUME_ITS_EQUAL_I32((int32_t)compressed, (int32_t)stats.resident_bytes);
+    ASSUME_ITS_EQUAL_I32((int32_t)dictionary, (int32_t)stats.dictionary_bytes);
+    ASSUME_ITS_TRUE(stats.bloom_bytes > 0);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_EXISTS, fossil_crabdb_create_namespace(restored, "empty"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_scan_prefix(restored, "namespace1", "key29", CRABDB_SCAN_FORWARD, &cursor));
+    count = 0;
+    while (fossil_crabdb_cursor_next(cursor, &k, xnull, xnull)) count++;
+    fossil_crabdb_cursor_close(cursor);
+    ASSUME_ITS_EQUAL_I32(10, count);
+    fossil_crabdb_erase(restored);
+
+    // A truncated dump is refused once the damage is reached
+    static char contents[1 << 16];
+    FILE *file = fopen("crabdb_dump_test.dump", "rb");
+    ASSUME_NOT_CNULL(file);
+    size_t size = fread(contents, 1, sizeof(contents), file);
+    fclose(file);
+    ASSUME_ITS_TRUE(size > 6 && size < sizeof(contents));
+    file = fopen("crabdb_dump_test.dump", "wb");
+    ASSUME_NOT_CNULL(file);
+    fwrite(contents, 1, size - 6, file);
+    fclose(file);
+    restored = fossil_crabdb_create();
+    ASSUME_ITS_EQUAL_I32(0, fossil_fstream_open(&stream, "crabdb_dump_test.dump", "rb"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_IO, fossil_crabdb_restore(restored, &stream));
+    fossil_fstream_close(&stream);
+    fossil_crabdb_erase(restored);
+    remove("crabdb_dump_test.dump");
+}
+
+FOSSIL_TEST(test_crabdb_get_view) {
+    ASSUME_NOT_CNULL(db);
+
+    fossil_crabdb_view_t view;
+    fossil_crabdb_create_namespace(db, "namespace1");
+    fossil_crabdb_insert(db, "namespace1", "key1", "value1");
+
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get_view(db, "namespace1", "key1", &view));
+    ASSUME_ITS_EQUAL_CSTR("value1", view.data);
+    ASSUME_ITS_EQUAL_I32(6, (int32_t)view.length);
+    fossil_crabdb_view_release(&view);
+
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_get_view(db, "namespace1", "key2", &view));
+    ASSUME_ITS_CNULL(view.data);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_NOT_FOUND, fossil_crabdb_get_view(db, "namespace2", "key1", &view));
+
+    // Releasing the guard of a thread-safe database lets writers back in
+    fossil_crabdb_t *shared = fossil_crabdb_create_concurrent(4);
+    fossil_crabdb_create_namespace(shared, "namespace1");
+    fossil_crabdb_insert(shared, "namespace1", "key1", "value1");
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get_view(shared, "namespace1", "key1", &view));
+    ASSUME_ITS_EQUAL_CSTR("value1", view.data);
+    fossil_crabdb_view_release(&view);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_update(shared, "namespace1", "key1", "value2"));
+    fossil_crabdb_erase(shared);
+}
+
+typedef struct {
+    fossil_crabdb_t *db;
+    int id;
+    int errors;
+} crabdb_worker_t;
+
+static void crabdb_concurrent_worker(void *arg) {
+    crabdb_worker_t *worker = (crabdb_worker_t *)arg;
+    char key[32];
+    char *value = xnull;
+
+    for (int i = 0; i < 500; i++) {
+        snprintf(key, sizeof(key), "w%d:key%d", worker->id, i);
+        if (fossil_crabdb_insert(worker->db, "namespace1", key, key) != CRABDB_OK) worker->errors++;
+        if (fossil_crabdb_get(worker->db, "namespace1", key, &value) != CRABDB_OK || strcmp(value, key) != 0) worker->errors++;
+        free(value);
+        value = xnull;
+        if (i % 2 && fossil_crabdb_delete(worker->db, "namespace1", key) != CRABDB_OK) worker->errors++;
+    }
+}
+
+FOSSIL_TEST(test_crabdb_concurrent) {
+    fossil_crabdb_t *shared = fossil_crabdb_create_concurrent(8);
+    ASSUME_NOT_CNULL(shared);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_create_namespace(shared, "namespace1"));
+
+    fossil_xthread_t threads[4];
+    crabdb_worker_t workers[4];
+    for (int i = 0; i < 4; i++) {
+        workers[i] = (crabdb_worker_t){ shared, i, 0 };
+        fossil_xtask_t task = { crabdb_concurrent_worker, &workers[i] };
+        ASSUME_ITS_EQUAL_I32(FOSSIL_SUCCESS, fossil_thread_create(&threads[i], xnull, task));
+    }
+    for (int i = 0; i < 4; i++) {
+        fossil_thread_join(threads[i], xnull);
+        ASSUME_ITS_EQUAL_I32(0, workers[i].errors);
+    }
+
+    char *value = xnull;
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(shared, "namespace1", "w3:key42", &value));
+    ASSUME_ITS_EQUAL_CSTR("w3:key42", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_get(shared, "namespace1", "w3:key43", &value));
+
+    fossil_crabdb_erase(shared);
+}
+
+static int crabdb_value_uniform(const char *value, size_t length) {
+    if (length < 8 || length > 207) return 0;
+    for (size_t i = 1; i < length; i++) {
+        if (value[i] != value[0]) return 0;
+    }
+    return 1;
+}
+
+static void crabdb_read_mostly_reader(void *arg) {
+    crabdb_worker_t *worker = (crabdb_worker_t *)arg;
+    char key[32];
+    void *value = xnull;
+    size_t length = 0;
+
+    for (int i = 0; i < 20000; i++) {
+        snprintf(key, sizeof(key), "hot%d", i % 16);
+        if (fossil_crabdb_get_bytes(worker->db, "namespace1", key, &value, &length) != CRABDB_OK ||
+            !crabdb_value_uniform((const char *)value, length)) worker->errors++;
+        free(value);
+        value = xnull;
+    }
+}
+
+static void crabdb_read_mostly_writer(void *arg) {
+    crabdb_worker_t *worker = (crabdb_worker_t *)arg;
+    char key[32];
+    char buffer[208];
+
+    for (int i = 0; i < 4000; i++) {
+        size_t length = 8 + (size_t)(i * 37) % 200;
+        memset(buffer, 'a' + i % 26, length);
+        snprintf(key, sizeof(key), "hot%d", i % 16);
+        if (fossil_crabdb_update_bytes(worker->db, "namespace1", key, buffer, length) != CRABDB_OK) worker->errors++;
+        // Churn grows and shrinks the index and fills the arena with garbage
+        snprintf(key, sizeof(key), "churn%d", i);
+        fossil_crabdb_insert(worker->db, "namespace1", key, "x");
+        if (i >= 64) {
+            snprintf(key, sizeof(key), "churn%d", i - 64);
+            fossil_crabdb_delete(worker->db, "namespace1", key);
+        }
+        if (i % 500 == 499) fossil_crabdb_compact(worker->db, "namespace1");
+    }
+}
+
+FOSSIL_TEST(test_crabdb_read_mostly) {
+    fossil_crabdb_t *shared = fossil_crabdb_create_read_mostly(4);
+    ASSUME_NOT_CNULL(shared);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_create_namespace(shared, "namespace1"));
+
+    char key[32];
+    char *value = xnull;
+    size_t length = 0;
+    for (int i = 0; i < 2000; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(shared, "namespace1", key, key));
+    }
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(shared, "namespace1", "key1999", &value));
+    ASSUME_ITS_EQUAL_CSTR("key1999", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_get(shared, "namespace1", "key2000", &value));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_NOT_FOUND, fossil_crabdb_get(shared, "namespace2", "key1", &value));
+
+    // Lock-free gets see every kind of structural change
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_create_bloom_filter(shared, "namespace1", 10));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_set_compression(shared, "namespace1", 16));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_update(shared, "namespace1", "key7",
+                                                         "a value long enough to be worth compressing, compressing, compressing"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get_bytes(shared, "namespace1", "key7", (void **)&value, &length));
+    ASSUME_ITS_EQUAL_I32(69, (int32_t)length);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_get(shared, "namespace1", "absent", &value));
+    for (int i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_delete(shared, "namespace1", key));
+    }
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_compact(shared, "namespace1"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_set_memory_budget(shared, "namespace1", 16384));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert_ttl(shared, "namespace1", "brief", "gone", 1));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(shared, "namespace1", "fresh", "kept"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(shared, "namespace1", "fresh", &value));
+    ASSUME_ITS_EQUAL_CSTR("kept", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_set_memory_budget(shared, "namespace1", 0));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_erase_namespace(shared, "namespace1"));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_NOT_FOUND, fossil_crabdb_get(shared, "namespace1", "fresh", &value));
+
+    // Readers never observe a torn value while a writer rewrites it
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_create_namespace(shared, "namespace1"));
+    for (int i = 0; i < 16; i++) {
+        snprintf(key, sizeof(key), "hot%d", i);
+        ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_insert(shared, "namespace1", key, "zzzzzzzz"));
+    }
+    fossil_xthread_t threads[3];
+    crabdb_worker_t workers[3];
+    for (int i = 0; i < 3; i++) {
+        workers[i] = (crabdb_worker_t){ shared, i, 0 };
+        fossil_xtask_t task = { i ? crabdb_read_mostly_reader : crabdb_read_mostly_writer, &workers[i] };
+        ASSUME_ITS_EQUAL_I32(FOSSIL_SUCCESS, fossil_thread_create(&threads[i], xnull, task));
+    }
+    for (int i = 0; i < 3; i++) {
+        fossil_thread_join(threads[i], xnull);
+        ASSUME_ITS_EQUAL_I32(0, workers[i].errors);
+    }
+
+    fossil_crabdb_erase(shared);
+}
+
+#ifndef _WIN32
+static int crabdb_leader_process(int fd) {
+    fossil_crabdb_t *leader = fossil_crabdb_create();
+    int failures = 0;
+    char key[32];
+
+    // Written before the stream opens, so it reaches the follower as contents
+    failures += fossil_crabdb_create_namespace(leader, "namespace1") != CRABDB_OK;
+    failures += fossil_crabdb_insert_bytes(leader, "namespace1", "binary", "a\0b", 3) != CRABDB_OK;
+    failures += fossil_crabdb_stream_open(leader, fd) != CRABDB_OK;
+    for (int i = 0; i < 300; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        failures += fossil_crabdb_insert(leader, "namespace1", key, key) != CRABDB_OK;
+    }
+    for (int i = 0; i < 300; i += 3) {
+        snprintf(key, sizeof(key), "key%d", i);
+        failures += fossil_crabdb_update(leader, "namespace1", key, "changed") != CRABDB_OK;
+    }
+    for (int i = 0; i < 300; i += 5) {
+        snprintf(key, sizeof(key), "key%d", i);
+        failures += fossil_crabdb_delete(leader, "namespace1", key) != CRABDB_OK;
+    }
+    fossil_crabdb_batch_entry_t batch[] = {
+        { CRABDB_BATCH_INSERT, "batched", "value" },
+        { CRABDB_BATCH_UPDATE, "key1", "value-batched" },
+    };
+    failures += fossil_crabdb_write_batch(leader, "namespace1", batch, 2) != CRABDB_OK;
+    failures += fossil_crabdb_create_sub_namespace(leader, "namespace1", "child") != CRABDB_OK;
+    failures += fossil_crabdb_insert(leader, "namespace1/child", "nested", "value") != CRABDB_OK;
+    failures += fossil_crabdb_create_namespace(leader, "namespace2") != CRABDB_OK;
+    failures += fossil_crabdb_erase_namespace(leader, "namespace2") != CRABDB_OK;
+    failures += fossil_crabdb_stream_close(leader) != CRABDB_OK;
+    fossil_crabdb_erase(leader);
+    return failures;
+}
+#endif
+
+FOSSIL_TEST(test_crabdb_replication) {
+#ifndef _WIN32
+    fossil_crabdb_follower_stats_t stats;
+    char *value = xnull;
+    size_t length = 0;
+    int fds[2];
+    ASSUME_ITS_EQUAL_I32(0, pipe(fds));
+
+    // The leader runs in a process of its own and streams through the pipe
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    ASSUME_ITS_TRUE(pid >= 0);
+    if (pid == 0) {
+        close(fds[0]);
+        _exit(crabdb_leader_process(fds[1]));
+    }
+    close(fds[1]);
+
+    fossil_crabdb_t *follower = fossil_crabdb_create_concurrent(4);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_IO, fossil_crabdb_follower_stats(follower, &stats));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_follow(follower, fds[0]));
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_IO, fossil_crabdb_follow(follower, fds[0]));
+    close(fds[0]);
+    while (fossil_crabdb_follower_poll(follower, 1000) == CRABDB_OK) {}
+    int status = 0;
+    ASSUME_ITS_EQUAL_I32((int32_t)pid, (int32_t)waitpid(pid, &status, 0));
+    ASSUME_ITS_TRUE(WIFEXITED(status));
+    ASSUME_ITS_EQUAL_I32(0, WEXITSTATUS(status));
+
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_follower_stats(follower, &stats));
+    ASSUME_ITS_EQUAL_I32(1, stats.closed);
+    ASSUME_ITS_EQUAL_I32(465, (int32_t)stats.applied);
+    ASSUME_ITS_EQUAL_I32(468, (int32_t)stats.records);
+    ASSUME_ITS_TRUE(stats.batches > 0);
+    ASSUME_ITS_EQUAL_I32(0, (int32_t)stats.lag_bytes);
+
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get_bytes(follower, "namespace1", "binary", (void **)&value, &length));
+    ASSUME_ITS_EQUAL_I32(3, (int32_t)length);
+    ASSUME_ITS_TRUE(memcmp(value, "a\0b", 3) == 0);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_KEY_NOT_FOUND, fossil_crabdb_get(follower, "namespace1", "key0", &value));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(follower, "namespace1", "key3", &value));
+    ASSUME_ITS_EQUAL_CSTR("changed", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(follower, "namespace1", "key299", &value));
+    ASSUME_ITS_EQUAL_CSTR("key299", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(follower, "namespace1", "key1", &value));
+    ASSUME_ITS_EQUAL_CSTR("value-batched", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(follower, "namespace1/child", "nested", &value));
+    ASSUME_ITS_EQUAL_CSTR("value", value);
+    free(value);
+    ASSUME_ITS_EQUAL_I32(CRABDB_ERR_NS_NOT_FOUND, fossil_crabdb_get(follower, "namespace2", "key", &value));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_unfollow(follower));
+    fossil_crabdb_erase(follower);
+
+    // A follower can also tail the log of a persistent leader
+    remove("crabdb_follow_test.wal");
+    remove("crabdb_follow_test.snapshot");
+    fossil_crabdb_t *leader = fossil_crabdb_create();
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_persist_open(leader, "crabdb_follow_test", CRABDB_SYNC_OS, 0, 0));
+    fossil_crabdb_create_namespace(leader, "namespace1");
+    fossil_crabdb_insert(leader, "namespace1", "key1", "value1");
+    fossil_crabdb_t *tail = fossil_crabdb_create();
+    int fd = open("crabdb_follow_test.wal", O_RDONLY);
+    ASSUME_ITS_TRUE(fd >= 0);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_follow(tail, fd));
+    close(fd);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_follower_poll(tail, 0));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(tail, "namespace1", "key1", &value));
+    ASSUME_ITS_EQUAL_CSTR("value1", value);
+    free(value);
+
+    fossil_crabdb_insert(leader, "namespace1", "key2", "value2");
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_follower_stats(tail, &stats));
+    ASSUME_ITS_TRUE(stats.lag_bytes > 0);
+    ASSUME_ITS_EQUAL_I32(2, (int32_t)stats.applied);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_follower_poll(tail, 0));
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_follower_stats(tail, &stats));
+    ASSUME_ITS_EQUAL_I32(0, (int32_t)stats.lag_bytes);
+    ASSUME_ITS_EQUAL_I32(0, (int32_t)stats.lag_ms);
+    ASSUME_ITS_EQUAL_I32(3, (int32_t)stats.applied);
+    ASSUME_ITS_EQUAL_I32(0, stats.closed);
+    ASSUME_ITS_EQUAL_I32(CRABDB_OK, fossil_crabdb_get(tail, "namespace1", "key2", &value));
+    ASSUME_ITS_EQUAL_CSTR("value2", value);
+    free(value);
+
+    fossil_crabdb_erase(tail);
+    fossil_crabdb_erase(leader);
+    remove("crabdb_follow_test.wal");
+    remove("crabdb_follow_test.snapshot");
+#endif
+}
+
 // * * * * * * * * * * * * * * * * * * * * * * * *
 // * Fossil Logic Test Pool
 // * * * * * * * * * * * * * * * * * * * * * * * *
@@ -575,4 +2054,28 @@ FOSSIL_TEST_GROUP(c_core_tests) {
     ADD_TESTF(test_create_sub_namespace, core_crabdb_fixture);
     ADD_TESTF(test_erase_namespace, core_crabdb_fixture);
     ADD_TESTF(test_erase_sub_namespace, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_namespace_tree, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_many_keys, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_many_namespaces, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_persist_recovery, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_persist_torn_tail, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_export_and_mmap, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_concurrent, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_read_mostly, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_replication, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_get_view, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_write_batch, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_prepared_query, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_ordered_scan, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_ttl, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_memory_budget, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_arena_compaction, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_bloom_filter, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_snapshot, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_bulk_load, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_stats, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_async, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_bytes, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_compression, core_crabdb_fixture);
+    ADD_TESTF(test_crabdb_dump, core_crabdb_fixture);
 } // end of tests
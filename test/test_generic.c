@@ -91,7 +91,7 @@ FOSSIL_TEST(test_fossil_tofu_create) {
 
     fossil_tofu_t tofu_bstr = fossil_tofu_create("bstr", "Hello");
     ASSUME_ITS_EQUAL_I32(FOSSIL_TOFU_TYPE_BSTR, tofu_bstr.type);
-    ASSUME_ITS_EQUAL_CSTR("Hello", tofu_bstr.value.byte_string_val);
+    ASSUME_ITS_EQUAL_CSTR("Hello", fossil_tofu_cstr(&tofu_bstr));
 }
 
 // Test case for fossil_tofu_equals function
@@ -110,8 +110,75 @@ FOSSIL_TEST(test_fossil_tofu_copy) {
     fossil_tofu_t tofu_copy = fossil_tofu_copy(tofu_orig);
 
     ASSUME_ITS_EQUAL_I32(tofu_orig.type, tofu_copy.type);
-    ASSUME_ITS_EQUAL_CSTR(tofu_orig.value.byte_string_val, tofu_copy.value.byte_string_val);
-    ASSUME_ITS_EQUAL_I32(tofu_orig.is_cached, tofu_copy.is_cached);
+    ASSUME_ITS_EQUAL_CSTR(fossil_tofu_cstr(&tofu_orig), fossil_tofu_cstr(&tofu_copy));
+    ASSUME_ITS_EQUAL_I32(fossil_tofu_is_cached(&tofu_orig), fossil_tofu_is_cached(&tofu_copy));
+}
+
+// Test case for the typed fossil_tofu_from_* functions
+FOSSIL_TEST(test_fossil_tofu_from_typed) {
+    fossil_tofu_t tofu_int = fossil_tofu_from_int64(-123);
+    ASSUME_ITS_EQUAL_I32(FOSSIL_TOFU_TYPE_INT, tofu_int.type);
+    ASSUME_ITS_EQUAL_I64(-123, tofu_int.value.int_val);
+    ASSUME_ITS_TRUE(fossil_tofu_equals(tofu_int, fossil_tofu_create("int", "-123")));
+
+    fossil_tofu_t tofu_hex = fossil_tofu_from_hex(0xff);
+    ASSUME_ITS_TRUE(fossil_tofu_equals(tofu_hex, fossil_tofu_create("hex", "ff")));
+
+    fossil_tofu_t tofu_double = fossil_tofu_from_double(2.5);
+    ASSUME_ITS_EQUAL_I32(FOSSIL_TOFU_TYPE_DOUBLE, tofu_double.type);
+    ASSUME_ITS_TRUE(tofu_double.value.double_val == 2.5);
+
+    fossil_tofu_t tofu_bool = fossil_tofu_from_bool(true);
+    ASSUME_ITS_EQUAL_I32(FOSSIL_TOFU_TYPE_BOOL, tofu_bool.type);
+    ASSUME_ITS_EQUAL_CSTR("bool", fossil_tofu_type_to_string(tofu_bool.type));
+
+    // Only the given length is copied, and terminated
+    fossil_tofu_t tofu_cstr = fossil_tofu_from_cstr_len("Hello, world", 5);
+    ASSUME_ITS_EQUAL_I32(FOSSIL_TOFU_TYPE_CSTR, tofu_cstr.type);
+    ASSUME_ITS_EQUAL_CSTR("Hello", fossil_tofu_cstr(&tofu_cstr));
+    fossil_tofu_t tofu_same = fossil_tofu_from_cstr("Hello");
+    ASSUME_ITS_TRUE(fossil_tofu_equals(tofu_cstr, tofu_same));
+    fossil_tofu_erase(&tofu_cstr);
+    fossil_tofu_erase(&tofu_same);
+
+    fossil_tofu_t tofu_ghost = fossil_tofu_from_cstr(NULL);
+    ASSUME_ITS_EQUAL_I32(FOSSIL_TOFU_TYPE_GHOST, tofu_ghost.type);
+}
+
+// Test case for the 16 byte layout and inline small strings
+FOSSIL_TEST(test_fossil_tofu_inline_strings) {
+    ASSUME_ITS_EQUAL_I32(16, (int32_t)sizeof(fossil_tofu_t));
+
+    // Up to FOSSIL_TOFU_INLINE_MAX characters live inside the tofu
+    fossil_tofu_t tofu_small = fossil_tofu_from_cstr("thirteen char");
+    ASSUME_ITS_TRUE(tofu_small.flags & FOSSIL_TOFU_FLAG_INLINE);
+    ASSUME_ITS_TRUE(fossil_tofu_cstr(&tofu_small) == (const char *)&tofu_small);
+    ASSUME_ITS_EQUAL_CSTR("thirteen char", fossil_tofu_cstr(&tofu_small));
+
+    fossil_tofu_t tofu_large = fossil_tofu_from_cstr("fourteen chars");
+    ASSUME_ITS_FALSE(tofu_large.flags & FOSSIL_TOFU_FLAG_INLINE);
+    ASSUME_ITS_EQUAL_CSTR("fourteen chars", fossil_tofu_cstr(&tofu_large));
+    ASSUME_ITS_FALSE(fossil_tofu_equals(tofu_small, tofu_large));
+
+    // Copies of inline strings need no allocation and compare equal
+    fossil_tofu_t tofu_copy = fossil_tofu_copy(tofu_small);
+    ASSUME_ITS_TRUE(fossil_tofu_equals(tofu_small, tofu_copy));
+    ASSUME_ITS_TRUE(fossil_tofu_equals(fossil_tofu_create("cstr", "thirteen char"), tofu_small));
+    fossil_tofu_t tofu_large_copy = fossil_tofu_copy(tofu_large);
+    ASSUME_ITS_TRUE(fossil_tofu_equals(tofu_large, tofu_large_copy));
+
+    // Memorizing only flags the tofu
+    ASSUME_ITS_FALSE(fossil_tofu_is_cached(&tofu_small));
+    fossil_tofu_memorize(&tofu_small);
+    ASSUME_ITS_TRUE(fossil_tofu_is_cached(&tofu_small));
+    ASSUME_ITS_TRUE(fossil_tofu_equals(tofu_small, tofu_copy));
+    fossil_tofu_t tofu_int = fossil_tofu_from_int64(7);
+    ASSUME_ITS_CNULL(fossil_tofu_cstr(&tofu_int));
+
+    fossil_tofu_erase(&tofu_small);
+    fossil_tofu_erase(&tofu_copy);
+    fossil_tofu_erase(&tofu_large);
+    fossil_tofu_erase(&tofu_large_copy);
 }
 
 // * * * * * * * * * * * * * * * * * * * * * * * *
@@ -433,6 +500,8 @@ FOSSIL_TEST_GROUP(c_generic_tests) {
     ADD_TESTF(test_fossil_tofu_create, c_tofu_fixture);
     ADD_TESTF(test_fossil_tofu_equals, c_tofu_fixture);
     ADD_TESTF(test_fossil_tofu_copy, c_tofu_fixture);
+    ADD_TESTF(test_fossil_tofu_from_typed, c_tofu_fixture);
+    ADD_TESTF(test_fossil_tofu_inline_strings, c_tofu_fixture);
 
     // Generic ToFu ArrayOf Fixture
     ADD_TESTF(test_fossil_tofu_arrayof_create, c_tofu_arrayof_fixture);